@@ -48,6 +48,9 @@ const I18N = {
     mlCcwLabel: 'ml/rev CCW',
     maxFlowLabel: 'Max Flow (L/h)',
     dosingFlowLabel: 'Dosing Flow (L/h)',
+    rampProfileLabel: 'Speed ramp',
+    rampLinearOption: 'Linear',
+    rampSCurveOption: 'S-curve (smooth)',
     motorAliasesTitle: 'Motor Aliases',
     ntpServerLabel: 'NTP Server',
     uiLanguageLabel: 'Language',
@@ -58,6 +61,7 @@ const I18N = {
     guidedCalTitle: 'Guided Calibration',
     dirLabel: 'Direction',
     revolutionsLabel: 'Revolutions',
+    calRpmLabel: 'Speed rpm (0 = single value)',
     runCalibrationBtn: 'Run Calibration',
     measuredMlLabel: 'Measured ml',
     applyCalibrationBtn: 'Apply',
@@ -195,6 +199,9 @@ const I18N = {
     mlCcwLabel: 'ml/оборот CCW',
     maxFlowLabel: 'Макс. поток (L/h)',
     dosingFlowLabel: 'Дозировка (L/h)',
+    rampProfileLabel: 'Разгон',
+    rampLinearOption: 'Линейный',
+    rampSCurveOption: 'S-кривая (плавный)',
     motorAliasesTitle: 'Алиасы моторов',
     ntpServerLabel: 'NTP Server',
     uiLanguageLabel: 'Язык',
@@ -205,6 +212,7 @@ const I18N = {
     guidedCalTitle: 'Пошаговая калибровка',
     dirLabel: 'Направление',
     revolutionsLabel: 'Обороты',
+    calRpmLabel: 'Скорость rpm (0 = одно значение)',
     runCalibrationBtn: 'Запустить калибровку',
     measuredMlLabel: 'Измерено ml',
     applyCalibrationBtn: 'Применить',
@@ -1338,6 +1346,7 @@ async function saveSettings() {
     mlPerRevCcw: Number(document.getElementById('mlCcw').value),
     dosingFlowLph: Number(document.getElementById('dFlow').value),
     maxFlowLph: Number(document.getElementById('maxFlowLph').value),
+    rampProfile: document.getElementById('rampProfile').value,
     ntpServer: document.getElementById('ntpServer').value.trim(),
     tzOffsetMinutes: Number(document.getElementById('tzOffsetMinutes').value || 0),
     growthProgramEnabled: document.getElementById('growthProgramEnabled').checked,
@@ -1361,11 +1370,19 @@ async function saveSecurity() {
   await refreshSecurity();
 }
 
+// A speed adds one point to the direction's calibration curve; 0 keeps the
+// single ml/rev value.
+function calibrationRpm() {
+  const rpm = Number(document.getElementById('calRpm').value || 0);
+  return rpm > 0 ? { rpm } : {};
+}
+
 async function runCalibration() {
   await post('/api/calibration/run', {
     motorId: currentMotorId,
     direction: document.getElementById('dir').value,
     revolutions: Number(document.getElementById('revs').value),
+    ...calibrationRpm(),
   });
 }
 
@@ -1375,6 +1392,7 @@ async function applyCalibration() {
     direction: document.getElementById('dir').value,
     revolutions: Number(document.getElementById('revs').value),
     measuredMl: Number(document.getElementById('measuredMl').value),
+    ...calibrationRpm(),
   });
 }
 
@@ -1409,13 +1427,100 @@ function renderMotorsOverview(motors) {
         <span>${uiDirectionName(m)}</span>
         <span>${Number(Math.abs(m.flowLph || 0)).toFixed(2)} L/h</span>
         <span>${Number(m.dosingRemainingMl || 0).toFixed(0)} ml</span>
+        ${Number(m.dosingEtaSec || 0) > 0 ? `<span>${Math.ceil(Number(m.dosingEtaSec))} s</span>` : ''}
       </div>
     </div>
   `).join('');
 }
 
+// Last /api/state body and its ETag: while nothing changes the device answers
+// 304 and this copy is reused. Its `time` is then stale, so the clock chip
+// counts on from when the body arrived.
+let stateEtag = null;
+let stateBody = null;
+let stateReceivedAt = 0;
+
+async function fetchState(motorId) {
+  const headers = stateEtag ? { 'If-None-Match': stateEtag } : {};
+  const r = await fetch(`/api/state?motorId=${motorId}`, { cache: 'no-store', headers });
+  if (r.status === 304 && stateBody) return stateBody;
+  const body = await r.json();
+  stateEtag = r.headers.get('ETag');
+  stateBody = body;
+  stateReceivedAt = Date.now();
+  return body;
+}
+
+function stateClockText(s) {
+  const m = /^(\d{2}):(\d{2}):(\d{2})$/.exec(s.time || '');
+  if (!m) return s.time || '-';
+  const elapsed = Math.floor((Date.now() - stateReceivedAt) / 1000);
+  const sec = (Number(m[1]) * 3600 + Number(m[2]) * 60 + Number(m[3]) + elapsed) % 86400;
+  return [Math.floor(sec / 3600), Math.floor(sec / 60) % 60, sec % 60].map((v) => String(v).padStart(2, '0')).join(':');
+}
+
+// Live state from /api/events: `system` and `motor` events are merged back
+// into the shape /api/state returns. While the stream is down the page polls.
+let eventsLive = false;
+let eventsOpened = false;
+let liveSystem = null;
+const liveMotors = [];
+let liveRenderPending = false;
+
+function liveState() {
+  if (!liveSystem) return null;
+  const motors = liveMotors.slice(0, Number(liveSystem.activeMotorCount || 1)).filter(Boolean);
+  const motor = motors.find((m) => Number(m.motorId) === currentMotorId) || motors[0];
+  if (!motor) return null;
+  const { alias, ...fields } = motor;
+  return { ...liveSystem, ...fields, motorAlias: alias, motors };
+}
+
+function scheduleLiveRender() {
+  if (liveRenderPending) return;
+  liveRenderPending = true;
+  setTimeout(() => {
+    liveRenderPending = false;
+    const s = liveState();
+    if (s) renderState(s);
+  }, 0);
+}
+
+function connectEvents() {
+  if (typeof EventSource === 'undefined') return;
+  const source = new EventSource('/api/events');
+  source.addEventListener('open', () => {
+    // Schedule changes made while disconnected were never announced.
+    if (eventsOpened && editingScheduleIndex < 0) loadSchedule();
+    eventsOpened = true;
+    eventsLive = true;
+  });
+  source.addEventListener('error', () => {
+    eventsLive = false;
+    // Refused outright (too many streams): the browser will not retry by itself.
+    if (source.readyState === EventSource.CLOSED) setTimeout(connectEvents, 10000);
+  });
+  source.addEventListener('system', (e) => {
+    liveSystem = JSON.parse(e.data);
+    stateReceivedAt = Date.now();
+    scheduleLiveRender();
+  });
+  source.addEventListener('motor', (e) => {
+    const motor = JSON.parse(e.data);
+    liveMotors[Number(motor.motorId)] = motor;
+    scheduleLiveRender();
+  });
+  source.addEventListener('schedule', () => {
+    if (editingScheduleIndex < 0) loadSchedule();
+  });
+}
+
 async function refresh() {
-  const s = await req(`/api/state?motorId=${currentMotorId}`);
+  const live = eventsLive ? liveState() : null;
+  renderState(live || await fetchState(currentMotorId));
+}
+
+function renderState(s) {
   lastState = s;
   syncAliasesFromMotors(s.motors || []);
   if (s.motorAlias && Number.isFinite(Number(s.motorId))) {
@@ -1447,7 +1552,7 @@ async function refresh() {
   document.getElementById('dosingLeftMl').textContent = Number(s.dosingRemainingMl || 0).toFixed(0);
   document.getElementById('modeChip').textContent = m;
   document.getElementById('dirChip').textContent = d;
-  document.getElementById('timeChip').textContent = s.time || '-';
+  document.getElementById('timeChip').textContent = stateClockText(s);
   document.getElementById('stopBtn').disabled = !s.running;
   renderMotorsOverview(s.motors || []);
 }
@@ -1637,6 +1742,8 @@ async function refreshSettings() {
     const maxFlowLph = document.getElementById('maxFlowLph');
     if (ntpServer && document.activeElement !== ntpServer) ntpServer.value = settings.ntpServer || 'time.google.com';
     if (maxFlowLph && document.activeElement !== maxFlowLph) maxFlowLph.value = Number(settings.maxFlowLph || 30).toFixed(1);
+    const rampProfile = document.getElementById('rampProfile');
+    if (rampProfile && document.activeElement !== rampProfile) rampProfile.value = settings.rampProfile || 'linear';
     if (typeof settings.tzOffsetMinutes === 'number') {
       currentTzOffsetMinutes = Number(settings.tzOffsetMinutes);
       populateTimezoneSelect(currentTzOffsetMinutes);
@@ -1675,7 +1782,13 @@ async function refreshSettings() {
   }
 }
 
-setInterval(refresh, 2000);
+setInterval(() => {
+  if (!eventsLive) refresh();
+}, 2000);
+setInterval(() => {
+  if (lastState) document.getElementById('timeChip').textContent = stateClockText(lastState);
+}, 1000);
+connectEvents();
 loadUiPreferences();
 loadFirmwareConfig();
 refresh();
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace pump {
+
+// One measured calibration run: volume per revolution at a motor speed.
+struct CalibrationPoint {
+  float rpm = 0.0f;
+  float mlPerRev = 0.0f;
+};
+
+// ml/rev as a function of rpm for one direction, for tubing that delivers
+// less per revolution as it speeds up. Measured points are joined linearly
+// and held flat outside their range. Lookups in both directions go through
+// tables precomputed when the points change, so they cost one multiply and
+// one interpolation in the control tick.
+class CalibrationCurve {
+ public:
+  static constexpr std::size_t kMaxPoints = 6;
+
+  bool empty() const { return count_ == 0; }
+  std::size_t size() const { return count_; }
+  const CalibrationPoint& point(std::size_t i) const { return points_[i]; }
+
+  // Adds a point, replacing one within 1 rpm. Returns false and keeps the
+  // curve if the point is not positive, the curve is full, or flow would no
+  // longer rise with speed.
+  bool setPoint(float rpm, float mlPerRev);
+  // Replaces every point; false (curve unchanged) on the same conditions.
+  bool assign(const CalibrationPoint* points, std::size_t count);
+  void clear();
+
+  // Volume per revolution at `rpm` (sign ignored). Requires !empty().
+  float mlPerRevAt(float rpm) const;
+  // Speed that delivers `mlPerMin` (sign ignored). Requires !empty().
+  float rpmForFlow(float mlPerMin) const;
+
+ private:
+  static constexpr int kSegments = 32;
+
+  static bool valid(const CalibrationPoint* points, std::size_t count);
+  float exactMlPerRev(float rpm) const;
+  void build();
+
+  std::array<CalibrationPoint, kMaxPoints> points_{};
+  std::uint8_t count_ = 0;
+  // ml/rev on a uniform rpm grid over [0, last point].
+  float spanRpm_ = 0.0f;
+  float segmentsPerRpm_ = 0.0f;
+  std::array<float, kSegments + 1> mlPerRev_{};
+  // rpm on a uniform flow grid over [0, flow at the last point].
+  float spanFlow_ = 0.0f;
+  float segmentsPerFlow_ = 0.0f;
+  std::array<float, kSegments + 1> rpm_{};
+};
+
+}  // namespace pump
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "CalibrationCurve.h"
+
+namespace pump {
+
+// Persistent settings as one fixed-layout record, stored as a single NVS blob
+// behind a ConfigBlobHeader. Fields are only ever appended: a blob written
+// by an older layout fills its prefix and leaves the newer fields at the
+// caller's defaults, one written by a newer firmware loads the prefix this
+// build knows. Bump kConfigVersion whenever fields are appended, and give
+// openConfigBlob an explicit step if a field ever changes meaning instead.
+//
+// Every field is sized and ordered so the structs carry no padding; the
+// static_asserts in ConfigBlob.cpp pin the layout.
+
+// Version 0 is the per-key layout migrated by migrateLegacyConfig().
+constexpr std::uint16_t kConfigVersion = 2;
+constexpr std::uint32_t kConfigMagic = 0x50434647;  // "PCFG"
+
+constexpr std::size_t kStoredMotors = 5;
+constexpr std::size_t kStoredSchedules = 8;
+
+struct StoredCurve {
+  std::uint8_t count;
+  std::uint8_t reserved[3];
+  CalibrationPoint points[CalibrationCurve::kMaxPoints];
+};
+
+struct StoredMotor {
+  float lastManualSpeed;
+  float maxSpeed;
+  float mlPerRevCw;
+  float mlPerRevCcw;
+  float dosingSpeed;
+  StoredCurve curveCw;
+  StoredCurve curveCcw;
+  std::uint8_t preferredReverse;
+  char alias[27];  // 24 bytes of UTF-8 and a terminator
+};
+
+struct StoredSchedule {
+  std::uint16_t volumeMl;
+  std::uint8_t enabled;
+  std::uint8_t hour;
+  std::uint8_t minute;
+  std::uint8_t reverse;
+  std::uint8_t motorId;
+  std::uint8_t weekdaysMask;
+  char name[36];  // 32 bytes of UTF-8 and a terminator
+};
+
+struct StoredConfig {
+  StoredMotor motors[kStoredMotors];
+  StoredSchedule schedules[kStoredSchedules];
+  std::int32_t tzOffsetMinutes;
+  std::uint8_t selectedMotorId;
+  std::uint8_t expansionEnabled;
+  std::uint8_t expansionMotorCount;
+  std::uint8_t authEnabled;
+  std::uint8_t growthProgramEnabled;
+  std::uint8_t phRegulationEnabled;
+  std::uint8_t reserved[2];
+  char expansionInterface[8];
+  char uiLanguage[4];
+  char authUser[32];
+  char authPass[64];
+  char ntpServer[64];
+  char firmwareRepo[124];
+  char firmwareAsset[64];
+  char firmwareFsAsset[64];
+  // Version 2: RampProfile of each motor's flow-mode speed changes.
+  std::uint8_t rampProfiles[kStoredMotors];
+  std::uint8_t reserved2[3];
+};
+
+struct ConfigBlobHeader {
+  std::uint32_t magic;
+  std::uint16_t version;
+  std::uint16_t size;  // bytes of config that follow
+  std::uint32_t crc;   // CRC-32 of those bytes
+};
+
+struct ConfigBlob {
+  ConfigBlobHeader header;
+  StoredConfig config;
+};
+
+enum class ConfigLoad : std::uint8_t {
+  kOk,
+  kMissing,  // no blob, or too short to hold a header
+  kCorrupt,  // wrong magic, size or CRC
+};
+
+std::uint32_t crc32(const void* data, std::size_t len);
+
+// Fills the header for the current layout from blob.config.
+void sealConfigBlob(ConfigBlob& blob);
+
+// Copies the config stored in `data` over `config`, which holds defaults for
+// anything the stored layout lacks. `config` is untouched unless kOk.
+ConfigLoad openConfigBlob(const void* data, std::size_t len, StoredConfig& config);
+
+// Copies a NUL-terminated string into a fixed field, truncating on a UTF-8
+// character boundary. Returns false if it had to truncate.
+bool copyStoredString(char* field, std::size_t fieldSize, const char* value);
+
+template <std::size_t N>
+bool copyStoredString(char (&field)[N], const char* value) {
+  return copyStoredString(field, N, value);
+}
+
+}  // namespace pump
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace pump {
+
+// Lifetime counters of one motor. Volumes are nanolitres, as State keeps
+// them, so journaling and replay are exact.
+struct CounterTotals {
+  std::uint32_t uptimeSec;
+  std::uint32_t reserved;
+  std::uint64_t pumpedNl;
+  std::uint64_t hoseNl;
+};
+
+// Journal entry: how far one motor's counters moved since its last entry.
+// Appended, never rewritten, so a power cut can only tear the entry being
+// written; the CRC catches that and replay stops there.
+struct CounterRecord {
+  std::uint8_t magic;
+  std::uint8_t motor;
+  std::uint16_t generation;  // low bits of the checkpoint generation it follows
+  std::int32_t uptimeSec;
+  std::int64_t pumpedNl;
+  std::int64_t hoseNl;
+  std::uint32_t crc;
+  std::uint32_t reserved;
+};
+
+constexpr std::size_t kJournalMotors = 5;
+
+// Every total at one point in time. Replay starts here; records from older
+// generations are ignored, so the checkpoint can be replaced before the
+// journal is cleared without counting anything twice. Checkpoints alternate
+// between two slots by generation, so a torn write leaves the previous one.
+struct CounterCheckpoint {
+  std::uint32_t magic;
+  std::uint32_t generation;
+  CounterTotals motors[kJournalMotors];
+  std::uint32_t crc;
+  std::uint32_t reserved;
+};
+
+// Counter totals rebuilt from a checkpoint plus the journal that follows it.
+// Storage is the caller's: this only encodes, validates and sums.
+class CounterJournal {
+ public:
+  // Starts over from `data`. False (totals zeroed, generation 0) if it is
+  // not an intact checkpoint. Checkpoints of the first format, in litres,
+  // are read too; see legacy().
+  bool restore(const void* data, std::size_t len);
+  // Restores the newer intact checkpoint of the two slots. False if neither is.
+  bool restoreNewest(const void* a, std::size_t aLen, const void* b, std::size_t bLen);
+  // Adds one record read back from the journal. False if it is torn,
+  // damaged or older than the checkpoint; replay should stop there.
+  bool replay(const void* data, std::size_t len);
+  // Size of the records that follow the restored checkpoint.
+  std::size_t recordBytes() const;
+  // True after restoring a first-format checkpoint, until the next one is
+  // committed. Write one after replay so the journal moves to this format.
+  bool legacy() const { return legacy_; }
+  // Sets totals directly, e.g. migrated from another store. Write a
+  // checkpoint afterwards so they survive.
+  void seed(std::size_t motor, const CounterTotals& totals);
+
+  // Fills `out` with the change from the last journaled totals to `now` and
+  // takes `now` as journaled. False if nothing moved.
+  bool record(std::size_t motor, const CounterTotals& now, CounterRecord& out);
+  // Checkpoint of the current totals under the next generation. Call
+  // committed() once it is stored; until then records follow the old one.
+  CounterCheckpoint nextCheckpoint() const;
+  void committed(const CounterCheckpoint& cp) {
+    generation_ = cp.generation;
+    legacy_ = false;
+  }
+
+  const CounterTotals& totals(std::size_t motor) const { return totals_[motor]; }
+  std::uint32_t generation() const { return generation_; }
+  // Slot (0 or 1) a checkpoint of `generation` is stored in.
+  static std::size_t slotOf(std::uint32_t generation) { return generation & 1u; }
+
+ private:
+  std::array<CounterTotals, kJournalMotors> totals_{};
+  std::uint32_t generation_ = 0;
+  bool legacy_ = false;
+};
+
+}  // namespace pump
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pump {
+
+// Paces the /api/events stream. State is compared at most once per
+// `minIntervalMs`, so a ramp that changes speed every control tick costs a
+// few events a second rather than one per tick. A stream that had nothing to
+// say for `keepAliveMs` gets a keep-alive, which also finds dead sockets.
+class EventThrottle {
+ public:
+  EventThrottle(std::uint32_t minIntervalMs, std::uint32_t keepAliveMs)
+      : minIntervalMs_(minIntervalMs), keepAliveMs_(keepAliveMs) {}
+
+  // True, at most once per interval, when it is time to look for changes.
+  bool due(std::uint32_t nowMs) {
+    if (checked_ && nowMs - lastCheckMs_ < minIntervalMs_) return false;
+    checked_ = true;
+    lastCheckMs_ = nowMs;
+    return true;
+  }
+  bool keepAliveDue(std::uint32_t nowMs) const { return nowMs - lastSentMs_ >= keepAliveMs_; }
+  // Something went out, keep-alive or not.
+  void sent(std::uint32_t nowMs) { lastSentMs_ = nowMs; }
+
+ private:
+  std::uint32_t minIntervalMs_;
+  std::uint32_t keepAliveMs_;
+  bool checked_ = false;
+  std::uint32_t lastCheckMs_ = 0;
+  std::uint32_t lastSentMs_ = 0;
+};
+
+}  // namespace pump
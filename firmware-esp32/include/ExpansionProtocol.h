@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "PumpController.h"
+
+// Central <-> expansion I2C framing, see docs/EXPANSION_I2C_PROTOCOL.md.
+namespace exproto {
+
+constexpr std::uint8_t kMagicA = 0x50;  // 'P'
+constexpr std::uint8_t kMagicB = 0x58;  // 'X'
+constexpr std::uint8_t kProtoVer = 1;
+constexpr std::uint8_t kCmdHello = 0x01;
+constexpr std::uint8_t kCmdGetState = 0x10;
+constexpr std::uint8_t kCmdSetFlow = 0x20;
+constexpr std::uint8_t kCmdStartDosing = 0x21;
+constexpr std::uint8_t kCmdStop = 0x22;
+constexpr std::uint8_t kCmdStart = 0x23;
+constexpr std::uint8_t kCmdSetSettings = 0x24;
+constexpr std::uint8_t kCmdSetCurve = 0x25;
+constexpr std::uint8_t kCmdStartRevolutions = 0x26;
+constexpr std::uint8_t kHelloRespLen = 6;
+constexpr std::uint8_t kStateRespLen = 29;
+// SET_CURVE request, command and CRC included, with a full curve.
+constexpr std::size_t kCurveFrameMaxLen = 5 + 4 * pump::CalibrationCurve::kMaxPoints;
+
+// XOR of all bytes before the CRC.
+std::uint8_t frameCrc(const std::uint8_t* data, std::size_t lenWithoutCrc);
+
+// GET_STATE response for one motor, CRC included. `out` holds kStateRespLen bytes.
+void encodeState(const pump::State& st, float maxSpeed, std::uint8_t* out);
+// Applies a GET_STATE response to `st`; fields not on the wire are kept.
+// Returns false and leaves `st` untouched on a CRC mismatch.
+bool decodeState(const std::uint8_t* in, pump::State& st, float& maxSpeed);
+
+// SET_CURVE request for one motor and direction; returns the frame length.
+// `out` holds kCurveFrameMaxLen bytes.
+std::size_t encodeCurve(std::uint8_t motor, bool reverse, const pump::CalibrationCurve& curve, std::uint8_t* out);
+// Parses a SET_CURVE request. Returns false on a bad length or CRC, or if
+// the points do not form a valid curve.
+bool decodeCurve(const std::uint8_t* in, std::size_t len, std::uint8_t& motor, bool& reverse,
+                 pump::CalibrationCurve& curve);
+
+}  // namespace exproto
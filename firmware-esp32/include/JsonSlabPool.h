@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pump {
+
+// Fixed buffers for JSON documents, lent smallest-fit first. When none is
+// free and big enough the memory comes from the heap instead, and is counted,
+// so diagnostics show whether requests still allocate. Not thread-safe: one
+// task borrows from it.
+class JsonSlabPool {
+ public:
+  static constexpr std::size_t kMaxSlabs = 16;
+
+  struct Stats {
+    std::uint32_t borrowed = 0;
+    std::uint32_t heapAllocations = 0;
+    std::uint32_t inUse = 0;
+    std::uint32_t maxInUse = 0;
+  };
+
+  // Carves `storage` into slabs of `sizes`, in that order.
+  JsonSlabPool(std::uint8_t* storage, const std::size_t* sizes, std::size_t count);
+  JsonSlabPool(const JsonSlabPool&) = delete;
+  JsonSlabPool& operator=(const JsonSlabPool&) = delete;
+
+  void* allocate(std::size_t n);
+  void deallocate(void* p);
+  void* reallocate(void* p, std::size_t n);
+
+  std::size_t slabs() const { return count_; }
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Slab {
+    std::uint8_t* data;
+    std::size_t size;
+    bool used;
+  };
+
+  Slab* slabOf(const void* p);
+
+  Slab slabs_[kMaxSlabs];
+  std::size_t count_ = 0;
+  Stats stats_;
+};
+
+// ArduinoJson allocator over the pool `Pool`:
+//   using PooledJsonDocument = BasicJsonDocument<SlabAllocator<jsonPool>>;
+template <JsonSlabPool& Pool>
+struct SlabAllocator {
+  void* allocate(std::size_t n) { return Pool.allocate(n); }
+  void deallocate(void* p) { Pool.deallocate(p); }
+  void* reallocate(void* p, std::size_t n) { return Pool.reallocate(p, n); }
+};
+
+}  // namespace pump
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace pump {
+
+// ArduinoJson writer that collects output in a fixed buffer and hands it to
+// `sink(const char*, size_t)` one buffer at a time, so a response goes
+// straight to the socket without the whole text ever sitting in RAM.
+// Whatever is left is flushed on destruction.
+template <typename Sink, std::size_t N = 512>
+class BufferedJsonWriter {
+ public:
+  explicit BufferedJsonWriter(const Sink& sink) : sink_(sink) {}
+  ~BufferedJsonWriter() { flush(); }
+  BufferedJsonWriter(const BufferedJsonWriter&) = delete;
+  BufferedJsonWriter& operator=(const BufferedJsonWriter&) = delete;
+
+  std::size_t write(std::uint8_t c) {
+    if (len_ == N) flush();
+    buf_[len_++] = static_cast<char>(c);
+    return 1;
+  }
+  std::size_t write(const std::uint8_t* data, std::size_t n) {
+    for (std::size_t left = n; left > 0;) {
+      if (len_ == N) flush();
+      const std::size_t take = left < N - len_ ? left : N - len_;
+      std::memcpy(buf_ + len_, data, take);
+      len_ += take;
+      data += take;
+      left -= take;
+    }
+    return n;
+  }
+  void flush() {
+    if (len_ == 0) return;
+    sink_(buf_, len_);
+    flushed_ += len_;
+    len_ = 0;
+  }
+
+  // Bytes handed to the sink so far.
+  std::size_t flushed() const { return flushed_; }
+
+ private:
+  Sink sink_;
+  char buf_[N];
+  std::size_t len_ = 0;
+  std::size_t flushed_ = 0;
+};
+
+}  // namespace pump
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <ArduinoJson.h>
+
+#include <cstdio>
+
+#include "ConfigBlob.h"
+
+namespace pump {
+
+// Settings keys of the per-key NVS layout (config version 0). Motor keys
+// carry a "_<id>" suffix; motor 0 may still use the older unsuffixed names.
+// The counters (uptime_, vol_total_, vol_hose_) are not config and stay.
+namespace legacy {
+
+constexpr const char* kMotorFloatKeys[] = {"last_speed", "max_speed", "ml_cw", "ml_ccw", "dose_speed"};
+// Unsuffixed motor 0 names, in kMotorFloatKeys order.
+constexpr const char* kMotor0FloatKeys[] = {"last_speed", "max_speed", "ml_cw", "ml_ccw", "dosing_speed"};
+constexpr const char* kGlobalKeys[] = {
+    "exp_en",      "exp_count",   "exp_if",   "sel_motor", "auth_en",     "auth_user",     "auth_pass", "ntp_server",
+    "ui_lang",     "grow_tab_en", "ph_reg_en", "fw_repo",  "fw_asset",    "fw_fs_asset",   "tz_offset_min",
+    "dose_sched",  "pref_rev",    "motor_alias"};
+
+inline float* motorFloat(StoredMotor& m, std::size_t i) {
+  float* fields[] = {&m.lastManualSpeed, &m.maxSpeed, &m.mlPerRevCw, &m.mlPerRevCcw, &m.dosingSpeed};
+  return fields[i];
+}
+
+template <typename Store>
+void readString(Store& prefs, const char* key, char* field, std::size_t fieldSize) {
+  if (!prefs.isKey(key)) return;
+  copyStoredString(field, fieldSize, prefs.getString(key, "").c_str());
+}
+
+template <typename Store>
+void readCurve(Store& prefs, const char* key, StoredCurve& curve) {
+  if (!prefs.isKey(key)) return;
+  const std::size_t len = prefs.getBytesLength(key);
+  if (len == 0 || len > sizeof(curve.points) || len % sizeof(CalibrationPoint) != 0) return;
+  if (prefs.getBytes(key, curve.points, len) != len) return;
+  curve.count = static_cast<std::uint8_t>(len / sizeof(CalibrationPoint));
+}
+
+template <typename Store>
+void readSchedules(Store& prefs, StoredConfig& config) {
+  if (!prefs.isKey("dose_sched")) return;
+  DynamicJsonDocument doc(2048);
+  if (deserializeJson(doc, prefs.getString("dose_sched", "").c_str()) != DeserializationError::Ok) return;
+  std::size_t i = 0;
+  for (JsonObject e : doc["entries"].as<JsonArray>()) {
+    if (i >= kStoredSchedules) break;
+    StoredSchedule& s = config.schedules[i++];
+    s.enabled = e["enabled"] | false;
+    s.hour = e["hour"] | 0;
+    s.minute = e["minute"] | 0;
+    s.volumeMl = e["volumeMl"] | 0;
+    s.reverse = e["reverse"] | false;
+    s.motorId = e["motorId"] | 0;
+    s.weekdaysMask = e["weekdaysMask"] | 0x7F;
+    copyStoredString(s.name, e["name"] | "");
+  }
+}
+
+template <typename Store>
+void removeKey(Store& prefs, const char* key) {
+  if (prefs.isKey(key)) prefs.remove(key);
+}
+
+}  // namespace legacy
+
+// Overlays every version 0 setting found in `prefs` onto `config`, which
+// holds defaults for keys that were never written. Returns whether any key
+// was found, i.e. whether there was anything to migrate.
+template <typename Store>
+bool migrateLegacyConfig(Store& prefs, StoredConfig& config) {
+  bool found = false;
+  char key[24];
+  for (std::size_t i = 0; i < kStoredMotors; ++i) {
+    StoredMotor& m = config.motors[i];
+    for (std::size_t f = 0; f < 5; ++f) {
+      std::snprintf(key, sizeof(key), "%s_%u", legacy::kMotorFloatKeys[f], static_cast<unsigned>(i));
+      const char* name = key;
+      if (!prefs.isKey(key) && i == 0) name = legacy::kMotor0FloatKeys[f];
+      if (!prefs.isKey(name)) continue;
+      *legacy::motorFloat(m, f) = prefs.getFloat(name, *legacy::motorFloat(m, f));
+      found = true;
+    }
+    std::snprintf(key, sizeof(key), "pref_rev_%u", static_cast<unsigned>(i));
+    const char* name = (!prefs.isKey(key) && i == 0) ? "pref_rev" : key;
+    if (prefs.isKey(name)) {
+      m.preferredReverse = prefs.getBool(name, false);
+      found = true;
+    }
+    std::snprintf(key, sizeof(key), "alias_%u", static_cast<unsigned>(i));
+    name = (!prefs.isKey(key) && i == 0) ? "motor_alias" : key;
+    if (prefs.isKey(name)) found = true;
+    legacy::readString(prefs, name, m.alias, sizeof(m.alias));
+    std::snprintf(key, sizeof(key), "cal_cw_%u", static_cast<unsigned>(i));
+    if (prefs.isKey(key)) found = true;
+    legacy::readCurve(prefs, key, m.curveCw);
+    std::snprintf(key, sizeof(key), "cal_ccw_%u", static_cast<unsigned>(i));
+    if (prefs.isKey(key)) found = true;
+    legacy::readCurve(prefs, key, m.curveCcw);
+  }
+  for (const char* k : legacy::kGlobalKeys) found = found || prefs.isKey(k);
+  if (prefs.isKey("exp_en")) config.expansionEnabled = prefs.getBool("exp_en", false);
+  if (prefs.isKey("exp_count")) config.expansionMotorCount = prefs.getUChar("exp_count", 0);
+  if (prefs.isKey("sel_motor")) config.selectedMotorId = prefs.getUChar("sel_motor", 0);
+  if (prefs.isKey("auth_en")) config.authEnabled = prefs.getBool("auth_en", false);
+  if (prefs.isKey("grow_tab_en")) config.growthProgramEnabled = prefs.getBool("grow_tab_en", false);
+  if (prefs.isKey("ph_reg_en")) config.phRegulationEnabled = prefs.getBool("ph_reg_en", false);
+  if (prefs.isKey("tz_offset_min")) config.tzOffsetMinutes = prefs.getInt("tz_offset_min", 0);
+  legacy::readString(prefs, "exp_if", config.expansionInterface, sizeof(config.expansionInterface));
+  legacy::readString(prefs, "ui_lang", config.uiLanguage, sizeof(config.uiLanguage));
+  legacy::readString(prefs, "auth_user", config.authUser, sizeof(config.authUser));
+  legacy::readString(prefs, "auth_pass", config.authPass, sizeof(config.authPass));
+  legacy::readString(prefs, "ntp_server", config.ntpServer, sizeof(config.ntpServer));
+  legacy::readString(prefs, "fw_repo", config.firmwareRepo, sizeof(config.firmwareRepo));
+  legacy::readString(prefs, "fw_asset", config.firmwareAsset, sizeof(config.firmwareAsset));
+  legacy::readString(prefs, "fw_fs_asset", config.firmwareFsAsset, sizeof(config.firmwareFsAsset));
+  legacy::readSchedules(prefs, config);
+  return found;
+}
+
+// Deletes every version 0 settings key; call once the blob is safely written.
+template <typename Store>
+void removeLegacyConfig(Store& prefs) {
+  char key[24];
+  for (std::size_t i = 0; i < kStoredMotors; ++i) {
+    for (const char* base : legacy::kMotorFloatKeys) {
+      std::snprintf(key, sizeof(key), "%s_%u", base, static_cast<unsigned>(i));
+      legacy::removeKey(prefs, key);
+    }
+    const char* suffixed[] = {"pref_rev", "alias", "cal_cw", "cal_ccw"};
+    for (const char* base : suffixed) {
+      std::snprintf(key, sizeof(key), "%s_%u", base, static_cast<unsigned>(i));
+      legacy::removeKey(prefs, key);
+    }
+  }
+  for (const char* k : legacy::kMotor0FloatKeys) legacy::removeKey(prefs, k);
+  for (const char* k : legacy::kGlobalKeys) legacy::removeKey(prefs, k);
+}
+
+}  // namespace pump
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pump {
+
+// Timing of loop() passes, and how late the control tick ran relative to its
+// period. Means cover everything since boot.
+struct LoopStats {
+  std::uint32_t slowPassMicros;
+  std::uint32_t passes = 0;
+  std::uint32_t slowPasses = 0;
+  std::uint32_t maxPassMicros = 0;
+  std::uint64_t totalPassMicros = 0;
+  std::uint32_t ticks = 0;
+  std::uint32_t maxTickLateMicros = 0;
+  std::uint64_t totalTickLateMicros = 0;
+
+  // Passes longer than `slowPassMicros` are counted as slow.
+  explicit LoopStats(std::uint32_t slowPassMicros) : slowPassMicros(slowPassMicros) {}
+
+  void pass(std::uint32_t micros) {
+    ++passes;
+    if (micros > slowPassMicros) ++slowPasses;
+    if (micros > maxPassMicros) maxPassMicros = micros;
+    totalPassMicros += micros;
+  }
+  // `intervalMicros` since the previous tick, against a `periodMicros` schedule.
+  void tick(std::uint32_t intervalMicros, std::uint32_t periodMicros) {
+    const std::uint32_t late = intervalMicros > periodMicros ? intervalMicros - periodMicros : 0;
+    ++ticks;
+    if (late > maxTickLateMicros) maxTickLateMicros = late;
+    totalTickLateMicros += late;
+  }
+
+  std::uint32_t meanPassMicros() const {
+    return passes == 0 ? 0 : static_cast<std::uint32_t>(totalPassMicros / passes);
+  }
+  std::uint32_t meanTickLateMicros() const {
+    return ticks == 0 ? 0 : static_cast<std::uint32_t>(totalTickLateMicros / ticks);
+  }
+};
+
+}  // namespace pump
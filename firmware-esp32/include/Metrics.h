@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace pump {
+
+// Counts of values at or under each of N fixed upper bounds, plus the ones
+// above the last (+Inf), with their sum. Observing is a short scan.
+template <std::size_t N>
+class Histogram {
+ public:
+  explicit Histogram(const std::array<std::uint32_t, N>& bounds) : bounds_(bounds) {}
+
+  void observe(std::uint32_t value) {
+    std::size_t i = 0;
+    while (i < N && value > bounds_[i]) ++i;
+    ++counts_[i];
+    ++count_;
+    sum_ += value;
+  }
+
+  std::uint32_t bound(std::size_t i) const { return bounds_[i]; }
+  // Observations at or under bound(i), as Prometheus reports buckets.
+  std::uint32_t cumulative(std::size_t i) const {
+    std::uint32_t total = 0;
+    for (std::size_t b = 0; b <= i; ++b) total += counts_[b];
+    return total;
+  }
+  std::uint32_t count() const { return count_; }
+  std::uint64_t sum() const { return sum_; }
+
+ private:
+  std::array<std::uint32_t, N> bounds_;
+  std::array<std::uint32_t, N + 1> counts_ = {};
+  std::uint32_t count_ = 0;
+  std::uint64_t sum_ = 0;
+};
+
+// Output that only counts, to learn a response's length before sending it.
+struct ByteCounter {
+  std::size_t bytes = 0;
+  std::size_t write(const std::uint8_t*, std::size_t n) {
+    bytes += n;
+    return n;
+  }
+};
+
+// Prometheus text format (0.0.4) into `out`, anything with
+// write(const uint8_t*, size_t) such as BufferedJsonWriter. Each line is
+// formatted in a small buffer on the stack.
+template <typename Out>
+class MetricsWriter {
+ public:
+  explicit MetricsWriter(Out& out) : out_(out) {}
+
+  // The # HELP and # TYPE lines, once per metric name.
+  void family(const char* name, const char* type, const char* help) {
+    line("# HELP %s %s\n", name, help);
+    line("# TYPE %s %s\n", name, type);
+  }
+  // `labels` is what goes between the braces, e.g. motor="1", or null.
+  void sample(const char* name, const char* labels, std::uint64_t value) {
+    line("%s%s%s%s %llu\n", name, open(labels), body(labels), close(labels), static_cast<unsigned long long>(value));
+  }
+  void sample(const char* name, const char* labels, double value) {
+    line("%s%s%s%s %.9g\n", name, open(labels), body(labels), close(labels), value);
+  }
+  // The _bucket, _sum and _count series of `h`, whose values are multiplied
+  // by `scale` (1e-6 turns microseconds into the usual seconds).
+  template <std::size_t N>
+  void histogram(const char* name, const char* labels, const Histogram<N>& h, double scale) {
+    const char* sep = labels != nullptr ? "," : "";
+    for (std::size_t i = 0; i < N; ++i) {
+      line("%s_bucket{%s%sle=\"%.9g\"} %lu\n", name, body(labels), sep, h.bound(i) * scale,
+           static_cast<unsigned long>(h.cumulative(i)));
+    }
+    line("%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, body(labels), sep, static_cast<unsigned long>(h.count()));
+    line("%s_sum%s%s%s %.9g\n", name, open(labels), body(labels), close(labels), static_cast<double>(h.sum()) * scale);
+    line("%s_count%s%s%s %lu\n", name, open(labels), body(labels), close(labels),
+         static_cast<unsigned long>(h.count()));
+  }
+
+ private:
+  static const char* open(const char* labels) { return labels != nullptr ? "{" : ""; }
+  static const char* body(const char* labels) { return labels != nullptr ? labels : ""; }
+  static const char* close(const char* labels) { return labels != nullptr ? "}" : ""; }
+
+  template <typename... Args>
+  void line(const char* format, Args... args) {
+    char buf[160];
+    const int n = std::snprintf(buf, sizeof(buf), format, args...);
+    if (n <= 0) return;
+    const std::size_t len = static_cast<std::size_t>(n) < sizeof(buf) ? static_cast<std::size_t>(n) : sizeof(buf) - 1;
+    out_.write(reinterpret_cast<const std::uint8_t*>(buf), len);
+  }
+
+  Out& out_;
+};
+
+}  // namespace pump
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace pump {
+
+// MessagePack encoder into a fixed buffer, for the few types the packed
+// state uses. Values that do not fit are dropped and ok() turns false.
+class MsgPackWriter {
+ public:
+  MsgPackWriter(std::uint8_t* buf, std::size_t capacity) : buf_(buf), capacity_(capacity) {}
+
+  void array(std::uint16_t count) {
+    if (count < 16) {
+      byte(static_cast<std::uint8_t>(0x90 | count));
+    } else {
+      std::uint8_t b[3] = {0xdc};
+      bigEndian(count, b + 1, 2);
+      bytes(b, sizeof(b));
+    }
+  }
+  void boolean(bool v) { byte(v ? 0xc3 : 0xc2); }
+  // Smallest encoding for the value.
+  void uint(std::uint32_t v) {
+    if (v < 0x80) {
+      byte(static_cast<std::uint8_t>(v));
+      return;
+    }
+    std::uint8_t b[5];
+    std::size_t n = 4;
+    if (v <= 0xff) {
+      b[0] = 0xcc;
+      n = 1;
+    } else if (v <= 0xffff) {
+      b[0] = 0xcd;
+      n = 2;
+    } else {
+      b[0] = 0xce;
+    }
+    bigEndian(v, b + 1, n);
+    bytes(b, n + 1);
+  }
+  void float32(float v) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    std::uint8_t b[5] = {0xca};
+    bigEndian(bits, b + 1, 4);
+    bytes(b, sizeof(b));
+  }
+  void float64(double v) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    std::uint8_t b[9] = {0xcb};
+    bigEndian(bits, b + 1, 8);
+    bytes(b, sizeof(b));
+  }
+
+  std::size_t size() const { return len_; }
+  bool ok() const { return ok_; }
+
+ private:
+  static void bigEndian(std::uint64_t v, std::uint8_t* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) out[i] = static_cast<std::uint8_t>(v >> (8 * (n - 1 - i)));
+  }
+  void byte(std::uint8_t b) { bytes(&b, 1); }
+  void bytes(const std::uint8_t* data, std::size_t n) {
+    if (!ok_ || capacity_ - len_ < n) {
+      ok_ = false;
+      return;
+    }
+    std::memcpy(buf_ + len_, data, n);
+    len_ += n;
+  }
+
+  std::uint8_t* buf_;
+  std::size_t capacity_;
+  std::size_t len_ = 0;
+  bool ok_ = true;
+};
+
+}  // namespace pump
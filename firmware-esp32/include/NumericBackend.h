@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace pump {
+
+// Signed Q16.16 fixed-point number: range +-32768 with 1/65536 resolution.
+// Products and quotients go through 64-bit intermediates.
+class Q16x16 {
+ public:
+  constexpr Q16x16() = default;
+  // Implicit so float constants mix with fixed values.
+  constexpr Q16x16(float value)
+      : raw_(static_cast<std::int32_t>(value * 65536.0f + (value < 0.0f ? -0.5f : 0.5f))) {}
+
+  static constexpr Q16x16 fromRaw(std::int32_t raw) { return Q16x16(raw, RawTag()); }
+  constexpr std::int32_t raw() const { return raw_; }
+  constexpr float toFloat() const { return static_cast<float>(raw_) / 65536.0f; }
+
+  friend constexpr Q16x16 operator+(Q16x16 a, Q16x16 b) { return fromRaw(a.raw_ + b.raw_); }
+  friend constexpr Q16x16 operator-(Q16x16 a, Q16x16 b) { return fromRaw(a.raw_ - b.raw_); }
+  friend constexpr Q16x16 operator-(Q16x16 a) { return fromRaw(-a.raw_); }
+  friend constexpr Q16x16 operator*(Q16x16 a, Q16x16 b) {
+    return fromRaw(static_cast<std::int32_t>((static_cast<std::int64_t>(a.raw_) * b.raw_ + 0x8000) >> 16));
+  }
+  friend constexpr Q16x16 operator/(Q16x16 a, Q16x16 b) {
+    return fromRaw(static_cast<std::int32_t>((static_cast<std::int64_t>(a.raw_) << 16) / b.raw_));
+  }
+  friend constexpr bool operator==(Q16x16 a, Q16x16 b) { return a.raw_ == b.raw_; }
+  friend constexpr bool operator!=(Q16x16 a, Q16x16 b) { return a.raw_ != b.raw_; }
+  friend constexpr bool operator<(Q16x16 a, Q16x16 b) { return a.raw_ < b.raw_; }
+  friend constexpr bool operator<=(Q16x16 a, Q16x16 b) { return a.raw_ <= b.raw_; }
+  friend constexpr bool operator>(Q16x16 a, Q16x16 b) { return a.raw_ > b.raw_; }
+  friend constexpr bool operator>=(Q16x16 a, Q16x16 b) { return a.raw_ >= b.raw_; }
+
+ private:
+  struct RawTag {};
+  constexpr Q16x16(std::int32_t raw, RawTag) : raw_(raw) {}
+
+  std::int32_t raw_ = 0;
+};
+
+// Arithmetic PumpController needs from its number type. Speeds are rpm,
+// spans are seconds; spans passed as Num stay within a single ramp.
+template <typename Num>
+struct NumTraits;
+
+template <>
+struct NumTraits<float> {
+  static float fromFloat(float v) { return v; }
+  static float toFloat(float v) { return v; }
+  static float abs(float v) { return v < 0.0f ? -v : v; }
+  static float seconds(std::uint32_t ms) { return static_cast<float>(ms) * 0.001f; }
+  // perSec * ms / 1000
+  static float mulMs(float perSec, std::uint32_t ms) { return perSec * seconds(ms); }
+  static std::uint32_t ceilMs(float sec) { return static_cast<std::uint32_t>(std::ceil(sec * 1000.0f)); }
+
+  // Turns speed * time into whole nanolitres, carrying the remainder.
+  class NlAccumulator {
+   public:
+    std::uint64_t addSpan(float meanSpeed, float mlPerRev, float sec) {
+      if (sec <= 0.0f) return 0;
+      return addMl(abs(meanSpeed) * (1.0f / 60.0f) * mlPerRev * sec);
+    }
+    std::uint64_t addMs(float meanSpeed, float mlPerRev, std::uint32_t ms) {
+      return addSpan(meanSpeed, mlPerRev, seconds(ms));
+    }
+    std::uint64_t addMl(float ml) {
+      // Carry the sub-nanolitre part so rounding does not bias long runs.
+      const float nl = ml * 1e6f + remainderNl_;
+      if (nl <= 0.0f) return 0;
+      // Single-precision conversion is native on the S3; 64-bit only for long gaps.
+      const std::uint64_t whole = nl < 4.0e9f ? static_cast<std::uint32_t>(nl) : static_cast<std::uint64_t>(nl);
+      remainderNl_ = nl - static_cast<float>(whole);
+      return whole;
+    }
+    // Sub-nanolitre carry, for callers that batch addMl() themselves.
+    float carryNl() const { return remainderNl_; }
+    void setCarryNl(float nl) { remainderNl_ = nl; }
+
+   private:
+    float remainderNl_ = 0.0f;
+  };
+};
+
+template <>
+struct NumTraits<Q16x16> {
+  static Q16x16 fromFloat(float v) { return Q16x16(v); }
+  static float toFloat(Q16x16 v) { return v.toFloat(); }
+  static Q16x16 abs(Q16x16 v) { return v.raw() < 0 ? -v : v; }
+  static Q16x16 seconds(std::uint32_t ms) {
+    return Q16x16::fromRaw(static_cast<std::int32_t>((static_cast<std::int64_t>(ms) << 16) / 1000));
+  }
+  static Q16x16 mulMs(Q16x16 perSec, std::uint32_t ms) {
+    return Q16x16::fromRaw(static_cast<std::int32_t>(static_cast<std::int64_t>(perSec.raw()) * ms / 1000));
+  }
+  static std::uint32_t ceilMs(Q16x16 sec) {
+    return sec.raw() <= 0 ? 0 : static_cast<std::uint32_t>((static_cast<std::int64_t>(sec.raw()) * 1000 + 0xFFFF) >> 16);
+  }
+
+  // Integer-only: the rate is nanolitres per millisecond in Q16, so volume is
+  // exact up to the resolution of the speed.
+  class NlAccumulator {
+   public:
+    std::uint64_t addSpan(Q16x16 meanSpeed, float mlPerRev, Q16x16 sec) {
+      if (sec.raw() <= 0) return 0;
+      const std::uint64_t rate = nlPerMsQ16(meanSpeed, mlPerRev);
+      const std::uint64_t msQ16 = static_cast<std::uint64_t>(sec.raw()) * 1000;
+      accQ16_ += rate * (msQ16 >> 16) + ((rate * (msQ16 & 0xFFFF)) >> 16);
+      return take();
+    }
+    std::uint64_t addMs(Q16x16 meanSpeed, float mlPerRev, std::uint32_t ms) {
+      const std::uint64_t rate = nlPerMsQ16(meanSpeed, mlPerRev);
+      // Chunks keep rate * ms inside 64 bits for any realistic rate.
+      while (ms > 0) {
+        const std::uint32_t chunk = ms < kMaxChunkMs ? ms : kMaxChunkMs;
+        accQ16_ += rate * chunk;
+        ms -= chunk;
+      }
+      return take();
+    }
+    std::uint64_t addMl(float ml) {
+      if (ml <= 0.0f) return 0;
+      const float nl = ml * 1e6f;
+      const std::uint64_t whole = nl < 4.0e9f ? static_cast<std::uint32_t>(nl) : static_cast<std::uint64_t>(nl);
+      accQ16_ += (whole << 16) + static_cast<std::uint64_t>((nl - static_cast<float>(whole)) * 65536.0f);
+      return take();
+    }
+
+   private:
+    static constexpr std::uint32_t kMaxChunkMs = 1u << 24;
+
+    // rpm * (nl/rev) / 60000 = nl/ms, kept in Q16.
+    static std::uint64_t nlPerMsQ16(Q16x16 speed, float mlPerRev) {
+      const auto rpmRaw = static_cast<std::uint64_t>(abs(speed).raw());
+      const auto nlPerRev = static_cast<std::uint64_t>(std::lround(mlPerRev * 1e6f));
+      return rpmRaw * nlPerRev / 60000;
+    }
+
+    std::uint64_t take() {
+      const std::uint64_t whole = accQ16_ >> 16;
+      accQ16_ &= 0xFFFF;
+      return whole;
+    }
+
+    std::uint64_t accQ16_ = 0;
+  };
+};
+
+}  // namespace pump
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace pump {
+
+// Cost of persistence passes: the last pass, the worst one, and running totals.
+struct SaveStats {
+  std::uint32_t passes = 0;
+  std::uint32_t lastKeys = 0;
+  std::uint32_t lastBytes = 0;
+  std::uint32_t lastMicros = 0;
+  std::uint32_t maxMicros = 0;
+  std::uint32_t totalKeys = 0;
+  std::uint32_t totalBytes = 0;
+  std::uint32_t totalMicros = 0;
+
+  void beginPass() {
+    lastKeys = 0;
+    lastBytes = 0;
+  }
+  void wrote(std::size_t bytes) {
+    ++lastKeys;
+    lastBytes += static_cast<std::uint32_t>(bytes);
+  }
+  void endPass(std::uint32_t micros) {
+    ++passes;
+    lastMicros = micros;
+    if (micros > maxMicros) maxMicros = micros;
+    totalKeys += lastKeys;
+    totalBytes += lastBytes;
+    totalMicros += micros;
+  }
+};
+
+// Remembers what was last committed under each NVS key so a save pass only
+// writes the keys whose value changed. Values up to 8 bytes are kept as-is;
+// longer ones (strings, blobs) as their length and a 64-bit FNV-1a hash.
+class PersistCache {
+ public:
+  static constexpr std::size_t kMaxKeys = 96;
+
+  // True if `key` has never been committed or held different bytes; the new
+  // value is recorded as committed either way. Past kMaxKeys distinct keys
+  // every call returns true, so nothing is ever skipped wrongly.
+  bool changed(const char* key, const void* data, std::size_t len);
+  // Drops `key`, e.g. after it was removed from NVS.
+  void forget(const char* key);
+  void clear() { count_ = 0; }
+  std::size_t size() const { return count_; }
+
+ private:
+  struct Entry {
+    std::uint32_t key = 0;
+    std::uint32_t len = 0;
+    std::uint64_t value = 0;
+  };
+
+  Entry* find(std::uint32_t key);
+
+  std::array<Entry, kMaxKeys> entries_{};
+  std::size_t count_ = 0;
+};
+
+}  // namespace pump
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pump {
+
+// Pulse budget of a STEP output counted by a 16-bit PCNT unit. The counter
+// wraps to 0 at kChunk (its high limit) and a threshold event marks the
+// pulses left for the last chunk; onEvent() says when the last budgeted
+// pulse has been counted, so the output can be cut on exactly that pulse.
+// Header-only and integer-only: the counter ISR runs from IRAM.
+class PulseBudget {
+ public:
+  static constexpr std::int16_t kChunk = 30000;  // under PCNT's 32767 limit
+
+  // Starts a budget of `pulses` (> 0), counted from a cleared counter.
+  void arm(std::uint32_t pulses) {
+    pulses_ = pulses;
+    wraps_ = (pulses - 1) / kChunk;
+    wrapsLeft_ = wraps_;
+    threshold_ = static_cast<std::int16_t>(pulses - wraps_ * kChunk);
+    armed_ = true;
+    spent_ = false;
+  }
+  void disarm() { armed_ = false; }
+
+  // Counter value, 1..kChunk, of the budget's last pulse in the final chunk.
+  std::int16_t threshold() const { return threshold_; }
+
+  // A counter event: `wrapped` at the high limit, `reachedThreshold` at
+  // threshold(). The threshold passes in every chunk, so only the final
+  // chunk's counts; when it equals kChunk the wrap is that same pulse.
+  // Both in one event means the ISR ran late, and the threshold came first.
+  // True once, when the last pulse was counted and the output must stop.
+  bool onEvent(bool wrapped, bool reachedThreshold) {
+    if (!armed_ || spent_) return false;
+    if (wrapsLeft_ == 0 && (wrapped || reachedThreshold)) {
+      spent_ = true;
+      return true;
+    }
+    if (wrapped) --wrapsLeft_;
+    return false;
+  }
+
+  bool armed() const { return armed_; }
+  bool spent() const { return spent_; }
+  std::uint32_t pulses() const { return pulses_; }
+  // Pulses counted so far with the unit's counter at `counter`.
+  std::uint32_t counted(std::int16_t counter) const {
+    if (spent_) return pulses_;
+    return (wraps_ - wrapsLeft_) * static_cast<std::uint32_t>(kChunk) + static_cast<std::uint32_t>(counter);
+  }
+
+ private:
+  std::uint32_t pulses_ = 0;
+  std::uint32_t wraps_ = 0;
+  std::uint32_t wrapsLeft_ = 0;
+  std::int16_t threshold_ = 0;
+  bool armed_ = false;
+  bool spent_ = false;
+};
+
+}  // namespace pump
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "PumpController.h"
+
+namespace pump {
+
+namespace detail {
+template <std::size_t... I>
+struct IndexList {};
+template <std::size_t N, std::size_t... I>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+template <std::size_t... I>
+struct MakeIndexList<0, I...> {
+  using type = IndexList<I...>;
+};
+
+// `cond ? a : b` as a bit blend, so neither operand load is conditional.
+inline float blend(bool cond, float a, float b) {
+  std::uint32_t ua;
+  std::uint32_t ub;
+  std::memcpy(&ua, &a, sizeof(ua));
+  std::memcpy(&ub, &b, sizeof(ub));
+  const std::uint32_t mask = 0u - static_cast<std::uint32_t>(cond);
+  const std::uint32_t bits = (ua & mask) | (ub & ~mask);
+  float out;
+  std::memcpy(&out, &bits, sizeof(out));
+  return out;
+}
+}  // namespace detail
+
+// N motors sharing one clock, stored as parallel arrays. tickAll() updates
+// every motor cruising or ramping linearly in flow mode in one branch-free
+// pass; the rest (dosing, S-curves, calibration curves, ramp ends, zero
+// crossings) are stepped through their controller. Either way the result
+// matches N independent BasicPumpController<Num> instances bit for bit. The
+// batched pass is float only; fixed-point banks step every motor through
+// its controller.
+template <std::size_t N, typename Num = float>
+class PumpBank {
+ public:
+  using Controller = BasicPumpController<Num>;
+
+  explicit PumpBank(const Config& cfg) : cold_(makeControllers(cfg, typename detail::MakeIndexList<N>::type())) {
+    for (std::size_t i = 0; i < N; ++i) store(i);
+  }
+
+  static constexpr std::size_t size() { return N; }
+  std::uint32_t nowMs() const { return nowMs_; }
+
+  const Config& config(std::size_t motor) const { return cold_[motor].config(); }
+  State state(std::size_t motor) const {
+    State st = cold_[motor].state();
+    st.currentSpeed = currentSpeed_[motor];
+    st.targetSpeed = targetSpeed_[motor];
+    st.mlPerRevCw = mlPerRevCw_[motor];
+    st.mlPerRevCcw = mlPerRevCcw_[motor];
+    st.running = running_[motor] != 0;
+    st.totalMotorUptimeSec = uptimeSec_[motor];
+    st.totalPumpedNl = pumpedNl_[motor];
+    st.totalHoseNl = hoseNl_[motor];
+    return st;
+  }
+  // Copy of one motor as a standalone controller at the bank's time.
+  Controller controller(std::size_t motor) const {
+    Controller ctrl = cold_[motor];
+    load(ctrl, motor);
+    return ctrl;
+  }
+
+  // Runs `fn(Controller&)` on one motor, e.g. to restore persisted state.
+  template <typename Fn>
+  void edit(std::size_t motor, Fn&& fn) {
+    load(cold_[motor], motor);
+    fn(cold_[motor]);
+    store(motor);
+  }
+
+  void setSpeed(std::size_t motor, float speed, Mode mode = Mode::FLOW) {
+    edit(motor, [&](Controller& ctrl) { ctrl.setSpeed(speed, mode); });
+  }
+  void start(std::size_t motor) {
+    edit(motor, [](Controller& ctrl) { ctrl.start(); });
+  }
+  void stop(std::size_t motor, bool emergency = false) {
+    edit(motor, [&](Controller& ctrl) { ctrl.stop(emergency); });
+  }
+  void startDosing(std::size_t motor, std::int32_t volumeMl) {
+    edit(motor, [&](Controller& ctrl) { ctrl.startDosing(volumeMl); });
+  }
+  void startRevolutions(std::size_t motor, float revolutions, float speed) {
+    edit(motor, [&](Controller& ctrl) { ctrl.startRevolutions(revolutions, speed); });
+  }
+  void setCalibrationCurve(std::size_t motor, bool reverse, const CalibrationCurve& curve) {
+    edit(motor, [&](Controller& ctrl) { ctrl.setCalibrationCurve(reverse, curve); });
+  }
+  void setMlPerRev(std::size_t motor, float cw, float ccw) {
+    edit(motor, [&](Controller& ctrl) { ctrl.setMlPerRev(cw, ccw); });
+  }
+  void setDosingSpeed(std::size_t motor, float speed) {
+    edit(motor, [&](Controller& ctrl) { ctrl.setDosingSpeed(speed); });
+  }
+  void setMaxSpeed(std::size_t motor, float speed) {
+    edit(motor, [&](Controller& ctrl) { ctrl.setMaxSpeed(speed); });
+  }
+  void setRampProfile(std::size_t motor, RampProfile profile) {
+    edit(motor, [&](Controller& ctrl) { ctrl.setRampProfile(profile); });
+  }
+
+  bool isRamping(std::size_t motor) const { return controller(motor).isRamping(); }
+  std::uint32_t nextEventMs(std::size_t motor) const { return controller(motor).nextEventMs(); }
+  std::uint32_t dosingEtaMs(std::size_t motor) const { return controller(motor).dosingEtaMs(); }
+  float speedForFlow(std::size_t motor, float mlPerMin, bool reverse) const {
+    return controller(motor).speedForFlow(mlPerMin, reverse);
+  }
+
+  // Like PumpController::advanceTo(), an older `timeMs` changes nothing.
+  void advanceAllTo(std::uint32_t timeMs) {
+    const std::int32_t elapsedMs = static_cast<std::int32_t>(timeMs - nowMs_);
+    if (elapsedMs > 0) tickAll(static_cast<std::uint32_t>(elapsedMs));
+  }
+
+  void tickAll(std::uint32_t deltaMs) {
+    if (deltaMs == 0) return;
+    const std::uint32_t startMs = nowMs_;
+    nowMs_ += deltaMs;
+    slow_.fill(1);
+    if (deltaMs < kMaxBatchedMs) batchFlow(deltaMs, std::is_same<Num, float>());
+    for (std::size_t i = 0; i < N; ++i) {
+      if (!slow_[i]) continue;
+      auto& ctrl = cold_[i];
+      load(ctrl, i);
+      ctrl.nowMs_ = startMs;
+      ctrl.advanceTo(nowMs_);
+      store(i);
+    }
+  }
+
+ private:
+  // Float converts delta exactly below 2^24 ms, so the ramp-end test below
+  // agrees with the controller's ceil().
+  static constexpr std::uint32_t kMaxBatchedMs = 1u << 24;
+
+  template <std::size_t... I>
+  static std::array<Controller, N> makeControllers(const Config& cfg, detail::IndexList<I...>) {
+    return {{(static_cast<void>(I), Controller(cfg))...}};
+  }
+
+  void batchFlow(std::uint32_t, std::false_type) {}
+
+  // Same arithmetic as BasicPumpController<float>::advanceFlow() for a tick
+  // that stays on one side of zero and does not finish its ramp. Motors that
+  // need anything else are flagged in slow_ and left untouched.
+  void batchFlow(std::uint32_t deltaMs, std::true_type) {
+    const float sec = static_cast<float>(deltaMs) * 0.001f;
+    const float deltaF = static_cast<float>(deltaMs);
+    for (std::size_t i = 0; i < N; ++i) {
+      // Flags combine with & and selects go through blend(): GCC will not
+      // if-convert a float op that only runs on one side of a branch.
+      const float from = currentSpeed_[i];
+      const float target = targetSpeed_[i];
+      const bool targetIsStop = std::fabs(target) < minSpeed_[i];
+      const float rate = detail::blend(targetIsStop, haltRate_[i], accelRate_[i]);
+      const bool cruising = from == target;
+      // from +- ramp towards the target, as in advanceFlow().
+      const float ramped = from + std::copysign(rate * sec, target - from);
+      const float speed = detail::blend(cruising, target, ramped);
+      const bool rampEnds = !cruising & !(std::fabs(target - from) / rate * 1000.0f > deltaF);
+      const bool crossing = (from >= 0.0f) != (speed >= 0.0f);
+
+      const float mean = (from + speed) * 0.5f;
+      const float mlPerRev = detail::blend(mean >= 0.0f, mlPerRevCw_[i], mlPerRevCcw_[i]);
+      const float ml = std::fabs(mean) * (1.0f / 60.0f) * mlPerRev * sec;
+      const float carry = volume_[i].carryNl();
+      const float nl = ml * 1e6f + carry;
+      const bool batched = (fast_[i] != 0) & !rampEnds & !crossing & (nl < 2147483648.0f);
+      const auto truncated = static_cast<std::int32_t>(detail::blend(nl < 2147483648.0f, nl, 0.0f));
+      const std::uint32_t keep = 0u - static_cast<std::uint32_t>(batched);
+      const std::uint32_t whole = static_cast<std::uint32_t>(truncated) & keep;
+
+      const bool idle = targetIsStop & (std::fabs(from) < minSpeed_[i]);
+      const std::uint32_t uptimeMs = uptimeRemainderMs_[i] + (deltaMs & keep & (0u - static_cast<std::uint32_t>(!idle)));
+      // |speed| < minSpeed, with the cruising case spelled out.
+      const bool halted = targetIsStop & (cruising | (std::fabs(ramped) < minSpeed_[i]));
+      const bool stopsNow = batched & halted;
+
+      slow_[i] = !batched;
+      currentSpeed_[i] = detail::blend(stopsNow, 0.0f, detail::blend(batched, speed, from));
+      running_[i] &= static_cast<std::uint32_t>(!stopsNow);
+      volume_[i].setCarryNl(detail::blend(batched, nl - static_cast<float>(truncated), carry));
+      pumpedNl_[i] += whole;
+      hoseNl_[i] += whole;
+      uptimeSec_[i] += uptimeMs / 1000;
+      uptimeRemainderMs_[i] = uptimeMs % 1000;
+    }
+  }
+
+  void load(Controller& ctrl, std::size_t i) const {
+    State& st = ctrl.state_;
+    st.currentSpeed = currentSpeed_[i];
+    st.targetSpeed = targetSpeed_[i];
+    st.mlPerRevCw = mlPerRevCw_[i];
+    st.mlPerRevCcw = mlPerRevCcw_[i];
+    st.running = running_[i] != 0;
+    st.totalMotorUptimeSec = uptimeSec_[i];
+    st.totalPumpedNl = pumpedNl_[i];
+    st.totalHoseNl = hoseNl_[i];
+    ctrl.uptimeRemainderMs_ = uptimeRemainderMs_[i];
+    ctrl.volume_ = volume_[i];
+    ctrl.nowMs_ = nowMs_;
+  }
+
+  void store(std::size_t i) {
+    const Controller& ctrl = cold_[i];
+    const State& st = ctrl.state_;
+    currentSpeed_[i] = st.currentSpeed;
+    targetSpeed_[i] = st.targetSpeed;
+    mlPerRevCw_[i] = st.mlPerRevCw;
+    mlPerRevCcw_[i] = st.mlPerRevCcw;
+    running_[i] = st.running ? 1 : 0;
+    uptimeSec_[i] = st.totalMotorUptimeSec;
+    pumpedNl_[i] = st.totalPumpedNl;
+    hoseNl_[i] = st.totalHoseNl;
+    uptimeRemainderMs_[i] = ctrl.uptimeRemainderMs_;
+    volume_[i] = ctrl.volume_;
+    minSpeed_[i] = ctrl.cfg_.minSpeed;
+    accelRate_[i] = ctrl.cfg_.speedAccelPerSec;
+    haltRate_[i] = ctrl.cfg_.speedHaltPerSec;
+    fast_[i] = ctrl.cfg_.rampProfile == RampProfile::LINEAR && !ctrl.dosePlan_.active() && ctrl.pendingDoseSteps_ == 0 &&
+               ctrl.curveCw_.empty() && ctrl.curveCcw_.empty();
+  }
+
+  // Hot per-motor fields; the controllers' copies are stale between syncs.
+  std::array<float, N> currentSpeed_{};
+  std::array<float, N> targetSpeed_{};
+  std::array<float, N> mlPerRevCw_{};
+  std::array<float, N> mlPerRevCcw_{};
+  std::array<float, N> minSpeed_{};
+  std::array<float, N> accelRate_{};
+  std::array<float, N> haltRate_{};
+  std::array<typename NumTraits<Num>::NlAccumulator, N> volume_{};
+  std::array<std::uint64_t, N> pumpedNl_{};
+  std::array<std::uint64_t, N> hoseNl_{};
+  std::array<std::uint32_t, N> uptimeSec_{};
+  std::array<std::uint32_t, N> uptimeRemainderMs_{};
+  // Flags are 32-bit so every lane of the batched pass is as wide as a float.
+  std::array<std::uint32_t, N> running_{};
+  // Linear flow with no dose plan or calibration curve: eligible for the
+  // batched pass.
+  std::array<std::uint32_t, N> fast_{};
+  // Motors the current tickAll() hands to their controller.
+  std::array<std::uint32_t, N> slow_{};
+  // Mode, config, dose plans and S-curve ramps.
+  std::array<Controller, N> cold_;
+  std::uint32_t nowMs_ = 0;
+};
+
+}  // namespace pump
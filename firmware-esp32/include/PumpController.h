@@ -1,7 +1,13 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
+#include "CalibrationCurve.h"
+#include "NumericBackend.h"
+#include "RampProfile.h"
+#include "StepPlanner.h"
+
 namespace pump {
 
 enum class Mode : uint8_t {
@@ -9,6 +15,9 @@ enum class Mode : uint8_t {
   DOSING = 1,
 };
 
+// Returned by PumpController::nextEventMs() when nothing is scheduled.
+constexpr std::uint32_t kNoEvent = 0xFFFFFFFFu;
+
 struct Config {
   float maxSpeed = 450.0f;
   float minSpeed = 0.01f;
@@ -16,6 +25,14 @@ struct Config {
   float speedHaltPerSec = 200.0f;
   float mlPerRevCw = 2.6f;
   float mlPerRevCcw = 2.6f;
+  // Full steps per revolution times microstepping (200 * 8 on both boards).
+  float stepsPerRev = 1600.0f;
+  // Shape of flow-mode speed changes. With S_CURVE speed-ups peak at
+  // sCurveAccelPerSec and halts peak at speedHaltPerSec; dose plans stay
+  // trapezoidal. The default peak matches the linear rate, so switching
+  // profiles never asks more torque of the motor, only a longer ramp.
+  RampProfile rampProfile = RampProfile::LINEAR;
+  float sCurveAccelPerSec = 50.0f;
 };
 
 struct State {
@@ -25,17 +42,32 @@ struct State {
   float lastManualSpeed = 120.0f;
   float mlPerRevCw = 2.6f;
   float mlPerRevCcw = 2.6f;
+  // Cruise speed of doses: the user's dosing flow, never above maxSpeed.
   float dosingSpeed = 180.0f;
   bool running = false;
   float dosingRemainingMl = 0.0f;
   std::uint32_t totalMotorUptimeSec = 0;
-  double totalPumpedVolumeL = 0.0;
-  double totalHoseVolumeL = 0.0;
+  // Volume totalizers in nanolitres. Integer so tiny per-tick deltas are never
+  // lost against a large total and the tick path needs no double math.
+  std::uint64_t totalPumpedNl = 0;
+  std::uint64_t totalHoseNl = 0;
+
+  double totalPumpedVolumeL() const;
+  double totalHoseVolumeL() const;
+  void setTotalPumpedVolumeL(double litres);
+  void setTotalHoseVolumeL(double litres);
 };
 
-class PumpController {
+template <std::size_t N, typename Num>
+class PumpBank;
+
+// Speed/volume control for one motor. `Num` is the arithmetic used by the
+// flow-mode ramp and volume path (see NumTraits); the State API and dose
+// plans are float for every backend.
+template <typename Num>
+class BasicPumpController {
  public:
-  explicit PumpController(Config cfg);
+  explicit BasicPumpController(Config cfg);
 
   const Config& config() const;
   const State& state() const;
@@ -45,17 +77,104 @@ class PumpController {
   void start();
   void stop(bool emergency = false);
   void startDosing(std::int32_t volumeMl);
+  // Runs exactly `revolutions` turns as a dose cruising at |speed|; the sign
+  // of `speed` sets the direction. Used for calibration runs.
+  void startRevolutions(float revolutions, float speed);
   void setMlPerRev(float cw, float ccw);
+  // Speed-dependent calibration for one direction. While a direction's curve
+  // is empty its State mlPerRevCw/Ccw scalar applies at every speed.
+  void setCalibrationCurve(bool reverse, const CalibrationCurve& curve);
+  const CalibrationCurve& calibrationCurve(bool reverse) const;
+  // ml/rev at signed `speed`.
+  float mlPerRevAt(float speed) const;
+  // Signed speed that delivers `mlPerMin` in the given direction.
+  float speedForFlow(float mlPerMin, bool reverse) const;
   void setDosingSpeed(float speed);
   void setMaxSpeed(float speed);
+  // A ramp under way carries on from its current speed in the new shape.
+  void setRampProfile(RampProfile profile);
 
   // Simulates elapsed time and updates speed, uptime and volume counters.
   void tick(std::uint32_t deltaMs);
+  // Advances ramp, volume, uptime and dosing state to `timeMs` in closed form.
+  // Cost does not depend on how much time has passed since the last call.
+  // A `timeMs` at or before nowMs() (by wrapping 32-bit comparison) does
+  // nothing, so gaps must stay under 2^31 ms (24 days).
+  void advanceTo(std::uint32_t timeMs);
+  std::uint32_t nowMs() const;
+  // Time of the next ramp end, dose phase change or dose completion, or
+  // kNoEvent while idle or cruising. Speed is constant until then unless
+  // isRamping() is true.
+  std::uint32_t nextEventMs() const;
+  bool isRamping() const;
+  // Predicted time until the running dose completes, 0 when not dosing. For
+  // mirrored state without a local plan it is estimated from the remaining
+  // volume and current speed with the same planner.
+  std::uint32_t dosingEtaMs() const;
+  // The running dose plan (inactive when none). dosePlanId() changes when a
+  // plan starts or is replanned, dosesFinished() when one reaches its last
+  // step, so the step output can follow the plan's exact count.
+  const StepPlanner& dosePlan() const;
+  std::uint32_t dosePlanId() const;
+  std::uint32_t dosesFinished() const;
 
  private:
+  float mlPerRevFor(bool reverse, float rpm) const;
+  float mlPerStep(bool reverse, float rpm) const;
+  float doseCruiseRpm() const;
+  std::uint32_t stepsForVolume(float volumeMl, bool reverse, float entrySpeed, float cruiseRpm) const;
+  float plannedMl(const StepPlanner& plan, bool reverse) const;
+  void beginDose(std::uint32_t steps, bool reverse, float cruiseRpm);
+  float rampRate() const;
+  float rampTarget() const;
+  float calibration(Num speed) const;
+  std::uint32_t rampMsTo(float target) const;
+  bool sCurveRampValid(float target) const;
+  float sCurveSpeedAt(std::uint32_t elapsedMs) const;
+  void planDose(StepPlanner& plan, std::uint32_t steps, float entrySpeed, float cruiseRpm) const;
+  void planDose(std::uint32_t steps);
+  void advanceFlow(std::uint32_t deltaMs);
+  void advanceSCurve(std::uint32_t deltaMs);
+  void advanceDosing(std::uint32_t deltaMs);
+  void addVolumeSpan(Num fromSpeed, Num toSpeed, Num sec);
+  void addVolumeMs(Num speed, std::uint32_t ms);
+  void addNl(std::uint64_t nl);
+  void addUptime(std::uint32_t deltaMs);
+
+  // Banks keep the hot fields in their own arrays and sync them in and out.
+  template <std::size_t N, typename BankNum>
+  friend class PumpBank;
+
   Config cfg_;
   State state_;
+  std::uint32_t nowMs_ = 0;
   std::uint32_t uptimeRemainderMs_ = 0;
+  typename NumTraits<Num>::NlAccumulator volume_;
+  // Doses are accounted as an exact planned step count and volume follows
+  // the plan; the firmware stops the pin on the same count (see StepPlanner).
+  StepPlanner dosePlan_;
+  std::uint32_t dosePlanId_ = 0;
+  std::uint32_t dosesFinished_ = 0;
+  std::uint32_t doseElapsedMs_ = 0;
+  std::uint32_t doseStepsDone_ = 0;
+  std::uint32_t pendingDoseSteps_ = 0;
+  bool doseReverse_ = false;
+  // Cruise speed of the running dose; dosingSpeed unless startRevolutions().
+  float doseSpeed_ = 0.0f;
+  CalibrationCurve curveCw_;
+  CalibrationCurve curveCcw_;
+  // Running S-curve ramp; rampMs_ == 0 when none.
+  float rampFrom_ = 0.0f;
+  float rampTo_ = 0.0f;
+  std::uint32_t rampMs_ = 0;
+  std::uint32_t rampElapsedMs_ = 0;
 };
 
+using PumpController = BasicPumpController<float>;
+// Q16.16 flow path for boards without a usable FPU.
+using FixedPumpController = BasicPumpController<Q16x16>;
+
+extern template class BasicPumpController<float>;
+extern template class BasicPumpController<Q16x16>;
+
 }  // namespace pump
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pump {
+
+enum class RampProfile : std::uint8_t {
+  LINEAR = 0,
+  // Jerk-limited: acceleration rises and falls as a half cosine, so the motor
+  // sees no torque step at the start and end of a speed change.
+  S_CURVE = 1,
+};
+
+// Largest slope of sCurveSpeedFraction(); a ramp of speed change `dv` at peak
+// acceleration `a` takes dv * kSCurvePeakSlope / a seconds.
+constexpr float kSCurvePeakSlope = 1.5682743f;
+
+// Fraction of the speed change reached after fraction `u` (0..1) of the ramp
+// time. Interpolated from a precomputed table.
+float sCurveSpeedFraction(float u);
+// Integral of sCurveSpeedFraction() from 0 to `u`; 0.5 at the end of the ramp.
+float sCurveAreaFraction(float u);
+
+}  // namespace pump
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <ArduinoJson.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "MsgPack.h"
+#include "PumpController.h"
+
+namespace pump {
+
+// Which keys of a state document to write, from /api/state?fields=: a comma
+// separated list such as "flowLph,running,motors.flowLph". No list means
+// every key. Only views the list, which must outlive the filter.
+class FieldFilter {
+ public:
+  FieldFilter() = default;
+  explicit FieldFilter(const char* list) : list_(list != nullptr && *list != '\0' ? list : nullptr) {}
+
+  bool all() const { return list_ == nullptr; }
+  // True for a listed key, and for the parent of a listed "parent.key".
+  bool wants(const char* key) const;
+  // The filter for the objects under `parent` ("motors" or "expansion"):
+  // all of their keys when `parent` itself is listed, else the keys listed
+  // as "parent.key". One level deep.
+  FieldFilter nested(const char* parent) const;
+
+ private:
+  const char* list_ = nullptr;
+  const char* parent_ = nullptr;
+};
+
+// Fields /api/state reports for every motor: mode, flow, calibration, dosing
+// progress and lifetime counters. Callers add ids, aliases and UI settings.
+void writeStateFields(JsonObject out, const PumpController& ctrl, const FieldFilter& fields = FieldFilter());
+
+// The same values for the packed (MessagePack) state, without names or
+// anything derivable: mode, running, forward, flowMlMin, targetFlowMlMin,
+// dosingFlowLph, mlPerRevCw, mlPerRevCcw, dosingRemainingMl, dosingEtaSec,
+// uptimeSec, totalPumpedL, totalHoseL.
+constexpr std::uint16_t kPackedStateFields = 13;
+void packStateFields(MsgPackWriter& out, const PumpController& ctrl);
+
+// FNV-1a over the values a state document reports, to tell whether it
+// changed without building it.
+class StateHash {
+ public:
+  void add(const void* data, std::size_t len);
+  void addString(const char* s);
+  template <typename T>
+  void add(T value) {
+    static_assert(std::is_arithmetic<T>::value, "hash values, not objects");
+    add(&value, sizeof(value));
+  }
+  std::uint32_t value() const { return h_; }
+
+ private:
+  std::uint32_t h_ = 2166136261u;
+};
+
+// Adds what writeStateFields() reports for `ctrl`.
+void hashStateFields(StateHash& hash, const PumpController& ctrl);
+
+}  // namespace pump
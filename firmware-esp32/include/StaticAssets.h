@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+
+namespace pump {
+
+// Hex digits the asset build step puts between a name and its extension,
+// e.g. app.1a2b3c4d.js.
+constexpr std::size_t kAssetFingerprintLen = 8;
+
+// Copies the fingerprint of `path` into `out` (kAssetFingerprintLen + 1
+// bytes) and returns true, or returns false for a name without one.
+inline bool assetFingerprint(const char* path, char* out) {
+  const char* ext = std::strrchr(path, '.');
+  if (ext == nullptr || ext - path < static_cast<std::ptrdiff_t>(kAssetFingerprintLen + 1)) return false;
+  const char* start = ext - kAssetFingerprintLen;
+  if (start[-1] != '.') return false;
+  for (const char* p = start; p < ext; ++p) {
+    if (!std::isxdigit(static_cast<unsigned char>(*p))) return false;
+  }
+  std::memcpy(out, start, kAssetFingerprintLen);
+  out[kAssetFingerprintLen] = '\0';
+  return true;
+}
+
+inline bool endsWith(const char* s, const char* suffix) {
+  const std::size_t n = std::strlen(s);
+  const std::size_t m = std::strlen(suffix);
+  return n >= m && std::strcmp(s + n - m, suffix) == 0;
+}
+
+inline const char* assetContentType(const char* path) {
+  if (endsWith(path, ".html")) return "text/html";
+  if (endsWith(path, ".css")) return "text/css";
+  if (endsWith(path, ".js")) return "application/javascript";
+  if (endsWith(path, ".json")) return "application/json";
+  if (endsWith(path, ".svg")) return "image/svg+xml";
+  if (endsWith(path, ".png")) return "image/png";
+  if (endsWith(path, ".ico")) return "image/x-icon";
+  return "application/octet-stream";
+}
+
+}  // namespace pump
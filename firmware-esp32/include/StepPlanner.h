@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pump {
+
+// Trapezoidal motion plan over an exact number of motor steps.
+// Speeds are in steps/s, time is seconds since the plan started. Position,
+// speed and step times are closed-form, so the plan can be sampled at any
+// time regardless of how often the caller ticks.
+//
+// It is a model, not a step generator: the firmware sets each STEP pin's
+// LEDC tone to speedAt() once per control tick, so pulses follow stepsAt()
+// only as closely as frequency rounding and tick timing allow. On the main
+// board a pulse counter on the pin (PulseBudget) cuts it on the plan's last
+// step, so a dose still puts out exactly totalSteps() pulses.
+class StepPlanner {
+ public:
+  // Plans `totalSteps` steps starting at `entrySpeed`, cruising at `cruiseSpeed`
+  // and ending at standstill on the last step. Short moves get a triangular
+  // profile; if `entrySpeed` is too high to stop in time the deceleration is
+  // raised just enough to land on the last step.
+  void plan(std::uint32_t totalSteps, float cruiseSpeed, float accel, float decel, float entrySpeed = 0.0f);
+  void reset();
+
+  bool active() const;
+  std::uint32_t totalSteps() const;
+  float durationSec() const;
+  float peakSpeed() const;
+
+  // Steps completed at time `tSec`; reaches totalSteps() exactly at durationSec().
+  std::uint32_t stepsAt(float tSec) const;
+  float speedAt(float tSec) const;
+  // Time at which the plan reaches step `step` (1-based).
+  float stepTimeSec(std::uint32_t step) const;
+  // Interval between step `step` and the following one.
+  float stepIntervalSec(std::uint32_t step) const;
+  // End of the phase (ramp, cruise, decel) running at `tSec`.
+  float phaseEndSec(float tSec) const;
+  bool cruisingAt(float tSec) const;
+
+ private:
+  float positionAt(float tSec) const;
+
+  std::uint32_t totalSteps_ = 0;
+  float entrySpeed_ = 0.0f;
+  float peakSpeed_ = 0.0f;
+  float rampAccel_ = 0.0f;
+  float decel_ = 0.0f;
+  float rampSec_ = 0.0f;
+  float cruiseSec_ = 0.0f;
+  float decelSec_ = 0.0f;
+  float rampSteps_ = 0.0f;
+  float cruiseSteps_ = 0.0f;
+};
+
+}  // namespace pump
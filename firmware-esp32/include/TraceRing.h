@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace pump {
+
+// What a trace event records. `id`, `arg` and `value` per type:
+//   kTickBegin, kTickEnd    -
+//   kStepFrequency          arg 1 when reversing, value step rate in mHz (0 stops)
+//   kI2c                    id address, arg 1 if acknowledged in full, value us taken
+//   kScheduleFire, -Skip    id schedule, arg motor, value volume in ml
+//   kNvsCommit              arg 1 if written, value us taken
+//   kHttpBegin, kHttpEnd    id route (0xff unregistered)
+// Values are never renumbered; scripts/trace_to_timeline.py decodes them.
+enum class TraceType : std::uint8_t {
+  kTickBegin = 1,
+  kTickEnd = 2,
+  kStepFrequency = 3,
+  kI2c = 4,
+  kScheduleFire = 5,
+  kScheduleSkip = 6,
+  kNvsCommit = 7,
+  kHttpBegin = 8,
+  kHttpEnd = 9,
+};
+
+struct TraceEvent {
+  std::uint32_t micros;
+  std::uint8_t type;
+  std::uint8_t id;
+  std::uint16_t arg;
+  std::uint32_t value;
+};
+static_assert(sizeof(TraceEvent) == 12, "dump layout");
+
+// Starts an /api/trace dump: this, `events` TraceEvents oldest first, then
+// the registered routes as "<uri>\n" in route id order. Little-endian.
+struct TraceDumpHeader {
+  char magic[4];
+  std::uint8_t version;
+  std::uint8_t eventBytes;
+  std::uint16_t events;
+  // Since boot; the oldest `recorded - events` were overwritten.
+  std::uint32_t recorded;
+  std::uint32_t nowMicros;
+};
+static_assert(sizeof(TraceDumpHeader) == 16, "dump layout");
+constexpr std::uint8_t kTraceDumpVersion = 1;
+
+// The last N events (a power of two) in RAM. Any task may record: a slot is
+// claimed with one atomic add, so a record costs a few stores and never
+// blocks. Pause it while reading, or the oldest events may be overwritten
+// mid-dump.
+template <std::size_t N>
+class TraceRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "power of two, so the index wraps with the counter");
+  static_assert(N <= 0xffff, "TraceDumpHeader::events");
+
+ public:
+  void record(std::uint32_t micros, TraceType type, std::uint8_t id = 0, std::uint16_t arg = 0,
+              std::uint32_t value = 0) {
+    if (!enabled_.load(std::memory_order_relaxed)) return;
+    const std::uint32_t seq = next_.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& e = events_[seq & (N - 1)];
+    e.micros = micros;
+    e.type = static_cast<std::uint8_t>(type);
+    e.id = id;
+    e.arg = arg;
+    e.value = value;
+  }
+
+  void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+  std::uint32_t recorded() const { return next_.load(std::memory_order_relaxed); }
+  std::size_t size() const { return recorded() < N ? recorded() : N; }
+  // i-th oldest of the size() events held.
+  const TraceEvent& at(std::size_t i) const {
+    const std::uint32_t oldest = recorded() - static_cast<std::uint32_t>(size());
+    return events_[(oldest + i) & (N - 1)];
+  }
+
+  TraceDumpHeader header(std::uint32_t nowMicros) const {
+    TraceDumpHeader h = {{'P', 'T', 'R', 'C'}, kTraceDumpVersion, sizeof(TraceEvent),
+                         static_cast<std::uint16_t>(size()), recorded(), nowMicros};
+    return h;
+  }
+
+ private:
+  TraceEvent events_[N] = {};
+  std::atomic<std::uint32_t> next_{0};
+  std::atomic<bool> enabled_{true};
+};
+
+}  // namespace pump
@@ -1,12 +1,19 @@
 from __future__ import annotations
 
+import hashlib
 import json
+import math
+import random
 import threading
 import time
 from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
 from typing import Any
 from urllib.parse import parse_qs, urlparse
 
+from integration.state_codec import encode_state
+
+MOTOR_OPS = ("start", "stop", "flow", "dosing")
+
 WEB_UI = """<!doctype html><html><body><h1>Peristaltic Pump</h1></body></html>"""
 
 
@@ -20,6 +27,8 @@ class PumpModel:
         self.ml_per_rev_cw = 2.6
         self.ml_per_rev_ccw = 2.6
         self.dosing_speed = 180.0
+        # Speed-dependent calibration points per direction, sorted by rpm.
+        self.calibration_curves: dict[str, list[dict[str, float]]] = {"cw": [], "ccw": []}
         self.running = False
         self.dosing_remaining_ml = 0.0
         self.total_pumped_l = 0.0
@@ -30,6 +39,7 @@ class PumpModel:
         self.ip = "127.0.0.1"
         self.last_zigbee_payload = ""
         self.ntp_server = "time.google.com"
+        self.ramp_profiles = ["linear"] * 5
         self.tz_offset_minutes = 0
         self.schedule_entries: list[dict[str, Any]] = []
         self.selected_motor_id = 0
@@ -58,6 +68,9 @@ class PumpModel:
             },
         ]
 
+        self.doses: dict[int, int] = {}
+        self.http_requests: dict[tuple[str, str], int] = {}
+
         self._lock = threading.Lock()
         self._stop = threading.Event()
         self._thread: threading.Thread | None = None
@@ -116,6 +129,29 @@ class PumpModel:
                     self.mode = 0
                     self.running = False
 
+    def _dosing_eta_sec(self) -> float:
+        # Same trapezoid as StepPlanner: accel to dosing speed, brake at the halt rate.
+        if self.mode != 1 or self.dosing_remaining_ml <= 0.0:
+            return 0.0
+        reverse = self.target_speed < 0
+        revs = self.dosing_remaining_ml / (self.ml_per_rev_ccw if reverse else self.ml_per_rev_cw)
+        accel, decel = 50.0 / 60.0, 200.0 / 60.0
+        cruise = min(abs(self.dosing_speed), self.max_speed) / 60.0
+        entry = abs(self.current_speed) / 60.0
+        eta = 0.0
+        if entry > 0.0 and (self.current_speed < 0) != reverse:
+            eta, entry = entry / accel, 0.0
+        if entry * entry / (2.0 * decel) >= revs:
+            return eta + 2.0 * revs / entry
+        peak = cruise
+        if (cruise * cruise - entry * entry) / (2.0 * accel) + cruise * cruise / (2.0 * decel) > revs:
+            peak = math.sqrt((2.0 * accel * decel * revs + decel * entry * entry) / (accel + decel))
+        ramp_sec = abs(peak - entry) / (accel if peak >= entry else decel)
+        ramp_revs = 0.5 * (entry + peak) * ramp_sec
+        decel_sec = peak / decel
+        cruise_revs = max(revs - ramp_revs - 0.5 * peak * decel_sec, 0.0)
+        return eta + ramp_sec + cruise_revs / peak + decel_sec
+
     def active_motor_count(self) -> int:
         if not self.expansion_enabled:
             return 1
@@ -139,6 +175,72 @@ class PumpModel:
             return None
         return motor_id
 
+    def command_error(self, op: str, body: dict[str, Any] | None) -> str | None:
+        """Why `body` is not a valid start/stop/flow/dosing command, checked in firmware order."""
+        if op == "flow":
+            if body is None or not isinstance(body.get("litersPerHour"), (int, float)):
+                return "litersPerHour is required"
+            if float(body["litersPerHour"]) < 0:
+                return "litersPerHour must be >= 0"
+        if op == "dosing":
+            if body is None or not isinstance(body.get("volumeMl"), (int, float)):
+                return "volumeMl is required"
+            if float(body["volumeMl"]) <= 0:
+                return "volumeMl must be > 0; use reverse=true"
+        if self._read_motor_id((body or {}).get("motorId"), default=0) is None:
+            return "invalid motorId"
+        return None
+
+    def apply_command(self, op: str, body: dict[str, Any]) -> None:
+        reverse = bool(body.get("reverse", False))
+        with self._lock:
+            if op == "start":
+                if abs(self.last_manual_speed) < 0.01:
+                    self.last_manual_speed = 120.0
+                self.mode = 0
+                self.target_speed = self.last_manual_speed
+                self.running = True
+            elif op == "stop":
+                self.target_speed = 0.0
+                self.running = False
+                self.mode = 0
+            elif op == "flow":
+                lph = float(body["litersPerHour"])
+                ml_per_rev = self.ml_per_rev_ccw if reverse else self.ml_per_rev_cw
+                speed = (lph * 1000.0 / 60.0) / ml_per_rev
+                if reverse:
+                    speed *= -1.0
+                self.mode = 0
+                self.target_speed = max(-self.max_speed, min(self.max_speed, speed))
+                self.last_manual_speed = self.target_speed
+                self.running = abs(self.target_speed) >= 0.01
+            elif op == "dosing":
+                motor_id = int(body.get("motorId", 0))
+                self.doses[motor_id] = self.doses.get(motor_id, 0) + 1
+                self.mode = 1
+                self.dosing_remaining_ml = abs(float(body["volumeMl"]))
+                self.target_speed = -self.dosing_speed if reverse else self.dosing_speed
+                self.running = True
+
+    def to_metrics(self) -> str:
+        """A subset of the firmware's /metrics, in the same text format."""
+        lines = []
+
+        def family(name: str, kind: str, samples: list[tuple[str, float]]) -> None:
+            lines.append(f"# TYPE {name} {kind}")
+            lines.extend(f"{name}{{{labels}}} {value:g}" if labels else f"{name} {value:g}" for labels, value in samples)
+
+        with self._lock:
+            motors = range(self.active_motor_count())
+            family("pump_pumped_liters_total", "counter", [(f'motor="{i}"', self.total_pumped_l) for i in motors])
+            family("pump_doses_total", "counter", [(f'motor="{i}"', self.doses.get(i, 0)) for i in motors])
+            family(
+                "pump_http_requests_total",
+                "counter",
+                [(f'method="{method}",route="{route}"', count) for (method, route), count in sorted(self.http_requests.items())],
+            )
+        return "\n".join(lines) + "\n"
+
     def to_state(self, motor_id: int = 0) -> dict[str, Any]:
         mode_name = "flow_lph" if self.mode == 0 else "dosing"
 
@@ -169,6 +271,7 @@ class PumpModel:
                 "mlPerRevCcw": self.ml_per_rev_ccw,
                 "dosingFlowLph": abs(self.dosing_speed * self.ml_per_rev_cw * 0.06),
                 "dosingRemainingMl": self.dosing_remaining_ml,
+                "dosingEtaSec": self._dosing_eta_sec(),
                 "uptimeSec": self.uptime_sec,
                 "totalPumpedL": self.total_pumped_l,
                 "totalHoseL": self.total_hose_l,
@@ -197,6 +300,7 @@ class PumpModel:
                         "mlPerRevCw": m["mlPerRevCw"],
                         "mlPerRevCcw": m["mlPerRevCcw"],
                         "dosingRemainingMl": m["dosingRemainingMl"],
+                        "dosingEtaSec": m["dosingEtaSec"],
                         "uptimeSec": m["uptimeSec"],
                         "totalPumpedL": m["totalPumpedL"],
                         "totalHoseL": m["totalHoseL"],
@@ -205,14 +309,89 @@ class PumpModel:
             return base
 
 
+def select_fields(doc: dict[str, Any], fields: str) -> dict[str, Any]:
+    """Keeps the keys ?fields= lists: "key", "parent" or "parent.key"; motorId always stays."""
+    top: set[str] = set()
+    nested: dict[str, set[str]] = {}
+    for name in fields.split(","):
+        parent, _, child = name.partition(".")
+        if child:
+            nested.setdefault(parent, set()).add(child)
+        else:
+            top.add(name)
+    out: dict[str, Any] = {}
+    for key, value in doc.items():
+        if key == "motorId" or key in top:
+            out[key] = value
+        elif key in nested:
+            wanted = ",".join(nested[key])
+            out[key] = [select_fields(item, wanted) for item in value] if isinstance(value, list) else select_fields(value, wanted)
+    return out
+
+
+class StateVersions:
+    """The firmware's /api/state versions: the system part and each motor keep the version they last changed at."""
+
+    def __init__(self) -> None:
+        self.boot = f"{random.getrandbits(32):08x}"
+        self.version = 0
+        self.changed: dict[str, int] = {}
+        self._seen: dict[str, str] = {}
+
+    @staticmethod
+    def parts(state: dict[str, Any]) -> dict[str, Any]:
+        motor_keys = set(state["motors"][0]) if state["motors"] else set()
+        system = {k: v for k, v in state.items() if k not in motor_keys and k not in ("motors", "motorAlias")}
+        return {"system": system, **{f"motor{m['motorId']}": m for m in state["motors"]}}
+
+    def update(self, state: dict[str, Any]) -> None:
+        changed = [name for name, part in self.parts(state).items() if self._seen.get(name) != json.dumps(part, sort_keys=True)]
+        if not changed:
+            return
+        self.version += 1
+        for name, part in self.parts(state).items():
+            if name in changed:
+                self._seen[name] = json.dumps(part, sort_keys=True)
+                self.changed[name] = self.version
+
+    def token(self) -> str:
+        return f"{self.boot}-{self.version}"
+
+    def since(self, token: str) -> int:
+        boot, _, version = token.partition("-")
+        if boot != self.boot or not version.isdigit() or int(version) > self.version:
+            return 0
+        return int(version)
+
+    def delta(self, state: dict[str, Any], since: int) -> dict[str, Any]:
+        if since == 0:
+            return state
+        parts = self.parts(state)
+        out = {"motorId": state["motorId"]}
+        if self.changed["system"] > since:
+            out.update(parts["system"])
+        if self.changed.get(f"motor{state['motorId']}", 0) > since:
+            out.update({k: v for k, v in state.items() if k not in parts["system"] and k != "motors"})
+        out["motors"] = [m for m in state["motors"] if self.changed[f"motor{m['motorId']}"] > since]
+        return out
+
+
 class FirmwareApiServer:
     def __init__(self, host: str = "127.0.0.1", port: int = 0) -> None:
         self.model = PumpModel()
         model = self.model
+        self._events_stop = threading.Event()
+        events_stop = self._events_stop
+        versions = StateVersions()
+        versions_lock = threading.Lock()
 
         class Handler(BaseHTTPRequestHandler):
             def _parsed(self) -> tuple[str, dict[str, list[str]]]:
                 parsed = urlparse(self.path)
+                route = parsed.path if parsed.path.startswith("/api/") or parsed.path in ("/", "/metrics") else "other"
+                with model._lock:
+                    key = (self.command if route != "other" else "ANY", route)
+                    model.http_requests[key] = model.http_requests.get(key, 0) + 1
                 return parsed.path, parse_qs(parsed.query)
 
             def _motor_id_from_query(self, query: dict[str, list[str]], default: int = 0) -> int | None:
@@ -224,9 +403,11 @@ class FirmwareApiServer:
                     return model._read_motor_id(default, default=default)
                 return model._read_motor_id(body.get("motorId"), default=default)
 
-            def _json_response(self, code: int, payload: dict[str, Any]) -> None:
+            def _json_response(self, code: int, payload: dict[str, Any], headers: dict[str, str] | None = None) -> None:
                 body = json.dumps(payload).encode("utf-8")
                 self.send_response(code)
+                for name, value in (headers or {}).items():
+                    self.send_header(name, value)
                 self.send_header("Content-Type", "application/json")
                 self.send_header("Access-Control-Allow-Origin", "*")
                 self.send_header("Access-Control-Allow-Headers", "Content-Type")
@@ -246,6 +427,40 @@ class FirmwareApiServer:
                 except json.JSONDecodeError:
                     return None
 
+            def _send_event(self, name: str, payload: dict[str, Any]) -> None:
+                self.wfile.write(f"event: {name}\ndata: {json.dumps(payload)}\n\n".encode("utf-8"))
+                self.wfile.flush()
+
+            def _event_stream(self) -> None:
+                # Mirrors the firmware: a snapshot, then whatever changed, checked every 250 ms.
+                self.send_response(200)
+                self.send_header("Content-Type", "text/event-stream")
+                self.send_header("Cache-Control", "no-cache")
+                self.send_header("Access-Control-Allow-Origin", "*")
+                self.end_headers()
+                sent: dict[str, Any] = {}
+                with model._lock:
+                    schedule = json.dumps(model.schedule_entries, sort_keys=True)
+                try:
+                    while not events_stop.is_set():
+                        state = model.to_state(model.selected_motor_id)
+                        system_keys = ("firmware", "selectedMotorId", "activeMotorCount", "expansion", "wifiConnected", "ssid", "ip")
+                        topics = {"system": ("system", {key: state[key] for key in system_keys})}
+                        for motor in state["motors"]:
+                            topics[f"motor{motor['motorId']}"] = ("motor", motor)
+                        for key, (name, payload) in topics.items():
+                            if sent.get(key) != payload:
+                                self._send_event(name, payload)
+                                sent[key] = payload
+                        with model._lock:
+                            current_schedule = json.dumps(model.schedule_entries, sort_keys=True)
+                        if current_schedule != schedule:
+                            self._send_event("schedule", {})
+                            schedule = current_schedule
+                        events_stop.wait(0.25)
+                except (BrokenPipeError, ConnectionResetError):
+                    return
+
             def do_OPTIONS(self) -> None:  # noqa: N802
                 self._json_response(200, {"ok": True})
 
@@ -266,7 +481,58 @@ class FirmwareApiServer:
                     if motor_id is None:
                         self._json_response(400, {"error": "invalid motorId"})
                         return
-                    self._json_response(200, model.to_state(motor_id))
+                    state = model.to_state(motor_id)
+                    packed = "application/msgpack" in (self.headers.get("Accept") or "")
+                    fields = "" if packed else query.get("fields", [""])[0]
+                    delta = not packed and "since" in query
+                    digest = hashlib.sha1(json.dumps(state, sort_keys=True).encode("utf-8") + fields.encode("utf-8")).hexdigest()
+                    etag = f'"{digest[:16]}{"p" if packed else ""}"'
+                    cache_headers = {} if delta else {"ETag": etag, "Cache-Control": "no-cache", "Vary": "Accept"}
+                    if not delta and etag in (self.headers.get("If-None-Match") or ""):
+                        self.send_response(304)
+                        for name, value in cache_headers.items():
+                            self.send_header(name, value)
+                        self.end_headers()
+                        return
+                    if packed:
+                        body = encode_state(state, int(time.time()))
+                        self.send_response(200)
+                        for name, value in cache_headers.items():
+                            self.send_header(name, value)
+                        self.send_header("Content-Type", "application/msgpack")
+                        self.send_header("Content-Length", str(len(body)))
+                        self.end_headers()
+                        self.wfile.write(body)
+                        return
+                    with versions_lock:
+                        versions.update(state)
+                        since = versions.since(query["since"][0]) if delta else 0
+                        state = {**versions.delta(state, since), "version": versions.token()}
+                    if fields:
+                        state = select_fields(state, fields + ",version")
+                    self._json_response(200, state, cache_headers)
+                    return
+
+                if path == "/api/events":
+                    self._event_stream()
+                    return
+
+                if path == "/metrics":
+                    body = model.to_metrics().encode("utf-8")
+                    self.send_response(200)
+                    self.send_header("Content-Type", "text/plain; version=0.0.4")
+                    self.send_header("Content-Length", str(len(body)))
+                    self.end_headers()
+                    self.wfile.write(body)
+                    return
+
+                if path == "/api/calibration/curve":
+                    motor_id = self._motor_id_from_query(query, default=0)
+                    if motor_id is None:
+                        self._json_response(400, {"error": "invalid motorId"})
+                        return
+                    with model._lock:
+                        self._json_response(200, {"motorId": motor_id, **model.calibration_curves})
                     return
 
                 if path == "/api/settings":
@@ -282,6 +548,7 @@ class FirmwareApiServer:
                             "mlPerRevCcw": model.ml_per_rev_ccw,
                             "dosingFlowLph": abs(model.dosing_speed * model.ml_per_rev_cw * 0.06),
                             "maxFlowLph": model.max_speed * model.ml_per_rev_cw * 0.06,
+                            "rampProfile": model.ramp_profiles[motor_id],
                             "ntpServer": model.ntp_server,
                             "growthProgramEnabled": model.growth_program_enabled,
                             "phRegulationEnabled": model.ph_regulation_enabled,
@@ -374,78 +641,36 @@ class FirmwareApiServer:
                 body = self._read_body()
                 path, _ = self._parsed()
 
-                if path == "/api/start":
-                    motor_id = self._motor_id_from_body(body, default=0)
-                    if motor_id is None:
-                        self._json_response(400, {"error": "invalid motorId"})
-                        return
-                    with model._lock:
-                        if abs(model.last_manual_speed) < 0.01:
-                            model.last_manual_speed = 120.0
-                        model.mode = 0
-                        model.target_speed = model.last_manual_speed
-                        model.running = True
-                    self._json_response(200, model.to_state(motor_id))
-                    return
-
-                if path == "/api/stop":
-                    motor_id = self._motor_id_from_body(body, default=0)
-                    if motor_id is None:
-                        self._json_response(400, {"error": "invalid motorId"})
+                if path in ("/api/start", "/api/stop", "/api/flow", "/api/dosing"):
+                    op = path[len("/api/"):]
+                    command = body if body is not None or op in ("start", "stop") else None
+                    error = model.command_error(op, command)
+                    if error is not None:
+                        self._json_response(400, {"error": error})
                         return
-                    with model._lock:
-                        model.target_speed = 0.0
-                        model.running = False
-                        model.mode = 0
-                    self._json_response(200, model.to_state(motor_id))
+                    model.apply_command(op, command or {})
+                    self._json_response(200, model.to_state(self._motor_id_from_body(command, default=0)))
                     return
 
-                if path == "/api/flow":
-                    if body is None or not isinstance(body.get("litersPerHour"), (int, float)):
-                        self._json_response(400, {"error": "litersPerHour is required"})
-                        return
-                    motor_id = self._motor_id_from_body(body, default=0)
-                    if motor_id is None:
-                        self._json_response(400, {"error": "invalid motorId"})
+                if path == "/api/batch":
+                    commands = body.get("commands") if body is not None else None
+                    if not isinstance(commands, list):
+                        self._json_response(400, {"error": "commands array is required"})
                         return
-                    lph = float(body["litersPerHour"])
-                    if lph < 0:
-                        self._json_response(400, {"error": "litersPerHour must be >= 0"})
+                    if not 1 <= len(commands) <= 16:
+                        self._json_response(400, {"error": "commands must hold 1 to 16 entries"})
                         return
-                    reverse = bool(body.get("reverse", False))
-
-                    with model._lock:
-                        ml_per_rev = model.ml_per_rev_ccw if reverse else model.ml_per_rev_cw
-                        speed = (lph * 1000.0 / 60.0) / ml_per_rev
-                        if reverse:
-                            speed *= -1.0
-                        model.mode = 0
-                        model.target_speed = max(-model.max_speed, min(model.max_speed, speed))
-                        model.last_manual_speed = model.target_speed
-                        model.running = abs(model.target_speed) >= 0.01
-                    self._json_response(200, model.to_state(motor_id))
-                    return
-
-                if path == "/api/dosing":
-                    if body is None or not isinstance(body.get("volumeMl"), (int, float)):
-                        self._json_response(400, {"error": "volumeMl is required"})
-                        return
-                    motor_id = self._motor_id_from_body(body, default=0)
-                    if motor_id is None:
-                        self._json_response(400, {"error": "invalid motorId"})
-                        return
-                    volume = float(body["volumeMl"])
-                    if volume <= 0:
-                        self._json_response(400, {"error": "volumeMl must be > 0; use reverse=true"})
-                        return
-                    reverse = bool(body.get("reverse", False))
-
-                    with model._lock:
-                        model.mode = 1
-                        model.dosing_remaining_ml = float(abs(volume))
-                        model.target_speed = -model.dosing_speed if reverse else model.dosing_speed
-                        model.running = True
-                    self._json_response(200, model.to_state(motor_id))
+                    for index, command in enumerate(commands):
+                        op = command.get("op") if isinstance(command, dict) else None
+                        error = model.command_error(op, command) if op in MOTOR_OPS else "op must be start, stop, flow or dosing"
+                        if error is not None:
+                            self._json_response(400, {"error": error, "index": index})
+                            return
+                    for command in commands:
+                        model.apply_command(command["op"], command)
+                    touched = sorted({self._motor_id_from_body(command, default=0) for command in commands})
+                    motors = [m for m in model.to_state()["motors"] if m["motorId"] in touched]
+                    self._json_response(200, {"applied": len(commands), "motors": motors})
                     return
 
                 if path == "/api/settings":
@@ -456,7 +681,12 @@ class FirmwareApiServer:
                     if motor_id is None:
                         self._json_response(400, {"error": "invalid motorId"})
                         return
+                    if "rampProfile" in body and body["rampProfile"] not in ("linear", "s-curve"):
+                        self._json_response(400, {"error": "rampProfile must be linear or s-curve"})
+                        return
                     with model._lock:
+                        if "rampProfile" in body:
+                            model.ramp_profiles[motor_id] = body["rampProfile"]
                         if isinstance(body.get("mlPerRevCw"), (int, float)) and body["mlPerRevCw"] > 0:
                             model.ml_per_rev_cw = float(body["mlPerRevCw"])
                         if isinstance(body.get("mlPerRevCcw"), (int, float)) and body["mlPerRevCcw"] > 0:
@@ -473,6 +703,9 @@ class FirmwareApiServer:
                             if not body["ntpServer"]:
                                 self._json_response(400, {"error": "ntpServer cannot be empty"})
                                 return
+                            if len(body["ntpServer"].encode()) >= 64:
+                                self._json_response(400, {"error": "ntpServer is too long"})
+                                return
                             model.ntp_server = body["ntpServer"]
                         if isinstance(body.get("growthProgramEnabled"), bool):
                             model.growth_program_enabled = body["growthProgramEnabled"]
@@ -531,14 +764,46 @@ class FirmwareApiServer:
                         self._json_response(400, {"error": "measuredMl and revolutions must be > 0"})
                         return
                     calibrated = measured / revs
+                    rpm = float(body.get("rpm", 0))
                     with model._lock:
-                        if body["direction"] == "ccw":
+                        if rpm > 0:
+                            direction = "ccw" if body["direction"] == "ccw" else "cw"
+                            points = [p for p in model.calibration_curves[direction] if abs(p["rpm"] - rpm) >= 1]
+                            if len(points) >= 6:
+                                self._json_response(400, {"error": "calibration point rejected: flow must rise with rpm, at most 6 points"})
+                                return
+                            points.append({"rpm": rpm, "mlPerRev": calibrated})
+                            model.calibration_curves[direction] = sorted(points, key=lambda p: p["rpm"])
+                        elif body["direction"] == "ccw":
                             model.ml_per_rev_ccw = calibrated
                         else:
                             model.ml_per_rev_cw = calibrated
                     self._json_response(200, model.to_state(motor_id))
                     return
 
+                if path == "/api/calibration/curve":
+                    if body is None or not isinstance(body.get("direction"), str) or not isinstance(body.get("points"), list):
+                        self._json_response(400, {"error": "direction (cw/ccw) and points are required"})
+                        return
+                    motor_id = self._motor_id_from_body(body, default=0)
+                    if motor_id is None:
+                        self._json_response(400, {"error": "invalid motorId"})
+                        return
+                    points = [{"rpm": float(p.get("rpm", 0)), "mlPerRev": float(p.get("mlPerRev", 0))} for p in body["points"]]
+                    points.sort(key=lambda p: p["rpm"])
+                    flows = [p["rpm"] * p["mlPerRev"] for p in points]
+                    if (
+                        len(points) > 6
+                        or any(p["rpm"] <= 0 or p["mlPerRev"] <= 0 for p in points)
+                        or any(b <= a for a, b in zip(flows, flows[1:]))
+                    ):
+                        self._json_response(400, {"error": "invalid curve: up to 6 points, flow must rise with rpm"})
+                        return
+                    with model._lock:
+                        model.calibration_curves["ccw" if body["direction"] == "ccw" else "cw"] = points
+                        self._json_response(200, {"motorId": motor_id, **model.calibration_curves})
+                    return
+
                 if path == "/api/wifi/reset":
                     with model._lock:
                         model.wifi_connected = False
@@ -641,6 +906,7 @@ class FirmwareApiServer:
         self._server_thread.start()
 
     def stop(self) -> None:
+        self._events_stop.set()
         self._server.shutdown()
         self._server.server_close()
         if self._server_thread is not None:
@@ -0,0 +1,133 @@
+"""Packed /api/state (Accept: application/msgpack), encoded and decoded.
+
+The firmware sends one MessagePack array:
+
+    [version, unixTime, selectedMotorId, activeMotorCount, wifiConnected,
+     expansionEnabled, expansionConnected, [motor, ...]]
+
+where each motor is [motorId, preferredReverse, *MOTOR_FIELDS]. Only the
+MessagePack types the firmware writes are handled.
+"""
+
+from __future__ import annotations
+
+import struct
+from typing import Any
+
+FORMAT_VERSION = 1
+MOTOR_FIELDS = (
+    "mode",
+    "running",
+    "forward",
+    "flowMlMin",
+    "targetFlowMlMin",
+    "dosingFlowLph",
+    "mlPerRevCw",
+    "mlPerRevCcw",
+    "dosingRemainingMl",
+    "dosingEtaSec",
+    "uptimeSec",
+    "totalPumpedL",
+    "totalHoseL",
+)
+_FLOAT32_FIELDS = {"flowMlMin", "targetFlowMlMin", "dosingFlowLph", "mlPerRevCw", "mlPerRevCcw", "dosingRemainingMl", "dosingEtaSec"}
+
+
+def _pack(value: Any, out: bytearray, float32: bool = False) -> None:
+    if isinstance(value, bool):
+        out.append(0xC3 if value else 0xC2)
+    elif isinstance(value, int):
+        if not 0 <= value <= 0xFFFFFFFF:
+            raise ValueError(f"unsigned 32-bit value expected, got {value}")
+        if value < 0x80:
+            out.append(value)
+        elif value <= 0xFF:
+            out += struct.pack(">BB", 0xCC, value)
+        elif value <= 0xFFFF:
+            out += struct.pack(">BH", 0xCD, value)
+        else:
+            out += struct.pack(">BI", 0xCE, value)
+    elif isinstance(value, float):
+        out += struct.pack(">Bf", 0xCA, value) if float32 else struct.pack(">Bd", 0xCB, value)
+    else:
+        raise TypeError(f"cannot pack {type(value).__name__}")
+
+
+def _unpack(data: bytes, pos: int) -> tuple[Any, int]:
+    tag = data[pos]
+    pos += 1
+    if tag < 0x80:
+        return tag, pos
+    if 0x90 <= tag <= 0x9F or tag in (0xDC, 0xDD):
+        if tag == 0xDC:
+            (count,), pos = struct.unpack_from(">H", data, pos), pos + 2
+        elif tag == 0xDD:
+            (count,), pos = struct.unpack_from(">I", data, pos), pos + 4
+        else:
+            count = tag & 0x0F
+        items = []
+        for _ in range(count):
+            item, pos = _unpack(data, pos)
+            items.append(item)
+        return items, pos
+    fixed = {0xC0: None, 0xC2: False, 0xC3: True}
+    if tag in fixed:
+        return fixed[tag], pos
+    formats = {0xCA: ">f", 0xCB: ">d", 0xCC: ">B", 0xCD: ">H", 0xCE: ">I", 0xCF: ">Q"}
+    if tag not in formats:
+        raise ValueError(f"unsupported MessagePack type 0x{tag:02x} at {pos - 1}")
+    (value,) = struct.unpack_from(formats[tag], data, pos)
+    return value, pos + struct.calcsize(formats[tag])
+
+
+def encode_state(state: dict[str, Any], unix_time: int = 0) -> bytes:
+    """Packs an /api/state JSON document the way the firmware does."""
+    out = bytearray([0x98])
+    for value in (FORMAT_VERSION, unix_time, state["selectedMotorId"], state["activeMotorCount"]):
+        _pack(int(value), out)
+    for value in (state["wifiConnected"], state["expansion"]["enabled"], state["expansion"]["connected"]):
+        _pack(bool(value), out)
+    motors = state["motors"]
+    out += bytes([0x90 | len(motors)]) if len(motors) < 16 else struct.pack(">BH", 0xDC, len(motors))
+    for motor in motors:
+        values = {**motor, "forward": motor["direction"] == "forward"}
+        out.append(0x90 | (2 + len(MOTOR_FIELDS)))
+        _pack(int(motor["motorId"]), out)
+        _pack(bool(motor["preferredReverse"]), out)
+        for name in MOTOR_FIELDS:
+            if name in ("running", "forward"):
+                _pack(bool(values[name]), out)
+            elif name in ("mode", "uptimeSec"):
+                _pack(int(values[name]), out)
+            else:
+                _pack(float(values[name]), out, float32=name in _FLOAT32_FIELDS)
+    return bytes(out)
+
+
+def decode_state(data: bytes) -> dict[str, Any]:
+    """Unpacks the packed state into /api/state names, derived fields included."""
+    root, end = _unpack(data, 0)
+    if end != len(data):
+        raise ValueError(f"{len(data) - end} trailing bytes")
+    if not isinstance(root, list) or len(root) != 8 or root[0] != FORMAT_VERSION:
+        raise ValueError("not a version 1 packed state")
+    version, unix_time, selected, active, wifi, exp_enabled, exp_connected, motors = root
+    decoded = []
+    for packed in motors:
+        if len(packed) != 2 + len(MOTOR_FIELDS):
+            raise ValueError(f"motor with {len(packed)} values")
+        motor = {"motorId": packed[0], "preferredReverse": packed[1], **dict(zip(MOTOR_FIELDS, packed[2:]))}
+        motor["modeName"] = "dosing" if motor["mode"] == 1 else "flow_lph"
+        motor["direction"] = "forward" if motor.pop("forward") else "reverse"
+        motor["flowLph"] = motor["flowMlMin"] * 0.06
+        motor["targetFlowLph"] = motor["targetFlowMlMin"] * 0.06
+        decoded.append(motor)
+    return {
+        "formatVersion": version,
+        "unixTime": unix_time,
+        "selectedMotorId": selected,
+        "activeMotorCount": active,
+        "wifiConnected": wifi,
+        "expansion": {"enabled": exp_enabled, "connected": exp_connected},
+        "motors": decoded,
+    }
@@ -8,6 +8,7 @@ import urllib.request
 import pytest
 
 from integration.firmware_api_sim import FirmwareApiServer
+from integration.state_codec import decode_state
 
 
 @pytest.fixture()
@@ -60,12 +61,176 @@ def test_flow_start_stop(api_server: tuple[FirmwareApiServer, str]) -> None:
     assert err["error"] == "invalid motorId"
 
 
+def test_state_etag_answers_not_modified(api_server: tuple[FirmwareApiServer, str]) -> None:
+    _, base = api_server
+    url = f"{base}/api/state?motorId=0"
+
+    with urllib.request.urlopen(url, timeout=3.0) as resp:
+        etag = resp.headers["ETag"]
+        assert resp.headers["Cache-Control"] == "no-cache"
+    assert etag
+
+    revalidate = urllib.request.Request(url=url, headers={"If-None-Match": etag})
+    with pytest.raises(urllib.error.HTTPError) as err:
+        urllib.request.urlopen(revalidate, timeout=3.0)
+    assert err.value.code == 304
+    assert err.value.headers["ETag"] == etag
+
+    code, _ = http_json(f"{base}/api/flow", method="POST", payload={"motorId": 0, "litersPerHour": 3.0})
+    assert code == 200
+    with urllib.request.urlopen(revalidate, timeout=3.0) as resp:
+        assert resp.status == 200
+        assert resp.headers["ETag"] != etag
+        assert json.loads(resp.read().decode("utf-8"))["motorId"] == 0
+
+
+def test_state_fields_and_since(api_server: tuple[FirmwareApiServer, str]) -> None:
+    _, base = api_server
+
+    code, state = http_json(f"{base}/api/state?motorId=1&fields=flowLph,motors.running")
+    assert code == 200
+    assert set(state) == {"motorId", "flowLph", "motors", "version"}
+    assert state["motorId"] == 1
+    assert all(set(motor) == {"motorId", "running"} for motor in state["motors"])
+
+    _, full = http_json(f"{base}/api/state")
+    version = full["version"]
+    code, delta = http_json(f"{base}/api/state?since={version}")
+    assert code == 200
+    assert delta == {"motorId": full["motorId"], "motors": [], "version": version}
+
+    code, _ = http_json(f"{base}/api/flow", method="POST", payload={"motorId": 0, "litersPerHour": 3.0})
+    assert code == 200
+    _, delta = http_json(f"{base}/api/state?since={version}")
+    assert delta["version"] != version
+    assert "firmware" not in delta and "expansion" not in delta
+    assert abs(delta["targetFlowLph"] - 3.0) < 0.25
+    assert delta["motors"] and all("targetFlowLph" in motor for motor in delta["motors"])
+
+    # A version from another boot, or garbage, gets the whole state.
+    for stale in ("00000000-1", "junk"):
+        _, state = http_json(f"{base}/api/state?since={stale}")
+        assert "firmware" in state and len(state["motors"]) == full["activeMotorCount"]
+
+
+def test_metrics_count_doses_and_requests(api_server: tuple[FirmwareApiServer, str]) -> None:
+    _, base = api_server
+    code, _ = http_json(f"{base}/api/dosing", method="POST", payload={"motorId": 1, "volumeMl": 5})
+    assert code == 200
+
+    with urllib.request.urlopen(f"{base}/metrics", timeout=3.0) as resp:
+        assert resp.headers["Content-Type"].startswith("text/plain")
+        text = resp.read().decode("utf-8")
+    samples = {}
+    for line in text.splitlines():
+        if line.startswith("#"):
+            continue
+        name, value = line.rsplit(" ", 1)
+        samples[name] = float(value)
+    assert samples['pump_doses_total{motor="1"}'] == 1
+    assert samples['pump_doses_total{motor="0"}'] == 0
+    assert samples['pump_http_requests_total{method="POST",route="/api/dosing"}'] == 1
+    assert samples['pump_http_requests_total{method="GET",route="/metrics"}'] == 1
+
+
+def test_batch_validates_all_before_applying(api_server: tuple[FirmwareApiServer, str]) -> None:
+    _, base = api_server
+
+    code, err = http_json(
+        f"{base}/api/batch",
+        method="POST",
+        payload={"commands": [{"op": "flow", "motorId": 1, "litersPerHour": 4.0}, {"op": "dosing", "motorId": 99, "volumeMl": 10}]},
+    )
+    assert code == 400
+    assert err == {"error": "invalid motorId", "index": 1}
+    code, state = http_json(f"{base}/api/state?motorId=1")
+    assert code == 200 and state["running"] is False
+
+    code, err = http_json(f"{base}/api/batch", method="POST", payload={"commands": [{"op": "drain", "motorId": 0}]})
+    assert code == 400
+    assert err["index"] == 0
+
+    code, result = http_json(
+        f"{base}/api/batch",
+        method="POST",
+        payload={"commands": [{"op": "flow", "motorId": 1, "litersPerHour": 4.0}, {"op": "dosing", "motorId": 2, "volumeMl": 25}]},
+    )
+    assert code == 200
+    assert result["applied"] == 2
+    assert [m["motorId"] for m in result["motors"]] == [1, 2]
+
+
+def read_event(stream) -> tuple[str, dict]:
+    name = ""
+    while True:
+        line = stream.readline().decode("utf-8").rstrip("\n")
+        if line.startswith("event: "):
+            name = line[len("event: "):]
+        elif line.startswith("data: "):
+            data = json.loads(line[len("data: "):])
+            assert stream.readline() == b"\n"
+            return name, data
+
+
+def test_events_stream_snapshot_then_deltas(api_server: tuple[FirmwareApiServer, str]) -> None:
+    _, base = api_server
+
+    with urllib.request.urlopen(f"{base}/api/events", timeout=3.0) as stream:
+        assert stream.headers["Content-Type"] == "text/event-stream"
+        name, system = read_event(stream)
+        assert name == "system"
+        motors = [read_event(stream) for _ in range(system["activeMotorCount"])]
+        assert [m["motorId"] for name, m in motors if name == "motor"] == list(range(system["activeMotorCount"]))
+
+        code, _ = http_json(f"{base}/api/schedule", method="POST", payload={"entries": [{"enabled": True, "hour": 8, "minute": 0, "volumeMl": 5}]})
+        assert code == 200
+        deadline = time.monotonic() + 2.0
+        seen = set()
+        while "schedule" not in seen and time.monotonic() < deadline:
+            name, _ = read_event(stream)
+            seen.add(name)
+        assert "schedule" in seen
+
+
+def test_packed_state_matches_json(api_server: tuple[FirmwareApiServer, str]) -> None:
+    _, base = api_server
+    code, _ = http_json(f"{base}/api/flow", method="POST", payload={"motorId": 0, "litersPerHour": 3.0})
+    assert code == 200
+    _, state = http_json(f"{base}/api/state")
+
+    req = urllib.request.Request(url=f"{base}/api/state", headers={"Accept": "application/msgpack"})
+    with urllib.request.urlopen(req, timeout=3.0) as resp:
+        assert resp.headers["Content-Type"] == "application/msgpack"
+        assert resp.headers["ETag"].endswith('p"')
+        raw = resp.read()
+    packed = decode_state(raw)
+
+    assert len(raw) * 4 < len(json.dumps(state))
+    assert packed["activeMotorCount"] == state["activeMotorCount"]
+    assert packed["expansion"]["connected"] == state["expansion"]["connected"]
+    for motor, expected in zip(packed["motors"], state["motors"]):
+        assert motor["motorId"] == expected["motorId"]
+        assert motor["running"] == expected["running"]
+        assert motor["direction"] == expected["direction"]
+        assert motor["modeName"] == expected["modeName"]
+        assert motor["targetFlowLph"] == pytest.approx(expected["targetFlowLph"], rel=1e-5)
+        assert motor["totalPumpedL"] == pytest.approx(expected["totalPumpedL"], abs=0.01)
+
+
 def test_dosing_and_calibration(api_server: tuple[FirmwareApiServer, str]) -> None:
     _, base = api_server
 
     code, state = http_json(f"{base}/api/dosing", method="POST", payload={"volumeMl": 5})
     assert code == 200
     assert state["modeName"] == "dosing"
+    assert 0 < state["dosingEtaSec"] < 10
+    assert state["motors"][0]["dosingEtaSec"] == state["dosingEtaSec"]
+    first_eta = state["dosingEtaSec"]
+
+    time.sleep(0.3)
+    _, state = http_json(f"{base}/api/state")
+    if state["modeName"] == "dosing":
+        assert state["dosingEtaSec"] < first_eta
 
     deadline = time.time() + 5.0
     while time.time() < deadline:
@@ -74,6 +239,7 @@ def test_dosing_and_calibration(api_server: tuple[FirmwareApiServer, str]) -> No
             break
         time.sleep(0.05)
     assert state["running"] is False
+    assert state["dosingEtaSec"] == 0
 
     code, state = http_json(
         f"{base}/api/calibration/apply",
@@ -84,6 +250,34 @@ def test_dosing_and_calibration(api_server: tuple[FirmwareApiServer, str]) -> No
     assert abs(state["mlPerRevCw"] - 3.5) < 1e-6
 
 
+def test_calibration_curve_points(api_server: tuple[FirmwareApiServer, str]) -> None:
+    _, base = api_server
+
+    for rpm, measured in ((300, 480.0), (60, 540.0)):
+        code, _ = http_json(
+            f"{base}/api/calibration/apply",
+            method="POST",
+            payload={"direction": "cw", "revolutions": 200, "measuredMl": measured, "rpm": rpm},
+        )
+        assert code == 200
+    code, curves = http_json(f"{base}/api/calibration/curve?motorId=0")
+    assert code == 200
+    assert [p["rpm"] for p in curves["cw"]] == [60, 300]
+    assert abs(curves["cw"][1]["mlPerRev"] - 2.4) < 1e-6
+    assert curves["ccw"] == []
+
+    # Flow has to rise with speed.
+    code, _ = http_json(
+        f"{base}/api/calibration/curve",
+        method="POST",
+        payload={"direction": "cw", "points": [{"rpm": 100, "mlPerRev": 2.6}, {"rpm": 200, "mlPerRev": 1.0}]},
+    )
+    assert code == 400
+    code, curves = http_json(f"{base}/api/calibration/curve", method="POST", payload={"direction": "cw", "points": []})
+    assert code == 200
+    assert curves["cw"] == []
+
+
 def test_settings_and_validation(api_server: tuple[FirmwareApiServer, str]) -> None:
     _, base = api_server
 
@@ -94,6 +288,7 @@ def test_settings_and_validation(api_server: tuple[FirmwareApiServer, str]) -> N
     assert settings["maxFlowLph"] > 0
     assert settings["growthProgramEnabled"] is False
     assert settings["phRegulationEnabled"] is False
+    assert settings["rampProfile"] == "linear"
 
     code, state = http_json(
         f"{base}/api/settings",
@@ -106,6 +301,7 @@ def test_settings_and_validation(api_server: tuple[FirmwareApiServer, str]) -> N
             "maxFlowLph": 20.0,
             "growthProgramEnabled": True,
             "phRegulationEnabled": True,
+            "rampProfile": "s-curve",
             "expansion": {"enabled": True, "interface": "i2c", "motorCount": 4},
         },
     )
@@ -117,6 +313,13 @@ def test_settings_and_validation(api_server: tuple[FirmwareApiServer, str]) -> N
     assert code == 200
     assert settings["growthProgramEnabled"] is True
     assert settings["phRegulationEnabled"] is True
+    assert settings["rampProfile"] == "s-curve"
+    code, settings = http_json(f"{base}/api/settings?motorId=0")
+    assert settings["rampProfile"] == "linear"
+
+    code, err = http_json(f"{base}/api/settings", method="POST", payload={"motorId": 1, "rampProfile": "cubic"})
+    assert code == 400
+    assert err["error"] == "rampProfile must be linear or s-curve"
 
     code, err = http_json(f"{base}/api/settings", method="POST", payload={"maxFlowLph": 0})
     assert code == 400
@@ -0,0 +1,57 @@
+from __future__ import annotations
+
+import json
+import os
+import subprocess
+from pathlib import Path
+
+import pytest
+
+REPO_ROOT = Path(__file__).resolve().parents[3]
+# Built by `pio run -e native-sim`; PERISTALTIC_SIM points at another build.
+SIM = Path(os.getenv("PERISTALTIC_SIM", "") or REPO_ROOT / "firmware-esp32" / ".pio" / "build" / "native-sim" / "program")
+
+pytestmark = pytest.mark.skipif(not SIM.is_file(), reason=f"no native-sim build at {SIM}")
+
+
+def run_sim(*args: str) -> dict:
+    out = subprocess.run([str(SIM), "--json", *args], check=True, capture_output=True, text=True, timeout=120)
+    return json.loads(out.stdout)
+
+
+def test_local_schedule_fires_on_the_pass_clock() -> None:
+    # Seed 4 puts several schedules on motor 0. Slow I2C makes the expansion
+    # poll before them take a few milliseconds, as on the board.
+    report = run_sim("--days", "3", "--seed", "4", "--i2c-ms", "1")
+    local = report["motors"][0]
+    assert local["hits"] > 0
+    assert local["dosed_ml"] == pytest.approx(local["scheduled_ml"], abs=0.5)
+    assert report["schedule"]["missed"] == 0
+    assert report["schedule"]["unexpected"] == 0
+    assert report["local_clock_ahead"] == 0
+
+
+def test_control_tick_waits_for_the_next_event() -> None:
+    # The harness steps every 10 ms while any motor moves. Motor 0 only needs
+    # a tick while its speed changes, so most of those passes skip it.
+    report = run_sim("--days", "3", "--seed", "4")
+    local = report["motors"][0]
+    assert local["dosed_ml"] == pytest.approx(local["scheduled_ml"], abs=0.5)
+    # Passes are 1 s apart when idle and 10 ms apart while moving, and every
+    # idle pass is late enough for a tick.
+    total_ms = 3 * 24 * 3600 * 1000
+    moving_passes = (1000 * report["loops"] - total_ms) / 990
+    idle_passes = report["loops"] - moving_passes
+    assert moving_passes > 0
+    assert report["control_ticks"] - idle_passes < moving_passes / 4
+
+
+def test_step_pulses_match_the_plan_under_tick_jitter() -> None:
+    # Late control ticks leave the LEDC tone at a stale speed; the pulse
+    # counter on the STEP pin still cuts each dose on its last planned step.
+    report = run_sim("--days", "3", "--seed", "7", "--tick-jitter-ms", "40")
+    local = report["motors"][0]
+    assert local["hits"] > 0
+    assert report["budgeted_steps"] > 0
+    assert report["step_pulses"] == report["budgeted_steps"]
+    assert local["dosed_ml"] == pytest.approx(local["scheduled_ml"], abs=0.01)
@@ -0,0 +1,63 @@
+from __future__ import annotations
+
+import importlib.util
+import re
+import struct
+from pathlib import Path
+
+REPO_ROOT = Path(__file__).resolve().parents[3]
+SCRIPT = REPO_ROOT / "firmware-esp32" / "scripts" / "trace_to_timeline.py"
+TRACE_HEADER = REPO_ROOT / "firmware-esp32" / "include" / "TraceRing.h"
+
+
+def _load_script():
+    spec = importlib.util.spec_from_file_location("trace_to_timeline", SCRIPT)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+def _dump(events: list[tuple[int, int, int, int, int]], recorded: int, routes: list[str]) -> bytes:
+    out = struct.pack("<4sBBHII", b"PTRC", 1, 12, len(events), recorded, events[-1][0])
+    out += b"".join(struct.pack("<IBBHI", *event) for event in events)
+    return out + "".join(route + "\n" for route in routes).encode("utf-8")
+
+
+def test_trace_types_match_firmware() -> None:
+    tool = _load_script()
+    firmware = {name: int(value) for name, value in re.findall(r"\bk(\w+) = (\d+),", TRACE_HEADER.read_text())}
+    assert len(firmware) == 9
+    for name, value in firmware.items():
+        constant = re.sub(r"(?<!^)(?=[A-Z])", "_", name).upper()
+        assert getattr(tool, constant) == value, name
+
+
+def test_dump_becomes_timeline_across_wrap() -> None:
+    tool = _load_script()
+    start = 2**32 - 300
+    events = [
+        (start, 2, 0, 0, 0),  # end of a tick that began before the ring
+        (start + 100, 8, 1, 0, 0),
+        (start + 200, 1, 0, 0, 0),
+        ((start + 260) % 2**32, 4, 0x2A, 1, 40),
+        ((start + 280) % 2**32, 3, 0, 1, 1_600_000),
+        ((start + 290) % 2**32, 2, 0, 0, 0),
+        ((start + 400) % 2**32, 5, 2, 1, 25),
+        ((start + 500) % 2**32, 9, 1, 0, 0),
+    ]
+    trace = tool.to_chrome_trace(_dump(events, recorded=1030, routes=["/", "/api/state"]))
+
+    assert trace["otherData"]["dropped"] == 1022
+    timed = [e for e in trace["traceEvents"] if e["ph"] != "M"]
+    assert [(e["ph"], e["name"], e["ts"]) for e in timed if e["ph"] in "BE"] == [
+        ("B", "/api/state", 100),
+        ("B", "tick", 200),
+        ("E", "tick", 290),
+        ("E", "/api/state", 500),
+    ]
+    i2c = next(e for e in timed if e["ph"] == "X")
+    assert (i2c["name"], i2c["ts"], i2c["dur"]) == ("i2c 0x2a", 220, 40)
+    rate = next(e for e in timed if e["ph"] == "C")
+    assert rate["args"]["Hz"] == -1600.0
+    fired = next(e for e in timed if e["ph"] == "i")
+    assert fired["name"] == "schedule 2 fired" and fired["args"] == {"motorId": 1, "volumeMl": 25}
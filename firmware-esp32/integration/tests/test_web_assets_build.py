@@ -0,0 +1,42 @@
+from __future__ import annotations
+
+import gzip
+import importlib.util
+import re
+from pathlib import Path
+
+REPO_ROOT = Path(__file__).resolve().parents[3]
+DATA_DIR = REPO_ROOT / "firmware-esp32" / "data"
+BUILD_SCRIPT = REPO_ROOT / "firmware-esp32" / "scripts" / "build_web_assets.py"
+
+
+def _load_build_script():
+    spec = importlib.util.spec_from_file_location("build_web_assets", BUILD_SCRIPT)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+
+def test_assets_are_gzipped_and_fingerprinted(tmp_path: Path) -> None:
+    renames = _load_build_script().build(DATA_DIR, tmp_path)
+
+    assert set(renames) == {"/app.js", "/growth-schedule.js", "/styles.css"}
+    for old, new in renames.items():
+        assert re.fullmatch(r"/[\w-]+\.[0-9a-f]{8}\.(js|css)", new)
+        stored = tmp_path / (new.lstrip("/") + ".gz")
+        assert gzip.decompress(stored.read_bytes()) == (DATA_DIR / old.lstrip("/")).read_bytes()
+
+    html = gzip.decompress((tmp_path / "index.html.gz").read_bytes()).decode("utf-8")
+    for old, new in renames.items():
+        assert f'"{new}"' in html
+        assert f'"{old}"' not in html
+    assert sorted(p.name for p in tmp_path.iterdir()) == sorted(["index.html.gz"] + [n.lstrip("/") + ".gz" for n in renames.values()])
+
+
+def test_asset_build_is_reproducible(tmp_path: Path) -> None:
+    build = _load_build_script().build
+    build(DATA_DIR, tmp_path / "a")
+    build(DATA_DIR, tmp_path / "b")
+
+    for path in (tmp_path / "a").iterdir():
+        assert path.read_bytes() == (tmp_path / "b" / path.name).read_bytes()
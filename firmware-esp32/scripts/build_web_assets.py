@@ -0,0 +1,81 @@
+"""Precompress and fingerprint the Web UI for the LittleFS image.
+
+Every file in data/ except the HTML pages is renamed to
+<name>.<hash>.<ext>, where <hash> is the first 8 hex digits of the
+SHA-256 of its contents, and the pages are rewritten to refer to the new
+names. Everything is stored gzip-compressed as <name>.gz. The firmware
+serves the .gz copies with Content-Encoding: gzip, and fingerprinted
+names with an immutable Cache-Control.
+
+Runs as a PlatformIO pre-script (the filesystem image is then built from
+the output directory) or on its own:
+
+    python scripts/build_web_assets.py data .pio/webfs
+"""
+
+from __future__ import annotations
+
+import gzip
+import hashlib
+import shutil
+import sys
+from pathlib import Path
+
+FINGERPRINT_LEN = 8
+PAGE_SUFFIXES = (".html",)
+
+
+def fingerprinted_name(path: Path, data: bytes) -> str:
+    digest = hashlib.sha256(data).hexdigest()[:FINGERPRINT_LEN]
+    return f"{path.stem}.{digest}{path.suffix}"
+
+
+def build(src: Path, out: Path) -> dict[str, str]:
+    """Writes the compressed image of `src` to `out`, returning the renames."""
+    if out.exists():
+        shutil.rmtree(out)
+    out.mkdir(parents=True)
+
+    files = sorted(p for p in src.rglob("*") if p.is_file())
+    pages = [p for p in files if p.suffix in PAGE_SUFFIXES]
+    renames: dict[str, str] = {}
+    for path in files:
+        if path in pages:
+            continue
+        rel = path.relative_to(src)
+        renamed = rel.with_name(fingerprinted_name(path, path.read_bytes()))
+        renames["/" + rel.as_posix()] = "/" + renamed.as_posix()
+
+    for path in files:
+        rel = path.relative_to(src)
+        data = path.read_bytes()
+        if path in pages:
+            text = data.decode("utf-8")
+            for old, new in renames.items():
+                text = text.replace(f'"{old}"', f'"{new}"')
+            data = text.encode("utf-8")
+            target = rel
+        else:
+            target = Path(renames["/" + rel.as_posix()].lstrip("/"))
+        dest = out / target.with_name(target.name + ".gz")
+        dest.parent.mkdir(parents=True, exist_ok=True)
+        # mtime=0 keeps the image byte-identical between builds.
+        dest.write_bytes(gzip.compress(data, compresslevel=9, mtime=0))
+    return renames
+
+
+def _pio_pre_script() -> None:
+    env = DefaultEnvironment()  # noqa: F821
+    src = Path(env.subst("$PROJECT_DATA_DIR"))
+    out = Path(env.subst("$BUILD_DIR")) / "webfs"
+    build(src, out)
+    env.Replace(PROJECT_DATA_DIR=str(out))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit("usage: build_web_assets.py <data dir> <output dir>")
+    for old, new in build(Path(sys.argv[1]), Path(sys.argv[2])).items():
+        print(f"{old} -> {new}")
+elif __name__ == "SCons.Script":
+    _pio_pre_script()
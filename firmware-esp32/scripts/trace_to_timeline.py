@@ -0,0 +1,124 @@
+"""Convert an /api/trace dump into a Chrome trace for Perfetto or chrome://tracing.
+
+    curl -u <user>:<pass> http://<device>/api/trace -o trace.bin
+    python scripts/trace_to_timeline.py trace.bin trace.json
+
+The dump is a header, the events oldest first and the route names, as
+laid out in include/TraceRing.h. Control ticks, HTTP handlers, I2C
+exchanges and NVS commits become slices on their own rows. The step
+rate becomes a counter, signed by direction. Schedule firings and skips
+become instants.
+"""
+
+from __future__ import annotations
+
+import json
+import struct
+import sys
+from pathlib import Path
+from typing import Any
+
+HEADER = struct.Struct("<4sBBHII")
+EVENT = struct.Struct("<IBBHI")
+DUMP_VERSION = 1
+
+# TraceType in include/TraceRing.h.
+TICK_BEGIN = 1
+TICK_END = 2
+STEP_FREQUENCY = 3
+I2C = 4
+SCHEDULE_FIRE = 5
+SCHEDULE_SKIP = 6
+NVS_COMMIT = 7
+HTTP_BEGIN = 8
+HTTP_END = 9
+
+THREADS = {1: "control tick", 2: "http", 3: "i2c", 4: "nvs", 5: "schedule"}
+
+
+def parse_dump(data: bytes) -> tuple[dict[str, int], list[tuple[int, int, int, int, int]], list[str]]:
+    """Returns the header fields, the (micros, type, id, arg, value) events and the routes."""
+    if len(data) < HEADER.size:
+        raise ValueError("not a trace dump: too short")
+    magic, version, event_bytes, count, recorded, now = HEADER.unpack_from(data)
+    if magic != b"PTRC" or version != DUMP_VERSION or event_bytes != EVENT.size:
+        raise ValueError(f"not a version {DUMP_VERSION} trace dump")
+    end = HEADER.size + count * EVENT.size
+    if len(data) < end:
+        raise ValueError(f"dump truncated: {count} events need {end} bytes, got {len(data)}")
+    events = [EVENT.unpack_from(data, HEADER.size + i * EVENT.size) for i in range(count)]
+    routes = data[end:].decode("utf-8").split("\n")[:-1]
+    return {"events": count, "recorded": recorded, "dropped": recorded - count, "nowMicros": now}, events, routes
+
+
+def timestamps(events: list[tuple[int, int, int, int, int]]) -> list[int]:
+    """Microseconds since the first event, across micros() wrapping.
+
+    Tasks can record a few microseconds out of order, so a step back is
+    read as a step back rather than as a wrap.
+    """
+    out: list[int] = []
+    ts = 0
+    for i, event in enumerate(events):
+        if i > 0:
+            ts += ((event[0] - events[i - 1][0] + 2**31) % 2**32) - 2**31
+        out.append(ts)
+    return out
+
+
+def to_chrome_trace(data: bytes) -> dict[str, Any]:
+    info, events, routes = parse_dump(data)
+    trace: list[dict[str, Any]] = [
+        {"ph": "M", "name": "thread_name", "pid": 1, "tid": tid, "args": {"name": name}} for tid, name in THREADS.items()
+    ]
+    open_slices = {1: 0, 2: 0}
+
+    def slice_event(phase: str, name: str, tid: int, ts: int) -> None:
+        # The ring may start after a slice began; drop its lone end.
+        if phase == "E":
+            if open_slices[tid] == 0:
+                return
+            open_slices[tid] -= 1
+        else:
+            open_slices[tid] += 1
+        trace.append({"ph": phase, "name": name, "pid": 1, "tid": tid, "ts": ts})
+
+    for ts, (_, kind, ident, arg, value) in zip(timestamps(events), events):
+        if kind in (TICK_BEGIN, TICK_END):
+            slice_event("B" if kind == TICK_BEGIN else "E", "tick", 1, ts)
+        elif kind in (HTTP_BEGIN, HTTP_END):
+            route = routes[ident] if ident < len(routes) else "other"
+            slice_event("B" if kind == HTTP_BEGIN else "E", route, 2, ts)
+        elif kind == STEP_FREQUENCY:
+            hz = value / 1000.0
+            trace.append({"ph": "C", "name": "step rate", "pid": 1, "ts": ts, "args": {"Hz": -hz if arg else hz}})
+        elif kind in (I2C, NVS_COMMIT):
+            # Recorded when done, with the time taken.
+            name = f"i2c 0x{ident:02x}" if kind == I2C else "nvs commit"
+            tid = 3 if kind == I2C else 4
+            trace.append(
+                {"ph": "X", "name": name if arg else name + " failed", "pid": 1, "tid": tid, "ts": ts - value, "dur": value}
+            )
+        elif kind in (SCHEDULE_FIRE, SCHEDULE_SKIP):
+            verb = "fired" if kind == SCHEDULE_FIRE else "skipped, motor busy"
+            trace.append(
+                {
+                    "ph": "i",
+                    "s": "t",
+                    "name": f"schedule {ident} {verb}",
+                    "pid": 1,
+                    "tid": 5,
+                    "ts": ts,
+                    "args": {"motorId": arg, "volumeMl": value},
+                }
+            )
+    return {"traceEvents": trace, "displayTimeUnit": "ms", "otherData": info}
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit("usage: trace_to_timeline.py <dump> <trace.json>")
+    result = to_chrome_trace(Path(sys.argv[1]).read_bytes())
+    Path(sys.argv[2]).write_text(json.dumps(result), encoding="utf-8")
+    info = result["otherData"]
+    print(f"{info['events']} events, {info['dropped']} overwritten before the dump")
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Wire.h>
+
+#define SSD1306_WHITE 1
+#define SSD1306_SWITCHCAPVCC 2
+
+// No panel on the simulated bus: begin() fails and the firmware skips drawing.
+class Adafruit_SSD1306 : public Print {
+ public:
+  Adafruit_SSD1306(std::uint8_t, std::uint8_t, TwoWire*, int8_t) {}
+  bool begin(std::uint8_t, std::uint8_t) { return false; }
+  std::size_t write(std::uint8_t) override { return 1; }
+  using Print::write;
+  void clearDisplay() {}
+  void display() {}
+  void setTextSize(std::uint8_t) {}
+  void setTextColor(std::uint16_t) {}
+  void setCursor(std::int16_t, std::int16_t) {}
+  void drawCircle(std::int16_t, std::int16_t, std::int16_t, std::uint16_t) {}
+  void fillCircle(std::int16_t, std::int16_t, std::int16_t, std::uint16_t) {}
+};
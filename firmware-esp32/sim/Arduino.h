@@ -0,0 +1,284 @@
+#pragma once
+
+// Host stand-in for the Arduino core, backed by sim::Board. Only what the
+// firmware uses is provided.
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "SimBoard.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+using byte = std::uint8_t;
+
+class String {
+ public:
+  String() = default;
+  String(const char* s) : s_(s ? s : "") {}
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c) : s_(1, c) {}
+  explicit String(int v) : s_(std::to_string(v)) {}
+  explicit String(unsigned v) : s_(std::to_string(v)) {}
+  explicit String(long v) : s_(std::to_string(v)) {}
+  explicit String(unsigned long v) : s_(std::to_string(v)) {}
+  explicit String(long long v) : s_(std::to_string(v)) {}
+  explicit String(unsigned long long v) : s_(std::to_string(v)) {}
+  explicit String(double v, unsigned decimals = 2) {
+    char buf[48];
+    std::snprintf(buf, sizeof(buf), "%.*f", static_cast<int>(decimals), v);
+    s_ = buf;
+  }
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned length() const { return static_cast<unsigned>(s_.size()); }
+  bool reserve(unsigned size) {
+    s_.reserve(size);
+    return true;
+  }
+  char charAt(unsigned i) const { return i < s_.size() ? s_[i] : 0; }
+  char operator[](unsigned i) const { return charAt(i); }
+
+  bool concat(const String& o) {
+    s_ += o.s_;
+    return true;
+  }
+  bool concat(const char* o) {
+    if (o) s_ += o;
+    return true;
+  }
+  bool concat(const char* o, unsigned n) {
+    s_.append(o, n);
+    return true;
+  }
+  bool concat(char c) {
+    s_ += c;
+    return true;
+  }
+  String& operator+=(const String& o) {
+    s_ += o.s_;
+    return *this;
+  }
+  String& operator+=(const char* o) {
+    concat(o);
+    return *this;
+  }
+  String& operator+=(char c) {
+    s_ += c;
+    return *this;
+  }
+  String& operator+=(int v) {
+    s_ += std::to_string(v);
+    return *this;
+  }
+  String& operator+=(unsigned v) {
+    s_ += std::to_string(v);
+    return *this;
+  }
+
+  bool equals(const String& o) const { return s_ == o.s_; }
+  bool equalsIgnoreCase(const String& o) const {
+    return s_.size() == o.s_.size() && std::equal(s_.begin(), s_.end(), o.s_.begin(), [](char a, char b) {
+             return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+           });
+  }
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String& p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+  int indexOf(char c, unsigned from = 0) const { return found(s_.find(c, from)); }
+  int indexOf(const String& p, unsigned from = 0) const { return found(s_.find(p.s_, from)); }
+  int lastIndexOf(char c) const { return found(s_.rfind(c)); }
+  int lastIndexOf(const String& p) const { return found(s_.rfind(p.s_)); }
+  String substring(unsigned from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+  String substring(unsigned from, unsigned to) const {
+    if (from > to) std::swap(from, to);
+    return from < s_.size() ? String(s_.substr(from, to - from)) : String();
+  }
+  void remove(unsigned index) {
+    if (index < s_.size()) s_.erase(index);
+  }
+  void remove(unsigned index, unsigned count) {
+    if (index < s_.size()) s_.erase(index, count);
+  }
+  void replace(const String& from, const String& to) {
+    if (from.s_.empty()) return;
+    for (std::size_t pos = s_.find(from.s_); pos != std::string::npos; pos = s_.find(from.s_, pos + to.s_.size())) {
+      s_.replace(pos, from.s_.size(), to.s_);
+    }
+  }
+  void trim() {
+    const auto first = s_.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+      s_.clear();
+      return;
+    }
+    s_ = s_.substr(first, s_.find_last_not_of(" \t\r\n") - first + 1);
+  }
+  void toLowerCase() {
+    for (auto& c : s_) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  void toUpperCase() {
+    for (auto& c : s_) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  }
+  long toInt() const { return std::strtol(s_.c_str(), nullptr, 10); }
+  float toFloat() const { return std::strtof(s_.c_str(), nullptr); }
+  bool isEmpty() const { return s_.empty(); }
+  void clear() { s_.clear(); }
+
+  friend bool operator==(const String& a, const String& b) { return a.s_ == b.s_; }
+  friend bool operator!=(const String& a, const String& b) { return a.s_ != b.s_; }
+  friend bool operator==(const String& a, const char* b) { return a.s_ == (b ? b : ""); }
+  friend bool operator!=(const String& a, const char* b) { return !(a == b); }
+  friend bool operator<(const String& a, const String& b) { return a.s_ < b.s_; }
+
+ private:
+  static int found(std::size_t pos) { return pos == std::string::npos ? -1 : static_cast<int>(pos); }
+
+  std::string s_;
+};
+
+// The Arduino core's concatenation temporary; ArduinoJson adapts to it.
+class StringSumHelper : public String {
+ public:
+  StringSumHelper(const String& s) : String(s) {}
+};
+
+inline StringSumHelper operator+(const String& a, const String& b) {
+  String out(a);
+  out += b;
+  return out;
+}
+inline StringSumHelper operator+(const String& a, const char* b) {
+  String out(a);
+  out += b;
+  return out;
+}
+inline StringSumHelper operator+(const char* a, const String& b) {
+  String out(a);
+  out += b;
+  return out;
+}
+inline StringSumHelper operator+(const String& a, char b) {
+  String out(a);
+  out += b;
+  return out;
+}
+
+class Print {
+ public:
+  virtual ~Print() = default;
+  virtual std::size_t write(std::uint8_t c) = 0;
+  virtual std::size_t write(const std::uint8_t* data, std::size_t len) {
+    for (std::size_t i = 0; i < len; ++i) write(data[i]);
+    return len;
+  }
+  std::size_t write(const char* s) { return write(reinterpret_cast<const std::uint8_t*>(s), std::strlen(s)); }
+  std::size_t write(const char* s, std::size_t len) { return write(reinterpret_cast<const std::uint8_t*>(s), len); }
+
+  std::size_t print(const char* s) { return write(s); }
+  std::size_t print(const String& s) { return write(s.c_str()); }
+  std::size_t print(char c) { return write(static_cast<std::uint8_t>(c)); }
+  std::size_t print(int v) { return printf("%d", v); }
+  std::size_t print(unsigned v) { return printf("%u", v); }
+  std::size_t print(long v) { return printf("%ld", v); }
+  std::size_t print(unsigned long v) { return printf("%lu", v); }
+  std::size_t print(double v, int decimals = 2) { return printf("%.*f", decimals, v); }
+  template <typename T>
+  std::size_t println(const T& v) {
+    return print(v) + println();
+  }
+  std::size_t println(double v, int decimals) { return print(v, decimals) + println(); }
+  std::size_t println() { return write("\r\n"); }
+  std::size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    const int n = std::vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return n > 0 ? write(buf, std::min<std::size_t>(static_cast<std::size_t>(n), sizeof(buf) - 1)) : 0;
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  std::size_t readBytes(char* buffer, std::size_t len) {
+    std::size_t n = 0;
+    while (n < len && available() > 0) buffer[n++] = static_cast<char>(read());
+    return n;
+  }
+  std::size_t readBytes(std::uint8_t* buffer, std::size_t len) { return readBytes(reinterpret_cast<char*>(buffer), len); }
+};
+
+// Console output goes to stderr with --verbose and is dropped otherwise.
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long) {}
+  std::size_t write(std::uint8_t c) override {
+    if (sim::board().verbose) std::fputc(c, stderr);
+    return 1;
+  }
+  using Print::write;
+};
+
+inline HardwareSerial Serial;
+
+inline std::uint32_t millis() { return static_cast<std::uint32_t>(sim::board().nowMs); }
+inline std::uint32_t micros() { return static_cast<std::uint32_t>(sim::board().nowMs * 1000); }
+inline void delay(std::uint32_t ms) { sim::board().advance(ms); }
+inline void yield() {}
+
+inline void pinMode(std::uint8_t, std::uint8_t) {}
+inline void digitalWrite(std::uint8_t pin, std::uint8_t level) { sim::board().pins[pin] = level; }
+inline int digitalRead(std::uint8_t pin) { return sim::board().pins[pin]; }
+
+#define IRAM_ATTR
+
+inline double ledcSetup(std::uint8_t, double freq, std::uint8_t) { return freq; }
+inline void ledcAttachPin(std::uint8_t pin, std::uint8_t channel) { sim::board().ledc[channel].pin = pin; }
+inline double ledcWriteTone(std::uint8_t channel, double freq) {
+  auto& ch = sim::board().ledc[channel];
+  ch.freqHz = freq;
+  ++ch.toneWrites;
+  return freq;
+}
+// Routes the pin back to its GPIO output register, off whatever drove it.
+inline void pinMatrixOutDetach(std::uint8_t pin, bool, bool) {
+  for (auto& ch : sim::board().ledc) {
+    if (ch.pin == pin) ch.pin = -1;
+  }
+}
+
+// time() itself is overridden by the harness; this only starts the sync.
+inline void configTime(long, int, const char*, const char* = nullptr, const char* = nullptr) {
+  auto& b = sim::board();
+  if (b.ntpRequested) return;
+  b.ntpRequested = true;
+  b.ntpRequestedAtMs = b.nowMs;
+}
+
+// Fixed, so runs stay reproducible.
+inline std::uint32_t esp_random() { return 0x51A7E000u; }
+
+struct EspClass {
+  [[noreturn]] void restart() {
+    std::fprintf(stderr, "sim: firmware requested a restart at %llu ms\n",
+                 static_cast<unsigned long long>(sim::board().nowMs));
+    std::exit(3);
+  }
+};
+
+inline EspClass ESP;
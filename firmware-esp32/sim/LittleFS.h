@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+
+// In-memory LittleFS kept in sim::Board so it survives a simulated reboot.
+// The UI assets are not part of the simulation, so only files the firmware
+// writes itself exist.
+class File : public Stream {
+ public:
+  File() = default;
+  File(std::string path, bool writable) : path_(std::move(path)), open_(true), writable_(writable) {}
+
+  explicit operator bool() const { return open_; }
+  std::size_t write(std::uint8_t c) override { return write(&c, 1); }
+  std::size_t write(const std::uint8_t* data, std::size_t len) override {
+    if (!open_ || !writable_) return 0;
+    data_().append(reinterpret_cast<const char*>(data), len);
+    sim::board().fsStats.bytesWritten += len;
+    return len;
+  }
+  using Print::write;
+  int available() override { return open_ ? static_cast<int>(data_().size() - pos_) : 0; }
+  int read() override { return available() > 0 ? static_cast<std::uint8_t>(data_()[pos_++]) : -1; }
+  std::size_t read(std::uint8_t* out, std::size_t len) {
+    const std::size_t n = std::min(len, static_cast<std::size_t>(available()));
+    if (n > 0) std::memcpy(out, data_().data() + pos_, n);
+    pos_ += n;
+    return n;
+  }
+  std::size_t size() const { return open_ ? sim::board().files[path_].size() : 0; }
+  void close() { open_ = false; }
+
+ private:
+  std::string& data_() { return sim::board().files[path_]; }
+
+  std::string path_;
+  bool open_ = false;
+  bool writable_ = false;
+  std::size_t pos_ = 0;
+};
+
+class LittleFSClass {
+ public:
+  bool begin(bool = false) { return true; }
+  void end() {}
+  bool exists(const char* path) { return sim::board().files.count(path) != 0; }
+  bool exists(const String& path) { return exists(path.c_str()); }
+  // "r" reads, "w" truncates, "a" appends.
+  File open(const char* path, const char* mode = "r") {
+    auto& b = sim::board();
+    ++b.fsStats.opens;
+    if (mode[0] == 'r') return exists(path) ? File(path, false) : File();
+    if (mode[0] == 'w') b.files[path].clear();
+    b.files[path];
+    return File(path, true);
+  }
+  File open(const String& path, const char* mode = "r") { return open(path.c_str(), mode); }
+  bool remove(const char* path) { return sim::board().files.erase(path) > 0; }
+  bool rename(const char* from, const char* to) {
+    auto& files = sim::board().files;
+    const auto it = files.find(from);
+    if (it == files.end()) return false;
+    files[to] = std::move(it->second);
+    files.erase(from);
+    ++sim::board().fsStats.renames;
+    return true;
+  }
+};
+
+inline LittleFSClass LittleFS;
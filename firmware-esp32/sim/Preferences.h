@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+
+// NVS namespace kept in sim::Board so it survives a simulated reboot. Each
+// put counts as a call; it counts as a flash write only when the stored bytes
+// change, matching NVS skipping identical values.
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false) {
+    ns_ = std::string(name) + ".";
+    readOnly_ = readOnly;
+    return true;
+  }
+  void end() {}
+
+  std::size_t putBool(const char* key, bool v) { return putRaw(key, &v, sizeof(v)); }
+  std::size_t putUChar(const char* key, std::uint8_t v) { return putRaw(key, &v, sizeof(v)); }
+  std::size_t putInt(const char* key, std::int32_t v) { return putRaw(key, &v, sizeof(v)); }
+  std::size_t putUInt(const char* key, std::uint32_t v) { return putRaw(key, &v, sizeof(v)); }
+  std::size_t putULong(const char* key, std::uint32_t v) { return putRaw(key, &v, sizeof(v)); }
+  std::size_t putULong64(const char* key, std::uint64_t v) { return putRaw(key, &v, sizeof(v)); }
+  std::size_t putFloat(const char* key, float v) { return putRaw(key, &v, sizeof(v)); }
+  std::size_t putDouble(const char* key, double v) { return putRaw(key, &v, sizeof(v)); }
+  std::size_t putString(const char* key, const String& v) { return putRaw(key, v.c_str(), v.length()); }
+  std::size_t putString(const char* key, const char* v) { return putRaw(key, v, std::strlen(v)); }
+  std::size_t putBytes(const char* key, const void* v, std::size_t len) { return putRaw(key, v, len); }
+
+  bool getBool(const char* key, bool def = false) { return getPod(key, def); }
+  std::uint8_t getUChar(const char* key, std::uint8_t def = 0) { return getPod(key, def); }
+  std::int32_t getInt(const char* key, std::int32_t def = 0) { return getPod(key, def); }
+  std::uint32_t getUInt(const char* key, std::uint32_t def = 0) { return getPod(key, def); }
+  std::uint32_t getULong(const char* key, std::uint32_t def = 0) { return getPod(key, def); }
+  std::uint64_t getULong64(const char* key, std::uint64_t def = 0) { return getPod(key, def); }
+  float getFloat(const char* key, float def = 0.0f) { return getPod(key, def); }
+  double getDouble(const char* key, double def = 0.0) { return getPod(key, def); }
+  String getString(const char* key, const String& def = String()) {
+    const std::string* raw = find(key);
+    return raw ? String(*raw) : def;
+  }
+  std::size_t getBytesLength(const char* key) {
+    const std::string* raw = find(key);
+    return raw ? raw->size() : 0;
+  }
+  std::size_t getBytes(const char* key, void* out, std::size_t len) {
+    const std::string* raw = find(key);
+    if (!raw || raw->size() > len) return 0;
+    std::memcpy(out, raw->data(), raw->size());
+    return raw->size();
+  }
+
+  bool isKey(const char* key) { return find(key) != nullptr; }
+  bool remove(const char* key) { return sim::board().nvs.erase(ns_ + key) > 0; }
+
+ private:
+  std::size_t putRaw(const char* key, const void* data, std::size_t len) {
+    if (readOnly_) return 0;
+    auto& b = sim::board();
+    ++b.nvsStats.putCalls;
+    std::string value(static_cast<const char*>(data), len);
+    std::string& slot = b.nvs[ns_ + key];
+    if (slot != value || value.empty()) {
+      ++b.nvsStats.writes;
+      b.nvsStats.bytesWritten += len;
+      ++b.nvsStats.writesByKey[key];
+      slot = std::move(value);
+    }
+    return len;
+  }
+
+  const std::string* find(const char* key) const {
+    const auto& nvs = sim::board().nvs;
+    const auto it = nvs.find(ns_ + key);
+    return it == nvs.end() ? nullptr : &it->second;
+  }
+
+  template <typename T>
+  T getPod(const char* key, T def) const {
+    const std::string* raw = find(key);
+    if (!raw || raw->size() != sizeof(T)) return def;
+    T v;
+    std::memcpy(&v, raw->data(), sizeof(T));
+    return v;
+  }
+
+  std::string ns_;
+  bool readOnly_ = false;
+};
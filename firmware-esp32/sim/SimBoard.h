@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Virtual hardware behind the host fakes in this directory. Nothing moves
+// unless the harness (or a firmware delay()) calls advance().
+namespace sim {
+
+class I2cDevice {
+ public:
+  virtual ~I2cDevice() = default;
+  virtual void onReceive(const std::uint8_t* data, std::size_t len) = 0;
+  // Fills up to `len` bytes of the pending response, returns how many.
+  virtual std::size_t onRequest(std::uint8_t* out, std::size_t len) = 0;
+  virtual void advanceTo(std::uint64_t nowMs) { (void)nowMs; }
+};
+
+struct LedcChannel {
+  int pin = -1;
+  double freqHz = 0.0;
+  // Rising edges that reached the pin so far, and how far the tone is into
+  // the next one.
+  double steps = 0.0;
+  double phase = 0.0;
+  std::uint32_t toneWrites = 0;
+};
+
+// Event bits as PCNT reports them (PCNT_EVT_* in driver/pcnt.h).
+constexpr std::uint32_t kPcntEvtThres0 = 0x08;
+constexpr std::uint32_t kPcntEvtHighLimit = 0x20;
+
+// A PCNT unit counting rising edges on `pin`. It wraps to 0 at the high
+// limit; enabled events call the ISR on the edge that raises them.
+struct PulseCounter {
+  int pin = -1;
+  bool running = false;
+  std::int16_t count = 0;
+  std::int16_t highLimit = 0x7FFF;
+  std::int16_t threshold0 = 0;
+  std::uint32_t eventsEnabled = 0;
+  // Events of the interrupt being served, for pcnt_get_event_status().
+  std::uint32_t status = 0;
+  void (*isr)(void*) = nullptr;
+  void* isrArg = nullptr;
+
+  // Edges until the next one that wraps or raises an event.
+  std::uint32_t edgesToEvent() const {
+    std::uint32_t n = static_cast<std::uint32_t>(highLimit - count);
+    if ((eventsEnabled & kPcntEvtThres0) && threshold0 > count) {
+      n = std::min(n, static_cast<std::uint32_t>(threshold0 - count));
+    }
+    return n;
+  }
+  // Counts `n` edges, at most edgesToEvent() of them.
+  void countEdges(std::uint32_t n) {
+    count = static_cast<std::int16_t>(count + n);
+    status = 0;
+    if ((eventsEnabled & kPcntEvtThres0) && count == threshold0) status |= kPcntEvtThres0;
+    if (count == highLimit) {
+      count = 0;
+      if (eventsEnabled & kPcntEvtHighLimit) status |= kPcntEvtHighLimit;
+    }
+    if (status != 0 && isr != nullptr) isr(isrArg);
+    status = 0;
+  }
+};
+
+struct NvsStats {
+  std::uint64_t putCalls = 0;
+  // Puts that changed the stored value; NVS skips rewriting identical data.
+  std::uint64_t writes = 0;
+  std::uint64_t bytesWritten = 0;
+  std::map<std::string, std::uint64_t> writesByKey;
+};
+
+struct FsStats {
+  std::uint64_t opens = 0;
+  std::uint64_t bytesWritten = 0;
+  std::uint64_t renames = 0;
+};
+
+struct I2cStats {
+  std::uint64_t transactions = 0;
+  std::uint64_t injectedFailures = 0;
+};
+
+class Board {
+ public:
+  std::uint64_t nowMs = 0;
+  // Wall clock once NTP has synced; before that time() counts from zero like
+  // an ESP32 after boot.
+  std::int64_t epochAtBootSec = 1767225600;  // 2026-01-01 00:00:00 UTC
+  std::uint32_t ntpDelayMs = 0;
+  bool ntpRequested = false;
+  std::uint64_t ntpRequestedAtMs = 0;
+  bool wifiConnected = false;
+  bool verbose = false;
+
+  std::map<int, int> pins;
+  std::array<LedcChannel, 16> ledc{};
+  std::array<PulseCounter, 4> pcnt{};
+
+  std::map<std::string, std::string> nvs;
+  NvsStats nvsStats;
+
+  // LittleFS, path to contents.
+  std::map<std::string, std::string> files;
+  FsStats fsStats;
+
+  std::map<std::uint8_t, I2cDevice*> i2cDevices;
+  double i2cFailRate = 0.0;
+  // Virtual time each I2C transfer takes; 0 makes the bus free.
+  std::uint32_t i2cTransferMs = 0;
+  I2cStats i2cStats;
+
+  void advance(std::uint32_t ms) {
+    for (auto& ch : ledc) emitEdges(ch, static_cast<double>(ms) / 1000.0);
+    nowMs += ms;
+    for (auto& dev : i2cDevices) dev.second->advanceTo(nowMs);
+  }
+
+  std::int64_t wallTimeSec() const {
+    const bool synced = ntpRequested && nowMs >= ntpRequestedAtMs + ntpDelayMs;
+    return static_cast<std::int64_t>(nowMs / 1000) + (synced ? epochAtBootSec : 0);
+  }
+
+  void seed(std::uint64_t value) { rng_ = value ? value : 0x9E3779B97F4A7C15ULL; }
+  // Uniform in [0, 1); xorshift64* so runs are reproducible across platforms.
+  double uniform() {
+    rng_ ^= rng_ >> 12;
+    rng_ ^= rng_ << 25;
+    rng_ ^= rng_ >> 27;
+    return static_cast<double>((rng_ * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+  }
+  bool i2cFault() { return i2cFailRate > 0.0 && uniform() < i2cFailRate; }
+
+  PulseCounter* counterOn(int pin) {
+    for (auto& pc : pcnt) {
+      if (pc.running && pc.pin == pin) return &pc;
+    }
+    return nullptr;
+  }
+
+  // The tone's rising edges over `sec`. A counter on the pin sees each one,
+  // and its ISR runs on the edge that raises an event, so it can take the
+  // pin off the channel part-way through.
+  void emitEdges(LedcChannel& ch, double sec) {
+    while (ch.pin >= 0 && ch.freqHz > 0.0 && sec > 0.0) {
+      const double edges = ch.phase + ch.freqHz * sec;
+      const auto whole = static_cast<std::uint64_t>(edges);
+      PulseCounter* pc = counterOn(ch.pin);
+      if (pc == nullptr || whole < pc->edgesToEvent()) {
+        ch.steps += static_cast<double>(whole);
+        if (pc != nullptr) pc->count = static_cast<std::int16_t>(pc->count + whole);
+        ch.phase = edges - static_cast<double>(whole);
+        return;
+      }
+      const std::uint32_t n = pc->edgesToEvent();
+      sec -= (static_cast<double>(n) - ch.phase) / ch.freqHz;
+      ch.phase = 0.0;
+      ch.steps += n;
+      pc->countEdges(n);
+    }
+  }
+
+ private:
+  std::uint64_t rng_ = 0x9E3779B97F4A7C15ULL;
+};
+
+inline Board& board() {
+  static Board instance;
+  return instance;
+}
+
+}  // namespace sim
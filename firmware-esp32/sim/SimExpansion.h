@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "ExpansionProtocol.h"
+#include "PumpBank.h"
+#include "SimBoard.h"
+
+namespace sim {
+
+// Expansion board on the simulated I2C bus. Frame handling mirrors
+// handleFrame() in expansion_main.cpp; the motors are a PumpBank on the
+// shared virtual clock.
+template <std::size_t N = 4>
+class ExpansionBoard : public I2cDevice {
+ public:
+  struct DoseCommand {
+    std::uint64_t atMs;
+    std::uint8_t motor;
+    std::uint16_t volumeMl;
+    bool reverse;
+  };
+
+  explicit ExpansionBoard(const pump::Config& cfg) : motors_(cfg) {}
+
+  const pump::PumpBank<N>& motors() const { return motors_; }
+  const std::vector<DoseCommand>& doseCommands() const { return doseCommands_; }
+
+  void advanceTo(std::uint64_t nowMs) override { motors_.advanceAllTo(static_cast<std::uint32_t>(nowMs)); }
+
+  void onReceive(const std::uint8_t* frame, std::size_t len) override {
+    txLen_ = 0;
+    if (len < 2 || frame[len - 1] != exproto::frameCrc(frame, len - 1)) return;
+    const std::uint8_t cmd = frame[0];
+    if (cmd == exproto::kCmdHello) {
+      tx_[0] = exproto::kMagicA;
+      tx_[1] = exproto::kMagicB;
+      tx_[2] = exproto::kProtoVer;
+      tx_[3] = static_cast<std::uint8_t>(N);
+      tx_[4] = 0;
+      tx_[5] = exproto::frameCrc(tx_.data(), 5);
+      txLen_ = exproto::kHelloRespLen;
+      return;
+    }
+    if (len < 3 || frame[1] >= N) return;
+    const std::uint8_t motor = frame[1];
+    if (cmd == exproto::kCmdGetState) {
+      exproto::encodeState(motors_.state(motor), motors_.config(motor).maxSpeed, tx_.data());
+      txLen_ = exproto::kStateRespLen;
+    } else if (cmd == exproto::kCmdSetFlow && len >= 6) {
+      const bool reverse = frame[4] != 0;
+      const float lph = static_cast<float>(u16(frame, 2)) / 10.0f;
+      motors_.setSpeed(motor, motors_.speedForFlow(motor, lph * 1000.0f / 60.0f, reverse));
+    } else if (cmd == exproto::kCmdStartDosing && len >= 6) {
+      const std::uint16_t volume = u16(frame, 2);
+      const bool reverse = frame[4] != 0;
+      doseCommands_.push_back({board().nowMs, motor, volume, reverse});
+      motors_.startDosing(motor, reverse ? -static_cast<std::int32_t>(volume) : static_cast<std::int32_t>(volume));
+    } else if (cmd == exproto::kCmdStop) {
+      motors_.stop(motor);
+    } else if (cmd == exproto::kCmdStart) {
+      motors_.start(motor);
+    } else if (cmd == exproto::kCmdSetSettings && len >= 11) {
+      const float mlCw = static_cast<float>(u16(frame, 2)) / 100.0f;
+      const float mlCcw = static_cast<float>(u16(frame, 4)) / 100.0f;
+      const float dosingFlowLph = static_cast<float>(u16(frame, 6)) / 10.0f;
+      const float maxFlowLph = static_cast<float>(u16(frame, 8)) / 10.0f;
+      if (mlCw > 0.0f || mlCcw > 0.0f) motors_.setMlPerRev(motor, mlCw, mlCcw);
+      if (dosingFlowLph > 0.0f) motors_.setDosingSpeed(motor, motors_.speedForFlow(motor, dosingFlowLph * 1000.0f / 60.0f, false));
+      if (maxFlowLph > 0.0f) motors_.setMaxSpeed(motor, motors_.speedForFlow(motor, maxFlowLph * 1000.0f / 60.0f, false));
+      if (len >= 12) {
+        motors_.setRampProfile(motor, frame[10] == static_cast<std::uint8_t>(pump::RampProfile::S_CURVE)
+                                          ? pump::RampProfile::S_CURVE
+                                          : pump::RampProfile::LINEAR);
+      }
+    } else if (cmd == exproto::kCmdSetCurve) {
+      std::uint8_t curveMotor = 0;
+      bool reverse = false;
+      pump::CalibrationCurve curve;
+      if (exproto::decodeCurve(frame, len, curveMotor, reverse, curve)) motors_.setCalibrationCurve(motor, reverse, curve);
+    } else if (cmd == exproto::kCmdStartRevolutions && len >= 7) {
+      const float revolutions = static_cast<float>(u16(frame, 2)) / 10.0f;
+      const float speed = static_cast<float>(static_cast<std::int16_t>(u16(frame, 4))) / 10.0f;
+      motors_.startRevolutions(motor, revolutions, speed);
+    }
+  }
+
+  std::size_t onRequest(std::uint8_t* out, std::size_t len) override {
+    const std::size_t n = len < txLen_ ? len : txLen_;
+    for (std::size_t i = 0; i < n; ++i) out[i] = tx_[i];
+    return n;
+  }
+
+ private:
+  static std::uint16_t u16(const std::uint8_t* in, int pos) {
+    return static_cast<std::uint16_t>(in[pos] | (in[pos + 1] << 8));
+  }
+
+  pump::PumpBank<N> motors_;
+  std::array<std::uint8_t, 40> tx_{};
+  std::size_t txLen_ = 0;
+  std::vector<DoseCommand> doseCommands_;
+};
+
+}  // namespace sim
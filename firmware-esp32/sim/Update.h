@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define U_FLASH 0
+#define U_SPIFFS 100
+
+class UpdateClass {
+ public:
+  bool begin(std::size_t, int = U_FLASH) { return false; }
+  std::size_t writeStream(Stream&) { return 0; }
+  bool end(bool = false) { return false; }
+  bool isFinished() { return false; }
+  void abort() {}
+  std::uint8_t getError() { return 1; }
+  const char* errorString() { return "not supported in simulation"; }
+};
+
+inline UpdateClass Update;
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+
+#include <LittleFS.h>
+#include <WiFi.h>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+enum HTTPAuthMethod { BASIC_AUTH, DIGEST_AUTH };
+
+// Routes are accepted and never called: the simulation has no HTTP clients.
+class WebServer {
+ public:
+  using THandlerFunction = std::function<void()>;
+
+  explicit WebServer(int) {}
+  void begin() {}
+  void handleClient() {}
+  void on(const String&, HTTPMethod, THandlerFunction) {}
+  void on(const String&, HTTPMethod, THandlerFunction, THandlerFunction) {}
+  void onNotFound(THandlerFunction) {}
+
+  WiFiClient client() { return WiFiClient(); }
+  HTTPMethod method() const { return HTTP_GET; }
+  String uri() const { return String(); }
+  bool hasArg(const String&) const { return false; }
+  String arg(const String&) const { return String(); }
+  void collectHeaders(const char**, std::size_t) {}
+  bool hasHeader(const String&) const { return false; }
+  String header(const String&) const { return String(); }
+  bool authenticate(const char*, const char*) { return true; }
+  void requestAuthentication(HTTPAuthMethod, const char* = nullptr) {}
+
+  void sendHeader(const String&, const String&, bool = false) {}
+  void send(int, const char* = nullptr, const String& = String()) {}
+  void send(int, const String&, const String&) {}
+  void setContentLength(std::size_t) {}
+  void sendContent(const char*, std::size_t) {}
+  template <typename T>
+  std::size_t streamFile(T&, const String&, int = 200) {
+    return 0;
+  }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define WIFI_STA 1
+#define WL_IDLE_STATUS 0
+#define WL_DISCONNECTED 6
+#define WL_CONNECTED 3
+
+class IPAddress {
+ public:
+  IPAddress() = default;
+  IPAddress(std::uint8_t a, std::uint8_t b, std::uint8_t c, std::uint8_t d) : octets_{a, b, c, d} {}
+  String toString() const {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets_[0], octets_[1], octets_[2], octets_[3]);
+    return String(buf);
+  }
+  operator std::uint32_t() const {
+    return octets_[0] | (octets_[1] << 8) | (octets_[2] << 16) | (static_cast<std::uint32_t>(octets_[3]) << 24);
+  }
+
+ private:
+  std::uint8_t octets_[4] = {0, 0, 0, 0};
+};
+
+class WiFiClient : public Stream {
+ public:
+  std::size_t write(std::uint8_t) override { return 1; }
+  using Print::write;
+  bool connected() { return false; }
+  int fd() const { return -1; }
+  void setNoDelay(bool) {}
+  void stop() {}
+};
+
+// Station that associates as soon as begin() is called.
+class WiFiClass {
+ public:
+  void mode(int) {}
+  void begin(const char* ssid, const char*) {
+    ssid_ = ssid;
+    sim::board().wifiConnected = true;
+  }
+  int status() const { return sim::board().wifiConnected ? WL_CONNECTED : WL_DISCONNECTED; }
+  String SSID() const { return sim::board().wifiConnected ? ssid_ : String(); }
+  IPAddress localIP() const { return sim::board().wifiConnected ? IPAddress(192, 168, 4, 50) : IPAddress(); }
+
+ private:
+  String ssid_;
+};
+
+inline WiFiClass WiFi;
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <WiFi.h>
+
+// The simulated station always joins on the first try, so the portal never opens.
+class WiFiManager {
+ public:
+  void setHostname(const char*) {}
+  void setWiFiAutoReconnect(bool) {}
+  void setConfigPortalTimeout(unsigned long) {}
+  bool autoConnect(const char* ssid, const char* pass) {
+    WiFi.begin(ssid, pass);
+    return true;
+  }
+  void resetSettings() {}
+};
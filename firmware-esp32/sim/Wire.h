@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+
+#include <Arduino.h>
+
+// I2C master routed to the sim::I2cDevice registered at each address.
+// Addresses with no device NACK, as do transactions picked by i2cFailRate.
+class TwoWire : public Stream {
+ public:
+  bool begin(int sda = -1, int scl = -1, std::uint32_t = 0) {
+    (void)sda;
+    (void)scl;
+    return true;
+  }
+
+  void beginTransmission(std::uint8_t address) {
+    address_ = address;
+    tx_.clear();
+  }
+  std::size_t write(std::uint8_t c) override {
+    tx_.push_back(c);
+    return 1;
+  }
+  using Print::write;
+  std::uint8_t endTransmission(bool sendStop = true) {
+    (void)sendStop;
+    auto& b = sim::board();
+    ++b.i2cStats.transactions;
+    if (b.i2cTransferMs) b.advance(b.i2cTransferMs);
+    sim::I2cDevice* dev = device(address_);
+    if (!dev) return 2;
+    if (b.i2cFault()) {
+      ++b.i2cStats.injectedFailures;
+      return 4;
+    }
+    dev->advanceTo(b.nowMs);
+    dev->onReceive(tx_.data(), tx_.size());
+    return 0;
+  }
+
+  std::uint8_t requestFrom(int address, int len, int sendStop = 1) {
+    (void)sendStop;
+    auto& b = sim::board();
+    rx_.assign(static_cast<std::size_t>(len), 0);
+    rxPos_ = 0;
+    if (b.i2cTransferMs) b.advance(b.i2cTransferMs);
+    sim::I2cDevice* dev = device(static_cast<std::uint8_t>(address));
+    if (!dev || b.i2cFault()) {
+      if (dev) ++b.i2cStats.injectedFailures;
+      rx_.clear();
+      return 0;
+    }
+    rx_.resize(dev->onRequest(rx_.data(), rx_.size()));
+    return static_cast<std::uint8_t>(rx_.size());
+  }
+  int available() override { return static_cast<int>(rx_.size() - rxPos_); }
+  int read() override { return rxPos_ < rx_.size() ? rx_[rxPos_++] : -1; }
+  int peek() override { return rxPos_ < rx_.size() ? rx_[rxPos_] : -1; }
+
+ private:
+  static sim::I2cDevice* device(std::uint8_t address) {
+    const auto& devices = sim::board().i2cDevices;
+    const auto it = devices.find(address);
+    return it == devices.end() ? nullptr : it->second;
+  }
+
+  std::uint8_t address_ = 0;
+  std::vector<std::uint8_t> tx_;
+  std::vector<std::uint8_t> rx_;
+  std::size_t rxPos_ = 0;
+};
+
+inline TwoWire Wire;
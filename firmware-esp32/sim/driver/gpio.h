@@ -0,0 +1,18 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF GPIO driver calls the firmware makes. Pads
+// are not modelled beyond sim::Board::pins, so these only check arguments.
+#include <cstdint>
+
+using esp_err_t = int;
+constexpr esp_err_t ESP_OK = 0;
+
+enum gpio_num_t : int {};
+
+enum gpio_mode_t {
+  GPIO_MODE_INPUT = 1,
+  GPIO_MODE_OUTPUT = 2,
+  GPIO_MODE_INPUT_OUTPUT = 3,
+};
+
+inline esp_err_t gpio_set_direction(gpio_num_t, gpio_mode_t) { return ESP_OK; }
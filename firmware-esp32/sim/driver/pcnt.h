@@ -0,0 +1,79 @@
+#pragma once
+
+// Host stand-in for the ESP-IDF 4.4 PCNT driver, backed by the counters in
+// sim::Board. Only what the firmware uses is provided.
+#include <cstdint>
+
+#include "SimBoard.h"
+#include "driver/gpio.h"
+
+#define ESP_INTR_FLAG_IRAM (1 << 10)
+constexpr int PCNT_PIN_NOT_USED = -1;
+
+enum pcnt_unit_t { PCNT_UNIT_0, PCNT_UNIT_1, PCNT_UNIT_2, PCNT_UNIT_3 };
+enum pcnt_channel_t { PCNT_CHANNEL_0, PCNT_CHANNEL_1 };
+enum pcnt_count_mode_t { PCNT_COUNT_DIS, PCNT_COUNT_INC, PCNT_COUNT_DEC };
+enum pcnt_ctrl_mode_t { PCNT_MODE_KEEP, PCNT_MODE_REVERSE, PCNT_MODE_DISABLE };
+enum pcnt_evt_type_t : std::uint32_t {
+  PCNT_EVT_THRES_0 = sim::kPcntEvtThres0,
+  PCNT_EVT_H_LIM = sim::kPcntEvtHighLimit,
+};
+
+struct pcnt_config_t {
+  int pulse_gpio_num;
+  int ctrl_gpio_num;
+  pcnt_ctrl_mode_t lctrl_mode;
+  pcnt_ctrl_mode_t hctrl_mode;
+  pcnt_count_mode_t pos_mode;
+  pcnt_count_mode_t neg_mode;
+  std::int16_t counter_h_lim;
+  std::int16_t counter_l_lim;
+  pcnt_unit_t unit;
+  pcnt_channel_t channel;
+};
+
+// Rising edges only, which is all the firmware counts.
+inline esp_err_t pcnt_unit_config(const pcnt_config_t* config) {
+  auto& pc = sim::board().pcnt[config->unit];
+  pc.pin = config->pulse_gpio_num;
+  pc.highLimit = config->counter_h_lim;
+  pc.count = 0;
+  pc.running = true;
+  return ESP_OK;
+}
+inline esp_err_t pcnt_filter_disable(pcnt_unit_t) { return ESP_OK; }
+inline esp_err_t pcnt_counter_pause(pcnt_unit_t unit) {
+  sim::board().pcnt[unit].running = false;
+  return ESP_OK;
+}
+inline esp_err_t pcnt_counter_resume(pcnt_unit_t unit) {
+  sim::board().pcnt[unit].running = true;
+  return ESP_OK;
+}
+inline esp_err_t pcnt_counter_clear(pcnt_unit_t unit) {
+  sim::board().pcnt[unit].count = 0;
+  return ESP_OK;
+}
+inline esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, std::int16_t* count) {
+  *count = sim::board().pcnt[unit].count;
+  return ESP_OK;
+}
+inline esp_err_t pcnt_event_enable(pcnt_unit_t unit, pcnt_evt_type_t evt) {
+  sim::board().pcnt[unit].eventsEnabled |= evt;
+  return ESP_OK;
+}
+inline esp_err_t pcnt_set_event_value(pcnt_unit_t unit, pcnt_evt_type_t evt, std::int16_t value) {
+  if (evt == PCNT_EVT_THRES_0) sim::board().pcnt[unit].threshold0 = value;
+  return ESP_OK;
+}
+inline esp_err_t pcnt_get_event_status(pcnt_unit_t unit, std::uint32_t* status) {
+  *status = sim::board().pcnt[unit].status;
+  return ESP_OK;
+}
+inline esp_err_t pcnt_isr_service_install(int) { return ESP_OK; }
+inline esp_err_t pcnt_isr_handler_add(pcnt_unit_t unit, void (*isr)(void*), void* arg) {
+  auto& pc = sim::board().pcnt[unit];
+  pc.isr = isr;
+  pc.isrArg = arg;
+  return ESP_OK;
+}
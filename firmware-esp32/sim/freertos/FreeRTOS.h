@@ -0,0 +1,177 @@
+#pragma once
+
+// Host stand-in for the FreeRTOS calls the firmware makes. A task runs on its
+// own thread, but only while the thread that created or notified it waits, so
+// a notify acts like a switch to a higher-priority task and runs stay
+// reproducible. A task that delays stays parked: nothing here wakes it
+// except a notification.
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SimBoard.h"
+
+using BaseType_t = int;
+using UBaseType_t = unsigned;
+using TickType_t = std::uint32_t;
+using TaskFunction_t = void (*)(void*);
+
+constexpr BaseType_t pdFALSE = 0;
+constexpr BaseType_t pdTRUE = 1;
+constexpr BaseType_t pdPASS = 1;
+constexpr TickType_t portMAX_DELAY = 0xFFFFFFFFu;
+constexpr UBaseType_t tskIDLE_PRIORITY = 0;
+
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms))
+
+namespace sim {
+
+struct RtosQueue {
+  std::size_t length;
+  std::size_t itemSize;
+  std::deque<std::vector<std::uint8_t>> items;
+};
+
+struct RtosMutex {
+  bool taken = false;
+  struct RtosTask* holder = nullptr;
+};
+
+struct RtosTask {
+  std::mutex m;
+  std::condition_variable cv;
+  std::uint32_t notified = 0;
+  bool running = true;
+};
+
+inline thread_local RtosTask* currentTask = nullptr;
+
+// Lets `task` run until it blocks again.
+inline void runUntilBlocked(RtosTask* task, std::unique_lock<std::mutex>& lock) {
+  task->running = true;
+  task->cv.notify_all();
+  task->cv.wait(lock, [task] { return !task->running; });
+}
+
+}  // namespace sim
+
+using QueueHandle_t = sim::RtosQueue*;
+using TaskHandle_t = sim::RtosTask*;
+using SemaphoreHandle_t = sim::RtosMutex*;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  return new sim::RtosQueue{length, itemSize, {}};
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t) {
+  if (q->items.size() >= q->length) return pdFALSE;
+  const auto* p = static_cast<const std::uint8_t*>(item);
+  q->items.emplace_back(p, p + q->itemSize);
+  return pdPASS;
+}
+
+inline BaseType_t xQueueOverwrite(QueueHandle_t q, const void* item) {
+  q->items.clear();
+  return xQueueSend(q, item, 0);
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t q, void* out, TickType_t) {
+  if (q->items.empty()) return pdFALSE;
+  std::memcpy(out, q->items.front().data(), q->itemSize);
+  q->items.pop_front();
+  return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) { return static_cast<UBaseType_t>(q->items.size()); }
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char*, std::uint32_t, void* arg, UBaseType_t,
+                                          TaskHandle_t* out, BaseType_t) {
+  auto* task = new sim::RtosTask();
+  if (out != nullptr) *out = task;
+  std::unique_lock<std::mutex> lock(task->m);
+  std::thread([task, fn, arg] {
+    {
+      std::lock_guard<std::mutex> started(task->m);
+    }
+    sim::currentTask = task;
+    fn(arg);
+  }).detach();
+  task->cv.wait(lock, [task] { return !task->running; });
+  return pdPASS;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  std::unique_lock<std::mutex> lock(task->m);
+  ++task->notified;
+  sim::runUntilBlocked(task, lock);
+  return pdPASS;
+}
+
+inline std::uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t) {
+  sim::RtosTask* task = sim::currentTask;
+  std::unique_lock<std::mutex> lock(task->m);
+  task->running = false;
+  task->cv.notify_all();
+  task->cv.wait(lock, [task] { return task->notified > 0 && task->running; });
+  const std::uint32_t value = task->notified;
+  task->notified = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+// The main thread stands in for Arduino's loop task.
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  static sim::RtosTask loopTask;
+  return sim::currentTask != nullptr ? sim::currentTask : &loopTask;
+}
+
+// Only one thread runs at a time, so a mutex held by someone else can never
+// be released while we wait: that is a deadlock in the firmware.
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new sim::RtosMutex(); }
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t) {
+  if (m->taken) {
+    std::fprintf(stderr, "sim: deadlock, mutex already held\n");
+    std::abort();
+  }
+  m->taken = true;
+  m->holder = xTaskGetCurrentTaskHandle();
+  return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t m) {
+  if (!m->taken || m->holder != xTaskGetCurrentTaskHandle()) return pdFALSE;
+  m->taken = false;
+  m->holder = nullptr;
+  return pdTRUE;
+}
+
+inline TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t m) { return m->taken ? m->holder : nullptr; }
+
+// Interrupt handlers run inside Board::advance(), between firmware
+// statements and never alongside them, so critical sections are empty.
+struct portMUX_TYPE {};
+#define portMUX_INITIALIZER_UNLOCKED \
+  {}
+inline void portENTER_CRITICAL(portMUX_TYPE*) {}
+inline void portEXIT_CRITICAL(portMUX_TYPE*) {}
+inline void portENTER_CRITICAL_ISR(portMUX_TYPE*) {}
+inline void portEXIT_CRITICAL_ISR(portMUX_TYPE*) {}
+
+// Main thread: the board clock moves on. A task: parked for good.
+inline void vTaskDelay(TickType_t ticks) {
+  sim::RtosTask* task = sim::currentTask;
+  if (task == nullptr) {
+    sim::board().advance(ticks);
+    return;
+  }
+  std::unique_lock<std::mutex> lock(task->m);
+  task->running = false;
+  task->cv.notify_all();
+  task->cv.wait(lock, [] { return false; });
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// lwIP's BSD socket API is the host's own.
+#include <sys/socket.h>
+#include <sys/types.h>
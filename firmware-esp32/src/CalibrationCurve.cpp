@@ -0,0 +1,124 @@
+#include "CalibrationCurve.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pump {
+
+namespace {
+
+// Points closer than this are the same calibration speed.
+constexpr float kSameRpm = 1.0f;
+constexpr int kBisectSteps = 32;
+
+int segmentOf(float x, int segments, float& frac) {
+  const int i = std::min(static_cast<int>(x), segments - 1);
+  frac = x - static_cast<float>(i);
+  return i;
+}
+
+}  // namespace
+
+bool CalibrationCurve::setPoint(float rpm, float mlPerRev) {
+  std::array<CalibrationPoint, kMaxPoints + 1> next{};
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < count_; ++i) {
+    if (std::fabs(points_[i].rpm - std::fabs(rpm)) < kSameRpm) continue;
+    next[n++] = points_[i];
+  }
+  if (n >= kMaxPoints) return false;
+  next[n].rpm = std::fabs(rpm);
+  next[n].mlPerRev = mlPerRev;
+  return assign(next.data(), n + 1);
+}
+
+bool CalibrationCurve::assign(const CalibrationPoint* points, std::size_t count) {
+  if (count > kMaxPoints) return false;
+  std::array<CalibrationPoint, kMaxPoints> sorted{};
+  std::copy(points, points + count, sorted.begin());
+  std::sort(sorted.begin(), sorted.begin() + count,
+            [](const CalibrationPoint& a, const CalibrationPoint& b) { return a.rpm < b.rpm; });
+  if (!valid(sorted.data(), count)) return false;
+  points_ = sorted;
+  count_ = static_cast<std::uint8_t>(count);
+  build();
+  return true;
+}
+
+void CalibrationCurve::clear() {
+  count_ = 0;
+  spanRpm_ = 0.0f;
+  spanFlow_ = 0.0f;
+}
+
+bool CalibrationCurve::valid(const CalibrationPoint* points, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    if (!(points[i].rpm > 0.0f) || !(points[i].mlPerRev > 0.0f)) return false;
+    if (!std::isfinite(points[i].rpm) || !std::isfinite(points[i].mlPerRev)) return false;
+    if (i == 0) continue;
+    const CalibrationPoint& a = points[i - 1];
+    const CalibrationPoint& b = points[i];
+    if (b.rpm - a.rpm < kSameRpm) return false;
+    // Flow r * (m0 + k * (r - r0)) has slope m0 + k * (2r - r0), linear in r,
+    // so it rises over the segment if it rises at both ends.
+    const float k = (b.mlPerRev - a.mlPerRev) / (b.rpm - a.rpm);
+    if (!(a.mlPerRev + k * a.rpm > 0.0f) || !(a.mlPerRev + k * (2.0f * b.rpm - a.rpm) > 0.0f)) return false;
+  }
+  return true;
+}
+
+float CalibrationCurve::exactMlPerRev(float rpm) const {
+  if (rpm <= points_[0].rpm) return points_[0].mlPerRev;
+  for (std::size_t i = 1; i < count_; ++i) {
+    const CalibrationPoint& a = points_[i - 1];
+    const CalibrationPoint& b = points_[i];
+    if (rpm <= b.rpm) return a.mlPerRev + (b.mlPerRev - a.mlPerRev) * (rpm - a.rpm) / (b.rpm - a.rpm);
+  }
+  return points_[count_ - 1].mlPerRev;
+}
+
+void CalibrationCurve::build() {
+  spanRpm_ = points_[count_ - 1].rpm;
+  segmentsPerRpm_ = kSegments / spanRpm_;
+  for (int i = 0; i <= kSegments; ++i) {
+    mlPerRev_[i] = exactMlPerRev(spanRpm_ * static_cast<float>(i) / kSegments);
+  }
+
+  // Flow rises with rpm (see valid()), so bisection inverts it.
+  spanFlow_ = spanRpm_ * points_[count_ - 1].mlPerRev;
+  segmentsPerFlow_ = kSegments / spanFlow_;
+  rpm_[0] = 0.0f;
+  for (int i = 1; i <= kSegments; ++i) {
+    const float flow = spanFlow_ * static_cast<float>(i) / kSegments;
+    float lo = 0.0f;
+    float hi = spanRpm_;
+    for (int step = 0; step < kBisectSteps; ++step) {
+      const float mid = 0.5f * (lo + hi);
+      if (mid * exactMlPerRev(mid) < flow) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    rpm_[i] = 0.5f * (lo + hi);
+  }
+  rpm_[kSegments] = spanRpm_;
+}
+
+float CalibrationCurve::mlPerRevAt(float rpm) const {
+  const float r = std::fabs(rpm);
+  if (r >= spanRpm_) return points_[count_ - 1].mlPerRev;
+  float frac = 0.0f;
+  const int i = segmentOf(r * segmentsPerRpm_, kSegments, frac);
+  return mlPerRev_[i] + (mlPerRev_[i + 1] - mlPerRev_[i]) * frac;
+}
+
+float CalibrationCurve::rpmForFlow(float mlPerMin) const {
+  const float flow = std::fabs(mlPerMin);
+  if (flow >= spanFlow_) return flow / points_[count_ - 1].mlPerRev;
+  float frac = 0.0f;
+  const int i = segmentOf(flow * segmentsPerFlow_, kSegments, frac);
+  return rpm_[i] + (rpm_[i + 1] - rpm_[i]) * frac;
+}
+
+}  // namespace pump
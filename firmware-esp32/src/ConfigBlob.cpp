@@ -0,0 +1,59 @@
+#include "ConfigBlob.h"
+
+#include <cstring>
+
+namespace pump {
+
+static_assert(sizeof(CalibrationPoint) == 8, "CalibrationPoint layout changed");
+static_assert(sizeof(StoredCurve) == 52, "StoredCurve layout changed");
+static_assert(sizeof(StoredMotor) == 152, "StoredMotor layout changed");
+static_assert(sizeof(StoredSchedule) == 44, "StoredSchedule layout changed");
+static_assert(sizeof(StoredConfig) == 1556, "StoredConfig layout changed");
+static_assert(sizeof(ConfigBlobHeader) == 12, "ConfigBlobHeader layout changed");
+static_assert(sizeof(ConfigBlob) == sizeof(ConfigBlobHeader) + sizeof(StoredConfig), "ConfigBlob is padded");
+
+std::uint32_t crc32(const void* data, std::size_t len) {
+  const auto* p = static_cast<const std::uint8_t*>(data);
+  std::uint32_t crc = 0xFFFFFFFFu;
+  for (std::size_t i = 0; i < len; ++i) {
+    crc ^= p[i];
+    for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+  }
+  return ~crc;
+}
+
+void sealConfigBlob(ConfigBlob& blob) {
+  blob.header.magic = kConfigMagic;
+  blob.header.version = kConfigVersion;
+  blob.header.size = sizeof(StoredConfig);
+  blob.header.crc = crc32(&blob.config, sizeof(StoredConfig));
+}
+
+ConfigLoad openConfigBlob(const void* data, std::size_t len, StoredConfig& config) {
+  ConfigBlobHeader header;
+  if (data == nullptr || len < sizeof(header)) return ConfigLoad::kMissing;
+  std::memcpy(&header, data, sizeof(header));
+  const auto* payload = static_cast<const std::uint8_t*>(data) + sizeof(header);
+  if (header.magic != kConfigMagic || header.version == 0) return ConfigLoad::kCorrupt;
+  if (header.size == 0 || header.size != len - sizeof(header)) return ConfigLoad::kCorrupt;
+  if (crc32(payload, header.size) != header.crc) return ConfigLoad::kCorrupt;
+  // Append-only layouts: older blobs cover a prefix, newer ones extend it.
+  const std::size_t n = header.size < sizeof(StoredConfig) ? header.size : sizeof(StoredConfig);
+  std::memcpy(&config, payload, n);
+  return ConfigLoad::kOk;
+}
+
+bool copyStoredString(char* field, std::size_t fieldSize, const char* value) {
+  std::size_t len = std::strlen(value);
+  const bool fits = len < fieldSize;
+  if (!fits) {
+    len = fieldSize - 1;
+    // Back off continuation bytes so a multi-byte character is not split.
+    while (len > 0 && (static_cast<std::uint8_t>(value[len]) & 0xC0) == 0x80) --len;
+  }
+  std::memcpy(field, value, len);
+  std::memset(field + len, 0, fieldSize - len);
+  return fits;
+}
+
+}  // namespace pump
@@ -0,0 +1,139 @@
+#include "CounterJournal.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "ConfigBlob.h"
+
+namespace pump {
+
+namespace {
+
+constexpr std::uint8_t kRecordMagic = 0xC8;
+constexpr std::uint32_t kCheckpointMagic = 0x50434e32;  // "PCN2"
+
+static_assert(sizeof(CounterTotals) == 24, "CounterTotals layout changed");
+static_assert(sizeof(CounterRecord) == 32, "CounterRecord layout changed");
+static_assert(sizeof(CounterCheckpoint) == 8 + 24 * kJournalMotors + 8, "CounterCheckpoint layout changed");
+
+// The first format: litres as double in checkpoints and float in records.
+constexpr std::uint8_t kLegacyRecordMagic = 0xC7;
+constexpr std::uint32_t kLegacyCheckpointMagic = 0x50434e54;  // "PCNT"
+
+struct LegacyTotals {
+  std::uint32_t uptimeSec;
+  std::uint32_t reserved;
+  double pumpedL;
+  double hoseL;
+};
+
+struct LegacyRecord {
+  std::uint8_t magic;
+  std::uint8_t motor;
+  std::uint16_t generation;
+  std::int32_t uptimeSec;
+  float pumpedL;
+  float hoseL;
+  std::uint32_t crc;
+};
+
+static_assert(sizeof(LegacyTotals) == sizeof(CounterTotals), "checkpoints share a layout");
+static_assert(sizeof(LegacyRecord) == 20, "LegacyRecord layout changed");
+
+std::int64_t litresToNl(double litres) { return static_cast<std::int64_t>(std::llround(litres * 1e9)); }
+
+bool replayLegacy(const void* data, std::size_t len, std::uint32_t generation, CounterTotals* totals) {
+  LegacyRecord r;
+  if (len != sizeof(r)) return false;
+  std::memcpy(&r, data, sizeof(r));
+  if (r.magic != kLegacyRecordMagic || r.crc != crc32(&r, offsetof(LegacyRecord, crc))) return false;
+  if (r.motor >= kJournalMotors || r.generation != static_cast<std::uint16_t>(generation)) return false;
+  CounterTotals& t = totals[r.motor];
+  t.uptimeSec += static_cast<std::uint32_t>(r.uptimeSec);
+  t.pumpedNl += static_cast<std::uint64_t>(litresToNl(r.pumpedL));
+  t.hoseNl += static_cast<std::uint64_t>(litresToNl(r.hoseL));
+  return true;
+}
+
+}  // namespace
+
+bool CounterJournal::restore(const void* data, std::size_t len) {
+  totals_ = {};
+  generation_ = 0;
+  legacy_ = false;
+  CounterCheckpoint cp;
+  if (data == nullptr || len != sizeof(cp)) return false;
+  std::memcpy(&cp, data, sizeof(cp));
+  if (cp.crc != crc32(&cp, offsetof(CounterCheckpoint, crc))) return false;
+  if (cp.magic == kLegacyCheckpointMagic) {
+    for (std::size_t i = 0; i < kJournalMotors; ++i) {
+      LegacyTotals old;
+      std::memcpy(&old, &cp.motors[i], sizeof(old));
+      totals_[i].uptimeSec = old.uptimeSec;
+      totals_[i].pumpedNl = old.pumpedL > 0.0 ? static_cast<std::uint64_t>(litresToNl(old.pumpedL)) : 0;
+      totals_[i].hoseNl = old.hoseL > 0.0 ? static_cast<std::uint64_t>(litresToNl(old.hoseL)) : 0;
+    }
+    legacy_ = true;
+  } else if (cp.magic == kCheckpointMagic) {
+    std::memcpy(totals_.data(), cp.motors, sizeof(cp.motors));
+  } else {
+    return false;
+  }
+  generation_ = cp.generation;
+  return true;
+}
+
+bool CounterJournal::restoreNewest(const void* a, std::size_t aLen, const void* b, std::size_t bLen) {
+  CounterJournal other;
+  const bool haveA = restore(a, aLen);
+  const bool haveB = other.restore(b, bLen);
+  if (haveB && (!haveA || other.generation_ > generation_)) *this = other;
+  return haveA || haveB;
+}
+
+std::size_t CounterJournal::recordBytes() const { return legacy_ ? sizeof(LegacyRecord) : sizeof(CounterRecord); }
+
+bool CounterJournal::replay(const void* data, std::size_t len) {
+  if (legacy_) return replayLegacy(data, len, generation_, totals_.data());
+  CounterRecord r;
+  if (len != sizeof(r)) return false;
+  std::memcpy(&r, data, sizeof(r));
+  if (r.magic != kRecordMagic || r.crc != crc32(&r, offsetof(CounterRecord, crc))) return false;
+  if (r.motor >= kJournalMotors || r.generation != static_cast<std::uint16_t>(generation_)) return false;
+  CounterTotals& t = totals_[r.motor];
+  t.uptimeSec += static_cast<std::uint32_t>(r.uptimeSec);
+  t.pumpedNl += static_cast<std::uint64_t>(r.pumpedNl);
+  t.hoseNl += static_cast<std::uint64_t>(r.hoseNl);
+  return true;
+}
+
+void CounterJournal::seed(std::size_t motor, const CounterTotals& totals) { totals_[motor] = totals; }
+
+bool CounterJournal::record(std::size_t motor, const CounterTotals& now, CounterRecord& out) {
+  CounterTotals& t = totals_[motor];
+  out = CounterRecord();
+  out.magic = kRecordMagic;
+  out.motor = static_cast<std::uint8_t>(motor);
+  out.generation = static_cast<std::uint16_t>(generation_);
+  // Differences wrap like the totals do, so a counter reset journals as a
+  // negative delta and replays exactly.
+  out.uptimeSec = static_cast<std::int32_t>(now.uptimeSec - t.uptimeSec);
+  out.pumpedNl = static_cast<std::int64_t>(now.pumpedNl - t.pumpedNl);
+  out.hoseNl = static_cast<std::int64_t>(now.hoseNl - t.hoseNl);
+  if (out.uptimeSec == 0 && out.pumpedNl == 0 && out.hoseNl == 0) return false;
+  out.crc = crc32(&out, offsetof(CounterRecord, crc));
+  t = now;
+  t.reserved = 0;
+  return true;
+}
+
+CounterCheckpoint CounterJournal::nextCheckpoint() const {
+  CounterCheckpoint cp = CounterCheckpoint();
+  cp.magic = kCheckpointMagic;
+  cp.generation = generation_ + 1;
+  std::memcpy(cp.motors, totals_.data(), sizeof(cp.motors));
+  cp.crc = crc32(&cp, offsetof(CounterCheckpoint, crc));
+  return cp;
+}
+
+}  // namespace pump
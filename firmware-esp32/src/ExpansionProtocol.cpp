@@ -0,0 +1,117 @@
+#include "ExpansionProtocol.h"
+
+#include <cmath>
+
+namespace exproto {
+
+namespace {
+
+// Volume totals travel as whole millilitres.
+constexpr std::uint64_t kNlPerMl = 1000000ULL;
+
+void putU16(std::uint8_t* out, int pos, std::uint16_t v) {
+  out[pos] = static_cast<std::uint8_t>(v & 0xFF);
+  out[pos + 1] = static_cast<std::uint8_t>((v >> 8) & 0xFF);
+}
+
+void putU32(std::uint8_t* out, int pos, std::uint32_t v) {
+  out[pos] = static_cast<std::uint8_t>(v & 0xFF);
+  out[pos + 1] = static_cast<std::uint8_t>((v >> 8) & 0xFF);
+  out[pos + 2] = static_cast<std::uint8_t>((v >> 16) & 0xFF);
+  out[pos + 3] = static_cast<std::uint8_t>((v >> 24) & 0xFF);
+}
+
+// Speeds are signed on the wire; everything else is unsigned.
+void putSigned16(std::uint8_t* out, int pos, float v, float scale) {
+  putU16(out, pos, static_cast<std::uint16_t>(static_cast<std::int16_t>(std::round(v * scale))));
+}
+
+void putUnsigned16(std::uint8_t* out, int pos, float v, float scale) {
+  putU16(out, pos, static_cast<std::uint16_t>(std::round(v * scale)));
+}
+
+std::uint16_t getU16(const std::uint8_t* in, int pos) {
+  return static_cast<std::uint16_t>(in[pos]) | static_cast<std::uint16_t>(static_cast<std::uint16_t>(in[pos + 1]) << 8);
+}
+
+std::uint32_t getU32(const std::uint8_t* in, int pos) {
+  return static_cast<std::uint32_t>(in[pos]) | (static_cast<std::uint32_t>(in[pos + 1]) << 8) |
+         (static_cast<std::uint32_t>(in[pos + 2]) << 16) | (static_cast<std::uint32_t>(in[pos + 3]) << 24);
+}
+
+}  // namespace
+
+std::uint8_t frameCrc(const std::uint8_t* data, std::size_t lenWithoutCrc) {
+  std::uint8_t crc = 0;
+  for (std::size_t i = 0; i < lenWithoutCrc; ++i) crc ^= data[i];
+  return crc;
+}
+
+void encodeState(const pump::State& st, float maxSpeed, std::uint8_t* out) {
+  out[0] = (st.mode == pump::Mode::DOSING) ? 1 : 0;
+  out[1] = st.running ? 1 : 0;
+  putSigned16(out, 2, st.targetSpeed, 10.0f);
+  putSigned16(out, 4, st.currentSpeed, 10.0f);
+  putUnsigned16(out, 6, std::fmax(st.dosingRemainingMl, 0.0f), 1.0f);
+  putU32(out, 8, st.totalMotorUptimeSec);
+  putU32(out, 12, static_cast<std::uint32_t>((st.totalPumpedNl + kNlPerMl / 2) / kNlPerMl));
+  putU32(out, 16, static_cast<std::uint32_t>((st.totalHoseNl + kNlPerMl / 2) / kNlPerMl));
+  putUnsigned16(out, 20, st.mlPerRevCw, 100.0f);
+  putUnsigned16(out, 22, st.mlPerRevCcw, 100.0f);
+  putUnsigned16(out, 24, st.dosingSpeed, 10.0f);
+  putUnsigned16(out, 26, maxSpeed, 10.0f);
+  out[kStateRespLen - 1] = frameCrc(out, kStateRespLen - 1);
+}
+
+bool decodeState(const std::uint8_t* in, pump::State& st, float& maxSpeed) {
+  if (in[kStateRespLen - 1] != frameCrc(in, kStateRespLen - 1)) return false;
+  st.mode = (in[0] == 1) ? pump::Mode::DOSING : pump::Mode::FLOW;
+  st.running = in[1] != 0;
+  st.targetSpeed = static_cast<float>(static_cast<std::int16_t>(getU16(in, 2))) / 10.0f;
+  st.currentSpeed = static_cast<float>(static_cast<std::int16_t>(getU16(in, 4))) / 10.0f;
+  st.dosingRemainingMl = static_cast<float>(getU16(in, 6));
+  st.totalMotorUptimeSec = getU32(in, 8);
+  st.totalPumpedNl = static_cast<std::uint64_t>(getU32(in, 12)) * kNlPerMl;
+  st.totalHoseNl = static_cast<std::uint64_t>(getU32(in, 16)) * kNlPerMl;
+  st.mlPerRevCw = static_cast<float>(getU16(in, 20)) / 100.0f;
+  st.mlPerRevCcw = static_cast<float>(getU16(in, 22)) / 100.0f;
+  st.dosingSpeed = static_cast<float>(getU16(in, 24)) / 10.0f;
+  maxSpeed = static_cast<float>(getU16(in, 26)) / 10.0f;
+  return true;
+}
+
+std::size_t encodeCurve(std::uint8_t motor, bool reverse, const pump::CalibrationCurve& curve, std::uint8_t* out) {
+  out[0] = kCmdSetCurve;
+  out[1] = motor;
+  out[2] = reverse ? 1 : 0;
+  out[3] = static_cast<std::uint8_t>(curve.size());
+  int pos = 4;
+  for (std::size_t i = 0; i < curve.size(); ++i) {
+    putUnsigned16(out, pos, curve.point(i).rpm, 10.0f);
+    putUnsigned16(out, pos + 2, curve.point(i).mlPerRev, 1000.0f);
+    pos += 4;
+  }
+  out[pos] = frameCrc(out, static_cast<std::size_t>(pos));
+  return static_cast<std::size_t>(pos) + 1;
+}
+
+bool decodeCurve(const std::uint8_t* in, std::size_t len, std::uint8_t& motor, bool& reverse,
+                 pump::CalibrationCurve& curve) {
+  if (len < 5 || in[0] != kCmdSetCurve || in[len - 1] != frameCrc(in, len - 1)) return false;
+  const std::size_t count = in[3];
+  if (count > pump::CalibrationCurve::kMaxPoints || len != 5 + 4 * count) return false;
+  pump::CalibrationPoint points[pump::CalibrationCurve::kMaxPoints];
+  for (std::size_t i = 0; i < count; ++i) {
+    const int pos = 4 + 4 * static_cast<int>(i);
+    points[i].rpm = static_cast<float>(getU16(in, pos)) / 10.0f;
+    points[i].mlPerRev = static_cast<float>(getU16(in, pos + 2)) / 1000.0f;
+  }
+  pump::CalibrationCurve parsed;
+  if (!parsed.assign(points, count)) return false;
+  motor = in[1];
+  reverse = in[2] != 0;
+  curve = parsed;
+  return true;
+}
+
+}  // namespace exproto
@@ -0,0 +1,70 @@
+#include "JsonSlabPool.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace pump {
+
+JsonSlabPool::JsonSlabPool(std::uint8_t* storage, const std::size_t* sizes, std::size_t count) {
+  for (std::size_t i = 0; i < count && i < kMaxSlabs; ++i) {
+    slabs_[i] = Slab{storage, sizes[i], false};
+    storage += sizes[i];
+    ++count_;
+  }
+}
+
+JsonSlabPool::Slab* JsonSlabPool::slabOf(const void* p) {
+  for (std::size_t i = 0; i < count_; ++i) {
+    if (slabs_[i].data == p) return &slabs_[i];
+  }
+  return nullptr;
+}
+
+void* JsonSlabPool::allocate(std::size_t n) {
+  Slab* best = nullptr;
+  for (std::size_t i = 0; i < count_; ++i) {
+    Slab& s = slabs_[i];
+    if (!s.used && s.size >= n && (best == nullptr || s.size < best->size)) best = &s;
+  }
+  void* p = nullptr;
+  if (best != nullptr) {
+    best->used = true;
+    p = best->data;
+  } else {
+    p = std::malloc(n);
+    if (p == nullptr) return nullptr;
+    ++stats_.heapAllocations;
+  }
+  ++stats_.borrowed;
+  if (++stats_.inUse > stats_.maxInUse) stats_.maxInUse = stats_.inUse;
+  return p;
+}
+
+void JsonSlabPool::deallocate(void* p) {
+  if (p == nullptr) return;
+  --stats_.inUse;
+  Slab* s = slabOf(p);
+  if (s != nullptr) {
+    s->used = false;
+  } else {
+    std::free(p);
+  }
+}
+
+void* JsonSlabPool::reallocate(void* p, std::size_t n) {
+  if (p == nullptr) return allocate(n);
+  Slab* s = slabOf(p);
+  if (s == nullptr) {
+    ++stats_.heapAllocations;
+    return std::realloc(p, n);
+  }
+  if (n <= s->size) return p;
+  // Outgrew its slab: move to a bigger one, or the heap.
+  void* q = allocate(n);
+  if (q == nullptr) return nullptr;
+  std::memcpy(q, p, s->size);
+  deallocate(p);
+  return q;
+}
+
+}  // namespace pump
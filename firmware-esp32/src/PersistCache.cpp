@@ -0,0 +1,64 @@
+#include "PersistCache.h"
+
+#include <cstring>
+
+namespace pump {
+
+namespace {
+
+std::uint32_t hashKey(const char* key) {
+  std::uint32_t h = 2166136261u;
+  for (; *key != '\0'; ++key) {
+    h ^= static_cast<std::uint8_t>(*key);
+    h *= 16777619u;
+  }
+  return h;
+}
+
+std::uint64_t valueOf(const void* data, std::size_t len) {
+  std::uint64_t v = 0;
+  if (len <= sizeof(v)) {
+    std::memcpy(&v, data, len);
+    return v;
+  }
+  v = 14695981039346656037ull;
+  const auto* p = static_cast<const std::uint8_t*>(data);
+  for (std::size_t i = 0; i < len; ++i) {
+    v ^= p[i];
+    v *= 1099511628211ull;
+  }
+  return v;
+}
+
+}  // namespace
+
+PersistCache::Entry* PersistCache::find(std::uint32_t key) {
+  for (std::size_t i = 0; i < count_; ++i) {
+    if (entries_[i].key == key) return &entries_[i];
+  }
+  return nullptr;
+}
+
+bool PersistCache::changed(const char* key, const void* data, std::size_t len) {
+  const std::uint32_t k = hashKey(key);
+  const std::uint64_t v = valueOf(data, len);
+  Entry* e = find(k);
+  if (e == nullptr) {
+    if (count_ == kMaxKeys) return true;
+    e = &entries_[count_++];
+    e->key = k;
+  } else if (e->len == len && e->value == v) {
+    return false;
+  }
+  e->len = static_cast<std::uint32_t>(len);
+  e->value = v;
+  return true;
+}
+
+void PersistCache::forget(const char* key) {
+  Entry* e = find(hashKey(key));
+  if (e == nullptr) return;
+  *e = entries_[--count_];
+}
+
+}  // namespace pump
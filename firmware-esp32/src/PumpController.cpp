@@ -5,18 +5,41 @@
 
 namespace pump {
 
-PumpController::PumpController(Config cfg) : cfg_(cfg) {
+namespace {
+
+constexpr double kNlPerL = 1e9;
+
+std::uint64_t litresToNl(double litres) { return litres > 0.0 ? static_cast<std::uint64_t>(litres * kNlPerL + 0.5) : 0; }
+
+}  // namespace
+
+double State::totalPumpedVolumeL() const { return static_cast<double>(totalPumpedNl) / kNlPerL; }
+
+double State::totalHoseVolumeL() const { return static_cast<double>(totalHoseNl) / kNlPerL; }
+
+void State::setTotalPumpedVolumeL(double litres) { totalPumpedNl = litresToNl(litres); }
+
+void State::setTotalHoseVolumeL(double litres) { totalHoseNl = litresToNl(litres); }
+
+template <typename Num>
+BasicPumpController<Num>::BasicPumpController(Config cfg) : cfg_(cfg) {
   state_.mlPerRevCw = cfg_.mlPerRevCw;
   state_.mlPerRevCcw = cfg_.mlPerRevCcw;
 }
 
-const Config& PumpController::config() const { return cfg_; }
+template <typename Num>
+const Config& BasicPumpController<Num>::config() const { return cfg_; }
 
-const State& PumpController::state() const { return state_; }
+template <typename Num>
+const State& BasicPumpController<Num>::state() const { return state_; }
 
-State& PumpController::mutableState() { return state_; }
+template <typename Num>
+State& BasicPumpController<Num>::mutableState() { return state_; }
 
-void PumpController::setSpeed(float speed, Mode mode) {
+template <typename Num>
+void BasicPumpController<Num>::setSpeed(float speed, Mode mode) {
+  dosePlan_.reset();
+  pendingDoseSteps_ = 0;
   state_.mode = mode;
   state_.targetSpeed = std::max(-cfg_.maxSpeed, std::min(speed, cfg_.maxSpeed));
 
@@ -30,88 +53,481 @@ void PumpController::setSpeed(float speed, Mode mode) {
   state_.lastManualSpeed = state_.targetSpeed;
 }
 
-void PumpController::start() {
+template <typename Num>
+void BasicPumpController<Num>::start() {
   float speed = state_.lastManualSpeed;
   if (std::fabs(speed) < cfg_.minSpeed) speed = 120.0f;
   setSpeed(speed, Mode::FLOW);
 }
 
-void PumpController::stop(bool emergency) {
+template <typename Num>
+void BasicPumpController<Num>::stop(bool emergency) {
   state_.targetSpeed = 0.0f;
   state_.mode = Mode::FLOW;
   state_.running = false;
+  dosePlan_.reset();
+  pendingDoseSteps_ = 0;
   if (emergency) {
     state_.currentSpeed = 0.0f;
   }
 }
 
-void PumpController::startDosing(std::int32_t volumeMl) {
+template <typename Num>
+void BasicPumpController<Num>::startDosing(std::int32_t volumeMl) {
   if (volumeMl == 0) {
     stop(false);
     return;
   }
 
-  state_.mode = Mode::DOSING;
-  state_.dosingRemainingMl = std::fabs(static_cast<float>(volumeMl));
-  setSpeed(volumeMl > 0 ? std::fabs(state_.dosingSpeed) : -std::fabs(state_.dosingSpeed), Mode::DOSING);
+  const bool reverse = volumeMl < 0;
+  const float cruise = std::fabs(state_.dosingSpeed);
+  const bool againstDose = reverse ? state_.currentSpeed > 0.0f : state_.currentSpeed < 0.0f;
+  const float entrySpeed = againstDose ? 0.0f : state_.currentSpeed;
+  const std::uint32_t steps = stepsForVolume(std::fabs(static_cast<float>(volumeMl)), reverse, entrySpeed, cruise);
+  if (steps == 0) {
+    stop(false);
+    return;
+  }
+  beginDose(steps, reverse, cruise);
+}
+
+template <typename Num>
+void BasicPumpController<Num>::startRevolutions(float revolutions, float speed) {
+  const auto steps = static_cast<std::uint32_t>(std::lround(std::fabs(revolutions) * cfg_.stepsPerRev));
+  if (steps == 0 || std::fabs(speed) < cfg_.minSpeed) {
+    stop(false);
+    return;
+  }
+  beginDose(steps, speed < 0.0f, std::fabs(speed));
+}
+
+template <typename Num>
+void BasicPumpController<Num>::beginDose(std::uint32_t steps, bool reverse, float cruiseRpm) {
+  setSpeed(reverse ? -cruiseRpm : cruiseRpm, Mode::DOSING);
+  doseReverse_ = reverse;
+  doseSpeed_ = cruiseRpm;
+  state_.dosingRemainingMl = static_cast<float>(steps) * mlPerStep(reverse, doseCruiseRpm());
+  const bool againstDose = reverse ? state_.currentSpeed > 0.0f : state_.currentSpeed < 0.0f;
+  if (againstDose) {
+    // Ramp through zero first; the plan starts once the motor turns our way.
+    pendingDoseSteps_ = steps;
+    return;
+  }
+  planDose(steps);
+}
+
+template <typename Num>
+std::uint32_t BasicPumpController<Num>::stepsForVolume(float volumeMl, bool reverse, float entrySpeed,
+                                                       float cruiseRpm) const {
+  const float cruise = std::min(cruiseRpm, cfg_.maxSpeed);
+  const auto steps = static_cast<std::uint32_t>(std::lround(volumeMl / mlPerStep(reverse, cruise)));
+  if (steps == 0 || calibrationCurve(reverse).empty()) return steps;
+  // Ramps run slower, where the tube delivers more per revolution: scale the
+  // count once by what the planned profile would actually pump.
+  StepPlanner plan;
+  planDose(plan, steps, entrySpeed, cruise);
+  const float planned = plannedMl(plan, reverse);
+  if (planned <= 0.0f) return steps;
+  return static_cast<std::uint32_t>(std::lround(static_cast<float>(steps) * volumeMl / planned));
+}
+
+template <typename Num>
+float BasicPumpController<Num>::plannedMl(const StepPlanner& plan, bool reverse) const {
+  constexpr int kSlices = 32;
+  const float duration = plan.durationSec();
+  const float rpmPerStepsPerSec = 60.0f / cfg_.stepsPerRev;
+  float ml = 0.0f;
+  std::uint32_t done = 0;
+  for (int i = 1; i <= kSlices; ++i) {
+    const std::uint32_t steps = i == kSlices ? plan.totalSteps() : plan.stepsAt(duration * i / kSlices);
+    const float midRpm = plan.speedAt(duration * (static_cast<float>(i) - 0.5f) / kSlices) * rpmPerStepsPerSec;
+    ml += static_cast<float>(steps - done) * mlPerStep(reverse, midRpm);
+    done = steps;
+  }
+  return ml;
 }
 
-void PumpController::setMlPerRev(float cw, float ccw) {
+template <typename Num>
+void BasicPumpController<Num>::setMlPerRev(float cw, float ccw) {
   if (cw > 0.0f) state_.mlPerRevCw = cw;
   if (ccw > 0.0f) state_.mlPerRevCcw = ccw;
 }
 
-void PumpController::setDosingSpeed(float speed) {
+template <typename Num>
+void BasicPumpController<Num>::setDosingSpeed(float speed) {
   if (std::fabs(speed) < cfg_.minSpeed) return;
   state_.dosingSpeed = std::max(cfg_.minSpeed, std::min(std::fabs(speed), cfg_.maxSpeed));
 }
 
-void PumpController::setMaxSpeed(float speed) {
+template <typename Num>
+void BasicPumpController<Num>::setRampProfile(RampProfile profile) {
+  if (profile == cfg_.rampProfile) return;
+  cfg_.rampProfile = profile;
+  rampMs_ = 0;
+}
+
+template <typename Num>
+void BasicPumpController<Num>::setMaxSpeed(float speed) {
   if (speed < 1.0f) return;
   cfg_.maxSpeed = speed;
   state_.targetSpeed = std::max(-cfg_.maxSpeed, std::min(state_.targetSpeed, cfg_.maxSpeed));
   state_.currentSpeed = std::max(-cfg_.maxSpeed, std::min(state_.currentSpeed, cfg_.maxSpeed));
   state_.lastManualSpeed = std::max(-cfg_.maxSpeed, std::min(state_.lastManualSpeed, cfg_.maxSpeed));
   state_.dosingSpeed = std::max(cfg_.minSpeed, std::min(std::fabs(state_.dosingSpeed), cfg_.maxSpeed));
+  if (dosePlan_.active() && dosePlan_.peakSpeed() > cfg_.maxSpeed * cfg_.stepsPerRev / 60.0f) {
+    planDose(dosePlan_.totalSteps() - doseStepsDone_);
+  }
 }
 
-void PumpController::tick(std::uint32_t deltaMs) {
-  if (deltaMs == 0) return;
+template <typename Num>
+void BasicPumpController<Num>::setCalibrationCurve(bool reverse, const CalibrationCurve& curve) {
+  (reverse ? curveCcw_ : curveCw_) = curve;
+}
+
+template <typename Num>
+const CalibrationCurve& BasicPumpController<Num>::calibrationCurve(bool reverse) const {
+  return reverse ? curveCcw_ : curveCw_;
+}
+
+template <typename Num>
+float BasicPumpController<Num>::mlPerRevAt(float speed) const { return mlPerRevFor(speed < 0.0f, speed); }
+
+template <typename Num>
+float BasicPumpController<Num>::speedForFlow(float mlPerMin, bool reverse) const {
+  const CalibrationCurve& curve = calibrationCurve(reverse);
+  const float rpm = curve.empty() ? std::fabs(mlPerMin) / (reverse ? state_.mlPerRevCcw : state_.mlPerRevCw)
+                                  : curve.rpmForFlow(mlPerMin);
+  return reverse ? -rpm : rpm;
+}
+
+template <typename Num>
+float BasicPumpController<Num>::mlPerRevFor(bool reverse, float rpm) const {
+  const CalibrationCurve& curve = calibrationCurve(reverse);
+  if (curve.empty()) return reverse ? state_.mlPerRevCcw : state_.mlPerRevCw;
+  return curve.mlPerRevAt(rpm);
+}
+
+template <typename Num>
+float BasicPumpController<Num>::mlPerStep(bool reverse, float rpm) const {
+  return mlPerRevFor(reverse, rpm) / cfg_.stepsPerRev;
+}
+
+template <typename Num>
+float BasicPumpController<Num>::doseCruiseRpm() const { return std::min(doseSpeed_, cfg_.maxSpeed); }
 
-  const float dtSec = static_cast<float>(deltaMs) / 1000.0f;
+template <typename Num>
+void BasicPumpController<Num>::planDose(StepPlanner& plan, std::uint32_t steps, float entrySpeed,
+                                        float cruiseRpm) const {
+  // Fastest profile within the limits: accelerate at the accel rate up to the
+  // dosing speed (capped by maxSpeed) and brake at the halt rate so the last
+  // step lands at standstill without a trailing halt ramp. The dosing speed
+  // is the ceiling, not maxSpeed: it is the flow the user doses at, and what
+  // a scalar ml/rev is usually measured at. Setting it to the max flow gives
+  // the fastest dose.
+  const float stepsPerSecPerRpm = cfg_.stepsPerRev / 60.0f;
+  const float cruise = std::min(std::fabs(cruiseRpm), cfg_.maxSpeed) * stepsPerSecPerRpm;
+  const float accel = cfg_.speedAccelPerSec * stepsPerSecPerRpm;
+  const float decel = cfg_.speedHaltPerSec * stepsPerSecPerRpm;
+  plan.plan(steps, cruise, accel, decel, std::fabs(entrySpeed) * stepsPerSecPerRpm);
+}
+
+template <typename Num>
+void BasicPumpController<Num>::planDose(std::uint32_t steps) {
+  planDose(dosePlan_, steps, state_.currentSpeed, doseSpeed_);
+  ++dosePlanId_;
+  pendingDoseSteps_ = 0;
+  doseElapsedMs_ = 0;
+  doseStepsDone_ = 0;
+}
+
+template <typename Num>
+float BasicPumpController<Num>::rampRate() const {
   const bool targetIsStop = std::fabs(state_.targetSpeed) < cfg_.minSpeed;
-  const float ramp = (targetIsStop ? cfg_.speedHaltPerSec : cfg_.speedAccelPerSec) * dtSec;
+  if (targetIsStop) return cfg_.speedHaltPerSec;
+  return cfg_.rampProfile == RampProfile::S_CURVE ? cfg_.sCurveAccelPerSec : cfg_.speedAccelPerSec;
+}
 
-  if (state_.currentSpeed < state_.targetSpeed) {
-    state_.currentSpeed = std::min(state_.currentSpeed + ramp, state_.targetSpeed);
-  } else if (state_.currentSpeed > state_.targetSpeed) {
-    state_.currentSpeed = std::max(state_.currentSpeed - ramp, state_.targetSpeed);
+template <typename Num>
+float BasicPumpController<Num>::rampTarget() const {
+  // S-curves come to rest before reversing; linear ramps pass through zero.
+  const float target = state_.targetSpeed;
+  if (cfg_.rampProfile == RampProfile::S_CURVE && state_.currentSpeed != 0.0f && target != 0.0f &&
+      (state_.currentSpeed < 0.0f) != (target < 0.0f)) {
+    return 0.0f;
   }
+  return target;
+}
 
-  if (std::fabs(state_.currentSpeed) < cfg_.minSpeed && targetIsStop) {
+template <typename Num>
+std::uint32_t BasicPumpController<Num>::rampMsTo(float target) const {
+  using T = NumTraits<Num>;
+  const Num delta = T::abs(T::fromFloat(target) - T::fromFloat(state_.currentSpeed));
+  const Num rate = T::fromFloat(rampRate());
+  if (cfg_.rampProfile == RampProfile::S_CURVE) {
+    if (sCurveRampValid(target)) return rampMs_ - rampElapsedMs_;
+    return std::max(T::ceilMs(delta * T::fromFloat(kSCurvePeakSlope) / rate), static_cast<std::uint32_t>(1));
+  }
+  return T::ceilMs(delta / rate);
+}
+
+template <typename Num>
+bool BasicPumpController<Num>::sCurveRampValid(float target) const {
+  // Any outside change of speed or target restarts the ramp from where it is.
+  return rampMs_ > 0 && rampTo_ == target && state_.currentSpeed == sCurveSpeedAt(rampElapsedMs_);
+}
+
+template <typename Num>
+float BasicPumpController<Num>::sCurveSpeedAt(std::uint32_t elapsedMs) const {
+  using T = NumTraits<Num>;
+  const float u = static_cast<float>(elapsedMs) / static_cast<float>(rampMs_);
+  const Num from = T::fromFloat(rampFrom_);
+  return T::toFloat(from + (T::fromFloat(rampTo_) - from) * T::fromFloat(sCurveSpeedFraction(u)));
+}
+
+template <typename Num>
+float BasicPumpController<Num>::calibration(Num speed) const {
+  const bool reverse = speed < Num(0.0f);
+  const CalibrationCurve& curve = calibrationCurve(reverse);
+  if (curve.empty()) return reverse ? state_.mlPerRevCcw : state_.mlPerRevCw;
+  return curve.mlPerRevAt(NumTraits<Num>::toFloat(speed));
+}
+
+template <typename Num>
+void BasicPumpController<Num>::addVolumeSpan(Num fromSpeed, Num toSpeed, Num sec) {
+  if (sec <= Num(0.0f)) return;
+  const Num zero(0.0f);
+  if ((fromSpeed >= zero) == (toSpeed >= zero)) {
+    const Num mean = (fromSpeed + toSpeed) * Num(0.5f);
+    addNl(volume_.addSpan(mean, calibration(mean), sec));
+    return;
+  }
+  // Linear ramp through zero: one triangle per direction.
+  using T = NumTraits<Num>;
+  const Num fromSec = sec * T::abs(fromSpeed) / (T::abs(fromSpeed) + T::abs(toSpeed));
+  addNl(volume_.addSpan(fromSpeed * Num(0.5f), calibration(fromSpeed), fromSec));
+  addNl(volume_.addSpan(toSpeed * Num(0.5f), calibration(toSpeed), sec - fromSec));
+}
+
+template <typename Num>
+void BasicPumpController<Num>::addVolumeMs(Num speed, std::uint32_t ms) {
+  if (ms == 0) return;
+  addNl(volume_.addMs(speed, calibration(speed), ms));
+}
+
+template <typename Num>
+void BasicPumpController<Num>::addNl(std::uint64_t nl) {
+  state_.totalPumpedNl += nl;
+  state_.totalHoseNl += nl;
+}
+
+template <typename Num>
+void BasicPumpController<Num>::addUptime(std::uint32_t deltaMs) {
+  const std::uint64_t totalMs = static_cast<std::uint64_t>(uptimeRemainderMs_) + deltaMs;
+  state_.totalMotorUptimeSec += static_cast<std::uint32_t>(totalMs / 1000);
+  uptimeRemainderMs_ = static_cast<std::uint32_t>(totalMs % 1000);
+}
+
+template <typename Num>
+void BasicPumpController<Num>::advanceDosing(std::uint32_t deltaMs) {
+  const auto planEndMs = static_cast<std::uint32_t>(std::ceil(dosePlan_.durationSec() * 1000.0f));
+  const std::uint32_t leftMs = planEndMs > doseElapsedMs_ ? planEndMs - doseElapsedMs_ : 0;
+  const bool finished = deltaMs >= leftMs;
+  const std::uint32_t movingMs = finished ? leftMs : deltaMs;
+  doseElapsedMs_ += movingMs;
+  const float tSec = static_cast<float>(doseElapsedMs_) / 1000.0f;
+  const std::uint32_t totalSteps = dosePlan_.totalSteps();
+  const std::uint32_t steps = finished ? totalSteps : dosePlan_.stepsAt(tSec);
+  const float speed = dosePlan_.speedAt(tSec) * 60.0f / cfg_.stepsPerRev;
+  const float meanRpm = 0.5f * (std::fabs(state_.currentSpeed) + speed);
+  const float deltaMl = static_cast<float>(steps - doseStepsDone_) * mlPerStep(doseReverse_, meanRpm);
+  doseStepsDone_ = steps;
+
+  state_.currentSpeed = doseReverse_ ? -speed : speed;
+  addNl(volume_.addMl(deltaMl));
+  addUptime(movingMs);
+  state_.dosingRemainingMl = static_cast<float>(totalSteps - steps) * mlPerStep(doseReverse_, doseCruiseRpm());
+
+  if (steps >= totalSteps) {
+    // The last planned step lands at standstill.
+    state_.dosingRemainingMl = 0;
+    state_.currentSpeed = 0.0f;
+    ++dosesFinished_;
+    stop(false);
+  }
+}
+
+template <typename Num>
+void BasicPumpController<Num>::advanceSCurve(std::uint32_t deltaMs) {
+  using T = NumTraits<Num>;
+  while (deltaMs > 0) {
+    const float target = rampTarget();
+    if (state_.currentSpeed == target) {
+      addVolumeMs(T::fromFloat(target), deltaMs);
+      if (std::fabs(target) >= cfg_.minSpeed) addUptime(deltaMs);
+      break;
+    }
+    if (!sCurveRampValid(target)) {
+      const std::uint32_t rampMs = rampMsTo(target);
+      rampFrom_ = state_.currentSpeed;
+      rampTo_ = target;
+      rampMs_ = rampMs;
+      rampElapsedMs_ = 0;
+    }
+
+    // Ramps never cross zero, so the mean speed over the step gives the volume.
+    const std::uint32_t stepMs = std::min(deltaMs, rampMs_ - rampElapsedMs_);
+    const float u0 = static_cast<float>(rampElapsedMs_) / static_cast<float>(rampMs_);
+    const float u1 = static_cast<float>(rampElapsedMs_ + stepMs) / static_cast<float>(rampMs_);
+    const float meanFraction = (sCurveAreaFraction(u1) - sCurveAreaFraction(u0)) / (u1 - u0);
+    const Num from = T::fromFloat(rampFrom_);
+    addVolumeMs(from + (T::fromFloat(rampTo_) - from) * T::fromFloat(meanFraction), stepMs);
+    addUptime(stepMs);
+    rampElapsedMs_ += stepMs;
+    deltaMs -= stepMs;
+    if (rampElapsedMs_ >= rampMs_) {
+      state_.currentSpeed = rampTo_;
+      rampMs_ = 0;
+    } else {
+      state_.currentSpeed = sCurveSpeedAt(rampElapsedMs_);
+    }
+  }
+
+  if (std::fabs(state_.currentSpeed) < cfg_.minSpeed && std::fabs(state_.targetSpeed) < cfg_.minSpeed) {
     state_.currentSpeed = 0.0f;
     state_.running = false;
   }
+}
 
-  const float mlPerRev = state_.currentSpeed >= 0 ? state_.mlPerRevCw : state_.mlPerRevCcw;
-  const float deltaMl = std::fabs(state_.currentSpeed) / 60.0f * mlPerRev * dtSec;
+template <typename Num>
+void BasicPumpController<Num>::advanceFlow(std::uint32_t deltaMs) {
+  if (cfg_.rampProfile == RampProfile::S_CURVE) {
+    advanceSCurve(deltaMs);
+    return;
+  }
+  using T = NumTraits<Num>;
+  const bool targetIsStop = std::fabs(state_.targetSpeed) < cfg_.minSpeed;
+  const Num fromSpeed = T::fromFloat(state_.currentSpeed);
+  const Num targetSpeed = T::fromFloat(state_.targetSpeed);
+  const Num rate = T::fromFloat(rampRate());
+  const bool cruising = fromSpeed == targetSpeed;
+  const Num rampSec = cruising ? Num(0.0f) : T::abs(targetSpeed - fromSpeed) / rate;
+  const std::uint32_t rampMs = cruising ? 0 : T::ceilMs(rampSec);
 
-  state_.totalPumpedVolumeL += deltaMl / 1000.0;
-  state_.totalHoseVolumeL += deltaMl / 1000.0;
+  if (rampMs > deltaMs) {
+    const Num ramp = T::mulMs(rate, deltaMs);
+    const Num speed = fromSpeed < targetSpeed ? fromSpeed + ramp : fromSpeed - ramp;
+    state_.currentSpeed = T::toFloat(speed);
+    addVolumeSpan(fromSpeed, speed, T::seconds(deltaMs));
+  } else {
+    // Ramp, the rest of its last millisecond, then whole milliseconds at target.
+    state_.currentSpeed = state_.targetSpeed;
+    if (rampMs > 0) {
+      addVolumeSpan(fromSpeed, targetSpeed, rampSec);
+      addVolumeSpan(targetSpeed, targetSpeed, T::seconds(rampMs) - rampSec);
+    }
+    addVolumeMs(targetSpeed, deltaMs - rampMs);
+  }
 
-  if (std::fabs(state_.currentSpeed) >= cfg_.minSpeed) {
-    uptimeRemainderMs_ += deltaMs;
-    state_.totalMotorUptimeSec += (uptimeRemainderMs_ / 1000);
-    uptimeRemainderMs_ %= 1000;
+  std::uint32_t movingMs = deltaMs;
+  if (targetIsStop) {
+    movingMs = std::fabs(T::toFloat(fromSpeed)) < cfg_.minSpeed ? 0 : std::min(rampMs, deltaMs);
   }
+  addUptime(movingMs);
+
+  if (std::fabs(state_.currentSpeed) < cfg_.minSpeed && targetIsStop) {
+    state_.currentSpeed = 0.0f;
+    state_.running = false;
+  }
+}
 
-  if (state_.mode == Mode::DOSING && state_.dosingRemainingMl > 0) {
-    state_.dosingRemainingMl -= deltaMl;
-    if (state_.dosingRemainingMl <= 0) {
-      state_.dosingRemainingMl = 0;
-      stop(false);
+template <typename Num>
+void BasicPumpController<Num>::tick(std::uint32_t deltaMs) { advanceTo(nowMs_ + deltaMs); }
+
+template <typename Num>
+void BasicPumpController<Num>::advanceTo(std::uint32_t timeMs) {
+  // Signed, so a caller whose clock reading is older than ours is a no-op
+  // instead of a 49-day jump.
+  const std::int32_t elapsedMs = static_cast<std::int32_t>(timeMs - nowMs_);
+  if (elapsedMs <= 0) return;
+  std::uint32_t deltaMs = static_cast<std::uint32_t>(elapsedMs);
+  nowMs_ = timeMs;
+
+  if (pendingDoseSteps_ > 0) {
+    // Finish the ramp through zero, then start the plan at the crossing.
+    const std::uint32_t rampMs = std::min(rampMsTo(0.0f), deltaMs);
+    if (rampMs > 0) advanceFlow(rampMs);
+    deltaMs -= rampMs;
+    if (doseReverse_ ? state_.currentSpeed <= 0.0f : state_.currentSpeed >= 0.0f) {
+      planDose(pendingDoseSteps_);
     }
+    if (deltaMs == 0) return;
+  }
+
+  if (dosePlan_.active()) {
+    advanceDosing(deltaMs);
+  } else {
+    advanceFlow(deltaMs);
   }
 }
 
+template <typename Num>
+std::uint32_t BasicPumpController<Num>::nowMs() const { return nowMs_; }
+
+template <typename Num>
+bool BasicPumpController<Num>::isRamping() const {
+  if (dosePlan_.active()) {
+    return !dosePlan_.cruisingAt(static_cast<float>(doseElapsedMs_) / 1000.0f);
+  }
+  return state_.currentSpeed != state_.targetSpeed;
+}
+
+template <typename Num>
+std::uint32_t BasicPumpController<Num>::nextEventMs() const {
+  if (dosePlan_.active()) {
+    const float tSec = static_cast<float>(doseElapsedMs_) / 1000.0f;
+    const auto phaseEndMs = static_cast<std::uint32_t>(std::ceil(dosePlan_.phaseEndSec(tSec) * 1000.0f));
+    return nowMs_ + (phaseEndMs > doseElapsedMs_ ? phaseEndMs - doseElapsedMs_ : 0);
+  }
+  if (state_.currentSpeed == state_.targetSpeed) return kNoEvent;
+  return nowMs_ + rampMsTo(pendingDoseSteps_ > 0 ? 0.0f : rampTarget());
+}
+
+template <typename Num>
+std::uint32_t BasicPumpController<Num>::dosingEtaMs() const {
+  if (state_.mode != Mode::DOSING) return 0;
+  if (dosePlan_.active()) {
+    const auto planEndMs = static_cast<std::uint32_t>(std::ceil(dosePlan_.durationSec() * 1000.0f));
+    return planEndMs > doseElapsedMs_ ? planEndMs - doseElapsedMs_ : 0;
+  }
+  if (state_.dosingRemainingMl <= 0.0f) return 0;
+
+  const bool reverse = pendingDoseSteps_ > 0 ? doseReverse_ : state_.targetSpeed < 0.0f;
+  // Mirrored state has no dose of its own; it cruises at dosingSpeed.
+  const float cruise = pendingDoseSteps_ > 0 ? doseSpeed_ : std::fabs(state_.dosingSpeed);
+  const auto steps = static_cast<std::uint32_t>(
+      std::lround(state_.dosingRemainingMl / mlPerStep(reverse, std::min(cruise, cfg_.maxSpeed))));
+  float etaMs = 0.0f;
+  float entrySpeed = state_.currentSpeed;
+  if (entrySpeed != 0.0f && (entrySpeed < 0.0f) != reverse) {
+    // Reversal first: ramp to zero, then the plan starts from standstill.
+    etaMs = static_cast<float>(rampMsTo(0.0f));
+    entrySpeed = 0.0f;
+  }
+  StepPlanner estimate;
+  planDose(estimate, steps, entrySpeed, cruise);
+  return static_cast<std::uint32_t>(etaMs + std::ceil(estimate.durationSec() * 1000.0f));
+}
+
+template <typename Num>
+const StepPlanner& BasicPumpController<Num>::dosePlan() const { return dosePlan_; }
+
+template <typename Num>
+std::uint32_t BasicPumpController<Num>::dosePlanId() const { return dosePlanId_; }
+
+template <typename Num>
+std::uint32_t BasicPumpController<Num>::dosesFinished() const { return dosesFinished_; }
+
+template class BasicPumpController<float>;
+template class BasicPumpController<Q16x16>;
+
 }  // namespace pump
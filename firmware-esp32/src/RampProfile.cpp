@@ -0,0 +1,50 @@
+#include "RampProfile.h"
+
+#include <algorithm>
+
+namespace pump {
+
+namespace {
+
+constexpr int kSegments = 32;
+
+// (1 - cos(pi * i / 32)) / 2
+constexpr float kSpeedTable[kSegments + 1] = {
+    0.0000000f, 0.0024076f, 0.0096074f, 0.0215298f, 0.0380602f, 0.0590394f, 0.0842652f, 0.1134948f,
+    0.1464466f, 0.1828034f, 0.2222149f, 0.2643016f, 0.3086583f, 0.3548577f, 0.4024548f, 0.4509914f,
+    0.5000000f, 0.5490086f, 0.5975452f, 0.6451423f, 0.6913417f, 0.7356984f, 0.7777851f, 0.8171966f,
+    0.8535534f, 0.8865052f, 0.9157348f, 0.9409606f, 0.9619398f, 0.9784702f, 0.9903926f, 0.9975924f,
+    1.0000000f};
+
+// Running integral of the interpolated speed table, so volume always matches
+// the speed that was reported.
+constexpr float kAreaTable[kSegments + 1] = {
+    0.0000000f, 0.0000376f, 0.0002254f, 0.0007119f, 0.0016430f, 0.0031601f, 0.0053993f, 0.0084893f,
+    0.0125509f, 0.0176954f, 0.0240238f, 0.0316256f, 0.0405781f, 0.0509456f, 0.0627786f, 0.0761137f,
+    0.0909729f, 0.1073637f, 0.1252786f, 0.1446956f, 0.1655781f, 0.1878756f, 0.2115238f, 0.2364454f,
+    0.2625509f, 0.2897393f, 0.3178993f, 0.3469101f, 0.3766430f, 0.4069619f, 0.4377254f, 0.4687876f,
+    0.5000000f};
+
+int segmentOf(float u, float& frac) {
+  const float x = std::max(0.0f, std::min(u, 1.0f)) * kSegments;
+  const int i = std::min(static_cast<int>(x), kSegments - 1);
+  frac = x - static_cast<float>(i);
+  return i;
+}
+
+}  // namespace
+
+float sCurveSpeedFraction(float u) {
+  float frac = 0.0f;
+  const int i = segmentOf(u, frac);
+  return kSpeedTable[i] + (kSpeedTable[i + 1] - kSpeedTable[i]) * frac;
+}
+
+float sCurveAreaFraction(float u) {
+  float frac = 0.0f;
+  const int i = segmentOf(u, frac);
+  const float slope = kSpeedTable[i + 1] - kSpeedTable[i];
+  return kAreaTable[i] + (kSpeedTable[i] * frac + 0.5f * slope * frac * frac) / kSegments;
+}
+
+}  // namespace pump
@@ -0,0 +1,146 @@
+#include "StateJson.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace pump {
+
+namespace {
+
+// The values behind one motor's state fields, so the writer and the hash
+// cannot drift apart.
+struct Fields {
+  std::uint8_t mode;
+  bool running;
+  float flowMlMin;
+  float targetFlowMlMin;
+  float dosingFlowLph;
+  bool forward;
+  float mlPerRevCw;
+  float mlPerRevCcw;
+  float dosingRemainingMl;
+  float dosingEtaSec;
+  std::uint32_t uptimeSec;
+  double totalPumpedL;
+  double totalHoseL;
+};
+
+Fields fieldsOf(const PumpController& ctrl) {
+  const auto& st = ctrl.state();
+  Fields f;
+  f.mode = static_cast<std::uint8_t>(st.mode);
+  f.running = st.running;
+  f.flowMlMin = st.currentSpeed * ctrl.mlPerRevAt(st.currentSpeed);
+  f.targetFlowMlMin = st.targetSpeed * ctrl.mlPerRevAt(st.targetSpeed);
+  f.dosingFlowLph = std::fabs(st.dosingSpeed * ctrl.mlPerRevAt(std::fabs(st.dosingSpeed)) * 0.06f);
+  f.forward = st.targetSpeed >= 0;
+  f.mlPerRevCw = st.mlPerRevCw;
+  f.mlPerRevCcw = st.mlPerRevCcw;
+  f.dosingRemainingMl = st.dosingRemainingMl;
+  f.dosingEtaSec = ctrl.dosingEtaMs() / 1000.0f;
+  f.uptimeSec = st.totalMotorUptimeSec;
+  f.totalPumpedL = st.totalPumpedVolumeL();
+  f.totalHoseL = st.totalHoseVolumeL();
+  return f;
+}
+
+}  // namespace
+
+bool FieldFilter::wants(const char* key) const {
+  if (list_ == nullptr) return true;
+  const std::size_t keyLen = std::strlen(key);
+  const std::size_t parentLen = parent_ == nullptr ? 0 : std::strlen(parent_);
+  const char* token = list_;
+  while (true) {
+    const char* end = std::strchr(token, ',');
+    if (end == nullptr) end = token + std::strlen(token);
+    const char* name = token;
+    std::size_t len = static_cast<std::size_t>(end - token);
+    bool inScope = true;
+    if (parent_ != nullptr) {
+      if (len == parentLen && std::memcmp(name, parent_, len) == 0) return true;
+      inScope = len > parentLen && std::memcmp(name, parent_, parentLen) == 0 && name[parentLen] == '.';
+      if (inScope) {
+        name += parentLen + 1;
+        len -= parentLen + 1;
+      }
+    }
+    if (inScope && len >= keyLen && std::memcmp(name, key, keyLen) == 0 && (len == keyLen || name[keyLen] == '.')) {
+      return true;
+    }
+    if (*end == '\0') return false;
+    token = end + 1;
+  }
+}
+
+FieldFilter FieldFilter::nested(const char* parent) const {
+  FieldFilter filter(*this);
+  if (list_ != nullptr) filter.parent_ = parent;
+  return filter;
+}
+
+void writeStateFields(JsonObject out, const PumpController& ctrl, const FieldFilter& fields) {
+  const Fields f = fieldsOf(ctrl);
+  if (fields.wants("mode")) out["mode"] = f.mode;
+  if (fields.wants("modeName")) out["modeName"] = f.mode == static_cast<std::uint8_t>(Mode::DOSING) ? "dosing" : "flow_lph";
+  if (fields.wants("running")) out["running"] = f.running;
+  if (fields.wants("flowMlMin")) out["flowMlMin"] = f.flowMlMin;
+  if (fields.wants("flowLph")) out["flowLph"] = f.flowMlMin * 0.06f;
+  if (fields.wants("targetFlowMlMin")) out["targetFlowMlMin"] = f.targetFlowMlMin;
+  if (fields.wants("targetFlowLph")) out["targetFlowLph"] = f.targetFlowMlMin * 0.06f;
+  if (fields.wants("dosingFlowLph")) out["dosingFlowLph"] = f.dosingFlowLph;
+  if (fields.wants("direction")) out["direction"] = f.forward ? "forward" : "reverse";
+  if (fields.wants("mlPerRevCw")) out["mlPerRevCw"] = f.mlPerRevCw;
+  if (fields.wants("mlPerRevCcw")) out["mlPerRevCcw"] = f.mlPerRevCcw;
+  if (fields.wants("dosingRemainingMl")) out["dosingRemainingMl"] = f.dosingRemainingMl;
+  if (fields.wants("dosingEtaSec")) out["dosingEtaSec"] = f.dosingEtaSec;
+  if (fields.wants("uptimeSec")) out["uptimeSec"] = f.uptimeSec;
+  if (fields.wants("totalPumpedL")) out["totalPumpedL"] = f.totalPumpedL;
+  if (fields.wants("totalHoseL")) out["totalHoseL"] = f.totalHoseL;
+}
+
+void packStateFields(MsgPackWriter& out, const PumpController& ctrl) {
+  const Fields f = fieldsOf(ctrl);
+  out.uint(f.mode);
+  out.boolean(f.running);
+  out.boolean(f.forward);
+  out.float32(f.flowMlMin);
+  out.float32(f.targetFlowMlMin);
+  out.float32(f.dosingFlowLph);
+  out.float32(f.mlPerRevCw);
+  out.float32(f.mlPerRevCcw);
+  out.float32(f.dosingRemainingMl);
+  out.float32(f.dosingEtaSec);
+  out.uint(f.uptimeSec);
+  out.float64(f.totalPumpedL);
+  out.float64(f.totalHoseL);
+}
+
+void StateHash::add(const void* data, std::size_t len) {
+  const auto* p = static_cast<const std::uint8_t*>(data);
+  for (std::size_t i = 0; i < len; ++i) {
+    h_ ^= p[i];
+    h_ *= 16777619u;
+  }
+}
+
+void StateHash::addString(const char* s) { add(s, std::strlen(s) + 1); }
+
+void hashStateFields(StateHash& hash, const PumpController& ctrl) {
+  const Fields f = fieldsOf(ctrl);
+  hash.add(f.mode);
+  hash.add(f.running);
+  hash.add(f.flowMlMin);
+  hash.add(f.targetFlowMlMin);
+  hash.add(f.dosingFlowLph);
+  hash.add(f.forward);
+  hash.add(f.mlPerRevCw);
+  hash.add(f.mlPerRevCcw);
+  hash.add(f.dosingRemainingMl);
+  hash.add(f.dosingEtaSec);
+  hash.add(f.uptimeSec);
+  hash.add(f.totalPumpedL);
+  hash.add(f.totalHoseL);
+}
+
+}  // namespace pump
@@ -0,0 +1,115 @@
+#include "StepPlanner.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pump {
+
+void StepPlanner::plan(std::uint32_t totalSteps, float cruiseSpeed, float accel, float decel, float entrySpeed) {
+  reset();
+  if (totalSteps == 0 || cruiseSpeed <= 0.0f || accel <= 0.0f || decel <= 0.0f) return;
+
+  const float steps = static_cast<float>(totalSteps);
+  const float entry = std::max(entrySpeed, 0.0f);
+  float peak = cruiseSpeed;
+
+  if (entry * entry / (2.0f * decel) >= steps) {
+    // Already too fast to stop within the move: brake from entry speed and
+    // land exactly on the last step.
+    peak = entry;
+    decel = entry * entry / (2.0f * steps);
+  } else if (entry <= cruiseSpeed) {
+    const float needed = (cruiseSpeed * cruiseSpeed - entry * entry) / (2.0f * accel) +
+                         cruiseSpeed * cruiseSpeed / (2.0f * decel);
+    if (needed > steps) {
+      // Triangular profile: highest peak that still decelerates in time.
+      peak = std::sqrt((2.0f * accel * decel * steps + decel * entry * entry) / (accel + decel));
+    }
+  }
+
+  totalSteps_ = totalSteps;
+  entrySpeed_ = entry;
+  peakSpeed_ = peak;
+  decel_ = decel;
+  if (peak > entry) {
+    rampAccel_ = accel;
+  } else if (peak < entry) {
+    rampAccel_ = -decel;
+  }
+  rampSec_ = rampAccel_ != 0.0f ? (peak - entry) / rampAccel_ : 0.0f;
+  rampSteps_ = 0.5f * (entry + peak) * rampSec_;
+  decelSec_ = peak / decel;
+  const float decelSteps = 0.5f * peak * decelSec_;
+  cruiseSteps_ = std::max(steps - rampSteps_ - decelSteps, 0.0f);
+  cruiseSec_ = cruiseSteps_ / peak;
+}
+
+void StepPlanner::reset() { *this = StepPlanner(); }
+
+bool StepPlanner::active() const { return totalSteps_ > 0; }
+
+std::uint32_t StepPlanner::totalSteps() const { return totalSteps_; }
+
+float StepPlanner::durationSec() const { return rampSec_ + cruiseSec_ + decelSec_; }
+
+float StepPlanner::peakSpeed() const { return peakSpeed_; }
+
+float StepPlanner::positionAt(float tSec) const {
+  if (tSec <= 0.0f) return 0.0f;
+  if (tSec < rampSec_) return entrySpeed_ * tSec + 0.5f * rampAccel_ * tSec * tSec;
+  tSec -= rampSec_;
+  if (tSec < cruiseSec_) return rampSteps_ + peakSpeed_ * tSec;
+  tSec -= cruiseSec_;
+  if (tSec < decelSec_) return rampSteps_ + cruiseSteps_ + peakSpeed_ * tSec - 0.5f * decel_ * tSec * tSec;
+  return static_cast<float>(totalSteps_);
+}
+
+std::uint32_t StepPlanner::stepsAt(float tSec) const {
+  if (!active()) return 0;
+  if (tSec >= durationSec()) return totalSteps_;
+  const float position = positionAt(tSec);
+  if (position <= 0.0f) return 0;
+  // Only the end of the plan may report the final step.
+  return std::min(static_cast<std::uint32_t>(position), totalSteps_ - 1);
+}
+
+float StepPlanner::speedAt(float tSec) const {
+  if (!active() || tSec < 0.0f) return 0.0f;
+  if (tSec < rampSec_) return entrySpeed_ + rampAccel_ * tSec;
+  tSec -= rampSec_;
+  if (tSec < cruiseSec_) return peakSpeed_;
+  tSec -= cruiseSec_;
+  if (tSec < decelSec_) return peakSpeed_ - decel_ * tSec;
+  return 0.0f;
+}
+
+float StepPlanner::stepTimeSec(std::uint32_t step) const {
+  if (!active() || step == 0) return 0.0f;
+  if (step >= totalSteps_) return durationSec();
+  const float position = static_cast<float>(step);
+  if (position <= rampSteps_) {
+    if (rampAccel_ == 0.0f) return position / entrySpeed_;
+    const float disc = std::max(entrySpeed_ * entrySpeed_ + 2.0f * rampAccel_ * position, 0.0f);
+    return (std::sqrt(disc) - entrySpeed_) / rampAccel_;
+  }
+  if (position <= rampSteps_ + cruiseSteps_) return rampSec_ + (position - rampSteps_) / peakSpeed_;
+  const float remaining = static_cast<float>(totalSteps_) - position;
+  return durationSec() - std::sqrt(2.0f * remaining / decel_);
+}
+
+float StepPlanner::stepIntervalSec(std::uint32_t step) const {
+  if (!active() || step >= totalSteps_) return 0.0f;
+  return stepTimeSec(step + 1) - stepTimeSec(step);
+}
+
+float StepPlanner::phaseEndSec(float tSec) const {
+  if (tSec < rampSec_) return rampSec_;
+  if (tSec < rampSec_ + cruiseSec_) return rampSec_ + cruiseSec_;
+  return durationSec();
+}
+
+bool StepPlanner::cruisingAt(float tSec) const {
+  return active() && tSec >= rampSec_ && tSec < rampSec_ + cruiseSec_;
+}
+
+}  // namespace pump
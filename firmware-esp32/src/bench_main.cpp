@@ -0,0 +1,698 @@
+// Host micro-benchmarks for the control, I2C and /api/state paths, plus the
+// peak heap, allocations and leftover holes of one /api/state response and its
+// size as JSON and packed. Build and run with
+//   pio run -e native-bench && .pio/build/native-bench/program [--json]
+// --json prints one JSON document instead of the table, for tracking between releases.
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "ExpansionProtocol.h"
+#include "JsonSlabPool.h"
+#include "JsonWriter.h"
+#include "MsgPack.h"
+#include "PumpBank.h"
+#include "PumpController.h"
+#include "StateJson.h"
+
+// Heap figures depend on how the library lays out a document, so they only
+// mean something against the version the firmware ships with.
+#if !defined(ARDUINOJSON_VERSION_MAJOR) || ARDUINOJSON_VERSION_MAJOR != 6
+#error "native-bench needs ArduinoJson 6 from lib_deps"
+#endif
+
+namespace {
+
+volatile double sinkDouble = 0.0;
+volatile std::uint64_t sinkU64 = 0;
+// 120 speed at 2.6 ml/rev for one 10 ms tick; volatile so the loop is not folded.
+volatile float tickMl = 0.052f;
+
+struct BenchResult {
+  std::string name;
+  std::uint32_t iterations;
+  double nsPerOp;
+};
+
+struct DivergenceResult {
+  std::string name;
+  float maxSpeedDiff;
+  double refL;
+  double fixedL;
+  std::uint32_t refUptimeSec;
+  std::uint32_t fixedUptimeSec;
+};
+
+struct HeapResult {
+  std::string name;
+  std::size_t peakBytes;
+  std::uint32_t allocations;
+  std::size_t holes;
+  std::size_t strandedBytes;
+};
+
+std::vector<BenchResult> results;
+std::vector<DivergenceResult> divergences;
+std::vector<HeapResult> heapResults;
+struct PayloadResult {
+  std::string name;
+  std::size_t bytes;
+};
+std::vector<PayloadResult> payloadResults;
+
+// Live and peak heap bytes, fed by the operator new/delete below and by
+// CountingAllocator for JSON documents.
+struct HeapMeter {
+  std::size_t live = 0;
+  std::size_t peak = 0;
+  std::uint32_t allocations = 0;
+  void add(std::size_t n) {
+    live += n;
+    ++allocations;
+    if (live > peak) peak = live;
+  }
+  void remove(std::size_t n) { live -= n; }
+};
+
+HeapMeter heap;
+
+// First-fit heap that merges neighbouring frees, like the ESP32's. While
+// active it serves every counted allocation, so measureHeap() can see which
+// free fragments a response leaves behind below what is still live.
+class ArenaHeap {
+ public:
+  static constexpr std::size_t kBytes = 64 * 1024;
+  static constexpr std::size_t kMaxHoles = 256;
+
+  bool active = false;
+
+  void reset() {
+    holes_[0] = Hole{0, kBytes};
+    holeCount_ = 1;
+  }
+  bool owns(const void* p) const {
+    const auto* b = static_cast<const unsigned char*>(p);
+    return b >= bytes_ && b < bytes_ + kBytes;
+  }
+  void* allocate(std::size_t n) {
+    n = roundUp(n);
+    for (std::size_t i = 0; i < holeCount_; ++i) {
+      if (holes_[i].size < n) continue;
+      void* p = bytes_ + holes_[i].offset;
+      holes_[i].offset += n;
+      holes_[i].size -= n;
+      if (holes_[i].size == 0) erase(i);
+      return p;
+    }
+    return nullptr;
+  }
+  void free(void* p, std::size_t n) {
+    n = roundUp(n);
+    const std::size_t offset = static_cast<std::size_t>(static_cast<unsigned char*>(p) - bytes_);
+    std::size_t i = 0;
+    while (i < holeCount_ && holes_[i].offset < offset) ++i;
+    if (i > 0 && holes_[i - 1].offset + holes_[i - 1].size == offset) {
+      holes_[i - 1].size += n;
+      if (i < holeCount_ && holes_[i - 1].offset + holes_[i - 1].size == holes_[i].offset) {
+        holes_[i - 1].size += holes_[i].size;
+        erase(i);
+      }
+      return;
+    }
+    if (i < holeCount_ && offset + n == holes_[i].offset) {
+      holes_[i].offset = offset;
+      holes_[i].size += n;
+      return;
+    }
+    if (holeCount_ == kMaxHoles) std::abort();
+    for (std::size_t j = holeCount_; j > i; --j) holes_[j] = holes_[j - 1];
+    holes_[i] = Hole{offset, n};
+    ++holeCount_;
+  }
+  // Free fragments below the highest live block, and their total size. The
+  // untouched top of the arena does not count.
+  std::size_t holes() const { return holeCount_ - (hasTop() ? 1 : 0); }
+  std::size_t strandedBytes() const {
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < holes(); ++i) total += holes_[i].size;
+    return total;
+  }
+
+ private:
+  struct Hole {
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  static std::size_t roundUp(std::size_t n) { return (n + 15) & ~static_cast<std::size_t>(15); }
+  bool hasTop() const { return holeCount_ > 0 && holes_[holeCount_ - 1].offset + holes_[holeCount_ - 1].size == kBytes; }
+  void erase(std::size_t i) {
+    for (std::size_t j = i + 1; j < holeCount_; ++j) holes_[j - 1] = holes_[j];
+    --holeCount_;
+  }
+
+  alignas(std::max_align_t) unsigned char bytes_[kBytes];
+  Hole holes_[kMaxHoles];
+  std::size_t holeCount_ = 0;
+};
+
+ArenaHeap arena;
+
+// Blocks carry their size in front so frees can be counted.
+void* countedAlloc(std::size_t n) {
+  const std::size_t total = n + sizeof(std::max_align_t);
+  auto* p = static_cast<std::size_t*>(arena.active ? arena.allocate(total) : std::malloc(total));
+  if (p == nullptr) return nullptr;
+  *p = n;
+  heap.add(n);
+  return reinterpret_cast<char*>(p) + sizeof(std::max_align_t);
+}
+
+void countedFree(void* ptr) {
+  if (ptr == nullptr) return;
+  auto* p = reinterpret_cast<std::size_t*>(static_cast<char*>(ptr) - sizeof(std::max_align_t));
+  heap.remove(*p);
+  if (arena.owns(p)) {
+    arena.free(p, *p + sizeof(std::max_align_t));
+  } else {
+    std::free(p);
+  }
+}
+
+template <typename Fn>
+void runBench(const char* name, std::uint32_t iterations, Fn&& fn) {
+  for (std::uint32_t i = 0; i < iterations / 10; ++i) fn();
+  const auto start = std::chrono::steady_clock::now();
+  for (std::uint32_t i = 0; i < iterations; ++i) fn();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  results.push_back({name, iterations, std::chrono::duration<double, std::nano>(elapsed).count() / iterations});
+}
+
+// Totalizer update as it was before the integer counters: two doubles per
+// tick, emulated in software on the ESP32-S3.
+struct LegacyTotals {
+  double pumpedL = 0.0;
+  double hoseL = 0.0;
+  void add(float deltaMl) {
+    pumpedL += deltaMl / 1000.0;
+    hoseL += deltaMl / 1000.0;
+  }
+};
+
+struct NanolitreTotals {
+  std::uint64_t pumpedNl = 0;
+  std::uint64_t hoseNl = 0;
+  float remainderNl = 0.0f;
+  void add(float deltaMl) {
+    const float nl = deltaMl * 1e6f + remainderNl;
+    const std::uint64_t whole = nl < 4.0e9f ? static_cast<std::uint32_t>(nl) : static_cast<std::uint64_t>(nl);
+    remainderNl = nl - static_cast<float>(whole);
+    pumpedNl += whole;
+    hoseNl += whole;
+  }
+};
+
+template <typename Controller>
+void benchTicks(const char* backend, std::uint32_t iterations) {
+  char name[48];
+  Controller flow{pump::Config{}};
+  flow.setSpeed(120.0f);
+  flow.advanceTo(flow.nextEventMs());
+  std::snprintf(name, sizeof(name), "tick_flow_cruise_10ms_%s", backend);
+  runBench(name, iterations, [&]() { flow.tick(10); });
+
+  Controller ramp{pump::Config{}};
+  bool up = true;
+  std::snprintf(name, sizeof(name), "tick_flow_ramp_10ms_%s", backend);
+  runBench(name, iterations, [&]() {
+    if (!ramp.isRamping()) {
+      ramp.setSpeed(up ? 450.0f : 0.0f);
+      up = !up;
+    }
+    ramp.tick(10);
+  });
+
+  Controller dose{pump::Config{}};
+  std::snprintf(name, sizeof(name), "tick_dosing_10ms_%s", backend);
+  runBench(name, iterations, [&]() {
+    if (!dose.state().running) dose.startDosing(100);
+    dose.tick(10);
+  });
+  sinkU64 = flow.state().totalPumpedNl + ramp.state().totalPumpedNl + dose.state().totalPumpedNl;
+}
+
+// Ramps and doses with a five-point calibration curve on both directions, to
+// compare against the scalar tick_*_float rows.
+void benchCurveTicks(std::uint32_t iterations) {
+  pump::CalibrationCurve curve;
+  const float speeds[] = {30.0f, 100.0f, 200.0f, 300.0f, 450.0f};
+  for (float rpm : speeds) curve.setPoint(rpm, 2.8f / (1.0f + 0.0006f * rpm));
+
+  pump::PumpController ramp{pump::Config{}};
+  ramp.setCalibrationCurve(false, curve);
+  ramp.setCalibrationCurve(true, curve);
+  bool up = true;
+  runBench("tick_flow_ramp_10ms_curve", iterations, [&]() {
+    if (!ramp.isRamping()) {
+      ramp.setSpeed(up ? 450.0f : 0.0f);
+      up = !up;
+    }
+    ramp.tick(10);
+  });
+
+  pump::PumpController dose{pump::Config{}};
+  dose.setCalibrationCurve(false, curve);
+  runBench("tick_dosing_10ms_curve", iterations, [&]() {
+    if (!dose.state().running) dose.startDosing(100);
+    dose.tick(10);
+  });
+  float rpm = 0.0f;
+  runBench("curve_speed_for_flow", iterations, [&]() { rpm += ramp.speedForFlow(rpm * 0.001f + 300.0f, false); });
+  sinkU64 = ramp.state().totalPumpedNl + dose.state().totalPumpedNl + static_cast<std::uint64_t>(rpm);
+}
+
+// Ticks N flow motors, half cruising and half ramping between two speeds,
+// as an array of controllers and as a PumpBank.
+template <std::size_t N>
+void benchBank(std::uint32_t iterations) {
+  char name[48];
+  std::vector<pump::PumpController> motors(N, pump::PumpController(pump::Config{}));
+  pump::PumpBank<N> bank{pump::Config{}};
+  for (std::size_t i = 0; i < N; ++i) {
+    motors[i].setSpeed(60.0f + 20.0f * static_cast<float>(i));
+    bank.setSpeed(i, 60.0f + 20.0f * static_cast<float>(i));
+  }
+  std::uint32_t now = 0;
+  std::uint32_t ticks = 0;
+  const auto retarget = [&](std::uint32_t tick) {
+    // Every 20 s the odd motors swap between two speeds.
+    if (tick % 2000 != 0) return;
+    const float speed = (tick / 2000) % 2 == 0 ? 300.0f : 150.0f;
+    for (std::size_t i = 1; i < N; i += 2) {
+      motors[i].setSpeed(speed);
+      bank.setSpeed(i, speed);
+    }
+  };
+  std::snprintf(name, sizeof(name), "tick_%zu_controllers_10ms", N);
+  runBench(name, iterations / N, [&]() {
+    retarget(++ticks);
+    now += 10;
+    for (auto& motor : motors) motor.advanceTo(now);
+  });
+  ticks = 0;
+  std::snprintf(name, sizeof(name), "tick_all_bank%zu_10ms", N);
+  runBench(name, iterations / N, [&]() {
+    retarget(++ticks);
+    bank.tickAll(10);
+  });
+  sinkU64 = motors[N - 1].state().totalPumpedNl + bank.state(N - 1).totalPumpedNl;
+}
+
+// Same command script on both backends in 10 ms ticks; reports how far the
+// fixed-point speed and volume drift from float.
+void reportDivergence(pump::RampProfile profile, const char* label) {
+  pump::Config cfg;
+  cfg.rampProfile = profile;
+  pump::PumpController ref(cfg);
+  pump::FixedPumpController fixed(cfg);
+  const float speeds[] = {450.0f, -120.0f, 33.3f, 0.6f, 0.0f, 275.5f};
+  float maxSpeedDiff = 0.0f;
+  std::uint32_t now = 0;
+  for (const float speed : speeds) {
+    ref.setSpeed(speed);
+    fixed.setSpeed(speed);
+    for (int i = 0; i < 60 * 60 * 100; ++i) {
+      now += 10;
+      ref.advanceTo(now);
+      fixed.advanceTo(now);
+      const float diff = std::fabs(ref.state().currentSpeed - fixed.state().currentSpeed);
+      if (diff > maxSpeedDiff) maxSpeedDiff = diff;
+    }
+  }
+  divergences.push_back({std::string("divergence_") + label, maxSpeedDiff,
+                         static_cast<double>(ref.state().totalPumpedNl) / 1e9,
+                         static_cast<double>(fixed.state().totalPumpedNl) / 1e9, ref.state().totalMotorUptimeSec,
+                         fixed.state().totalMotorUptimeSec});
+}
+
+// Segments handed to lwIP stay allocated until the peer ACKs them; here that
+// is when the next response starts.
+struct InFlightSegments {
+  static constexpr std::size_t kMax = 32;
+  void* held[kMax];
+  std::size_t count = 0;
+
+  void hold(const char* data, std::size_t len) {
+    void* p = countedAlloc(len);
+    if (p == nullptr) std::abort();
+    std::memcpy(p, data, len);
+    if (count < kMax) {
+      held[count++] = p;
+    } else {
+      countedFree(p);
+    }
+  }
+  void release() {
+    for (std::size_t i = 0; i < count; ++i) countedFree(held[i]);
+    count = 0;
+  }
+};
+
+InFlightSegments inFlight;
+
+// Peak heap above what was live before and allocations, for one run of `fn`.
+// A second run on a fresh arena shows the holes it leaves below the segments
+// still in flight.
+template <typename Fn>
+void measureHeap(const char* name, Fn&& fn) {
+  inFlight.release();
+  const std::size_t base = heap.live;
+  const std::uint32_t allocations = heap.allocations;
+  heap.peak = base;
+  fn();
+  const std::size_t peak = heap.peak - base;
+  const std::uint32_t count = heap.allocations - allocations;
+  inFlight.release();
+
+  arena.reset();
+  arena.active = true;
+  fn();
+  const std::size_t holes = arena.holes();
+  const std::size_t stranded = arena.strandedBytes();
+  inFlight.release();
+  arena.active = false;
+  heapResults.push_back({name, peak, count, holes, stranded});
+}
+
+// One GET_STATE response, as setStateResponse() writes it on the expansion
+// board and expansionReadState() applies it on the main board.
+void benchExpansionFrames(std::uint32_t iterations) {
+  pump::PumpController ctrl{pump::Config{}};
+  ctrl.setSpeed(-137.5f);
+  ctrl.advanceTo(3600u * 1000u);
+  std::uint8_t frame[exproto::kStateRespLen];
+  runBench("i2c_state_encode", iterations, [&]() {
+    exproto::encodeState(ctrl.state(), ctrl.config().maxSpeed, frame);
+    sinkU64 = frame[exproto::kStateRespLen - 1];
+  });
+
+  pump::State mirror;
+  float maxSpeed = 0.0f;
+  runBench("i2c_state_decode", iterations, [&]() {
+    sinkU64 = exproto::decodeState(frame, mirror, maxSpeed) ? mirror.totalPumpedNl : 0;
+  });
+}
+
+struct CountingAllocator {
+  void* allocate(std::size_t n) { return countedAlloc(n); }
+  void deallocate(void* p) { countedFree(p); }
+  void* reallocate(void* p, std::size_t n) {
+    void* q = countedAlloc(n);
+    if (q != nullptr && p != nullptr) {
+      const std::size_t old = *reinterpret_cast<std::size_t*>(static_cast<char*>(p) - sizeof(std::max_align_t));
+      std::memcpy(q, p, old < n ? old : n);
+    }
+    countedFree(p);
+    return q;
+  }
+};
+
+using CountedJsonDocument = BasicJsonDocument<CountingAllocator>;
+
+// Copies each write into heap segments of at most one MSS, as tcp_write()
+// does with TCP_WRITE_FLAG_COPY.
+struct SocketSink {
+  void operator()(const char* data, std::size_t len) const {
+    constexpr std::size_t kMss = 1460;
+    for (std::size_t done = 0; done < len;) {
+      const std::size_t n = len - done < kMss ? len - done : kMss;
+      inFlight.hold(data + done, n);
+      done += n;
+    }
+    sinkU64 = sinkU64 + static_cast<std::uint8_t>(data[0]) + len;
+  }
+};
+
+// The firmware's JSON slabs (cfg::kJsonSlabSizes in main.cpp).
+constexpr std::size_t kBenchSlabSizes[] = {256, 256, 256, 256, 1024, 1024, 4096, 4096};
+constexpr std::size_t kBenchSlabBytes = 4 * 256 + 2 * 1024 + 2 * 4096;
+alignas(8) std::uint8_t benchSlabStorage[kBenchSlabBytes];
+pump::JsonSlabPool benchPool(benchSlabStorage, kBenchSlabSizes, sizeof(kBenchSlabSizes) / sizeof(kBenchSlabSizes[0]));
+using BenchPooledDocument = BasicJsonDocument<pump::SlabAllocator<benchPool>>;
+
+// /api/state for a main board with four expansion motors: the same document
+// writeJsonState() builds, minus the WiFi and clock lookups, then serialized.
+void benchStateJson(std::uint32_t iterations) {
+  constexpr std::size_t kMotors = 5;
+  constexpr std::size_t kStateJsonCapacity = 3072;
+  std::vector<pump::PumpController> motors(kMotors, pump::PumpController(pump::Config{}));
+  for (std::size_t i = 0; i < kMotors; ++i) motors[i].setSpeed(40.0f * static_cast<float>(i));
+  motors[2].startDosing(250);
+  for (auto& motor : motors) motor.advanceTo(5000);
+
+  const auto build = [&](JsonDocument& doc) {
+    doc["firmware"] = "0.0.0-bench";
+    doc["motorId"] = 0;
+    doc["motorAlias"] = "Motor 1";
+    doc["selectedMotorId"] = 0;
+    doc["activeMotorCount"] = kMotors;
+    JsonObject expansion = doc.createNestedObject("expansion");
+    expansion["enabled"] = true;
+    expansion["interface"] = "i2c";
+    expansion["motorCount"] = kMotors - 1;
+    expansion["connected"] = true;
+    expansion["address"] = 0x2A;
+    doc["preferredReverse"] = false;
+    doc["uiLanguage"] = "en";
+    pump::writeStateFields(doc.as<JsonObject>(), motors[0]);
+    doc["wifiConnected"] = true;
+    doc["ssid"] = "bench";
+    doc["ip"] = "192.168.1.50";
+    doc["time"] = "12:34:56";
+    JsonArray list = doc.createNestedArray("motors");
+    for (std::size_t i = 0; i < kMotors; ++i) {
+      JsonObject motor = list.createNestedObject();
+      motor["motorId"] = i;
+      motor["alias"] = "Motor";
+      motor["preferredReverse"] = false;
+      pump::writeStateFields(motor, motors[i]);
+    }
+  };
+
+  runBench("state_json_build", iterations, [&]() {
+    DynamicJsonDocument doc(kStateJsonCapacity);
+    build(doc);
+    sinkU64 = doc.memoryUsage();
+  });
+
+  static char out[kStateJsonCapacity];
+  runBench("state_json_build_serialize", iterations, [&]() {
+    DynamicJsonDocument doc(kStateJsonCapacity);
+    build(doc);
+    sinkU64 = serializeJson(doc, out, sizeof(out));
+  });
+
+  // GET /api/state?motorId=3&fields=flowLph: the same writers, most keys skipped.
+  const pump::FieldFilter flowOnly("flowLph");
+  const auto buildFlowOnly = [&](JsonDocument& doc) {
+    doc["motorId"] = 3;
+    pump::writeStateFields(doc.as<JsonObject>(), motors[3], flowOnly);
+    doc["version"] = "5eed0001-42";
+  };
+  runBench("state_fields_build_serialize", iterations, [&]() {
+    DynamicJsonDocument doc(kStateJsonCapacity);
+    buildFlowOnly(doc);
+    sinkU64 = serializeJson(doc, out, sizeof(out));
+  });
+
+  // Whole GET /api/state responses into a stand-in socket that copies like
+  // lwIP does. Before: the text went into a String (std::string here) that
+  // send() then wrote out. Then: sendJson() streams it in 512-byte pieces.
+  // Now: the document also comes from the slab pool instead of the heap.
+  const auto respondString = [&]() {
+    inFlight.release();
+    CountedJsonDocument doc(kStateJsonCapacity);
+    build(doc);
+    std::string text;
+    serializeJson(doc, text);
+    SocketSink()(text.data(), text.size());
+  };
+  const auto respondStream = [&]() {
+    inFlight.release();
+    CountedJsonDocument doc(kStateJsonCapacity);
+    build(doc);
+    sinkU64 = measureJson(doc);
+    pump::BufferedJsonWriter<SocketSink> writer{SocketSink()};
+    serializeJson(doc, writer);
+  };
+  const auto respondPooled = [&]() {
+    inFlight.release();
+    BenchPooledDocument doc(kStateJsonCapacity);
+    build(doc);
+    sinkU64 = measureJson(doc);
+    pump::BufferedJsonWriter<SocketSink> writer{SocketSink()};
+    serializeJson(doc, writer);
+  };
+  // Accept: application/msgpack, as sendPackedState() writes it.
+  static std::uint8_t packed[512];
+  const auto pack = [&]() {
+    pump::MsgPackWriter w(packed, sizeof(packed));
+    w.array(8);
+    w.uint(1);
+    w.uint(1760000000u);
+    w.uint(0);
+    w.uint(kMotors);
+    w.boolean(true);
+    w.boolean(true);
+    w.boolean(true);
+    w.array(kMotors);
+    for (std::size_t i = 0; i < kMotors; ++i) {
+      w.array(2 + pump::kPackedStateFields);
+      w.uint(static_cast<std::uint32_t>(i));
+      w.boolean(false);
+      pump::packStateFields(w, motors[i]);
+    }
+    return w.size();
+  };
+  runBench("state_packed_build", iterations, [&]() { sinkU64 = pack(); });
+  {
+    DynamicJsonDocument doc(kStateJsonCapacity);
+    build(doc);
+    payloadResults.push_back({"state_json", measureJson(doc)});
+    payloadResults.push_back({"state_packed", pack()});
+    DynamicJsonDocument fields(kStateJsonCapacity);
+    buildFlowOnly(fields);
+    payloadResults.push_back({"state_fields", measureJson(fields)});
+  }
+
+  // One motor's Fields snapshot (the dosing one, so every value is set)
+  // three ways: the JSON object writeStateFields() adds to /api/state, the
+  // same object through ArduinoJson's serializeMsgPack(), which keeps the
+  // keys, and the keyless array packStateFields() writes.
+  const pump::PumpController& snapshot = motors[2];
+  static std::uint8_t fieldsOut[1024];
+  const auto buildFields = [&](JsonDocument& doc) { pump::writeStateFields(doc.to<JsonObject>(), snapshot); };
+  const auto packFields = [&]() {
+    pump::MsgPackWriter w(fieldsOut, sizeof(fieldsOut));
+    w.array(pump::kPackedStateFields);
+    pump::packStateFields(w, snapshot);
+    return w.size();
+  };
+  runBench("fields_json_serialize", iterations, [&]() {
+    DynamicJsonDocument doc(1024);
+    buildFields(doc);
+    sinkU64 = serializeJson(doc, reinterpret_cast<char*>(fieldsOut), sizeof(fieldsOut));
+  });
+  runBench("fields_msgpack_serialize", iterations, [&]() {
+    DynamicJsonDocument doc(1024);
+    buildFields(doc);
+    sinkU64 = serializeMsgPack(doc, fieldsOut, sizeof(fieldsOut));
+  });
+  runBench("fields_packed", iterations, [&]() { sinkU64 = packFields(); });
+  {
+    DynamicJsonDocument doc(1024);
+    buildFields(doc);
+    payloadResults.push_back({"fields_json", measureJson(doc)});
+    payloadResults.push_back({"fields_msgpack", measureMsgPack(doc)});
+    payloadResults.push_back({"fields_packed", packFields()});
+  }
+
+  runBench("state_response_string", iterations, respondString);
+  runBench("state_response_stream", iterations, respondStream);
+  runBench("state_response_pooled", iterations, respondPooled);
+  measureHeap("state_response_string", respondString);
+  measureHeap("state_response_stream", respondStream);
+  measureHeap("state_response_pooled", respondPooled);
+  inFlight.release();
+}
+
+void printTable() {
+  std::printf("ArduinoJson %s\n", ARDUINOJSON_VERSION);
+  for (const auto& r : results) {
+    std::printf("%-28s %10u iters %10.2f ns/op %12.0f ops/s\n", r.name.c_str(), r.iterations, r.nsPerOp, 1e9 / r.nsPerOp);
+  }
+  for (const auto& d : divergences) {
+    std::printf("%-28s max_speed_diff %.6f rpm, volume %.3f L vs %.3f L (rel %.2e), uptime %u vs %u s\n", d.name.c_str(),
+                d.maxSpeedDiff, d.refL, d.fixedL, std::fabs(d.fixedL - d.refL) / d.refL, d.refUptimeSec,
+                d.fixedUptimeSec);
+  }
+  for (const auto& h : heapResults) {
+    std::printf("%-28s peak heap %8zu bytes, %4u allocations, %3zu holes (%zu bytes) left behind\n", h.name.c_str(),
+                h.peakBytes, h.allocations, h.holes, h.strandedBytes);
+  }
+  for (const auto& p : payloadResults) std::printf("%-28s payload %10zu bytes\n", p.name.c_str(), p.bytes);
+}
+
+// Names are plain identifiers, so no escaping is needed.
+void printJson() {
+  std::printf("{\"schema\":1,\"arduinojson\":\"%s\",\"results\":[", ARDUINOJSON_VERSION);
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    std::printf("%s\n{\"name\":\"%s\",\"iterations\":%u,\"ns_per_op\":%.3f,\"ops_per_sec\":%.0f}", i ? "," : "",
+                r.name.c_str(), r.iterations, r.nsPerOp, 1e9 / r.nsPerOp);
+  }
+  std::printf("],\"divergence\":[");
+  for (std::size_t i = 0; i < divergences.size(); ++i) {
+    const auto& d = divergences[i];
+    std::printf("%s\n{\"name\":\"%s\",\"max_speed_diff_rpm\":%.6f,\"volume_l\":%.6f,\"fixed_volume_l\":%.6f,"
+                "\"uptime_sec\":%u,\"fixed_uptime_sec\":%u}",
+                i ? "," : "", d.name.c_str(), d.maxSpeedDiff, d.refL, d.fixedL, d.refUptimeSec, d.fixedUptimeSec);
+  }
+  std::printf("],\"heap\":[");
+  for (std::size_t i = 0; i < heapResults.size(); ++i) {
+    const auto& h = heapResults[i];
+    std::printf("%s\n{\"name\":\"%s\",\"peak_bytes\":%zu,\"allocations\":%u,\"holes\":%zu,\"stranded_bytes\":%zu}",
+                i ? "," : "", h.name.c_str(), h.peakBytes, h.allocations, h.holes, h.strandedBytes);
+  }
+  std::printf("],\"payload\":[");
+  for (std::size_t i = 0; i < payloadResults.size(); ++i) {
+    std::printf("%s\n{\"name\":\"%s\",\"bytes\":%zu}", i ? "," : "", payloadResults[i].name.c_str(),
+                payloadResults[i].bytes);
+  }
+  std::printf("]}\n");
+}
+
+}  // namespace
+
+void* operator new(std::size_t n) {
+  void* p = countedAlloc(n);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete(void* p, std::size_t) noexcept { countedFree(p); }
+
+int main(int argc, char** argv) {
+  const bool json = argc > 1 && std::strcmp(argv[1], "--json") == 0;
+  const std::uint32_t iterations = 5000000;
+
+  LegacyTotals legacy;
+  runBench("totals_double_add", iterations, [&]() { legacy.add(tickMl); });
+  sinkDouble = legacy.pumpedL + legacy.hoseL;
+
+  NanolitreTotals nl;
+  runBench("totals_u64_nl_add", iterations, [&]() { nl.add(tickMl); });
+  sinkU64 = nl.pumpedNl + nl.hoseNl;
+
+  benchTicks<pump::PumpController>("float", iterations);
+  benchTicks<pump::FixedPumpController>("q16", iterations);
+  benchCurveTicks(iterations);
+  benchBank<4>(iterations);
+  benchBank<16>(iterations);
+  benchExpansionFrames(iterations);
+  benchStateJson(iterations / 50);
+  reportDivergence(pump::RampProfile::LINEAR, "linear_6h");
+  reportDivergence(pump::RampProfile::S_CURVE, "s_curve_6h");
+  if (json) {
+    printJson();
+  } else {
+    printTable();
+  }
+  return 0;
+}
@@ -1,10 +1,13 @@
 #include <Arduino.h>
 #include <Wire.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include <array>
 #include <cmath>
 
-#include "PumpController.h"
+#include "ExpansionProtocol.h"
+#include "PumpBank.h"
 
 namespace cfg {
 constexpr uint8_t kMotorCount = 4;
@@ -12,6 +15,9 @@ constexpr uint8_t kI2cAddress = 0x2A;
 constexpr uint8_t kI2cSda = 8;
 constexpr uint8_t kI2cScl = 9;
 constexpr uint16_t kControlTickMs = 10;
+// With every motor cruising or idle the loop waits for the next event, up to
+// this long. I2C commands catch the bank up themselves.
+constexpr uint16_t kControlIdleMs = 1000;
 constexpr int kMicroStepping = 8;
 constexpr float kStepAngleDeg = 1.8f;
 constexpr int kLedcResolutionBits = 8;
@@ -27,38 +33,50 @@ constexpr std::array<uint8_t, kMotorCount> kPinEnable = {13, 12, 2, 5};
 #endif
 }  // namespace cfg
 
-namespace exproto {
-constexpr uint8_t kMagicA = 0x50;
-constexpr uint8_t kMagicB = 0x58;
-constexpr uint8_t kProtoVer = 1;
-constexpr uint8_t kCmdHello = 0x01;
-constexpr uint8_t kCmdGetState = 0x10;
-constexpr uint8_t kCmdSetFlow = 0x20;
-constexpr uint8_t kCmdStartDosing = 0x21;
-constexpr uint8_t kCmdStop = 0x22;
-constexpr uint8_t kCmdStart = 0x23;
-constexpr uint8_t kCmdSetSettings = 0x24;
-}  // namespace exproto
-
-std::array<pump::PumpController, cfg::kMotorCount> controllers = {
-    pump::PumpController(pump::Config{}),
-    pump::PumpController(pump::Config{}),
-    pump::PumpController(pump::Config{}),
-    pump::PumpController(pump::Config{}),
+const float kStepsPerRevolution = (360.0f / cfg::kStepAngleDeg) * cfg::kMicroStepping;
+
+pump::Config controllerConfig() {
+  pump::Config conf;
+  conf.stepsPerRev = kStepsPerRevolution;
+  return conf;
+}
+
+// Build with -DPUMP_FIXED_POINT to run the flow path in Q16.16.
+#ifdef PUMP_FIXED_POINT
+using MotorNum = pump::Q16x16;
+#else
+using MotorNum = float;
+#endif
+
+pump::PumpBank<cfg::kMotorCount, MotorNum> motors(controllerConfig());
+
+// Wire runs onReceive in its own task, so an I2C command and the control
+// tick in loop() take this before touching `motors`. Each reads millis()
+// once it holds it, so the bank's clock only moves forward.
+SemaphoreHandle_t motorsMutex = nullptr;
+
+class MotorsLock {
+ public:
+  MotorsLock() : held_(motorsMutex != nullptr && xSemaphoreTake(motorsMutex, portMAX_DELAY) == pdTRUE) {}
+  ~MotorsLock() {
+    if (held_) xSemaphoreGive(motorsMutex);
+  }
+  MotorsLock(const MotorsLock&) = delete;
+  MotorsLock& operator=(const MotorsLock&) = delete;
+
+ private:
+  bool held_;
 };
 
 uint32_t lastControlMs = 0;
-const float kStepsPerRevolution = (360.0f / cfg::kStepAngleDeg) * cfg::kMicroStepping;
+// Set under motorsMutex; loop() reads it without the lock to decide whether
+// to take it.
+volatile uint32_t nextControlMs = 0;
+std::array<float, cfg::kMotorCount> appliedSpeed = {};
 
 uint8_t txBuffer[40] = {0};
 size_t txLen = 0;
 
-uint8_t frameCrc(const uint8_t* data, size_t lenWithoutCrc) {
-  uint8_t crc = 0;
-  for (size_t i = 0; i < lenWithoutCrc; ++i) crc ^= data[i];
-  return crc;
-}
-
 float speedToFrequency(float speed) {
   return fabsf(speed) * kStepsPerRevolution / 60.0f;
 }
@@ -76,7 +94,7 @@ void setDriverFrequencyHz(uint8_t motor, float freqHz) {
 }
 
 void applyMotorSpeed(uint8_t motor, float speed) {
-  const auto& conf = controllers[motor].config();
+  const auto& conf = motors.config(motor);
   if (fabsf(speed) < conf.minSpeed) {
     setDriverFrequencyHz(motor, 0);
     return;
@@ -85,54 +103,29 @@ void applyMotorSpeed(uint8_t motor, float speed) {
   setDriverFrequencyHz(motor, speedToFrequency(speed));
 }
 
-void encodeU16(uint8_t* out, int pos, uint16_t v) {
-  out[pos] = static_cast<uint8_t>(v & 0xFF);
-  out[pos + 1] = static_cast<uint8_t>((v >> 8) & 0xFF);
-}
-
-void encodeU32(uint8_t* out, int pos, uint32_t v) {
-  out[pos] = static_cast<uint8_t>(v & 0xFF);
-  out[pos + 1] = static_cast<uint8_t>((v >> 8) & 0xFF);
-  out[pos + 2] = static_cast<uint8_t>((v >> 16) & 0xFF);
-  out[pos + 3] = static_cast<uint8_t>((v >> 24) & 0xFF);
-}
-
 uint16_t decodeU16(const uint8_t* in, int pos) {
   return static_cast<uint16_t>(in[pos]) | (static_cast<uint16_t>(in[pos + 1]) << 8);
 }
 
 void setHelloResponse() {
-  txLen = 6;
+  txLen = exproto::kHelloRespLen;
   txBuffer[0] = exproto::kMagicA;
   txBuffer[1] = exproto::kMagicB;
   txBuffer[2] = exproto::kProtoVer;
   txBuffer[3] = cfg::kMotorCount;
   txBuffer[4] = 0;
-  txBuffer[5] = frameCrc(txBuffer, 5);
+  txBuffer[5] = exproto::frameCrc(txBuffer, 5);
 }
 
 void setStateResponse(uint8_t motor) {
-  const auto& st = controllers[motor].state();
-  txLen = 29;
-  txBuffer[0] = (st.mode == pump::Mode::DOSING) ? 1 : 0;
-  txBuffer[1] = st.running ? 1 : 0;
-  encodeU16(txBuffer, 2, static_cast<uint16_t>(static_cast<int16_t>(roundf(st.targetSpeed * 10.0f))));
-  encodeU16(txBuffer, 4, static_cast<uint16_t>(static_cast<int16_t>(roundf(st.currentSpeed * 10.0f))));
-  encodeU16(txBuffer, 6, static_cast<uint16_t>(roundf(fmaxf(st.dosingRemainingMl, 0.0f))));
-  encodeU32(txBuffer, 8, st.totalMotorUptimeSec);
-  encodeU32(txBuffer, 12, static_cast<uint32_t>(round(st.totalPumpedVolumeL * 1000.0)));
-  encodeU32(txBuffer, 16, static_cast<uint32_t>(round(st.totalHoseVolumeL * 1000.0)));
-  encodeU16(txBuffer, 20, static_cast<uint16_t>(roundf(st.mlPerRevCw * 100.0f)));
-  encodeU16(txBuffer, 22, static_cast<uint16_t>(roundf(st.mlPerRevCcw * 100.0f)));
-  encodeU16(txBuffer, 24, static_cast<uint16_t>(roundf(st.dosingSpeed * 10.0f)));
-  encodeU16(txBuffer, 26, static_cast<uint16_t>(roundf(controllers[motor].config().maxSpeed * 10.0f)));
-  txBuffer[28] = frameCrc(txBuffer, 28);
+  txLen = exproto::kStateRespLen;
+  exproto::encodeState(motors.state(motor), motors.config(motor).maxSpeed, txBuffer);
 }
 
 void handleFrame(const uint8_t* frame, size_t len) {
   txLen = 0;
   if (len < 2) return;
-  if (frame[len - 1] != frameCrc(frame, len - 1)) return;
+  if (frame[len - 1] != exproto::frameCrc(frame, len - 1)) return;
 
   const uint8_t cmd = frame[0];
   if (cmd == exproto::kCmdHello) {
@@ -143,7 +136,8 @@ void handleFrame(const uint8_t* frame, size_t len) {
 
   const uint8_t motor = frame[1];
   if (motor >= cfg::kMotorCount) return;
-  auto& ctrl = controllers[motor];
+  // Catch up before reporting counters or applying a command.
+  motors.advanceAllTo(millis());
 
   if (cmd == exproto::kCmdGetState) {
     setStateResponse(motor);
@@ -152,25 +146,22 @@ void handleFrame(const uint8_t* frame, size_t len) {
   if (cmd == exproto::kCmdSetFlow && len >= 6) {
     const uint16_t lphX10 = decodeU16(frame, 2);
     const bool reverse = frame[4] != 0;
-    const auto& st = ctrl.state();
     const float lph = static_cast<float>(lphX10) / 10.0f;
-    const float mlPerRev = reverse ? st.mlPerRevCcw : st.mlPerRevCw;
-    const float speed = (lph * 1000.0f / 60.0f) / mlPerRev * (reverse ? -1.0f : 1.0f);
-    ctrl.setSpeed(speed, pump::Mode::FLOW);
+    motors.setSpeed(motor, motors.speedForFlow(motor, lph * 1000.0f / 60.0f, reverse), pump::Mode::FLOW);
     return;
   }
   if (cmd == exproto::kCmdStartDosing && len >= 6) {
     const uint16_t volume = decodeU16(frame, 2);
     const bool reverse = frame[4] != 0;
-    ctrl.startDosing(reverse ? -static_cast<int32_t>(volume) : static_cast<int32_t>(volume));
+    motors.startDosing(motor, reverse ? -static_cast<int32_t>(volume) : static_cast<int32_t>(volume));
     return;
   }
   if (cmd == exproto::kCmdStop) {
-    ctrl.stop(false);
+    motors.stop(motor, false);
     return;
   }
   if (cmd == exproto::kCmdStart) {
-    ctrl.start();
+    motors.start(motor);
     return;
   }
   if (cmd == exproto::kCmdSetSettings && len >= 11) {
@@ -178,17 +169,31 @@ void handleFrame(const uint8_t* frame, size_t len) {
     const float mlCcw = static_cast<float>(decodeU16(frame, 4)) / 100.0f;
     const float dosingFlowLph = static_cast<float>(decodeU16(frame, 6)) / 10.0f;
     const float maxFlowLph = static_cast<float>(decodeU16(frame, 8)) / 10.0f;
-    if (mlCw > 0.0f || mlCcw > 0.0f) ctrl.setMlPerRev(mlCw, mlCcw);
-    if (dosingFlowLph > 0.0f) {
-      const float refMlPerRev = ctrl.state().mlPerRevCw > 0.0f ? ctrl.state().mlPerRevCw : 2.6f;
-      ctrl.setDosingSpeed((dosingFlowLph * 1000.0f / 60.0f) / refMlPerRev);
-    }
-    if (maxFlowLph > 0.0f) {
-      const float refMlPerRev = ctrl.state().mlPerRevCw > 0.0f ? ctrl.state().mlPerRevCw : 2.6f;
-      ctrl.setMaxSpeed((maxFlowLph * 1000.0f / 60.0f) / refMlPerRev);
+    if (mlCw > 0.0f || mlCcw > 0.0f) motors.setMlPerRev(motor, mlCw, mlCcw);
+    // Flows are forward; the curve, if any, maps them back to rpm.
+    if (dosingFlowLph > 0.0f) motors.setDosingSpeed(motor, motors.speedForFlow(motor, dosingFlowLph * 1000.0f / 60.0f, false));
+    if (maxFlowLph > 0.0f) motors.setMaxSpeed(motor, motors.speedForFlow(motor, maxFlowLph * 1000.0f / 60.0f, false));
+    // Centrals before the ramp profile byte send 11-byte frames.
+    if (len >= 12) {
+      motors.setRampProfile(motor, frame[10] == static_cast<uint8_t>(pump::RampProfile::S_CURVE)
+                                       ? pump::RampProfile::S_CURVE
+                                       : pump::RampProfile::LINEAR);
     }
     return;
   }
+  if (cmd == exproto::kCmdSetCurve) {
+    uint8_t curveMotor = 0;
+    bool reverse = false;
+    pump::CalibrationCurve curve;
+    if (exproto::decodeCurve(frame, len, curveMotor, reverse, curve)) motors.setCalibrationCurve(motor, reverse, curve);
+    return;
+  }
+  if (cmd == exproto::kCmdStartRevolutions && len >= 7) {
+    const float revolutions = static_cast<float>(decodeU16(frame, 2)) / 10.0f;
+    const float speed = static_cast<float>(static_cast<int16_t>(decodeU16(frame, 4))) / 10.0f;
+    motors.startRevolutions(motor, revolutions, speed);
+    return;
+  }
 }
 
 void onI2cReceive(int len) {
@@ -198,7 +203,10 @@ void onI2cReceive(int len) {
   while (Wire.available() && i < len) {
     buf[i++] = Wire.read();
   }
+  MotorsLock lock;
   handleFrame(buf, static_cast<size_t>(i));
+  // A command may have started a ramp: tick on the normal period.
+  nextControlMs = lastControlMs + cfg::kControlTickMs;
 }
 
 void onI2cRequest() {
@@ -219,19 +227,42 @@ void setup() {
     ledcAttachPin(cfg::kPinStep[i], i);
   }
 
+  motorsMutex = xSemaphoreCreateMutex();
+  lastControlMs = millis();
+  nextControlMs = lastControlMs;
+  motors.advanceAllTo(lastControlMs);
+  // Commands may arrive from here on.
   Wire.begin(cfg::kI2cAddress, cfg::kI2cSda, cfg::kI2cScl, 400000);
   Wire.onReceive(onI2cReceive);
   Wire.onRequest(onI2cRequest);
-  lastControlMs = millis();
+}
+
+// Every kControlTickMs while a motor's speed changes, else at the soonest
+// event of any motor (at least one tick period on), else kControlIdleMs on.
+uint32_t controlTickDueMs() {
+  const uint32_t soonest = lastControlMs + cfg::kControlTickMs;
+  uint32_t waitMs = cfg::kControlIdleMs;
+  for (uint8_t i = 0; i < cfg::kMotorCount; ++i) {
+    if (motors.isRamping(i)) return soonest;
+    const uint32_t event = motors.nextEventMs(i);
+    if (event == pump::kNoEvent) continue;
+    const uint32_t until = event - lastControlMs;
+    if (static_cast<int32_t>(until) >= 0 && until < waitMs) waitMs = until;
+  }
+  return lastControlMs + (waitMs > cfg::kControlTickMs ? waitMs : cfg::kControlTickMs);
 }
 
 void loop() {
-  const uint32_t now = millis();
-  if (now - lastControlMs < cfg::kControlTickMs) return;
-  const uint32_t delta = now - lastControlMs;
-  lastControlMs = now;
+  if (static_cast<int32_t>(millis() - nextControlMs) < 0) return;
+  MotorsLock lock;
+  lastControlMs = millis();
+  motors.advanceAllTo(lastControlMs);
   for (uint8_t i = 0; i < cfg::kMotorCount; ++i) {
-    controllers[i].tick(delta);
-    applyMotorSpeed(i, controllers[i].state().currentSpeed);
+    // Cruising or idle: keep the LEDC tone running instead of rewriting it.
+    const float speed = motors.state(i).currentSpeed;
+    if (speed == appliedSpeed[i]) continue;
+    appliedSpeed[i] = speed;
+    applyMotorSpeed(i, speed);
   }
+  nextControlMs = controlTickDueMs();
 }
@@ -8,6 +8,7 @@
 #include <array>
 #include <cmath>
 #include <cstring>
+#include <vector>
 #include <HTTPClient.h>
 #include <time.h>
 #include <Wire.h>
@@ -16,8 +17,30 @@
 #include <WiFiManager.h>
 #include <Update.h>
 #include <WiFiClientSecure.h>
-
+#include <atomic>
+#include <driver/gpio.h>
+#include <driver/pcnt.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+
+#include "ConfigBlob.h"
+#include "CounterJournal.h"
+#include "EventThrottle.h"
+#include "ExpansionProtocol.h"
+#include "JsonSlabPool.h"
+#include "JsonWriter.h"
+#include "LegacyConfig.h"
+#include "LoopStats.h"
+#include "Metrics.h"
+#include "PersistCache.h"
+#include "PulseBudget.h"
 #include "PumpController.h"
+#include "StateJson.h"
+#include "StaticAssets.h"
+#include "TraceRing.h"
 
 namespace cfg {
 constexpr char kFirmwareVersion[] = "0.2.11-esp32";
@@ -48,10 +71,70 @@ constexpr uint16_t kOledRefreshMs = 500;
 
 constexpr int kLedcChannel = 0;
 constexpr int kLedcResolutionBits = 8;
+// Counts the STEP pulses of motor 0 to end doses on their last planned step.
+constexpr pcnt_unit_t kStepPcntUnit = PCNT_UNIT_0;
+// Tone for pulses a finished dose still owes: 200 steps/s at 1/8 stepping,
+// about where the plan's own last steps run.
+constexpr float kStepFinishRpm = 7.5f;
 constexpr int kMicroStepping = 8;
 constexpr float kStepAngleDeg = 1.8f;
 constexpr uint16_t kControlTickMs = 10;
+// Cruising or idle the tick only waits for the controller's next event, but
+// runs at least this often so counters and the OLED keep moving.
+constexpr uint16_t kControlIdleMs = 250;
 constexpr uint16_t kSavePeriodMs = 5000;
+// Uptime and volume counters change every tick; journaling them this rarely
+// bounds flash wear at the cost of up to a minute of counts on power loss.
+constexpr uint32_t kCounterSavePeriodMs = 60000;
+// Journal size that triggers a new checkpoint, about 200 records.
+constexpr size_t kCounterJournalMaxBytes = 4096;
+// Flash writes run in their own task so they never stall loop(). It sits on
+// core 0 with the Wi-Fi stack, below every other task but idle.
+constexpr uint32_t kPersistTaskStackBytes = 8192;
+constexpr UBaseType_t kPersistTaskPriority = tskIDLE_PRIORITY + 1;
+constexpr BaseType_t kPersistTaskCore = 0;
+constexpr uint32_t kPersistFlushTimeoutMs = 2000;
+// The API is served from its own task too, so a slow client or a GitHub/OTA
+// request never holds up the control tick. TLS needs the larger stack.
+constexpr uint32_t kHttpTaskStackBytes = 12288;
+constexpr UBaseType_t kHttpTaskPriority = tskIDLE_PRIORITY + 1;
+constexpr BaseType_t kHttpTaskCore = 0;
+constexpr uint32_t kHttpPollMs = 2;
+// /api/events: open streams, how often state is compared against what they
+// were last sent (a ramp changes it every tick), and the keep-alive period.
+constexpr uint8_t kMaxEventClients = 4;
+constexpr uint32_t kEventMinIntervalMs = 250;
+constexpr uint32_t kEventKeepAliveMs = 15000;
+// One system or motor event.
+constexpr size_t kEventJsonCapacity = 512;
+// Text of one push, a system event and every motor at most (about 2.5 KB).
+constexpr size_t kEventBufferBytes = 4096;
+// API documents are lent from these instead of the heap: small and error
+// docs, request bodies, then /api/state-sized ones. Larger requests (the
+// GitHub release lists) still fall back to the heap.
+constexpr size_t kJsonSlabSizes[] = {256, 256, 256, 256, 1024, 1024, 4096, 4096};
+constexpr size_t kJsonSlabCount = sizeof(kJsonSlabSizes) / sizeof(kJsonSlabSizes[0]);
+constexpr size_t sumOf(const size_t* v, size_t n) { return n == 0 ? 0 : v[0] + sumOf(v + 1, n - 1); }
+constexpr size_t kJsonSlabBytes = sumOf(kJsonSlabSizes, kJsonSlabCount);
+// Fingerprinted UI assets (app.<hash>.js) never change under their name.
+constexpr const char* kImmutableCacheControl = "public, max-age=31536000, immutable";
+constexpr uint8_t kAssetEtagSlots = 4;
+// Top-level state plus one object per motor; 2048 overflowed with all expansion motors.
+constexpr size_t kStateJsonCapacity = 3072;
+// Packed /api/state: layout version (bump when values move) and buffer.
+constexpr uint8_t kPackedStateVersion = 1;
+constexpr size_t kPackedStateBytes = 512;
+// /api/batch: commands per request, and the body holding them.
+constexpr uint8_t kMaxBatchCommands = 16;
+constexpr size_t kBatchJsonCapacity = 2048;
+// /metrics: routes counted by name (later ones go uncounted), and histogram
+// bucket bounds in microseconds. A pass is mostly under a millisecond; the
+// control tick is due every 10 ms.
+constexpr uint8_t kMaxHttpRoutes = 32;
+constexpr std::array<uint32_t, 10> kLoopPassBuckets = {{100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000}};
+constexpr std::array<uint32_t, 8> kTickIntervalBuckets = {{9900, 10100, 10500, 11000, 12500, 15000, 20000, 50000}};
+// /api/trace ring: 12 bytes an event, a few seconds of a busy loop.
+constexpr size_t kTraceEvents = 1024;
 constexpr uint8_t kMaxSchedules = 8;
 constexpr uint8_t kMaxScheduleNameLen = 32;
 constexpr uint8_t kBaseMotors = 1;
@@ -67,38 +150,163 @@ constexpr uint16_t kFirmwareReleaseDocBytes = 32768;
 constexpr char kDefaultFirmwareRepo[] = "dslimp/peristaltic-pump";
 constexpr char kDefaultFirmwareAsset[] = "firmware.bin";
 constexpr char kDefaultFirmwareFsAsset[] = "littlefs.bin";
+constexpr char kConfigKey[] = "config";
+constexpr char kCounterStashKey[] = "ctr_stash";
+constexpr const char* kCounterCheckpointPaths[] = {"/counters.a", "/counters.b"};
+constexpr char kLegacyCounterCheckpointPath[] = "/counters.bin";
+constexpr char kCounterJournalPath[] = "/counters.log";
 }  // namespace cfg
 
-namespace exproto {
-constexpr uint8_t kMagicA = 0x50;  // 'P'
-constexpr uint8_t kMagicB = 0x58;  // 'X'
-constexpr uint8_t kProtoVer = 1;
-constexpr uint8_t kCmdHello = 0x01;
-constexpr uint8_t kCmdGetState = 0x10;
-constexpr uint8_t kCmdSetFlow = 0x20;
-constexpr uint8_t kCmdStartDosing = 0x21;
-constexpr uint8_t kCmdStop = 0x22;
-constexpr uint8_t kCmdStart = 0x23;
-constexpr uint8_t kCmdSetSettings = 0x24;
-constexpr uint8_t kHelloRespLen = 6;
-constexpr uint8_t kStateRespLen = 29;
-}  // namespace exproto
-
-WebServer server(80);
+static_assert(cfg::kMaxMotors == pump::kStoredMotors, "StoredConfig motor count");
+static_assert(cfg::kMaxSchedules == pump::kStoredSchedules, "StoredConfig schedule count");
+static_assert(cfg::kMaxScheduleNameLen < sizeof(pump::StoredSchedule::name), "StoredSchedule name length");
+
+const float kStepsPerRevolution = (360.0f / cfg::kStepAngleDeg) * cfg::kMicroStepping;
+
+pump::Config controllerConfig() {
+  pump::Config conf;
+  conf.stepsPerRev = kStepsPerRevolution;
+  return conf;
+}
+
+// Held by loop() for a pass and by the HTTP task for one API handler, so the
+// two never touch controllers, settings or schedules at the same time.
+SemaphoreHandle_t stateMutex = nullptr;
+TaskHandle_t httpTask = nullptr;
+std::atomic<bool> apiWaiting(false);
+
+class StateLock {
+ public:
+  StateLock() : held_(stateMutex != nullptr && xSemaphoreTake(stateMutex, portMAX_DELAY) == pdTRUE) {}
+  ~StateLock() {
+    if (held_) xSemaphoreGive(stateMutex);
+  }
+  StateLock(const StateLock&) = delete;
+  StateLock& operator=(const StateLock&) = delete;
+
+ private:
+  bool held_;
+};
+
+// Lets loop() carry on while a handler waits on the network. Does nothing
+// unless the calling task holds the lock.
+class StateUnlock {
+ public:
+  StateUnlock()
+      : released_(stateMutex != nullptr && xSemaphoreGetMutexHolder(stateMutex) == xTaskGetCurrentTaskHandle() &&
+                  xSemaphoreGive(stateMutex) == pdTRUE) {}
+  ~StateUnlock() {
+    if (released_) xSemaphoreTake(stateMutex, portMAX_DELAY);
+  }
+  StateUnlock(const StateUnlock&) = delete;
+  StateUnlock& operator=(const StateUnlock&) = delete;
+
+ private:
+  bool released_;
+};
+
+// Requests per registered route, for /metrics. Only the task serving HTTP
+// touches these.
+struct HttpRouteCount {
+  String uri;
+  HTTPMethod method = HTTP_GET;
+  uint32_t requests = 0;
+};
+std::array<HttpRouteCount, cfg::kMaxHttpRoutes> httpRoutes;
+uint8_t httpRouteCount = 0;
+uint32_t httpUnmatchedRequests = 0;
+
+// Recent events of the control tick, the driver, I2C, schedules, NVS and
+// HTTP, for /api/trace. Any task records into it.
+pump::TraceRing<cfg::kTraceEvents> traceRing;
+constexpr uint8_t kUnmatchedRouteId = 0xff;
+
+void trace(pump::TraceType type, uint8_t id = 0, uint16_t arg = 0, uint32_t value = 0) {
+  traceRing.record(micros(), type, id, arg, value);
+}
+
+void catchUpLocalMotor();
+
+// WebServer whose /api/ handlers run under the state lock. Static assets
+// only read LittleFS and stream without it. Every route counts its requests
+// and traces them.
+class LockedWebServer : public WebServer {
+ public:
+  using WebServer::WebServer;
+
+  void on(const String& uri, HTTPMethod method, THandlerFunction fn) {
+    WebServer::on(uri, method, instrumented(uri, method, uri.startsWith("/api/") ? locked(fn) : fn));
+  }
+  void onNotFound(THandlerFunction fn) {
+    WebServer::onNotFound([fn]() {
+      ++httpUnmatchedRequests;
+      trace(pump::TraceType::kHttpBegin, kUnmatchedRouteId);
+      fn();
+      trace(pump::TraceType::kHttpEnd, kUnmatchedRouteId);
+    });
+  }
+
+ private:
+  static THandlerFunction instrumented(const String& uri, HTTPMethod method, THandlerFunction fn) {
+    if (httpRouteCount == httpRoutes.size()) return fn;
+    const uint8_t id = httpRouteCount++;
+    HttpRouteCount& route = httpRoutes[id];
+    route.uri = uri;
+    route.method = method;
+    return [fn, id]() {
+      ++httpRoutes[id].requests;
+      trace(pump::TraceType::kHttpBegin, id);
+      fn();
+      trace(pump::TraceType::kHttpEnd, id);
+    };
+  }
+  static THandlerFunction locked(THandlerFunction fn) {
+    return [fn]() {
+      apiWaiting = true;
+      StateLock lock;
+      apiWaiting = false;
+      catchUpLocalMotor();
+      fn();
+    };
+  }
+};
+
+LockedWebServer server(80);
+alignas(8) uint8_t jsonSlabStorage[cfg::kJsonSlabBytes];
+pump::JsonSlabPool jsonPool(jsonSlabStorage, cfg::kJsonSlabSizes, cfg::kJsonSlabCount);
+// Every document built while serving a request. Only the HTTP task creates
+// them, so the pool needs no lock.
+using PooledJsonDocument = BasicJsonDocument<pump::SlabAllocator<jsonPool>>;
 Preferences prefs;
 WiFiManager wifiManager;
 std::array<pump::PumpController, cfg::kMaxMotors> controllers = {
-    pump::PumpController(pump::Config{}),
-    pump::PumpController(pump::Config{}),
-    pump::PumpController(pump::Config{}),
-    pump::PumpController(pump::Config{}),
-    pump::PumpController(pump::Config{}),
+    pump::PumpController(controllerConfig()),
+    pump::PumpController(controllerConfig()),
+    pump::PumpController(controllerConfig()),
+    pump::PumpController(controllerConfig()),
+    pump::PumpController(controllerConfig()),
 };
 Adafruit_SSD1306 oled(cfg::kOledWidth, cfg::kOledHeight, &Wire, -1);
 
-const float kStepsPerRevolution = (360.0f / cfg::kStepAngleDeg) * cfg::kMicroStepping;
 uint32_t lastControlMs = 0;
+uint32_t lastControlMicros = 0;
+float appliedMotorSpeed = 0.0f;
+// Motor 0's dose pulse budget. The counter ISR takes the STEP pin off the
+// LEDC on the plan's last step, so the driver gets exactly totalSteps()
+// pulses however the control ticks fell; the tone only sets their pace.
+pump::PulseBudget stepBudget;
+portMUX_TYPE stepBudgetMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool stepGateClosed = false;
+uint32_t stepPlanId = 0;
+uint32_t stepDosesFinished = 0;
+// The plan ended before the pin caught up; owed pulses go out at
+// kStepFinishRpm until the gate closes.
+bool stepFinishing = false;
+bool stepFinishReverse = false;
+uint32_t stepBudgetsArmed = 0;
+uint64_t stepsBudgeted = 0;
 uint32_t lastSaveMs = 0;
+uint32_t lastCounterSaveMs = 0;
 uint32_t lastOledMs = 0;
 bool oledReady = false;
 std::array<bool, cfg::kMaxMotors> preferredReverse = {false, false, false, false, false};
@@ -121,6 +329,16 @@ bool expansionConnected = false;
 uint8_t expansionI2cAddress = 0;
 uint32_t lastExpansionDiscoveryMs = 0;
 uint32_t lastExpansionPollMs = 0;
+// /api/state version, bumped whenever a request finds the reported state
+// changed. The boot tag keeps ETags from before a restart from matching.
+// Each part remembers the version it last changed at, for ?since=.
+uint32_t stateVersion = 0;
+uint32_t stateBootTag = 0;
+uint32_t systemFingerprint = 0;
+uint32_t systemVersion = 0;
+std::array<uint32_t, cfg::kMaxMotors> motorFingerprints = {};
+std::array<uint32_t, cfg::kMaxMotors> motorVersions = {};
+uint8_t versionedMotorCount = 0;
 
 struct DoseScheduleEntry {
   bool enabled = false;
@@ -136,10 +354,39 @@ struct DoseScheduleEntry {
 
 DoseScheduleEntry doseSchedules[cfg::kMaxSchedules];
 int tzOffsetMinutes = 0;
+pump::PersistCache persistCache;
+pump::SaveStats settingsSaveStats;
+pump::SaveStats counterSaveStats;
+pump::CounterJournal counterJournal;
+bool counterJournalReady = false;
+bool counterCheckpointsDamaged = false;
+size_t counterJournalBytes = 0;
+pump::LoopStats loopStats(cfg::kControlTickMs * 1000u);
+pump::Histogram<10> loopPassHistogram(cfg::kLoopPassBuckets);
+pump::Histogram<8> tickIntervalHistogram(cfg::kTickIntervalBuckets);
+// More /metrics counters, all written under the state lock.
+uint32_t i2cTransactions = 0;
+uint32_t i2cErrors = 0;
+std::array<uint32_t, cfg::kMaxMotors> doseCounts = {};
+uint32_t scheduleTriggers = 0;
+uint32_t scheduleSkips = 0;
+
+// Counter totals of every motor, as handed to the persist task.
+struct CounterSnapshot {
+  pump::CounterTotals motors[cfg::kMaxMotors];
+};
+
+// Each mailbox holds only the newest snapshot; null until the task runs.
+TaskHandle_t persistTask = nullptr;
+QueueHandle_t settingsMailbox = nullptr;
+QueueHandle_t countersMailbox = nullptr;
+std::atomic<bool> persistBusy(false);
 bool getLocalTimeWithOffset(struct tm* outTm);
 pump::PumpController& controllerById(uint8_t motorId);
+void savePersistentState(pump::SaveStats* stats = &settingsSaveStats);
 
 bool githubHttpGet(const String& url, int* statusCode, String* body) {
+  StateUnlock unlock;
   if (statusCode) *statusCode = 0;
   if (body) body->clear();
   WiFiClientSecure client;
@@ -157,6 +404,7 @@ bool githubHttpGet(const String& url, int* statusCode, String* body) {
 }
 
 bool performHttpOta(const String& url, int command, int* updateError, String* updateErrorString) {
+  StateUnlock unlock;
   if (updateError) *updateError = 0;
   if (updateErrorString) updateErrorString->clear();
   const bool isHttps = url.startsWith("https://");
@@ -368,7 +616,7 @@ bool resolveFirmwareAsset(const String& repo, const String& mode, const String&
     if (error) *error = "github release request failed";
     return false;
   }
-  DynamicJsonDocument releaseDoc(cfg::kFirmwareReleaseDocBytes);
+  PooledJsonDocument releaseDoc(cfg::kFirmwareReleaseDocBytes);
   if (deserializeJson(releaseDoc, payload) != DeserializationError::Ok || !releaseDoc.is<JsonObject>()) {
     if (error) *error = "invalid github release response";
     return false;
@@ -421,7 +669,7 @@ bool resolveReleaseForUpdate(const String& repo, const String& mode, const Strin
     if (error) *error = "github release request failed";
     return false;
   }
-  DynamicJsonDocument releaseDoc(cfg::kFirmwareReleaseDocBytes);
+  PooledJsonDocument releaseDoc(cfg::kFirmwareReleaseDocBytes);
   if (deserializeJson(releaseDoc, payload) != DeserializationError::Ok || !releaseDoc.is<JsonObject>()) {
     if (error) *error = "invalid github release response";
     return false;
@@ -518,13 +766,7 @@ void setScheduleName(DoseScheduleEntry& entry, const String& value) {
   entry.name[cfg::kMaxScheduleNameLen] = '\0';
 }
 
-uint8_t frameCrc(const uint8_t* data, size_t lenWithoutCrc) {
-  uint8_t crc = 0;
-  for (size_t i = 0; i < lenWithoutCrc; ++i) crc ^= data[i];
-  return crc;
-}
-
-bool i2cExchange(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, size_t rxLen) {
+bool i2cTransfer(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, size_t rxLen) {
   Wire.beginTransmission(addr);
   for (size_t i = 0; i < txLen; ++i) {
     Wire.write(tx[i]);
@@ -540,41 +782,25 @@ bool i2cExchange(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, siz
   return true;
 }
 
+bool i2cExchange(uint8_t addr, const uint8_t* tx, size_t txLen, uint8_t* rx, size_t rxLen) {
+  const uint32_t started = micros();
+  const bool ok = i2cTransfer(addr, tx, txLen, rx, rxLen);
+  ++i2cTransactions;
+  if (!ok) ++i2cErrors;
+  trace(pump::TraceType::kI2c, addr, ok ? 1 : 0, micros() - started);
+  return ok;
+}
+
 bool expansionReadState(uint8_t remoteMotorIdx) {
   if (!expansionConnected || remoteMotorIdx >= expansionMotorCount) return false;
   uint8_t tx[3] = {exproto::kCmdGetState, remoteMotorIdx, 0};
-  tx[2] = frameCrc(tx, 2);
+  tx[2] = exproto::frameCrc(tx, 2);
   uint8_t rx[exproto::kStateRespLen] = {0};
   if (!i2cExchange(expansionI2cAddress, tx, sizeof(tx), rx, sizeof(rx))) return false;
-  if (rx[28] != frameCrc(rx, 28)) return false;
-
   auto& ctrl = controllerById(static_cast<uint8_t>(remoteMotorIdx + 1));
-  auto& st = ctrl.mutableState();
-  auto rd16 = [&](int pos) -> int16_t {
-    return static_cast<int16_t>(static_cast<uint16_t>(rx[pos]) | (static_cast<uint16_t>(rx[pos + 1]) << 8));
-  };
-  auto rdU16 = [&](int pos) -> uint16_t {
-    return static_cast<uint16_t>(rx[pos]) | (static_cast<uint16_t>(rx[pos + 1]) << 8);
-  };
-  auto rdU32 = [&](int pos) -> uint32_t {
-    return static_cast<uint32_t>(rx[pos]) |
-           (static_cast<uint32_t>(rx[pos + 1]) << 8) |
-           (static_cast<uint32_t>(rx[pos + 2]) << 16) |
-           (static_cast<uint32_t>(rx[pos + 3]) << 24);
-  };
-
-  st.mode = (rx[0] == 1) ? pump::Mode::DOSING : pump::Mode::FLOW;
-  st.running = rx[1] != 0;
-  st.targetSpeed = static_cast<float>(rd16(2)) / 10.0f;
-  st.currentSpeed = static_cast<float>(rd16(4)) / 10.0f;
-  st.dosingRemainingMl = static_cast<float>(rdU16(6));
-  st.totalMotorUptimeSec = rdU32(8);
-  st.totalPumpedVolumeL = static_cast<double>(rdU32(12)) / 1000.0;
-  st.totalHoseVolumeL = static_cast<double>(rdU32(16)) / 1000.0;
-  st.mlPerRevCw = static_cast<float>(rdU16(20)) / 100.0f;
-  st.mlPerRevCcw = static_cast<float>(rdU16(22)) / 100.0f;
-  st.dosingSpeed = static_cast<float>(rdU16(24)) / 10.0f;
-  ctrl.setMaxSpeed(static_cast<float>(rdU16(26)) / 10.0f);
+  float maxSpeed = 0.0f;
+  if (!exproto::decodeState(rx, ctrl.mutableState(), maxSpeed)) return false;
+  ctrl.setMaxSpeed(maxSpeed);
   return true;
 }
 
@@ -584,7 +810,7 @@ bool expansionCommandNoResp(uint8_t cmd, const uint8_t* payload, size_t payloadL
   if (payloadLen + 2 > sizeof(frame)) return false;
   frame[0] = cmd;
   for (size_t i = 0; i < payloadLen; ++i) frame[1 + i] = payload[i];
-  frame[1 + payloadLen] = frameCrc(frame, 1 + payloadLen);
+  frame[1 + payloadLen] = exproto::frameCrc(frame, 1 + payloadLen);
   return i2cExchange(expansionI2cAddress, frame, payloadLen + 2, nullptr, 0);
 }
 
@@ -617,8 +843,10 @@ bool expansionStop(uint8_t remoteMotorIdx) {
   return expansionCommandNoResp(exproto::kCmdStop, p, sizeof(p));
 }
 
-bool expansionSetSettings(uint8_t remoteMotorIdx, float mlCw, float mlCcw, float dosingFlowLph, float maxFlowLph) {
-  uint8_t p[9] = {0};
+// Zero values leave the remote setting as it is.
+bool expansionSetSettings(uint8_t remoteMotorIdx, float mlCw, float mlCcw, float dosingFlowLph, float maxFlowLph,
+                          pump::RampProfile profile) {
+  uint8_t p[10] = {0};
   const uint16_t mlCwX100 = static_cast<uint16_t>(roundf(fmaxf(mlCw, 0.0f) * 100.0f));
   const uint16_t mlCcwX100 = static_cast<uint16_t>(roundf(fmaxf(mlCcw, 0.0f) * 100.0f));
   const uint16_t dosingLphX10 = static_cast<uint16_t>(roundf(fmaxf(dosingFlowLph, 0.0f) * 10.0f));
@@ -632,24 +860,56 @@ bool expansionSetSettings(uint8_t remoteMotorIdx, float mlCw, float mlCcw, float
   p[6] = static_cast<uint8_t>((dosingLphX10 >> 8) & 0xFF);
   p[7] = static_cast<uint8_t>(maxLphX10 & 0xFF);
   p[8] = static_cast<uint8_t>((maxLphX10 >> 8) & 0xFF);
+  p[9] = static_cast<uint8_t>(profile);
   return expansionCommandNoResp(exproto::kCmdSetSettings, p, sizeof(p));
 }
 
+bool expansionSetCurve(uint8_t remoteMotorIdx, bool reverse, const pump::CalibrationCurve& curve) {
+  if (!expansionConnected) return false;
+  uint8_t frame[exproto::kCurveFrameMaxLen] = {0};
+  const size_t len = exproto::encodeCurve(remoteMotorIdx, reverse, curve, frame);
+  return i2cExchange(expansionI2cAddress, frame, len, nullptr, 0);
+}
+
+bool expansionStartRevolutions(uint8_t remoteMotorIdx, float revolutions, float speed) {
+  uint8_t p[5] = {0};
+  const uint16_t revsX10 = static_cast<uint16_t>(roundf(fmaxf(revolutions, 0.0f) * 10.0f));
+  const int16_t speedX10 = static_cast<int16_t>(roundf(speed * 10.0f));
+  p[0] = remoteMotorIdx;
+  p[1] = static_cast<uint8_t>(revsX10 & 0xFF);
+  p[2] = static_cast<uint8_t>((revsX10 >> 8) & 0xFF);
+  p[3] = static_cast<uint8_t>(speedX10 & 0xFF);
+  p[4] = static_cast<uint8_t>((speedX10 >> 8) & 0xFF);
+  return expansionCommandNoResp(exproto::kCmdStartRevolutions, p, sizeof(p));
+}
+
+// Expansion boards keep curves and ramp profiles in RAM only; resend ours
+// on every connect.
+void syncExpansionSettings() {
+  for (uint8_t i = 0; i < expansionMotorCount; ++i) {
+    const auto& ctrl = controllerById(static_cast<uint8_t>(i + 1));
+    expansionSetCurve(i, false, ctrl.calibrationCurve(false));
+    expansionSetCurve(i, true, ctrl.calibrationCurve(true));
+    expansionSetSettings(i, 0.0f, 0.0f, 0.0f, 0.0f, ctrl.config().rampProfile);
+  }
+}
+
 bool discoverExpansionI2c() {
   if (!expansionEnabled || expansionInterface != "i2c") return false;
   uint8_t tx[2] = {exproto::kCmdHello, 0};
-  tx[1] = frameCrc(tx, 1);
+  tx[1] = exproto::frameCrc(tx, 1);
   uint8_t rx[exproto::kHelloRespLen] = {0};
 
   for (uint8_t addr = cfg::kExpansionI2cAddrFrom; addr <= cfg::kExpansionI2cAddrTo; ++addr) {
     if (!i2cExchange(addr, tx, sizeof(tx), rx, sizeof(rx))) continue;
-    if (rx[5] != frameCrc(rx, 5)) continue;
+    if (rx[5] != exproto::frameCrc(rx, 5)) continue;
     if (rx[0] != exproto::kMagicA || rx[1] != exproto::kMagicB || rx[2] != exproto::kProtoVer) continue;
     const uint8_t discovered = rx[3] > cfg::kExpansionMaxMotors ? cfg::kExpansionMaxMotors : rx[3];
     if (discovered == 0) continue;
     expansionI2cAddress = addr;
     expansionConnected = true;
     expansionMotorCount = discovered;
+    syncExpansionSettings();
     return true;
   }
   expansionConnected = false;
@@ -692,7 +952,7 @@ pump::PumpController& controllerById(uint8_t motorId) {
   return controllers[motorId];
 }
 
-uint8_t readMotorIdFromJson(const DynamicJsonDocument& in, bool* ok = nullptr) {
+uint8_t readMotorIdFromJson(JsonVariantConst in, bool* ok = nullptr) {
   if (!in["motorId"].is<int>()) {
     if (ok) *ok = true;
     return 0;
@@ -715,6 +975,204 @@ uint8_t readMotorIdFromRequest(bool* ok = nullptr) {
   return valid ? static_cast<uint8_t>(motorId) : 0;
 }
 
+enum class MotorOp : uint8_t { kStart, kStop, kFlow, kDosing };
+
+// One command of /api/start, /api/stop, /api/flow, /api/dosing or /api/batch.
+struct MotorCommand {
+  MotorOp op = MotorOp::kStart;
+  uint8_t motorId = 0;
+  float litersPerHour = 0.0f;
+  int32_t volumeMl = 0;
+  bool reverse = false;
+};
+
+bool parseMotorOp(const char* name, MotorOp& op) {
+  if (name == nullptr) return false;
+  if (strcmp(name, "start") == 0) {
+    op = MotorOp::kStart;
+  } else if (strcmp(name, "stop") == 0) {
+    op = MotorOp::kStop;
+  } else if (strcmp(name, "flow") == 0) {
+    op = MotorOp::kFlow;
+  } else if (strcmp(name, "dosing") == 0) {
+    op = MotorOp::kDosing;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Returns nullptr, or the reason `in` is not a valid `op` command.
+const char* parseMotorCommand(MotorOp op, JsonVariantConst in, MotorCommand& cmd) {
+  cmd = MotorCommand{};
+  cmd.op = op;
+  if (op == MotorOp::kFlow) {
+    if (!in["litersPerHour"].is<float>()) return "litersPerHour is required";
+    cmd.litersPerHour = in["litersPerHour"].as<float>();
+    if (cmd.litersPerHour < 0) return "litersPerHour must be >= 0";
+    const String direction = in["direction"].is<const char*>() ? in["direction"].as<String>() : String("");
+    cmd.reverse = (in["reverse"] | false) || direction == "ccw" || direction == "reverse";
+  } else if (op == MotorOp::kDosing) {
+    if (!in["volumeMl"].is<int>()) return "volumeMl is required";
+    cmd.volumeMl = in["volumeMl"].as<int32_t>();
+    if (cmd.volumeMl <= 0) return "volumeMl must be > 0; use reverse=true";
+    cmd.reverse = in["reverse"] | false;
+  }
+  bool ok = false;
+  cmd.motorId = readMotorIdFromJson(in, &ok);
+  return ok ? nullptr : "invalid motorId";
+}
+
+// Returns nullptr, or the error when the expansion did not take the command.
+// Without `readBack` an expansion motor's state is left for the caller to
+// read, so a batch reads each motor once.
+const char* applyMotorCommand(const MotorCommand& cmd, bool readBack) {
+  auto& ctrl = controllerById(cmd.motorId);
+  const uint8_t remoteIdx = cmd.motorId - 1;
+  bool sent = true;
+  const char* error = nullptr;
+  switch (cmd.op) {
+    case MotorOp::kStart:
+      if (cmd.motorId == 0) {
+        ctrl.start();
+      } else {
+        sent = expansionStart(remoteIdx);
+      }
+      error = "expansion motor start failed";
+      break;
+    case MotorOp::kStop:
+      if (cmd.motorId == 0) {
+        ctrl.stop(false);
+      } else {
+        sent = expansionStop(remoteIdx);
+      }
+      error = "expansion motor stop failed";
+      break;
+    case MotorOp::kFlow:
+      preferredReverse[cmd.motorId] = cmd.reverse;
+      if (cmd.motorId == 0) {
+        ctrl.setSpeed(ctrl.speedForFlow(cmd.litersPerHour * 1000.0f / 60.0f, cmd.reverse), pump::Mode::FLOW);
+      } else {
+        sent = expansionSetFlow(remoteIdx, cmd.litersPerHour, cmd.reverse);
+      }
+      error = "expansion flow command failed";
+      break;
+    case MotorOp::kDosing:
+      preferredReverse[cmd.motorId] = cmd.reverse;
+      if (cmd.motorId == 0) {
+        ctrl.startDosing(cmd.reverse ? -cmd.volumeMl : cmd.volumeMl);
+      } else {
+        sent = expansionStartDosing(remoteIdx, static_cast<uint16_t>(cmd.volumeMl), cmd.reverse);
+      }
+      if (sent) ++doseCounts[cmd.motorId];
+      error = "expansion dosing command failed";
+      break;
+  }
+  if (cmd.motorId == 0) return nullptr;
+  if (!sent || (readBack && !expansionReadState(remoteIdx))) return error;
+  return nullptr;
+}
+
+void IRAM_ATTR onStepCounterEvent(void*) {
+  uint32_t status = 0;
+  pcnt_get_event_status(cfg::kStepPcntUnit, &status);
+  portENTER_CRITICAL_ISR(&stepBudgetMux);
+  const bool spent = stepBudget.onEvent(status & PCNT_EVT_H_LIM, status & PCNT_EVT_THRES_0);
+  portEXIT_CRITICAL_ISR(&stepBudgetMux);
+  if (!spent) return;
+  // Low first: off the LEDC, the pad shows the GPIO output register.
+  digitalWrite(cfg::kPinStep, LOW);
+  pinMatrixOutDetach(cfg::kPinStep, false, false);
+  stepGateClosed = true;
+}
+
+// The LEDC drives the STEP pad and the counter reads it back through it.
+void attachStepPin() {
+  ledcAttachPin(cfg::kPinStep, cfg::kLedcChannel);
+  gpio_set_direction(static_cast<gpio_num_t>(cfg::kPinStep), GPIO_MODE_INPUT_OUTPUT);
+}
+
+void setupStepCounter() {
+  pcnt_config_t pc = {};
+  pc.pulse_gpio_num = cfg::kPinStep;
+  pc.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  pc.lctrl_mode = PCNT_MODE_KEEP;
+  pc.hctrl_mode = PCNT_MODE_KEEP;
+  pc.pos_mode = PCNT_COUNT_INC;
+  pc.neg_mode = PCNT_COUNT_DIS;
+  pc.counter_h_lim = pump::PulseBudget::kChunk;
+  pc.counter_l_lim = -1;
+  pc.unit = cfg::kStepPcntUnit;
+  pc.channel = PCNT_CHANNEL_0;
+  pcnt_unit_config(&pc);
+  pcnt_filter_disable(cfg::kStepPcntUnit);
+  pcnt_counter_pause(cfg::kStepPcntUnit);
+  pcnt_counter_clear(cfg::kStepPcntUnit);
+  pcnt_event_enable(cfg::kStepPcntUnit, PCNT_EVT_H_LIM);
+  pcnt_event_enable(cfg::kStepPcntUnit, PCNT_EVT_THRES_0);
+  // IRAM, so flash writes from the persist task do not hold the cut back.
+  pcnt_isr_service_install(ESP_INTR_FLAG_IRAM);
+  pcnt_isr_handler_add(cfg::kStepPcntUnit, onStepCounterEvent, nullptr);
+}
+
+// Counts `steps` from here on and puts the pin back on the LEDC.
+void armStepBudget(uint32_t steps) {
+  pcnt_counter_pause(cfg::kStepPcntUnit);
+  pcnt_counter_clear(cfg::kStepPcntUnit);
+  portENTER_CRITICAL(&stepBudgetMux);
+  stepBudget.arm(steps);
+  portEXIT_CRITICAL(&stepBudgetMux);
+  pcnt_set_event_value(cfg::kStepPcntUnit, PCNT_EVT_THRES_0, stepBudget.threshold());
+  if (stepGateClosed) {
+    stepGateClosed = false;
+    attachStepPin();
+  }
+  pcnt_counter_resume(cfg::kStepPcntUnit);
+  ++stepBudgetsArmed;
+  stepsBudgeted += steps;
+}
+
+void disarmStepBudget() {
+  pcnt_counter_pause(cfg::kStepPcntUnit);
+  portENTER_CRITICAL(&stepBudgetMux);
+  stepBudget.disarm();
+  portEXIT_CRITICAL(&stepBudgetMux);
+  stepFinishing = false;
+  if (stepGateClosed) {
+    stepGateClosed = false;
+    attachStepPin();
+  }
+}
+
+// Keeps the budget on the controller's dose plan: armed with totalSteps()
+// when a plan starts or is replanned, finished at a creep if the plan ends
+// first, dropped when a flow run takes over. A stopped dose keeps it, so a
+// halt ramp never runs past the dose.
+void syncStepBudget(const pump::PumpController& ctrl) {
+  if (ctrl.dosePlanId() != stepPlanId) {
+    stepPlanId = ctrl.dosePlanId();
+    stepFinishing = false;
+    if (ctrl.dosePlan().active()) {
+      stepFinishReverse = ctrl.state().targetSpeed < 0.0f;
+      armStepBudget(ctrl.dosePlan().totalSteps());
+    }
+  }
+  if (ctrl.dosesFinished() != stepDosesFinished) {
+    stepDosesFinished = ctrl.dosesFinished();
+    stepFinishing = stepBudget.armed();
+  }
+  if (stepGateClosed) stepFinishing = false;
+  if (stepBudget.armed() && ctrl.state().running && ctrl.state().mode == pump::Mode::FLOW) disarmStepBudget();
+}
+
+// What the STEP tone runs at: the controller's speed, or the creep while a
+// finished dose still owes pulses.
+float stepToneSpeed(const pump::PumpController& ctrl) {
+  const float speed = ctrl.state().currentSpeed;
+  if (!stepFinishing || stepGateClosed || fabsf(speed) >= cfg::kStepFinishRpm) return speed;
+  return stepFinishReverse ? -cfg::kStepFinishRpm : cfg::kStepFinishRpm;
+}
+
 void setDriverFrequencyHz(float freqHz) {
   if (freqHz < 1.0f) {
     ledcWriteTone(cfg::kLedcChannel, 0);
@@ -734,143 +1192,180 @@ float speedToFrequency(float speed) {
 void applyMotorSpeed(float speed) {
   const auto& conf = controllerById(0).config();
   if (fabsf(speed) < conf.minSpeed) {
+    trace(pump::TraceType::kStepFrequency);
     setDriverFrequencyHz(0);
     return;
   }
 
+  const float freqHz = speedToFrequency(speed);
+  trace(pump::TraceType::kStepFrequency, 0, speed < 0 ? 1 : 0, static_cast<uint32_t>(freqHz * 1000.0f));
   digitalWrite(cfg::kPinDir, speed >= 0 ? LOW : HIGH);
-  setDriverFrequencyHz(speedToFrequency(speed));
+  setDriverFrequencyHz(freqHz);
 }
 
-void writeMotorState(JsonObject out, const pump::PumpController& ctrl, uint8_t motorId) {
-  const auto& st = ctrl.state();
-  const char* modeName = st.mode == pump::Mode::DOSING ? "dosing" : "flow_lph";
-  const float flowMlMin = st.currentSpeed * ((st.currentSpeed >= 0) ? st.mlPerRevCw : st.mlPerRevCcw);
-  const float targetFlowMlMin = st.targetSpeed * ((st.targetSpeed >= 0) ? st.mlPerRevCw : st.mlPerRevCcw);
+void writeMotorState(JsonObject out, const pump::PumpController& ctrl, uint8_t motorId,
+                     const pump::FieldFilter& fields = pump::FieldFilter()) {
   out["motorId"] = motorId;
-  out["alias"] = motorAliases[motorId];
-  out["mode"] = static_cast<uint8_t>(st.mode);
-  out["modeName"] = modeName;
-  out["running"] = st.running;
-  out["flowMlMin"] = flowMlMin;
-  out["flowLph"] = flowMlMin * 0.06f;
-  out["targetFlowMlMin"] = targetFlowMlMin;
-  out["targetFlowLph"] = targetFlowMlMin * 0.06f;
-  out["dosingFlowLph"] = fabsf(st.dosingSpeed * st.mlPerRevCw * 0.06f);
-  out["direction"] = (st.targetSpeed >= 0) ? "forward" : "reverse";
-  out["preferredReverse"] = preferredReverse[motorId];
-  out["mlPerRevCw"] = st.mlPerRevCw;
-  out["mlPerRevCcw"] = st.mlPerRevCcw;
-  out["dosingRemainingMl"] = st.dosingRemainingMl;
-  out["uptimeSec"] = st.totalMotorUptimeSec;
-  out["totalPumpedL"] = st.totalPumpedVolumeL;
-  out["totalHoseL"] = st.totalHoseVolumeL;
-}
-
-void savePersistentState() {
+  if (fields.wants("alias")) out["alias"] = motorAliases[motorId];
+  if (fields.wants("preferredReverse")) out["preferredReverse"] = preferredReverse[motorId];
+  pump::writeStateFields(out, ctrl, fields);
+}
+
+// Forward flow <-> rpm through the cw curve, or the scalar `mlPerRevCw` when
+// the motor has none (settings may be about to change the scalar).
+float forwardSpeedForFlowLph(const pump::PumpController& ctrl, float lph, float mlPerRevCw) {
+  if (!ctrl.calibrationCurve(false).empty()) return ctrl.speedForFlow(lph * 1000.0f / 60.0f, false);
+  return (lph * 1000.0f / 60.0f) / mlPerRevCw;
+}
+
+float forwardFlowLph(const pump::PumpController& ctrl, float speed, float mlPerRevCw) {
+  const float mlPerRev = ctrl.calibrationCurve(false).empty() ? mlPerRevCw : ctrl.mlPerRevAt(fabsf(speed));
+  return fabsf(speed * mlPerRev * 0.06f);
+}
+
+// The /api/settings names of pump::RampProfile.
+const char* rampProfileName(pump::RampProfile profile) {
+  return profile == pump::RampProfile::S_CURVE ? "s-curve" : "linear";
+}
+
+bool parseRampProfile(const char* name, pump::RampProfile* out) {
+  if (strcmp(name, "linear") == 0) {
+    *out = pump::RampProfile::LINEAR;
+  } else if (strcmp(name, "s-curve") == 0) {
+    *out = pump::RampProfile::S_CURVE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool applyCalibrationCurve(uint8_t motorId, bool reverse, const pump::CalibrationCurve& curve) {
+  if (motorId > 0 && !expansionSetCurve(motorId - 1, reverse, curve)) return false;
+  controllerById(motorId).setCalibrationCurve(reverse, curve);
+  savePersistentState();
+  return true;
+}
+
+void writeCalibrationCurves(JsonDocument& doc, uint8_t motorId) {
+  const auto& ctrl = controllerById(motorId);
+  doc["motorId"] = motorId;
+  for (int dir = 0; dir < 2; ++dir) {
+    const bool reverse = dir == 1;
+    const auto& curve = ctrl.calibrationCurve(reverse);
+    JsonArray points = doc.createNestedArray(reverse ? "ccw" : "cw");
+    for (size_t i = 0; i < curve.size(); ++i) {
+      JsonObject p = points.createNestedObject();
+      p["rpm"] = curve.point(i).rpm;
+      p["mlPerRev"] = curve.point(i).mlPerRev;
+    }
+  }
+}
+
+// Commits `key` only if its value changed since it was last committed. A null
+// `stats` records the value without writing, to prime the cache after load.
+bool persistNeeded(pump::SaveStats* stats, const char* key, const void* data, size_t len) {
+  if (!persistCache.changed(key, data, len) || stats == nullptr) return false;
+  stats->wrote(len);
+  return true;
+}
+
+void storeCurve(pump::StoredCurve& out, const pump::CalibrationCurve& curve) {
+  out.count = static_cast<uint8_t>(curve.size());
+  for (size_t i = 0; i < curve.size(); ++i) out.points[i] = curve.point(i);
+}
+
+void loadCurve(uint8_t motorId, bool reverse, const pump::StoredCurve& stored) {
+  pump::CalibrationCurve curve;
+  if (stored.count > 0 && curve.assign(stored.points, stored.count)) {
+    controllerById(motorId).setCalibrationCurve(reverse, curve);
+  }
+}
+
+// Snapshot of every setting as stored; zero-filled so equal settings give
+// equal bytes.
+void captureConfig(pump::StoredConfig& config) {
+  config = pump::StoredConfig();
   for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) {
-    const auto& st = controllerById(i).state();
-    char key[24];
-    snprintf(key, sizeof(key), "last_speed_%u", i);
-    prefs.putFloat(key, st.lastManualSpeed);
-    snprintf(key, sizeof(key), "max_speed_%u", i);
-    prefs.putFloat(key, controllerById(i).config().maxSpeed);
-    snprintf(key, sizeof(key), "ml_cw_%u", i);
-    prefs.putFloat(key, st.mlPerRevCw);
-    snprintf(key, sizeof(key), "ml_ccw_%u", i);
-    prefs.putFloat(key, st.mlPerRevCcw);
-    snprintf(key, sizeof(key), "dose_speed_%u", i);
-    prefs.putFloat(key, st.dosingSpeed);
-    snprintf(key, sizeof(key), "pref_rev_%u", i);
-    prefs.putBool(key, preferredReverse[i]);
-    snprintf(key, sizeof(key), "uptime_%u", i);
-    prefs.putULong(key, st.totalMotorUptimeSec);
-    snprintf(key, sizeof(key), "vol_total_%u", i);
-    prefs.putDouble(key, st.totalPumpedVolumeL);
-    snprintf(key, sizeof(key), "vol_hose_%u", i);
-    prefs.putDouble(key, st.totalHoseVolumeL);
-    snprintf(key, sizeof(key), "alias_%u", i);
-    prefs.putString(key, motorAliases[i]);
-  }
-  prefs.putBool("exp_en", expansionEnabled);
-  prefs.putUChar("exp_count", expansionMotorCount);
-  prefs.putString("exp_if", expansionInterface);
-  prefs.putUChar("sel_motor", selectedMotorId);
-  prefs.putBool("auth_en", webAuthEnabled);
-  prefs.putString("auth_user", webAuthUser);
-  prefs.putString("auth_pass", webAuthPass);
-  prefs.putString("ntp_server", ntpServer);
-  prefs.putString("ui_lang", uiLanguage);
-  prefs.putBool("grow_tab_en", growthProgramEnabled);
-  prefs.putBool("ph_reg_en", phRegulationEnabled);
-  prefs.putString("fw_repo", firmwareRepo);
-  prefs.putString("fw_asset", firmwareAssetName);
-  prefs.putString("fw_fs_asset", firmwareFsAssetName);
-  prefs.putInt("tz_offset_min", tzOffsetMinutes);
-  DynamicJsonDocument schedDoc(2048);
-  JsonArray arr = schedDoc.createNestedArray("entries");
+    const auto& ctrl = controllerById(i);
+    pump::StoredMotor& m = config.motors[i];
+    m.lastManualSpeed = ctrl.state().lastManualSpeed;
+    m.maxSpeed = ctrl.config().maxSpeed;
+    m.mlPerRevCw = ctrl.state().mlPerRevCw;
+    m.mlPerRevCcw = ctrl.state().mlPerRevCcw;
+    m.dosingSpeed = ctrl.state().dosingSpeed;
+    storeCurve(m.curveCw, ctrl.calibrationCurve(false));
+    storeCurve(m.curveCcw, ctrl.calibrationCurve(true));
+    m.preferredReverse = preferredReverse[i];
+    pump::copyStoredString(m.alias, motorAliases[i].c_str());
+    config.rampProfiles[i] = static_cast<uint8_t>(ctrl.config().rampProfile);
+  }
   for (uint8_t i = 0; i < cfg::kMaxSchedules; ++i) {
-    JsonObject e = arr.createNestedObject();
-    e["enabled"] = doseSchedules[i].enabled;
-    e["hour"] = doseSchedules[i].hour;
-    e["minute"] = doseSchedules[i].minute;
-    e["volumeMl"] = doseSchedules[i].volumeMl;
-    e["reverse"] = doseSchedules[i].reverse;
-    e["motorId"] = doseSchedules[i].motorId;
-    e["name"] = doseSchedules[i].name;
-    e["weekdaysMask"] = doseSchedules[i].weekdaysMask;
+    const DoseScheduleEntry& e = doseSchedules[i];
+    pump::StoredSchedule& s = config.schedules[i];
+    s.volumeMl = e.volumeMl;
+    s.enabled = e.enabled;
+    s.hour = e.hour;
+    s.minute = e.minute;
+    s.reverse = e.reverse;
+    s.motorId = e.motorId;
+    s.weekdaysMask = e.weekdaysMask;
+    pump::copyStoredString(s.name, e.name);
   }
-  String schedJson;
-  serializeJson(schedDoc, schedJson);
-  prefs.putString("dose_sched", schedJson);
+  config.tzOffsetMinutes = tzOffsetMinutes;
+  config.selectedMotorId = selectedMotorId;
+  config.expansionEnabled = expansionEnabled;
+  config.expansionMotorCount = expansionMotorCount;
+  config.authEnabled = webAuthEnabled;
+  config.growthProgramEnabled = growthProgramEnabled;
+  config.phRegulationEnabled = phRegulationEnabled;
+  pump::copyStoredString(config.expansionInterface, expansionInterface.c_str());
+  pump::copyStoredString(config.uiLanguage, uiLanguage.c_str());
+  pump::copyStoredString(config.authUser, webAuthUser.c_str());
+  pump::copyStoredString(config.authPass, webAuthPass.c_str());
+  pump::copyStoredString(config.ntpServer, ntpServer.c_str());
+  pump::copyStoredString(config.firmwareRepo, firmwareRepo.c_str());
+  pump::copyStoredString(config.firmwareAsset, firmwareAssetName.c_str());
+  pump::copyStoredString(config.firmwareFsAsset, firmwareFsAssetName.c_str());
 }
 
-void loadPersistentState() {
+void applyConfig(const pump::StoredConfig& config) {
   for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) {
     auto& ctrl = controllerById(i);
     auto& st = ctrl.mutableState();
-    char key[24];
-    snprintf(key, sizeof(key), "last_speed_%u", i);
-    st.lastManualSpeed = prefs.getFloat(key, i == 0 ? prefs.getFloat("last_speed", 120.0f) : 120.0f);
-    snprintf(key, sizeof(key), "max_speed_%u", i);
-    ctrl.setMaxSpeed(prefs.getFloat(key, i == 0 ? prefs.getFloat("max_speed", ctrl.config().maxSpeed) : ctrl.config().maxSpeed));
-    snprintf(key, sizeof(key), "ml_cw_%u", i);
-    st.mlPerRevCw = prefs.getFloat(key, i == 0 ? prefs.getFloat("ml_cw", st.mlPerRevCw) : st.mlPerRevCw);
-    snprintf(key, sizeof(key), "ml_ccw_%u", i);
-    st.mlPerRevCcw = prefs.getFloat(key, i == 0 ? prefs.getFloat("ml_ccw", st.mlPerRevCcw) : st.mlPerRevCcw);
-    snprintf(key, sizeof(key), "dose_speed_%u", i);
-    st.dosingSpeed = prefs.getFloat(key, i == 0 ? prefs.getFloat("dosing_speed", st.dosingSpeed) : st.dosingSpeed);
-    snprintf(key, sizeof(key), "pref_rev_%u", i);
-    preferredReverse[i] = prefs.getBool(key, i == 0 ? prefs.getBool("pref_rev", false) : false);
-    snprintf(key, sizeof(key), "uptime_%u", i);
-    st.totalMotorUptimeSec = prefs.getULong(key, i == 0 ? prefs.getULong("uptime", 0) : 0);
-    snprintf(key, sizeof(key), "vol_total_%u", i);
-    st.totalPumpedVolumeL = prefs.getDouble(key, i == 0 ? prefs.getDouble("vol_total", 0.0) : 0.0);
-    snprintf(key, sizeof(key), "vol_hose_%u", i);
-    st.totalHoseVolumeL = prefs.getDouble(key, i == 0 ? prefs.getDouble("vol_hose", 0.0) : 0.0);
-    snprintf(key, sizeof(key), "alias_%u", i);
-    const String legacyAlias = (i == 0) ? prefs.getString("motor_alias", defaultMotorAlias(i)) : defaultMotorAlias(i);
-    motorAliases[i] = normalizedMotorAlias(prefs.getString(key, legacyAlias), i);
-  }
-  expansionEnabled = prefs.getBool("exp_en", false);
-  expansionMotorCount = prefs.getUChar("exp_count", 0);
+    const pump::StoredMotor& m = config.motors[i];
+    st.lastManualSpeed = m.lastManualSpeed;
+    ctrl.setMaxSpeed(m.maxSpeed);
+    st.mlPerRevCw = m.mlPerRevCw;
+    st.mlPerRevCcw = m.mlPerRevCcw;
+    st.dosingSpeed = m.dosingSpeed;
+    loadCurve(i, false, m.curveCw);
+    loadCurve(i, true, m.curveCcw);
+    preferredReverse[i] = m.preferredReverse != 0;
+    motorAliases[i] = normalizedMotorAlias(String(m.alias), i);
+    ctrl.setRampProfile(config.rampProfiles[i] == static_cast<uint8_t>(pump::RampProfile::S_CURVE)
+                            ? pump::RampProfile::S_CURVE
+                            : pump::RampProfile::LINEAR);
+  }
+  tzOffsetMinutes = config.tzOffsetMinutes;
+  expansionEnabled = config.expansionEnabled != 0;
+  expansionMotorCount = config.expansionMotorCount;
   if (expansionMotorCount > cfg::kExpansionMaxMotors) expansionMotorCount = cfg::kExpansionMaxMotors;
-  expansionInterface = prefs.getString("exp_if", "i2c");
+  expansionInterface = config.expansionInterface;
   if (expansionInterface != "i2c" && expansionInterface != "rs485" && expansionInterface != "uart") {
     expansionInterface = "i2c";
   }
-  selectedMotorId = prefs.getUChar("sel_motor", 0);
+  selectedMotorId = config.selectedMotorId;
   if (!isValidMotorId(selectedMotorId)) selectedMotorId = 0;
-  webAuthEnabled = prefs.getBool("auth_en", false);
-  webAuthUser = prefs.getString("auth_user", "admin");
-  webAuthPass = prefs.getString("auth_pass", "admin");
-  ntpServer = prefs.getString("ntp_server", "time.google.com");
-  uiLanguage = prefs.getString("ui_lang", "en");
-  growthProgramEnabled = prefs.getBool("grow_tab_en", false);
-  phRegulationEnabled = prefs.getBool("ph_reg_en", false);
-  firmwareRepo = prefs.getString("fw_repo", cfg::kDefaultFirmwareRepo);
-  firmwareAssetName = prefs.getString("fw_asset", cfg::kDefaultFirmwareAsset);
-  firmwareFsAssetName = prefs.getString("fw_fs_asset", cfg::kDefaultFirmwareFsAsset);
+  webAuthEnabled = config.authEnabled != 0;
+  webAuthUser = config.authUser;
+  webAuthPass = config.authPass;
+  ntpServer = config.ntpServer;
+  uiLanguage = config.uiLanguage;
+  growthProgramEnabled = config.growthProgramEnabled != 0;
+  phRegulationEnabled = config.phRegulationEnabled != 0;
+  firmwareRepo = config.firmwareRepo;
+  firmwareAssetName = config.firmwareAsset;
+  firmwareFsAssetName = config.firmwareFsAsset;
   if (webAuthUser.length() == 0) webAuthUser = "admin";
   if (webAuthPass.length() == 0) webAuthPass = "admin";
   if (ntpServer.length() == 0) ntpServer = "time.google.com";
@@ -878,94 +1373,700 @@ void loadPersistentState() {
   if (firmwareAssetName.length() == 0) firmwareAssetName = cfg::kDefaultFirmwareAsset;
   if (firmwareFsAssetName.length() == 0) firmwareFsAssetName = cfg::kDefaultFirmwareFsAsset;
   if (uiLanguage != "ru" && uiLanguage != "en") uiLanguage = "en";
-  tzOffsetMinutes = prefs.getInt("tz_offset_min", 0);
-  String schedJson = prefs.getString("dose_sched", "");
-  if (schedJson.length() > 0) {
-    DynamicJsonDocument schedDoc(2048);
-    if (deserializeJson(schedDoc, schedJson) == DeserializationError::Ok) {
-      JsonArray arr = schedDoc["entries"].as<JsonArray>();
-      uint8_t i = 0;
-      for (JsonObject e : arr) {
-        if (i >= cfg::kMaxSchedules) break;
-        doseSchedules[i].enabled = e["enabled"] | false;
-        doseSchedules[i].hour = e["hour"] | 0;
-        doseSchedules[i].minute = e["minute"] | 0;
-        doseSchedules[i].volumeMl = e["volumeMl"] | 0;
-        doseSchedules[i].reverse = e["reverse"] | false;
-        doseSchedules[i].motorId = e["motorId"] | 0;
-        if (!isValidMotorId(doseSchedules[i].motorId)) doseSchedules[i].motorId = 0;
-        setScheduleName(doseSchedules[i], e["name"].is<const char*>() ? e["name"].as<String>() : String(""));
-        doseSchedules[i].weekdaysMask = e["weekdaysMask"] | 0x7F;
-        doseSchedules[i].lastRunYDay = -1;
-        ++i;
+  // After the expansion settings, which decide which motor ids are valid.
+  for (uint8_t i = 0; i < cfg::kMaxSchedules; ++i) {
+    const pump::StoredSchedule& s = config.schedules[i];
+    DoseScheduleEntry& e = doseSchedules[i];
+    e.enabled = s.enabled != 0;
+    e.hour = s.hour;
+    e.minute = s.minute;
+    e.volumeMl = s.volumeMl;
+    e.reverse = s.reverse != 0;
+    e.motorId = isValidMotorId(s.motorId) ? s.motorId : 0;
+    setScheduleName(e, String(s.name));
+    e.weekdaysMask = s.weekdaysMask;
+    e.lastRunYDay = -1;
+  }
+}
+
+// Writes `blob` if its config differs from the last one committed. A null
+// `stats` only records it, to prime the cache after load.
+bool commitConfigBlob(pump::ConfigBlob& blob, pump::SaveStats* stats) {
+  if (!persistNeeded(stats, cfg::kConfigKey, &blob.config, sizeof(blob.config))) return false;
+  pump::sealConfigBlob(blob);
+  const uint32_t started = micros();
+  const bool written = prefs.putBytes(cfg::kConfigKey, &blob, sizeof(blob)) == sizeof(blob);
+  trace(pump::TraceType::kNvsCommit, 0, written ? 1 : 0, micros() - started);
+  if (written) return true;
+  persistCache.forget(cfg::kConfigKey);
+  return false;
+}
+
+// Settings pass: all settings live in one blob, rewritten only when it changed.
+void writeSettings(const pump::StoredConfig& config, pump::SaveStats* stats) {
+  const uint32_t started = micros();
+  if (stats != nullptr) stats->beginPass();
+  static pump::ConfigBlob blob;
+  blob.config = config;
+  commitConfigBlob(blob, stats);
+  if (stats != nullptr) stats->endPass(micros() - started);
+}
+
+// Snapshots the settings and hands them to the persist task. Before it runs,
+// and when only priming (null `stats`), writes them here instead.
+void savePersistentState(pump::SaveStats* stats) {
+  static pump::StoredConfig config;
+  captureConfig(config);
+  if (persistTask != nullptr && stats != nullptr) {
+    xQueueOverwrite(settingsMailbox, &config);
+    xTaskNotifyGive(persistTask);
+    return;
+  }
+  writeSettings(config, stats);
+}
+
+pump::CounterTotals countersOf(uint8_t motorId) {
+  const auto& st = controllerById(motorId).state();
+  pump::CounterTotals totals = pump::CounterTotals();
+  totals.uptimeSec = st.totalMotorUptimeSec;
+  totals.pumpedNl = st.totalPumpedNl;
+  totals.hoseNl = st.totalHoseNl;
+  return totals;
+}
+
+// Writes the next checkpoint over the older of the two slots and starts an
+// empty journal. The other slot keeps the current checkpoint and records
+// left from before carry the old generation, so a power cut anywhere in
+// here neither loses nor double-counts anything.
+bool writeCounterCheckpoint() {
+  const pump::CounterCheckpoint cp = counterJournal.nextCheckpoint();
+  File f = LittleFS.open(cfg::kCounterCheckpointPaths[pump::CounterJournal::slotOf(cp.generation)], "w");
+  if (!f) return false;
+  const size_t written = f.write(reinterpret_cast<const uint8_t*>(&cp), sizeof(cp));
+  f.close();
+  if (written != sizeof(cp)) return false;
+  counterJournal.committed(cp);
+  File log = LittleFS.open(cfg::kCounterJournalPath, "w");
+  if (log) log.close();
+  counterJournalBytes = 0;
+  return true;
+}
+
+// Counter pass: appends one record per motor whose counters moved, and
+// checkpoints once the journal is full.
+void writeCounters(const CounterSnapshot& snapshot) {
+  const uint32_t started = micros();
+  counterSaveStats.beginPass();
+  pump::CounterRecord records[cfg::kMaxMotors];
+  size_t count = 0;
+  for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) {
+    if (counterJournal.record(i, snapshot.motors[i], records[count])) ++count;
+  }
+  bool appended = true;
+  if (count > 0) {
+    const size_t bytes = count * sizeof(pump::CounterRecord);
+    File log = LittleFS.open(cfg::kCounterJournalPath, "a");
+    const size_t written = log ? log.write(reinterpret_cast<const uint8_t*>(records), bytes) : 0;
+    if (log) log.close();
+    counterJournalBytes += written;
+    for (size_t i = 0; i < count; ++i) counterSaveStats.wrote(sizeof(pump::CounterRecord));
+    appended = written == bytes;
+  }
+  // A failed append leaves the journal behind the totals; a checkpoint catches up.
+  if ((!appended || counterJournalBytes >= cfg::kCounterJournalMaxBytes) && writeCounterCheckpoint()) {
+    counterSaveStats.wrote(sizeof(pump::CounterCheckpoint));
+  }
+  counterSaveStats.endPass(micros() - started);
+}
+
+// Snapshots the counters for the persist task, on the longer
+// kCounterSavePeriodMs.
+void saveCounters() {
+  if (!counterJournalReady) return;
+  CounterSnapshot snapshot;
+  for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) snapshot.motors[i] = countersOf(i);
+  if (persistTask != nullptr) {
+    xQueueOverwrite(countersMailbox, &snapshot);
+    xTaskNotifyGive(persistTask);
+    return;
+  }
+  writeCounters(snapshot);
+}
+
+// Drains the mailboxes whenever loop() notifies. Passes queued behind a slow
+// write collapse into the newest snapshot.
+void persistTaskMain(void*) {
+  static pump::StoredConfig config;
+  CounterSnapshot counters;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    persistBusy = true;
+    if (xQueueReceive(settingsMailbox, &config, 0) == pdTRUE) writeSettings(config, &settingsSaveStats);
+    if (xQueueReceive(countersMailbox, &counters, 0) == pdTRUE) writeCounters(counters);
+    persistBusy = false;
+  }
+}
+
+// Without the task, loop() keeps saving inline as before.
+void startPersistTask() {
+  settingsMailbox = xQueueCreate(1, sizeof(pump::StoredConfig));
+  countersMailbox = xQueueCreate(1, sizeof(CounterSnapshot));
+  if (settingsMailbox == nullptr || countersMailbox == nullptr ||
+      xTaskCreatePinnedToCore(persistTaskMain, "persist", cfg::kPersistTaskStackBytes, nullptr,
+                              cfg::kPersistTaskPriority, &persistTask, cfg::kPersistTaskCore) != pdPASS) {
+    persistTask = nullptr;
+    Serial.println("Persist task failed to start, saving from loop()");
+  }
+}
+
+// Waits until the persist task has written everything queued, e.g. before a
+// restart or before something else takes over the filesystem.
+bool flushPersistence() {
+  const uint32_t started = millis();
+  while (persistTask != nullptr && (uxQueueMessagesWaiting(settingsMailbox) > 0 ||
+                                    uxQueueMessagesWaiting(countersMailbox) > 0 || persistBusy)) {
+    if (millis() - started >= cfg::kPersistFlushTimeoutMs) return false;
+    delay(10);
+  }
+  return true;
+}
+
+const char* const kNvsCounterKeys[] = {"uptime", "vol_total", "vol_hose", "pumped_nl", "hose_nl"};
+
+uint64_t nvsLitresAsNl(const char* key, double fallback) {
+  const double litres = prefs.getDouble(key, fallback);
+  return litres > 0.0 ? static_cast<uint64_t>(llround(litres * 1e9)) : 0;
+}
+
+// Counters as the firmware before the journal kept them, in NVS, or as the
+// OTA stash left them: exact nanolitres when those keys exist.
+void readNvsCounters() {
+  for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) {
+    pump::CounterTotals totals = pump::CounterTotals();
+    char key[24];
+    snprintf(key, sizeof(key), "uptime_%u", i);
+    totals.uptimeSec = prefs.getULong(key, i == 0 ? prefs.getULong("uptime", 0) : 0);
+    snprintf(key, sizeof(key), "pumped_nl_%u", i);
+    if (prefs.isKey(key)) {
+      totals.pumpedNl = prefs.getULong64(key, 0);
+    } else {
+      snprintf(key, sizeof(key), "vol_total_%u", i);
+      totals.pumpedNl = nvsLitresAsNl(key, i == 0 ? prefs.getDouble("vol_total", 0.0) : 0.0);
+    }
+    snprintf(key, sizeof(key), "hose_nl_%u", i);
+    if (prefs.isKey(key)) {
+      totals.hoseNl = prefs.getULong64(key, 0);
+    } else {
+      snprintf(key, sizeof(key), "vol_hose_%u", i);
+      totals.hoseNl = nvsLitresAsNl(key, i == 0 ? prefs.getDouble("vol_hose", 0.0) : 0.0);
+    }
+    counterJournal.seed(i, totals);
+  }
+}
+
+// A filesystem update replaces LittleFS and the journal with it; parking the
+// totals in the NVS keys lets the next boot migrate them back. The flag
+// makes them win over whatever checkpoint the partition is left with.
+void stashCountersInNvs() {
+  for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) {
+    const pump::CounterTotals totals = countersOf(i);
+    char key[24];
+    snprintf(key, sizeof(key), "uptime_%u", i);
+    prefs.putULong(key, totals.uptimeSec);
+    snprintf(key, sizeof(key), "pumped_nl_%u", i);
+    prefs.putULong64(key, totals.pumpedNl);
+    snprintf(key, sizeof(key), "hose_nl_%u", i);
+    prefs.putULong64(key, totals.hoseNl);
+  }
+  prefs.putBool(cfg::kCounterStashKey, true);
+}
+
+bool hasNvsCounters() {
+  for (const char* base : kNvsCounterKeys) {
+    if (prefs.isKey(base)) return true;
+    for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) {
+      char key[24];
+      snprintf(key, sizeof(key), "%s_%u", base, i);
+      if (prefs.isKey(key)) return true;
+    }
+  }
+  return false;
+}
+
+void removeNvsCounters() {
+  if (prefs.isKey(cfg::kCounterStashKey)) prefs.remove(cfg::kCounterStashKey);
+  for (const char* base : kNvsCounterKeys) {
+    if (prefs.isKey(base)) prefs.remove(base);
+    for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) {
+      char key[24];
+      snprintf(key, sizeof(key), "%s_%u", base, i);
+      if (prefs.isKey(key)) prefs.remove(key);
+    }
+  }
+}
+
+// Before checkpointing totals from elsewhere: older generations left on
+// disk would otherwise win over them.
+void removeCounterFiles() {
+  for (const char* path : cfg::kCounterCheckpointPaths) LittleFS.remove(path);
+  LittleFS.remove(cfg::kLegacyCounterCheckpointPath);
+  LittleFS.remove(cfg::kCounterJournalPath);
+  counterJournalBytes = 0;
+}
+
+size_t readCounterCheckpoint(const char* path, pump::CounterCheckpoint& cp) {
+  File f = LittleFS.open(path, "r");
+  if (!f) return 0;
+  const size_t len = f.read(reinterpret_cast<uint8_t*>(&cp), sizeof(cp));
+  f.close();
+  return len;
+}
+
+// Counters are the newer checkpoint plus the journal appended since. Without
+// a filesystem they are read from NVS and not saved. If every checkpoint is
+// damaged they come from NVS too (the keys from before the journal, or an
+// OTA stash); with nothing there either, journaling stays off rather than
+// checkpointing zeros over the damaged files. A flagged OTA stash always wins.
+void loadCounters(bool fsMounted) {
+  const bool stashed = prefs.getBool(cfg::kCounterStashKey, false);
+  bool restored = false;
+  bool damaged = false;
+  bool migrating = false;
+  if (fsMounted && !stashed) {
+    pump::CounterCheckpoint a, b;
+    const size_t aLen = readCounterCheckpoint(cfg::kCounterCheckpointPaths[0], a);
+    const size_t bLen = readCounterCheckpoint(cfg::kCounterCheckpointPaths[1], b);
+    restored = counterJournal.restoreNewest(&a, aLen, &b, bLen);
+    damaged = !restored && (LittleFS.exists(cfg::kCounterCheckpointPaths[0]) ||
+                            LittleFS.exists(cfg::kCounterCheckpointPaths[1]));
+    if (!restored && !damaged && LittleFS.exists(cfg::kLegacyCounterCheckpointPath)) {
+      // The single checkpoint of the firmware before the A/B pair.
+      const size_t len = readCounterCheckpoint(cfg::kLegacyCounterCheckpointPath, a);
+      restored = migrating = counterJournal.restore(&a, len);
+      damaged = !restored;
+    }
+  }
+  if (restored) {
+    File log = LittleFS.open(cfg::kCounterJournalPath, "r");
+    size_t logSize = 0;
+    if (log) {
+      logSize = log.size();
+      pump::CounterRecord rec;
+      const size_t recBytes = counterJournal.recordBytes();
+      while (log.read(reinterpret_cast<uint8_t*>(&rec), recBytes) == recBytes &&
+             counterJournal.replay(&rec, recBytes)) {
+        counterJournalBytes += recBytes;
       }
+      log.close();
+    }
+    // Stopped short at a torn or stale record, or read an older format:
+    // start a clean journal so later records are not appended behind it.
+    if ((counterJournalBytes != logSize || counterJournal.legacy() || migrating) && writeCounterCheckpoint() &&
+        migrating) {
+      LittleFS.remove(cfg::kLegacyCounterCheckpointPath);
     }
+  } else {
+    const bool inNvs = hasNvsCounters();
+    readNvsCounters();
+    if (damaged) {
+      Serial.println(inNvs ? "Counter checkpoints corrupt, restored from NVS"
+                           : "Counter checkpoints corrupt, counters not saved");
+    }
+    counterCheckpointsDamaged = damaged && !inNvs;
+    if (fsMounted && stashed) removeCounterFiles();
+    // First boot with the journal, a recovery or an update: move the NVS
+    // counters over, then drop them.
+    if (fsMounted && !counterCheckpointsDamaged && writeCounterCheckpoint()) removeNvsCounters();
+  }
+  counterJournalReady = fsMounted && !counterCheckpointsDamaged;
+  for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) {
+    auto& st = controllerById(i).mutableState();
+    const pump::CounterTotals& totals = counterJournal.totals(i);
+    st.totalMotorUptimeSec = totals.uptimeSec;
+    st.totalPumpedNl = totals.pumpedNl;
+    st.totalHoseNl = totals.hoseNl;
   }
 }
 
-void writeJsonState(DynamicJsonDocument& doc, uint8_t motorId) {
-  if (!isValidMotorId(motorId)) motorId = 0;
-  const auto& st = controllerById(motorId).state();
+// After a failed update, which may have erased or partly written the
+// partition: remount, checkpoint the totals held in RAM and journal again.
+// Until that lands the stash stays flagged and the next boot takes it.
+void resumeCountersAfterFailedOta() {
+  if (counterCheckpointsDamaged) {
+    // Counted since boot only; not a source to restore from.
+    removeNvsCounters();
+    return;
+  }
+  LittleFS.end();
+  if (!LittleFS.begin(true)) {
+    Serial.println("LittleFS mount failed after update, counters left in NVS");
+    return;
+  }
+  removeCounterFiles();
+  for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) counterJournal.seed(i, countersOf(i));
+  if (!writeCounterCheckpoint()) return;
+  removeNvsCounters();
+  counterJournalReady = true;
+}
+
+void writeSaveStats(JsonObject out, const pump::SaveStats& stats) {
+  out["passes"] = stats.passes;
+  out["lastKeys"] = stats.lastKeys;
+  out["lastBytes"] = stats.lastBytes;
+  out["lastMicros"] = stats.lastMicros;
+  out["maxMicros"] = stats.maxMicros;
+  out["totalKeys"] = stats.totalKeys;
+  out["totalBytes"] = stats.totalBytes;
+  out["totalMicros"] = stats.totalMicros;
+}
+
+bool readConfigBlob(pump::StoredConfig& config) {
+  const size_t len = prefs.getBytesLength(cfg::kConfigKey);
+  if (len == 0) return false;
+  std::vector<uint8_t> raw(len);
+  if (prefs.getBytes(cfg::kConfigKey, raw.data(), len) != len) return false;
+  const pump::ConfigLoad result = pump::openConfigBlob(raw.data(), len, config);
+  if (result == pump::ConfigLoad::kCorrupt) Serial.println("Config blob corrupt, using defaults");
+  return result == pump::ConfigLoad::kOk;
+}
+
+void loadPersistentState() {
+  // In-memory values are the defaults for anything not stored.
+  static pump::ConfigBlob blob;
+  captureConfig(blob.config);
+  if (!readConfigBlob(blob.config) && pump::migrateLegacyConfig(prefs, blob.config)) {
+    // Settings from the per-key layout: commit them as a blob, then drop the keys.
+    if (commitConfigBlob(blob, &settingsSaveStats)) pump::removeLegacyConfig(prefs);
+  }
+  applyConfig(blob.config);
+}
+
+void writeExpansionState(JsonObject expansion, const pump::FieldFilter& fields = pump::FieldFilter()) {
+  if (fields.wants("enabled")) expansion["enabled"] = expansionEnabled;
+  if (fields.wants("interface")) expansion["interface"] = expansionInterface;
+  if (fields.wants("motorCount")) expansion["motorCount"] = expansionMotorCount;
+  if (fields.wants("connected")) expansion["connected"] = expansionConnected;
+  if (fields.wants("address")) expansion["address"] = expansionConnected ? expansionI2cAddress : 0;
+}
+
+// Wi-Fi and the clock.
+void writeNetworkState(JsonObject out, const pump::FieldFilter& fields = pump::FieldFilter()) {
+  if (fields.wants("wifiConnected")) out["wifiConnected"] = (WiFi.status() == WL_CONNECTED);
+  if (fields.wants("ssid")) out["ssid"] = WiFi.SSID();
+  if (fields.wants("ip")) out["ip"] = WiFi.localIP().toString();
+  if (!fields.wants("time")) return;
   struct tm nowTm{};
-  const char* modeName = st.mode == pump::Mode::DOSING ? "dosing" : "flow_lph";
-  doc["firmware"] = cfg::kFirmwareVersion;
-  doc["motorId"] = motorId;
-  doc["motorAlias"] = motorAliases[motorId];
-  doc["selectedMotorId"] = selectedMotorId;
-  doc["activeMotorCount"] = activeMotorCount();
-  JsonObject expansion = doc.createNestedObject("expansion");
-  expansion["enabled"] = expansionEnabled;
-  expansion["interface"] = expansionInterface;
-  expansion["motorCount"] = expansionMotorCount;
-  expansion["connected"] = expansionConnected;
-  expansion["address"] = expansionConnected ? expansionI2cAddress : 0;
-  doc["mode"] = static_cast<uint8_t>(st.mode);
-  doc["modeName"] = modeName;
-  doc["running"] = st.running;
-  const float flowMlMin = st.currentSpeed * ((st.currentSpeed >= 0) ? st.mlPerRevCw : st.mlPerRevCcw);
-  const float targetFlowMlMin = st.targetSpeed * ((st.targetSpeed >= 0) ? st.mlPerRevCw : st.mlPerRevCcw);
-  doc["flowMlMin"] = flowMlMin;
-  doc["flowLph"] = flowMlMin * 0.06f;
-  doc["targetFlowMlMin"] = targetFlowMlMin;
-  doc["targetFlowLph"] = targetFlowMlMin * 0.06f;
-  doc["dosingFlowLph"] = fabsf(st.dosingSpeed * st.mlPerRevCw * 0.06f);
-  doc["direction"] = (st.targetSpeed >= 0) ? "forward" : "reverse";
-  doc["preferredReverse"] = preferredReverse[motorId];
-  doc["uiLanguage"] = uiLanguage;
-  doc["mlPerRevCw"] = st.mlPerRevCw;
-  doc["mlPerRevCcw"] = st.mlPerRevCcw;
-  doc["dosingRemainingMl"] = st.dosingRemainingMl;
-  doc["uptimeSec"] = st.totalMotorUptimeSec;
-  doc["totalPumpedL"] = st.totalPumpedVolumeL;
-  doc["totalHoseL"] = st.totalHoseVolumeL;
-  doc["wifiConnected"] = (WiFi.status() == WL_CONNECTED);
-  doc["ssid"] = WiFi.SSID();
-  doc["ip"] = WiFi.localIP().toString();
   if (getLocalTimeWithOffset(&nowTm)) {
     char buf[9];
     snprintf(buf, sizeof(buf), "%02d:%02d:%02d", nowTm.tm_hour, nowTm.tm_min, nowTm.tm_sec);
-    doc["time"] = buf;
+    out["time"] = buf;
   } else {
-    doc["time"] = "-";
+    out["time"] = "-";
+  }
+}
+
+// The full state, or with `fields` only the listed keys, and with `since`
+// (a stateVersion) only the parts that changed after it. `motorId` is always
+// written, and so is each reported motor's.
+void writeJsonState(JsonDocument& doc, uint8_t motorId, const pump::FieldFilter& fields = pump::FieldFilter(),
+                    uint32_t since = 0) {
+  if (!isValidMotorId(motorId)) motorId = 0;
+  const bool system = systemVersion > since || since == 0;
+  const bool selected = motorVersions[motorId] > since || since == 0;
+  if (system && fields.wants("firmware")) doc["firmware"] = cfg::kFirmwareVersion;
+  doc["motorId"] = motorId;
+  if (selected && fields.wants("motorAlias")) doc["motorAlias"] = motorAliases[motorId];
+  if (system && fields.wants("selectedMotorId")) doc["selectedMotorId"] = selectedMotorId;
+  if (system && fields.wants("activeMotorCount")) doc["activeMotorCount"] = activeMotorCount();
+  if (system && fields.wants("expansion")) {
+    writeExpansionState(doc.createNestedObject("expansion"), fields.nested("expansion"));
+  }
+  if (selected && fields.wants("preferredReverse")) doc["preferredReverse"] = preferredReverse[motorId];
+  if (system && fields.wants("uiLanguage")) doc["uiLanguage"] = uiLanguage;
+  if (selected) pump::writeStateFields(doc.as<JsonObject>(), controllerById(motorId), fields);
+  if (system) writeNetworkState(doc.as<JsonObject>(), fields);
+
+  if (!fields.wants("motors")) return;
+  const pump::FieldFilter motorFields = fields.nested("motors");
+  JsonArray motors = doc.createNestedArray("motors");
+  for (uint8_t i = 0; i < activeMotorCount(); ++i) {
+    if (since != 0 && motorVersions[i] <= since) continue;
+    JsonObject motor = motors.createNestedObject();
+    writeMotorState(motor, controllerById(i), i, motorFields);
+  }
+}
+
+struct ResponseSink {
+  void operator()(const char* data, size_t len) const { server.sendContent(data, len); }
+};
+
+// What /api/state reports outside the motors, except the clock.
+uint32_t fingerprintSystem() {
+  pump::StateHash hash;
+  hash.add(selectedMotorId);
+  hash.add(activeMotorCount());
+  hash.add(expansionEnabled);
+  hash.addString(expansionInterface.c_str());
+  hash.add(expansionMotorCount);
+  hash.add(expansionConnected);
+  hash.add(expansionI2cAddress);
+  hash.addString(uiLanguage.c_str());
+  hash.add(WiFi.status() == WL_CONNECTED);
+  hash.addString(WiFi.SSID().c_str());
+  hash.add(static_cast<uint32_t>(WiFi.localIP()));
+  return hash.value();
+}
+
+uint32_t fingerprintMotor(uint8_t motorId) {
+  pump::StateHash hash;
+  hash.addString(motorAliases[motorId].c_str());
+  hash.add(preferredReverse[motorId]);
+  pump::hashStateFields(hash, controllerById(motorId));
+  return hash.value();
+}
+
+// Compares everything /api/state reports, except the clock, with the last
+// call and bumps stateVersion if anything changed. `time` is left out, or an
+// idle pump would change every second; the UI keeps its clock ticking.
+void updateStateVersion() {
+  const uint32_t next = stateVersion + 1;
+  bool changed = false;
+  const uint32_t system = fingerprintSystem();
+  if (stateVersion == 0 || system != systemFingerprint) {
+    systemFingerprint = system;
+    systemVersion = next;
+    changed = true;
+  }
+  for (uint8_t i = 0; i < activeMotorCount(); ++i) {
+    const uint32_t motor = fingerprintMotor(i);
+    if (stateVersion == 0 || i >= versionedMotorCount || motor != motorFingerprints[i]) {
+      motorFingerprints[i] = motor;
+      motorVersions[i] = next;
+      changed = true;
+    }
+  }
+  versionedMotorCount = activeMotorCount();
+  if (changed) stateVersion = next;
+}
+
+uint32_t fingerprintSchedules() {
+  pump::StateHash hash;
+  hash.add(tzOffsetMinutes);
+  for (const DoseScheduleEntry& e : doseSchedules) {
+    hash.add(e.enabled);
+    hash.add(e.hour);
+    hash.add(e.minute);
+    hash.add(e.volumeMl);
+    hash.add(e.reverse);
+    hash.add(e.motorId);
+    hash.addString(e.name);
+    hash.add(e.weekdaysMask);
   }
+  return hash.value();
+}
 
-  JsonArray motors = doc.createNestedArray("motors");
+// Costs a hash of the state instead of a full document; call
+// updateStateVersion() first. A field list gets a tag of its own.
+String stateEtag(uint8_t motorId, bool packed, const String& fields) {
+  char list[10] = "";
+  if (fields.length() > 0) {
+    pump::StateHash hash;
+    hash.addString(fields.c_str());
+    snprintf(list, sizeof(list), "-%08lx", static_cast<unsigned long>(hash.value()));
+  }
+  char tag[48];
+  snprintf(tag, sizeof(tag), "\"%08lx-%lu-%u%s%s\"", static_cast<unsigned long>(stateBootTag),
+           static_cast<unsigned long>(stateVersion), motorId, list, packed ? "p" : "");
+  return String(tag);
+}
+
+// The "version" /api/state reports and ?since= takes back: "<boot>-<n>".
+String stateVersionToken() {
+  char token[20];
+  snprintf(token, sizeof(token), "%08lx-%lu", static_cast<unsigned long>(stateBootTag),
+           static_cast<unsigned long>(stateVersion));
+  return String(token);
+}
+
+// The version a ?since= token names, or 0 (everything) for one from another
+// boot, from the future or that does not parse.
+uint32_t parseStateSince(const String& token) {
+  unsigned long boot = 0;
+  unsigned long version = 0;
+  char rest = 0;
+  if (sscanf(token.c_str(), "%lx-%lu%c", &boot, &version, &rest) != 2) return 0;
+  if (boot != stateBootTag || version > stateVersion) return 0;
+  return static_cast<uint32_t>(version);
+}
+
+// /api/state for machine clients (Accept: application/msgpack): every motor
+// as one MessagePack array of numbers in a fixed order, written without a
+// JSON document. The layout is in the README.
+void sendPackedState() {
+  uint8_t buf[cfg::kPackedStateBytes];
+  pump::MsgPackWriter out(buf, sizeof(buf));
+  const time_t now = time(nullptr);
+  out.array(8);
+  out.uint(cfg::kPackedStateVersion);
+  out.uint(now < 100000 ? 0 : static_cast<uint32_t>(now));
+  out.uint(selectedMotorId);
+  out.uint(activeMotorCount());
+  out.boolean(WiFi.status() == WL_CONNECTED);
+  out.boolean(expansionEnabled);
+  out.boolean(expansionConnected);
+  out.array(activeMotorCount());
   for (uint8_t i = 0; i < activeMotorCount(); ++i) {
-    JsonObject motor = motors.createNestedObject();
-    writeMotorState(motor, controllerById(i), i);
+    out.array(2 + pump::kPackedStateFields);
+    out.uint(i);
+    out.boolean(preferredReverse[i]);
+    pump::packStateFields(out, controllerById(i));
+  }
+  // Built; the socket drains without the lock.
+  StateUnlock unlock;
+  if (!out.ok()) {
+    server.send(500, "text/plain", "packed state does not fit");
+    return;
   }
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  server.setContentLength(out.size());
+  server.send(200, "application/msgpack", "");
+  server.sendContent(reinterpret_cast<const char*>(buf), out.size());
 }
 
-void sendJson(int code, DynamicJsonDocument& doc) {
-  String out;
-  serializeJson(doc, out);
+// Serializes straight into the socket in 512-byte pieces rather than into a
+// String first. The size is measured up front, so the response still carries
+// a Content-Length and needs no chunked encoding. `doc` holds copies of what
+// it reports, so a handler's lock is released while the client reads.
+void sendJson(int code, JsonDocument& doc) {
+  StateUnlock unlock;
   server.sendHeader("Access-Control-Allow-Origin", "*");
   server.sendHeader("Access-Control-Allow-Headers", "Content-Type");
   server.sendHeader("Access-Control-Allow-Methods", "GET,POST,OPTIONS");
-  server.send(code, "application/json", out);
+  server.setContentLength(measureJson(doc));
+  server.send(code, "application/json", "");
+  pump::BufferedJsonWriter<ResponseSink> out{ResponseSink()};
+  serializeJson(doc, out);
+}
+
+// What /metrics reports outside the HTTP counters, copied under the state
+// lock. Both passes over it (length, then body) see the same values, and
+// the socket drains without the lock.
+struct MetricsSnapshot {
+  uint8_t motorCount;
+  std::array<pump::CounterTotals, cfg::kMaxMotors> totals;
+  std::array<bool, cfg::kMaxMotors> running;
+  std::array<uint32_t, cfg::kMaxMotors> doses;
+  uint32_t scheduleTriggers;
+  uint32_t scheduleSkips;
+  uint32_t i2cTransactions;
+  uint32_t i2cErrors;
+  pump::SaveStats settings;
+  pump::SaveStats counters;
+  pump::Histogram<10> loopPass;
+  pump::Histogram<8> tickInterval;
+
+  MetricsSnapshot()
+      : motorCount(activeMotorCount()),
+        doses(doseCounts),
+        scheduleTriggers(::scheduleTriggers),
+        scheduleSkips(::scheduleSkips),
+        i2cTransactions(::i2cTransactions),
+        i2cErrors(::i2cErrors),
+        settings(settingsSaveStats),
+        counters(counterSaveStats),
+        loopPass(loopPassHistogram),
+        tickInterval(tickIntervalHistogram) {
+    for (uint8_t i = 0; i < cfg::kMaxMotors; ++i) {
+      totals[i] = countersOf(i);
+      running[i] = controllerById(i).state().running;
+    }
+  }
+};
+
+MetricsSnapshot lockedMetricsSnapshot() {
+  apiWaiting = true;
+  StateLock lock;
+  apiWaiting = false;
+  return MetricsSnapshot();
+}
+
+const char* httpMethodName(HTTPMethod method) {
+  switch (method) {
+    case HTTP_GET:
+      return "GET";
+    case HTTP_POST:
+      return "POST";
+    default:
+      return "OTHER";
+  }
+}
+
+template <typename Out>
+void writeMetrics(Out& out, const MetricsSnapshot& m) {
+  pump::MetricsWriter<Out> w(out);
+  char labels[64];
+  w.family("pump_pumped_liters_total", "counter", "Volume pumped by the motor.");
+  for (uint8_t i = 0; i < m.motorCount; ++i) {
+    snprintf(labels, sizeof(labels), "motor=\"%u\"", i);
+    w.sample("pump_pumped_liters_total", labels, m.totals[i].pumpedNl / 1e9);
+  }
+  w.family("pump_hose_liters_total", "counter", "Volume through the current hose.");
+  for (uint8_t i = 0; i < m.motorCount; ++i) {
+    snprintf(labels, sizeof(labels), "motor=\"%u\"", i);
+    w.sample("pump_hose_liters_total", labels, m.totals[i].hoseNl / 1e9);
+  }
+  w.family("pump_motor_uptime_seconds_total", "counter", "Time the motor has run.");
+  for (uint8_t i = 0; i < m.motorCount; ++i) {
+    snprintf(labels, sizeof(labels), "motor=\"%u\"", i);
+    w.sample("pump_motor_uptime_seconds_total", labels, static_cast<uint64_t>(m.totals[i].uptimeSec));
+  }
+  w.family("pump_running", "gauge", "1 while the motor turns.");
+  for (uint8_t i = 0; i < m.motorCount; ++i) {
+    snprintf(labels, sizeof(labels), "motor=\"%u\"", i);
+    w.sample("pump_running", labels, static_cast<uint64_t>(m.running[i] ? 1 : 0));
+  }
+  w.family("pump_doses_total", "counter", "Doses started since boot, by the API or a schedule.");
+  for (uint8_t i = 0; i < m.motorCount; ++i) {
+    snprintf(labels, sizeof(labels), "motor=\"%u\"", i);
+    w.sample("pump_doses_total", labels, static_cast<uint64_t>(m.doses[i]));
+  }
+  w.family("pump_schedule_triggers_total", "counter", "Scheduled doses started since boot.");
+  w.sample("pump_schedule_triggers_total", nullptr, static_cast<uint64_t>(m.scheduleTriggers));
+  w.family("pump_schedule_skips_total", "counter", "Scheduled doses skipped because the motor was busy.");
+  w.sample("pump_schedule_skips_total", nullptr, static_cast<uint64_t>(m.scheduleSkips));
+  w.family("pump_i2c_transactions_total", "counter", "I2C exchanges with the expansion board.");
+  w.sample("pump_i2c_transactions_total", nullptr, static_cast<uint64_t>(m.i2cTransactions));
+  w.family("pump_i2c_errors_total", "counter", "I2C exchanges that were not acknowledged or came back short.");
+  w.sample("pump_i2c_errors_total", nullptr, static_cast<uint64_t>(m.i2cErrors));
+
+  const pump::SaveStats* saves[] = {&m.settings, &m.counters};
+  const char* saveLabels[] = {"store=\"settings\"", "store=\"counters\""};
+  w.family("pump_save_passes_total", "counter", "Save passes: settings to NVS, counters to the journal.");
+  for (uint8_t i = 0; i < 2; ++i) w.sample("pump_save_passes_total", saveLabels[i], static_cast<uint64_t>(saves[i]->passes));
+  w.family("pump_save_bytes_total", "counter", "Bytes written by save passes.");
+  for (uint8_t i = 0; i < 2; ++i) w.sample("pump_save_bytes_total", saveLabels[i], static_cast<uint64_t>(saves[i]->totalBytes));
+  w.family("pump_save_seconds_total", "counter", "Time spent in save passes.");
+  for (uint8_t i = 0; i < 2; ++i) w.sample("pump_save_seconds_total", saveLabels[i], saves[i]->totalMicros * 1e-6);
+  w.family("pump_save_last_seconds", "gauge", "Duration of the last save pass.");
+  for (uint8_t i = 0; i < 2; ++i) w.sample("pump_save_last_seconds", saveLabels[i], saves[i]->lastMicros * 1e-6);
+  w.family("pump_save_max_seconds", "gauge", "Longest save pass since boot.");
+  for (uint8_t i = 0; i < 2; ++i) w.sample("pump_save_max_seconds", saveLabels[i], saves[i]->maxMicros * 1e-6);
+
+  w.family("pump_loop_pass_seconds", "histogram", "Duration of loop() passes.");
+  w.histogram("pump_loop_pass_seconds", nullptr, m.loopPass, 1e-6);
+  w.family("pump_control_tick_interval_seconds", "histogram", "Time between control ticks while the speed changes, due every 10 ms.");
+  w.histogram("pump_control_tick_interval_seconds", nullptr, m.tickInterval, 1e-6);
+
+  w.family("pump_http_requests_total", "counter", "HTTP requests by route; \"other\" is static files and 404s.");
+  for (uint8_t i = 0; i < httpRouteCount; ++i) {
+    snprintf(labels, sizeof(labels), "method=\"%s\",route=\"%s\"", httpMethodName(httpRoutes[i].method),
+             httpRoutes[i].uri.c_str());
+    w.sample("pump_http_requests_total", labels, static_cast<uint64_t>(httpRoutes[i].requests));
+  }
+  w.sample("pump_http_requests_total", "method=\"ANY\",route=\"other\"", static_cast<uint64_t>(httpUnmatchedRequests));
 }
 
-bool parseBody(DynamicJsonDocument& doc) {
+bool parseBody(JsonDocument& doc) {
   if (!server.hasArg("plain")) return false;
   DeserializationError err = deserializeJson(doc, server.arg("plain"));
   return !err;
@@ -974,25 +2075,30 @@ bool parseBody(DynamicJsonDocument& doc) {
 bool ensureAuthenticated() {
   if (!webAuthEnabled) return true;
   if (server.authenticate(webAuthUser.c_str(), webAuthPass.c_str())) return true;
+  StateUnlock unlock;
   server.requestAuthentication(BASIC_AUTH, "Peristaltic Pump");
   return false;
 }
 
-bool startDosingNow(uint8_t motorId, uint16_t volumeMl, bool reverse) {
+// `nowMs` is the loop pass's clock, which the control tick will pass to the
+// controller too.
+bool startDosingNow(uint8_t motorId, uint16_t volumeMl, bool reverse, uint32_t nowMs) {
   if (!isValidMotorId(motorId)) return false;
   if (volumeMl == 0) return false;
   auto& ctrl = controllerById(motorId);
   if (ctrl.state().running) return false;
+  // Committed by the next settings pass.
   preferredReverse[motorId] = reverse;
-  char key[24];
-  snprintf(key, sizeof(key), "pref_rev_%u", motorId);
-  prefs.putBool(key, preferredReverse[motorId]);
   if (motorId == 0) {
+    // The plan starts at the controller's clock; catch up to now first.
+    ctrl.advanceTo(nowMs);
     ctrl.startDosing(reverse ? -static_cast<int32_t>(volumeMl) : static_cast<int32_t>(volumeMl));
+    ++doseCounts[0];
     return true;
   }
   const uint8_t remoteIdx = motorId - 1;
   if (!expansionStartDosing(remoteIdx, volumeMl, reverse)) return false;
+  ++doseCounts[motorId];
   delay(2);
   return expansionReadState(remoteIdx);
 }
@@ -1015,7 +2121,7 @@ bool isWeekdayEnabled(uint8_t weekdaysMask, int tmWday) {
   return (weekdaysMask & (1u << bit)) != 0;
 }
 
-void processDosingSchedule() {
+void processDosingSchedule(uint32_t nowMs) {
   struct tm nowTm{};
   if (!getLocalTimeWithOffset(&nowTm)) return;
 
@@ -1031,61 +2137,226 @@ void processDosingSchedule() {
     if (controllerById(s.motorId).state().running) {
       // Busy at trigger minute: skip this schedule for today.
       s.lastRunYDay = nowTm.tm_yday;
+      ++scheduleSkips;
+      trace(pump::TraceType::kScheduleSkip, i, s.motorId, s.volumeMl);
       continue;
     }
-    if (startDosingNow(s.motorId, s.volumeMl, s.reverse)) {
+    if (startDosingNow(s.motorId, s.volumeMl, s.reverse, nowMs)) {
       s.lastRunYDay = nowTm.tm_yday;
+      ++scheduleTriggers;
+      trace(pump::TraceType::kScheduleFire, i, s.motorId, s.volumeMl);
       break;
     }
   }
 }
 
+// /api/events subscribers: sockets kept open after their handler returned.
+// Only the task serving HTTP touches them.
+WiFiClient eventClients[cfg::kMaxEventClients];
+pump::EventThrottle eventThrottle(cfg::kEventMinIntervalMs, cfg::kEventKeepAliveMs);
+// Fingerprints of what the streams were last sent.
+uint32_t pushedSystem = 0;
+std::array<uint32_t, cfg::kMaxMotors> pushedMotors = {};
+uint32_t pushedSchedules = 0;
+
+uint8_t openEventClients() {
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < cfg::kMaxEventClients; ++i) {
+    if (eventClients[i].connected()) mask |= 1u << i;
+  }
+  return mask;
+}
+
+void recordPushedState() {
+  pushedSystem = fingerprintSystem();
+  for (uint8_t i = 0; i < activeMotorCount(); ++i) pushedMotors[i] = fingerprintMotor(i);
+  pushedSchedules = fingerprintSchedules();
+}
+
+// Event stream text, built under the state lock and written to the
+// subscribers once it is released. Only the HTTP task uses it.
+struct EventBuffer {
+  char data[cfg::kEventBufferBytes];
+  size_t len = 0;
+
+  // False, leaving the buffer as it was, when the event does not fit.
+  bool append(const char* name, JsonDocument& doc) {
+    const size_t need = strlen("event: \ndata: \n\n") + strlen(name) + measureJson(doc);
+    // serializeJson() also writes a terminating NUL.
+    if (len + need >= sizeof(data)) return false;
+    len += snprintf(data + len, sizeof(data) - len, "event: %s\ndata: ", name);
+    len += serializeJson(doc, data + len, sizeof(data) - len);
+    len += snprintf(data + len, sizeof(data) - len, "\n\n");
+    return true;
+  }
+};
+EventBuffer eventBuffer;
+
+// Hands event bytes to the subscribers in `mask` without waiting on any of
+// them. One whose socket cannot take all of it now is dropped rather than
+// left to stall the HTTP task; EventSource reconnects for a fresh snapshot.
+void writeEvents(uint8_t mask, const char* data, size_t len) {
+  for (uint8_t i = 0; i < cfg::kMaxEventClients; ++i) {
+    if ((mask & (1u << i)) == 0 || !eventClients[i].connected()) continue;
+    const int fd = eventClients[i].fd();
+    if (fd < 0 || send(fd, data, len, MSG_DONTWAIT) != static_cast<ssize_t>(len)) eventClients[i].stop();
+  }
+}
+
+// `system` carries the /api/state fields outside the motors, `motor` one
+// entry of its `motors` array, `schedule` only says the schedule changed.
+// A snapshot takes every system and motor event and leaves the fingerprints
+// alone, so the other subscribers still get their deltas. An event that does
+// not fit in `out` keeps its old fingerprint and goes with the next push.
+bool buildStateEvents(EventBuffer& out, bool snapshot) {
+  out.len = 0;
+  const uint32_t system = fingerprintSystem();
+  if (snapshot || system != pushedSystem) {
+    PooledJsonDocument doc(cfg::kEventJsonCapacity);
+    JsonObject obj = doc.to<JsonObject>();
+    obj["firmware"] = cfg::kFirmwareVersion;
+    obj["selectedMotorId"] = selectedMotorId;
+    obj["activeMotorCount"] = activeMotorCount();
+    writeExpansionState(obj.createNestedObject("expansion"));
+    obj["uiLanguage"] = uiLanguage;
+    writeNetworkState(obj);
+    if (out.append("system", doc) && !snapshot) pushedSystem = system;
+  }
+  for (uint8_t i = 0; i < activeMotorCount(); ++i) {
+    const uint32_t motor = fingerprintMotor(i);
+    if (!snapshot && motor == pushedMotors[i]) continue;
+    PooledJsonDocument doc(cfg::kEventJsonCapacity);
+    writeMotorState(doc.to<JsonObject>(), controllerById(i), i);
+    if (out.append("motor", doc) && !snapshot) pushedMotors[i] = motor;
+  }
+  const uint32_t schedules = fingerprintSchedules();
+  if (!snapshot && schedules != pushedSchedules) {
+    PooledJsonDocument doc(64);
+    doc.to<JsonObject>();
+    if (out.append("schedule", doc)) pushedSchedules = schedules;
+  }
+  return out.len > 0;
+}
+
+// Called after every handleClient(). Takes the state lock only while someone
+// is subscribed, and then at most once per kEventMinIntervalMs, for as long
+// as it takes to build the events.
+void pushEvents() {
+  const uint8_t mask = openEventClients();
+  if (mask == 0) return;
+  const uint32_t now = millis();
+  if (!eventThrottle.due(now)) return;
+  bool sent = false;
+  {
+    apiWaiting = true;
+    StateLock lock;
+    apiWaiting = false;
+    sent = buildStateEvents(eventBuffer, false);
+  }
+  if (sent) writeEvents(mask, eventBuffer.data, eventBuffer.len);
+  if (!sent && eventThrottle.keepAliveDue(now)) {
+    writeEvents(mask, ": keep-alive\n\n", 15);
+    sent = true;
+  }
+  if (sent) eventThrottle.sent(now);
+}
+
+// ETags of assets without a fingerprint (the page itself), hashed on first
+// request. A filesystem update reboots, which clears them.
+struct AssetEtag {
+  String path;
+  String etag;
+};
+std::array<AssetEtag, cfg::kAssetEtagSlots> assetEtags;
+uint8_t nextAssetEtag = 0;
+
+String contentEtag(const String& stored) {
+  for (const AssetEtag& e : assetEtags) {
+    if (e.path == stored) return e.etag;
+  }
+  File f = LittleFS.open(stored, "r");
+  pump::StateHash hash;
+  uint8_t buf[256];
+  for (size_t n = f.read(buf, sizeof(buf)); n > 0; n = f.read(buf, sizeof(buf))) hash.add(buf, n);
+  f.close();
+  char tag[12];
+  snprintf(tag, sizeof(tag), "\"%08lx\"", static_cast<unsigned long>(hash.value()));
+  AssetEtag& slot = assetEtags[nextAssetEtag];
+  nextAssetEtag = (nextAssetEtag + 1) % cfg::kAssetEtagSlots;
+  slot.path = stored;
+  slot.etag = tag;
+  return slot.etag;
+}
+
+// Serves a UI file from LittleFS, preferring the gzip copy from the asset
+// build step; streamFile() adds Content-Encoding: gzip for *.gz names. An
+// older filesystem image with plain files is served as it is.
+bool serveStaticAsset(const String& path) {
+  // Only LittleFS: a caller's state lock is not needed while the file streams.
+  StateUnlock unlock;
+  if (path.endsWith("/")) return false;
+  String stored = path + ".gz";
+  if (!LittleFS.exists(stored)) stored = path;
+  if (!LittleFS.exists(stored)) return false;
+  char fingerprint[pump::kAssetFingerprintLen + 1];
+  String etag;
+  if (pump::assetFingerprint(path.c_str(), fingerprint)) {
+    etag = String("\"") + fingerprint + "\"";
+    server.sendHeader("Cache-Control", cfg::kImmutableCacheControl);
+  } else {
+    etag = contentEtag(stored);
+    server.sendHeader("Cache-Control", "no-cache");
+  }
+  server.sendHeader("ETag", etag);
+  if (server.hasHeader("If-None-Match") && server.header("If-None-Match").indexOf(etag) >= 0) {
+    server.send(304);
+    return true;
+  }
+  File f = LittleFS.open(stored, "r");
+  if (!f) return false;
+  server.streamFile(f, pump::assetContentType(path.c_str()));
+  f.close();
+  return true;
+}
+
+// /api/start, /api/stop, /api/flow and /api/dosing: one command, answered
+// with the state of its motor. Start and stop take an empty body as motor 0.
+void handleMotorCommand(MotorOp op) {
+  if (!ensureAuthenticated()) return;
+  PooledJsonDocument in(1024);
+  if (server.hasArg("plain") && !parseBody(in)) in.clear();
+  MotorCommand cmd;
+  const char* error = parseMotorCommand(op, in, cmd);
+  if (error != nullptr) {
+    PooledJsonDocument err(256);
+    err["error"] = error;
+    sendJson(400, err);
+    return;
+  }
+  error = applyMotorCommand(cmd, true);
+  if (error != nullptr) {
+    PooledJsonDocument err(256);
+    err["error"] = error;
+    sendJson(503, err);
+    return;
+  }
+  PooledJsonDocument doc(cfg::kStateJsonCapacity);
+  writeJsonState(doc, cmd.motorId);
+  sendJson(200, doc);
+}
+
 void handleOptions() {
-  DynamicJsonDocument doc(64);
+  PooledJsonDocument doc(64);
   doc["ok"] = true;
   sendJson(200, doc);
 }
 
 void setupApi() {
+  static const char* kCollectedHeaders[] = {"If-None-Match", "Accept"};
+  server.collectHeaders(kCollectedHeaders, 2);
   server.on("/", HTTP_GET, []() {
     if (!ensureAuthenticated()) return;
-    File f = LittleFS.open("/index.html", "r");
-    if (!f) {
-      server.send(500, "text/plain", "index.html not found in LittleFS");
-      return;
-    }
-    server.streamFile(f, "text/html");
-    f.close();
-  });
-  server.on("/styles.css", HTTP_GET, []() {
-    if (!ensureAuthenticated()) return;
-    File f = LittleFS.open("/styles.css", "r");
-    if (!f) {
-      server.send(404, "text/plain", "styles.css not found");
-      return;
-    }
-    server.streamFile(f, "text/css");
-    f.close();
-  });
-  server.on("/app.js", HTTP_GET, []() {
-    if (!ensureAuthenticated()) return;
-    File f = LittleFS.open("/app.js", "r");
-    if (!f) {
-      server.send(404, "text/plain", "app.js not found");
-      return;
-    }
-    server.streamFile(f, "application/javascript");
-    f.close();
-  });
-  server.on("/growth-schedule.js", HTTP_GET, []() {
-    if (!ensureAuthenticated()) return;
-    File f = LittleFS.open("/growth-schedule.js", "r");
-    if (!f) {
-      server.send(404, "text/plain", "growth-schedule.js not found");
-      return;
-    }
-    server.streamFile(f, "application/javascript");
-    f.close();
+    if (!serveStaticAsset("/index.html")) server.send(500, "text/plain", "index.html not found in LittleFS");
   });
 
   server.on("/api/state", HTTP_GET, []() {
@@ -1093,71 +2364,73 @@ void setupApi() {
     bool ok = false;
     const uint8_t motorId = readMotorIdFromRequest(&ok);
     if (!ok) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "invalid motorId";
       sendJson(400, err);
       return;
     }
-    DynamicJsonDocument doc(2048);
-    writeJsonState(doc, motorId);
-    sendJson(200, doc);
-  });
-
-  server.on("/api/start", HTTP_POST, []() {
-    if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(256);
-    if (server.hasArg("plain") && !parseBody(in)) in.clear();
-    bool ok = false;
-    const uint8_t motorId = readMotorIdFromJson(in, &ok);
-    if (!ok) {
-      DynamicJsonDocument err(128);
-      err["error"] = "invalid motorId";
-      sendJson(400, err);
-      return;
+    const bool packed = server.hasHeader("Accept") && server.header("Accept").indexOf("application/msgpack") >= 0;
+    // The packed state is fixed; fields and since only shape the JSON.
+    const String fields = packed ? String() : server.arg("fields");
+    const bool delta = !packed && server.hasArg("since");
+    updateStateVersion();
+    if (!delta) {
+      // A delta is relative to the client's version, so it gets no ETag.
+      const String etag = stateEtag(packed ? 0 : motorId, packed, fields);
+      server.sendHeader("ETag", etag);
+      server.sendHeader("Cache-Control", "no-cache");
+      server.sendHeader("Vary", "Accept");
+      if (server.hasHeader("If-None-Match") && server.header("If-None-Match").indexOf(etag) >= 0) {
+        StateUnlock unlock;
+        server.send(304);
+        return;
+      }
     }
-    if (motorId == 0) {
-      controllerById(motorId).start();
-    } else if (!expansionStart(motorId - 1) || !expansionReadState(motorId - 1)) {
-      DynamicJsonDocument err(128);
-      err["error"] = "expansion motor start failed";
-      sendJson(503, err);
+    if (packed) {
+      sendPackedState();
       return;
     }
-    DynamicJsonDocument doc(2048);
-    writeJsonState(doc, motorId);
+    PooledJsonDocument doc(cfg::kStateJsonCapacity);
+    writeJsonState(doc, motorId, pump::FieldFilter(fields.c_str()), delta ? parseStateSince(server.arg("since")) : 0);
+    doc["version"] = stateVersionToken();
     sendJson(200, doc);
   });
 
-  server.on("/api/stop", HTTP_POST, []() {
+  // Server-sent events: the socket outlives the handler and is written by
+  // pushEvents() from then on. It starts with a snapshot of every motor.
+  server.on("/api/events", HTTP_GET, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(256);
-    if (server.hasArg("plain") && !parseBody(in)) in.clear();
-    bool ok = false;
-    const uint8_t motorId = readMotorIdFromJson(in, &ok);
-    if (!ok) {
-      DynamicJsonDocument err(128);
-      err["error"] = "invalid motorId";
-      sendJson(400, err);
-      return;
-    }
-    if (motorId == 0) {
-      controllerById(motorId).stop(false);
-    } else if (!expansionStop(motorId - 1) || !expansionReadState(motorId - 1)) {
-      DynamicJsonDocument err(128);
-      err["error"] = "expansion motor stop failed";
+    const uint8_t open = openEventClients();
+    uint8_t slot = 0;
+    while (slot < cfg::kMaxEventClients && (open & (1u << slot)) != 0) ++slot;
+    if (slot == cfg::kMaxEventClients) {
+      PooledJsonDocument err(128);
+      err["error"] = "too many event streams";
       sendJson(503, err);
       return;
     }
-    DynamicJsonDocument doc(2048);
-    writeJsonState(doc, motorId);
-    sendJson(200, doc);
+    if (open == 0) recordPushedState();
+    buildStateEvents(eventBuffer, true);
+    StateUnlock unlock;
+    WiFiClient& client = eventClients[slot];
+    client = server.client();
+    client.setNoDelay(true);
+    client.print("HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/event-stream\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Connection: keep-alive\r\n"
+                 "Access-Control-Allow-Origin: *\r\n\r\n");
+    writeEvents(1u << slot, eventBuffer.data, eventBuffer.len);
   });
 
+  server.on("/api/start", HTTP_POST, []() { handleMotorCommand(MotorOp::kStart); });
+  server.on("/api/stop", HTTP_POST, []() { handleMotorCommand(MotorOp::kStop); });
+
   server.on("/api/ui/preferences", HTTP_POST, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(512);
+    PooledJsonDocument in(512);
     if (!parseBody(in)) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "invalid json";
       sendJson(400, err);
       return;
@@ -1165,15 +2438,12 @@ void setupApi() {
     bool hasUpdate = false;
     if (in["reverse"].is<bool>()) {
       preferredReverse[selectedMotorId] = in["reverse"].as<bool>();
-      char key[24];
-      snprintf(key, sizeof(key), "pref_rev_%u", selectedMotorId);
-      prefs.putBool(key, preferredReverse[selectedMotorId]);
       hasUpdate = true;
     }
     if (in["motorId"].is<int>()) {
       const int motorId = in["motorId"].as<int>();
       if (motorId < 0 || motorId >= static_cast<int>(activeMotorCount())) {
-        DynamicJsonDocument err(128);
+        PooledJsonDocument err(128);
         err["error"] = "invalid motorId";
         sendJson(400, err);
         return;
@@ -1184,7 +2454,7 @@ void setupApi() {
     if (in["language"].is<const char*>()) {
       const String lang = in["language"].as<String>();
       if (lang != "en" && lang != "ru") {
-        DynamicJsonDocument err(128);
+        PooledJsonDocument err(128);
         err["error"] = "language must be en or ru";
         sendJson(400, err);
         return;
@@ -1193,21 +2463,20 @@ void setupApi() {
       hasUpdate = true;
     }
     if (!hasUpdate) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "at least one field is required: reverse, motorId or language";
       sendJson(400, err);
       return;
     }
-    prefs.putUChar("sel_motor", selectedMotorId);
-    prefs.putString("ui_lang", uiLanguage);
-    DynamicJsonDocument doc(2048);
+    savePersistentState();
+    PooledJsonDocument doc(cfg::kStateJsonCapacity);
     writeJsonState(doc, selectedMotorId);
     sendJson(200, doc);
   });
 
   server.on("/api/ui/preferences", HTTP_GET, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument doc(1024);
+    PooledJsonDocument doc(1024);
     doc["reverse"] = preferredReverse[selectedMotorId];
     doc["motorId"] = selectedMotorId;
     doc["activeMotorCount"] = activeMotorCount();
@@ -1219,118 +2488,95 @@ void setupApi() {
     sendJson(200, doc);
   });
 
-  server.on("/api/flow", HTTP_POST, []() {
-    if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(1024);
-    if (!parseBody(in) || !in["litersPerHour"].is<float>()) {
-      DynamicJsonDocument err(256);
-      err["error"] = "litersPerHour is required";
-      sendJson(400, err);
-      return;
-    }
+  server.on("/api/flow", HTTP_POST, []() { handleMotorCommand(MotorOp::kFlow); });
+  server.on("/api/dosing", HTTP_POST, []() { handleMotorCommand(MotorOp::kDosing); });
 
-    const float lph = in["litersPerHour"].as<float>();
-    const bool reverse = in["reverse"] | false;
-    const String direction = (in["direction"].is<const char*>()) ? in["direction"].as<String>() : String("");
-    if (lph < 0) {
-      DynamicJsonDocument err(256);
-      err["error"] = "litersPerHour must be >= 0";
+  // Validates every command before issuing any, then answers with the
+  // motors they touched. Expansion commands go out back to back and each
+  // expansion motor is read once at the end. Commands are carried out in
+  // order and stop at the first the expansion refuses; `applied` counts the
+  // ones that went through.
+  server.on("/api/batch", HTTP_POST, []() {
+    if (!ensureAuthenticated()) return;
+    PooledJsonDocument in(cfg::kBatchJsonCapacity);
+    if (!parseBody(in) || !in["commands"].is<JsonArray>()) {
+      PooledJsonDocument err(128);
+      err["error"] = "commands array is required";
       sendJson(400, err);
       return;
     }
-    bool ok = false;
-    const uint8_t motorId = readMotorIdFromJson(in, &ok);
-    if (!ok) {
-      DynamicJsonDocument err(256);
-      err["error"] = "invalid motorId";
+    JsonArrayConst list = in["commands"].as<JsonArrayConst>();
+    if (list.size() == 0 || list.size() > cfg::kMaxBatchCommands) {
+      PooledJsonDocument err(128);
+      err["error"] = "commands must hold 1 to 16 entries";
       sendJson(400, err);
       return;
     }
-    const bool useReverse = reverse || direction == "ccw" || direction == "reverse";
-    preferredReverse[motorId] = useReverse;
-    char key[24];
-    snprintf(key, sizeof(key), "pref_rev_%u", motorId);
-    prefs.putBool(key, preferredReverse[motorId]);
-    if (motorId == 0) {
-      const auto& st = controllerById(motorId).state();
-      const float mlPerRev = useReverse ? st.mlPerRevCcw : st.mlPerRevCw;
-      const float speed = (lph * 1000.0f / 60.0f) / mlPerRev * (useReverse ? -1.0f : 1.0f);
-      controllerById(motorId).setSpeed(speed, pump::Mode::FLOW);
-    } else if (!expansionSetFlow(motorId - 1, lph, useReverse) || !expansionReadState(motorId - 1)) {
-      DynamicJsonDocument err(256);
-      err["error"] = "expansion flow command failed";
-      sendJson(503, err);
-      return;
+    MotorCommand cmds[cfg::kMaxBatchCommands];
+    size_t count = 0;
+    for (JsonVariantConst entry : list) {
+      MotorOp op = MotorOp::kStart;
+      const char* error = parseMotorOp(entry["op"].as<const char*>(), op)
+                              ? parseMotorCommand(op, entry, cmds[count])
+                              : "op must be start, stop, flow or dosing";
+      if (error != nullptr) {
+        PooledJsonDocument err(128);
+        err["error"] = error;
+        err["index"] = count;
+        sendJson(400, err);
+        return;
+      }
+      ++count;
     }
 
-    DynamicJsonDocument doc(2048);
-    writeJsonState(doc, motorId);
-    sendJson(200, doc);
-  });
-
-  auto dosingHandler = []() {
-    if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(1024);
-    if (!parseBody(in) || !in["volumeMl"].is<int>()) {
-      DynamicJsonDocument err(256);
-      err["error"] = "volumeMl is required";
-      sendJson(400, err);
-      return;
+    uint8_t touched = 0;
+    size_t applied = 0;
+    const char* failure = nullptr;
+    for (; applied < count; ++applied) {
+      touched |= 1u << cmds[applied].motorId;
+      failure = applyMotorCommand(cmds[applied], false);
+      if (failure != nullptr) break;
     }
-
-    const int32_t volume = in["volumeMl"].as<int32_t>();
-    if (volume <= 0) {
-      DynamicJsonDocument err(256);
-      err["error"] = "volumeMl must be > 0; use reverse=true";
-      sendJson(400, err);
-      return;
+    bool readFailed = false;
+    for (uint8_t i = 1; i < activeMotorCount(); ++i) {
+      if ((touched & (1u << i)) != 0 && !expansionReadState(i - 1)) readFailed = true;
     }
-    bool ok = false;
-    const uint8_t motorId = readMotorIdFromJson(in, &ok);
-    if (!ok) {
-      DynamicJsonDocument err(256);
-      err["error"] = "invalid motorId";
-      sendJson(400, err);
-      return;
+
+    PooledJsonDocument doc(cfg::kStateJsonCapacity);
+    doc["applied"] = applied;
+    if (failure != nullptr) {
+      doc["error"] = failure;
+      doc["index"] = applied;
+    } else if (readFailed) {
+      doc["error"] = "expansion state read failed";
     }
-    const bool reverse = in["reverse"] | false;
-    preferredReverse[motorId] = reverse;
-    char key[24];
-    snprintf(key, sizeof(key), "pref_rev_%u", motorId);
-    prefs.putBool(key, preferredReverse[motorId]);
-    if (motorId == 0) {
-      controllerById(motorId).startDosing(reverse ? -volume : volume);
-    } else if (!expansionStartDosing(motorId - 1, static_cast<uint16_t>(volume), reverse) || !expansionReadState(motorId - 1)) {
-      DynamicJsonDocument err(256);
-      err["error"] = "expansion dosing command failed";
-      sendJson(503, err);
-      return;
+    JsonArray motors = doc.createNestedArray("motors");
+    for (uint8_t i = 0; i < activeMotorCount(); ++i) {
+      if ((touched & (1u << i)) != 0) writeMotorState(motors.createNestedObject(), controllerById(i), i);
     }
-    DynamicJsonDocument doc(2048);
-    writeJsonState(doc, motorId);
-    sendJson(200, doc);
-  };
-  server.on("/api/dosing", HTTP_POST, dosingHandler);
+    sendJson(failure != nullptr || readFailed ? 503 : 200, doc);
+  });
 
   server.on("/api/settings", HTTP_GET, []() {
     if (!ensureAuthenticated()) return;
     bool ok = false;
     const uint8_t motorId = readMotorIdFromRequest(&ok);
     if (!ok) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "invalid motorId";
       sendJson(400, err);
       return;
     }
-    DynamicJsonDocument doc(1024);
+    PooledJsonDocument doc(1024);
     const auto& ctrl = controllerById(motorId);
     const auto& st = ctrl.state();
     doc["motorId"] = motorId;
     doc["motorAlias"] = motorAliases[motorId];
     doc["mlPerRevCw"] = st.mlPerRevCw;
     doc["mlPerRevCcw"] = st.mlPerRevCcw;
-    doc["dosingFlowLph"] = fabsf(st.dosingSpeed * st.mlPerRevCw * 0.06f);
-    doc["maxFlowLph"] = ctrl.config().maxSpeed * st.mlPerRevCw * 0.06f;
+    doc["dosingFlowLph"] = forwardFlowLph(ctrl, st.dosingSpeed, st.mlPerRevCw);
+    doc["maxFlowLph"] = forwardFlowLph(ctrl, ctrl.config().maxSpeed, st.mlPerRevCw);
+    doc["rampProfile"] = rampProfileName(ctrl.config().rampProfile);
     doc["ntpServer"] = ntpServer;
     doc["tzOffsetMinutes"] = tzOffsetMinutes;
     doc["growthProgramEnabled"] = growthProgramEnabled;
@@ -1353,9 +2599,9 @@ void setupApi() {
 
   server.on("/api/settings", HTTP_POST, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(1024);
+    PooledJsonDocument in(1024);
     if (!parseBody(in)) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "invalid json";
       sendJson(400, err);
       return;
@@ -1364,7 +2610,7 @@ void setupApi() {
     bool ok = false;
     const uint8_t motorId = readMotorIdFromJson(in, &ok);
     if (!ok) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "invalid motorId";
       sendJson(400, err);
       return;
@@ -1375,34 +2621,46 @@ void setupApi() {
     const float ccw = in["mlPerRevCcw"] | st.mlPerRevCcw;
     float dosingSpeed = st.dosingSpeed;
     float dosingFlowLph = -1.0f;
-    float maxFlowLph = ctrl.config().maxSpeed * st.mlPerRevCw * 0.06f;
+    float maxFlowLph = forwardFlowLph(ctrl, ctrl.config().maxSpeed, st.mlPerRevCw);
     if (in["dosingFlowLph"].is<float>()) dosingFlowLph = in["dosingFlowLph"].as<float>();
     if (in["maxFlowLph"].is<float>()) maxFlowLph = in["maxFlowLph"].as<float>();
     if (dosingFlowLph > 0.0f) {
-      const float mlPerRev = cw > 0.0f ? cw : st.mlPerRevCw;
-      dosingSpeed = (dosingFlowLph * 1000.0f / 60.0f) / mlPerRev;
+      dosingSpeed = forwardSpeedForFlowLph(ctrl, dosingFlowLph, cw > 0.0f ? cw : st.mlPerRevCw);
     }
     if (maxFlowLph <= 0.0f) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "maxFlowLph must be > 0";
       sendJson(400, err);
       return;
     }
+    pump::RampProfile rampProfile = ctrl.config().rampProfile;
+    if (!in["rampProfile"].isNull() && !parseRampProfile(in["rampProfile"] | "", &rampProfile)) {
+      PooledJsonDocument err(128);
+      err["error"] = "rampProfile must be linear or s-curve";
+      sendJson(400, err);
+      return;
+    }
     if (in["ntpServer"].is<const char*>()) {
       const String candidate = in["ntpServer"].as<String>();
       if (candidate.length() == 0) {
-        DynamicJsonDocument err(128);
+        PooledJsonDocument err(128);
         err["error"] = "ntpServer cannot be empty";
         sendJson(400, err);
         return;
       }
+      if (candidate.length() >= sizeof(pump::StoredConfig::ntpServer)) {
+        PooledJsonDocument err(128);
+        err["error"] = "ntpServer is too long";
+        sendJson(400, err);
+        return;
+      }
       ntpServer = candidate;
       applyNtpConfig();
     }
     if (in["tzOffsetMinutes"].is<int>()) {
       const int candidateTzOffset = in["tzOffsetMinutes"].as<int>();
       if (candidateTzOffset < -720 || candidateTzOffset > 840) {
-        DynamicJsonDocument err(128);
+        PooledJsonDocument err(128);
         err["error"] = "tzOffsetMinutes must be between -720 and 840";
         sendJson(400, err);
         return;
@@ -1449,34 +2707,36 @@ void setupApi() {
       }
     }
     if (motorId == 0) {
-      const float mlPerRevForMax = cw > 0.0f ? cw : st.mlPerRevCw;
-      ctrl.setMaxSpeed((maxFlowLph * 1000.0f / 60.0f) / mlPerRevForMax);
+      ctrl.setMaxSpeed(forwardSpeedForFlowLph(ctrl, maxFlowLph, cw > 0.0f ? cw : st.mlPerRevCw));
       ctrl.setMlPerRev(cw, ccw);
       ctrl.setDosingSpeed(dosingSpeed);
     } else {
-      if (!expansionSetSettings(motorId - 1, cw, ccw, dosingFlowLph > 0.0f ? dosingFlowLph : fabsf(dosingSpeed * cw * 0.06f), maxFlowLph)) {
-        DynamicJsonDocument err(128);
+      if (!expansionSetSettings(motorId - 1, cw, ccw, dosingFlowLph > 0.0f ? dosingFlowLph : forwardFlowLph(ctrl, dosingSpeed, cw), maxFlowLph,
+                                rampProfile)) {
+        PooledJsonDocument err(128);
         err["error"] = "expansion settings update failed";
         sendJson(503, err);
         return;
       }
       if (!expansionReadState(motorId - 1)) {
-        DynamicJsonDocument err(128);
+        PooledJsonDocument err(128);
         err["error"] = "expansion state refresh failed";
         sendJson(503, err);
         return;
       }
     }
+    // The expansion runs its own copy; this one is what gets stored.
+    ctrl.setRampProfile(rampProfile);
     savePersistentState();
 
-    DynamicJsonDocument doc(2048);
+    PooledJsonDocument doc(cfg::kStateJsonCapacity);
     writeJsonState(doc, motorId);
     sendJson(200, doc);
   });
 
   server.on("/api/firmware/config", HTTP_GET, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument doc(384);
+    PooledJsonDocument doc(384);
     doc["repo"] = firmwareRepo;
     doc["assetName"] = firmwareAssetName;
     doc["filesystemAssetName"] = firmwareFsAssetName;
@@ -1487,14 +2747,14 @@ void setupApi() {
   server.on("/api/firmware/probe", HTTP_GET, []() {
     if (!ensureAuthenticated()) return;
     if (!server.hasArg("url")) {
-      DynamicJsonDocument err(192);
+      PooledJsonDocument err(192);
       err["error"] = "url query arg is required";
       sendJson(400, err);
       return;
     }
     const String url = server.arg("url");
     if (!isValidHttpUrl(url)) {
-      DynamicJsonDocument err(224);
+      PooledJsonDocument err(224);
       err["error"] = "url must be valid http(s) url";
       sendJson(400, err);
       return;
@@ -1503,7 +2763,7 @@ void setupApi() {
     int contentLength = -1;
     String probeError;
     const bool ok = probeHttpUrl(url, &code, &contentLength, &probeError);
-    DynamicJsonDocument doc(320);
+    PooledJsonDocument doc(320);
     doc["ok"] = ok;
     doc["url"] = url;
     doc["statusCode"] = code;
@@ -1514,9 +2774,9 @@ void setupApi() {
 
   server.on("/api/firmware/config", HTTP_POST, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(384);
+    PooledJsonDocument in(384);
     if (!parseBody(in)) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "invalid json";
       sendJson(400, err);
       return;
@@ -1524,29 +2784,39 @@ void setupApi() {
     if (in["repo"].is<const char*>()) {
       const String candidate = in["repo"].as<String>();
       if (candidate.length() > 0 && !isValidRepoSlug(candidate)) {
-        DynamicJsonDocument err(192);
+        PooledJsonDocument err(192);
         err["error"] = "repo must be in owner/repo format";
         sendJson(400, err);
         return;
       }
       firmwareRepo = candidate;
-      prefs.putString("fw_repo", firmwareRepo);
     }
     if (in["assetName"].is<const char*>()) {
       String candidate = in["assetName"].as<String>();
       candidate.trim();
       if (candidate.length() == 0) candidate = cfg::kDefaultFirmwareAsset;
+      if (candidate.length() >= sizeof(pump::StoredConfig::firmwareAsset)) {
+        PooledJsonDocument err(128);
+        err["error"] = "assetName is too long";
+        sendJson(400, err);
+        return;
+      }
       firmwareAssetName = candidate;
-      prefs.putString("fw_asset", firmwareAssetName);
     }
     if (in["filesystemAssetName"].is<const char*>()) {
       String candidate = in["filesystemAssetName"].as<String>();
       candidate.trim();
       if (candidate.length() == 0) candidate = cfg::kDefaultFirmwareFsAsset;
+      if (candidate.length() >= sizeof(pump::StoredConfig::firmwareFsAsset)) {
+        PooledJsonDocument err(128);
+        err["error"] = "filesystemAssetName is too long";
+        sendJson(400, err);
+        return;
+      }
       firmwareFsAssetName = candidate;
-      prefs.putString("fw_fs_asset", firmwareFsAssetName);
     }
-    DynamicJsonDocument doc(384);
+    savePersistentState();
+    PooledJsonDocument doc(384);
     doc["repo"] = firmwareRepo;
     doc["assetName"] = firmwareAssetName;
     doc["filesystemAssetName"] = firmwareFsAssetName;
@@ -1559,7 +2829,7 @@ void setupApi() {
     String repo = firmwareRepo;
     if (server.hasArg("repo")) repo = server.arg("repo");
     if (!isValidRepoSlug(repo)) {
-      DynamicJsonDocument err(192);
+      PooledJsonDocument err(192);
       err["error"] = "configure firmware repo in owner/repo format";
       sendJson(400, err);
       return;
@@ -1569,28 +2839,28 @@ void setupApi() {
     int statusCode = 0;
     String payload;
     if (!githubHttpGet(endpoint, &statusCode, &payload)) {
-      DynamicJsonDocument err(192);
+      PooledJsonDocument err(192);
       err["error"] = "github request failed";
       sendJson(502, err);
       return;
     }
     if (statusCode != 200) {
-      DynamicJsonDocument err(256);
+      PooledJsonDocument err(256);
       err["error"] = "github release list request failed";
       err["statusCode"] = statusCode;
       sendJson(502, err);
       return;
     }
 
-    DynamicJsonDocument ghDoc(cfg::kFirmwareReleasesDocBytes);
+    PooledJsonDocument ghDoc(cfg::kFirmwareReleasesDocBytes);
     if (deserializeJson(ghDoc, payload) != DeserializationError::Ok || !ghDoc.is<JsonArray>()) {
-      DynamicJsonDocument err(192);
+      PooledJsonDocument err(192);
       err["error"] = "invalid github release list response";
       sendJson(502, err);
       return;
     }
 
-    DynamicJsonDocument doc(4096);
+    PooledJsonDocument doc(4096);
     doc["repo"] = repo;
     doc["assetName"] = firmwareAssetName;
     doc["filesystemAssetName"] = firmwareFsAssetName;
@@ -1618,15 +2888,15 @@ void setupApi() {
 
   server.on("/api/firmware/update", HTTP_POST, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(1024);
+    PooledJsonDocument in(1024);
     if (!parseBody(in)) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "invalid json";
       sendJson(400, err);
       return;
     }
     if (WiFi.status() != WL_CONNECTED) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "wifi is not connected";
       sendJson(503, err);
       return;
@@ -1651,7 +2921,7 @@ void setupApi() {
     String assetUrl;
     String fsUrl;
     if (mode != "latest" && mode != "tag" && mode != "url") {
-      DynamicJsonDocument err(160);
+      PooledJsonDocument err(160);
       err["error"] = "mode must be latest, tag or url";
       sendJson(400, err);
       return;
@@ -1660,7 +2930,7 @@ void setupApi() {
       assetUrl = in["url"] | "";
       fsUrl = in["filesystemUrl"] | in["fsUrl"] | "";
       if (!isValidHttpUrl(assetUrl) || !isValidHttpUrl(fsUrl)) {
-        DynamicJsonDocument err(256);
+        PooledJsonDocument err(256);
         err["error"] = "url and filesystemUrl must be valid http(s) urls when mode=url";
         sendJson(400, err);
         return;
@@ -1674,7 +2944,7 @@ void setupApi() {
       if (!resolveReleaseForUpdate(repo, mode, tag, assetName, fsAssetName,
                                    &resolvedTag, &resolvedAssetName, &assetUrl,
                                    &resolvedFsAssetName, &fsUrl, &resolveError, &githubStatus)) {
-        DynamicJsonDocument err(320);
+        PooledJsonDocument err(320);
         err["error"] = resolveError;
         if (githubStatus > 0) err["statusCode"] = githubStatus;
         sendJson(400, err);
@@ -1684,8 +2954,14 @@ void setupApi() {
 
     int fsUpdateError = 0;
     String fsUpdateErrorString;
+    // No journal writes while the update rewrites the filesystem partition,
+    // nor after: until the restart, the NVS stash is what counts.
+    counterJournalReady = false;
+    flushPersistence();
+    stashCountersInNvs();
     if (!performHttpOta(fsUrl, U_SPIFFS, &fsUpdateError, &fsUpdateErrorString)) {
-      DynamicJsonDocument err(384);
+      resumeCountersAfterFailedOta();
+      PooledJsonDocument err(384);
       err["error"] = "filesystem update failed";
       err["updateError"] = fsUpdateError;
       err["updateErrorString"] = fsUpdateErrorString;
@@ -1696,7 +2972,7 @@ void setupApi() {
     int fwUpdateError = 0;
     String fwUpdateErrorString;
     if (performHttpOta(assetUrl, U_FLASH, &fwUpdateError, &fwUpdateErrorString)) {
-      DynamicJsonDocument ok(512);
+      PooledJsonDocument ok(512);
       ok["ok"] = true;
       ok["repo"] = repo;
       ok["tag"] = resolvedTag;
@@ -1706,11 +2982,18 @@ void setupApi() {
       ok["url"] = assetUrl;
       ok["message"] = "firmware and filesystem updated, restarting";
       sendJson(200, ok);
-      delay(500);
+      flushPersistence();
+      stashCountersInNvs();
+      {
+        StateUnlock unlock;
+        delay(500);
+      }
       ESP.restart();
       return;
     }
-    DynamicJsonDocument err(384);
+    // The new filesystem is in place but the firmware is not.
+    resumeCountersAfterFailedOta();
+    PooledJsonDocument err(384);
     err["error"] = "firmware update failed";
     err["updateError"] = fwUpdateError;
     err["updateErrorString"] = fwUpdateErrorString;
@@ -1722,7 +3005,7 @@ void setupApi() {
 
   server.on("/api/ui/security", HTTP_GET, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument doc(256);
+    PooledJsonDocument doc(256);
     doc["enabled"] = webAuthEnabled;
     doc["username"] = webAuthUser;
     sendJson(200, doc);
@@ -1730,7 +3013,7 @@ void setupApi() {
 
   server.on("/api/schedule", HTTP_GET, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument doc(2048);
+    PooledJsonDocument doc(2048);
     doc["tzOffsetMinutes"] = tzOffsetMinutes;
     JsonArray entries = doc.createNestedArray("entries");
     for (uint8_t i = 0; i < cfg::kMaxSchedules; ++i) {
@@ -1751,9 +3034,9 @@ void setupApi() {
 
   server.on("/api/schedule", HTTP_POST, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(4096);
+    PooledJsonDocument in(4096);
     if (!parseBody(in)) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "invalid json";
       sendJson(400, err);
       return;
@@ -1761,7 +3044,7 @@ void setupApi() {
     if (in["tzOffsetMinutes"].is<int>()) {
       const int candidateTzOffset = in["tzOffsetMinutes"].as<int>();
       if (candidateTzOffset < -720 || candidateTzOffset > 840) {
-        DynamicJsonDocument err(128);
+        PooledJsonDocument err(128);
         err["error"] = "tzOffsetMinutes must be between -720 and 840";
         sendJson(400, err);
         return;
@@ -1789,16 +3072,16 @@ void setupApi() {
       }
     }
     savePersistentState();
-    DynamicJsonDocument doc(128);
+    PooledJsonDocument doc(128);
     doc["ok"] = true;
     sendJson(200, doc);
   });
 
   server.on("/api/ui/security", HTTP_POST, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(512);
+    PooledJsonDocument in(512);
     if (!parseBody(in)) {
-      DynamicJsonDocument err(128);
+      PooledJsonDocument err(128);
       err["error"] = "invalid json";
       sendJson(400, err);
       return;
@@ -1809,27 +3092,37 @@ void setupApi() {
     if (in["username"].is<const char*>()) {
       String u = in["username"].as<String>();
       if (u.length() == 0) {
-        DynamicJsonDocument err(128);
+        PooledJsonDocument err(128);
         err["error"] = "username cannot be empty";
         sendJson(400, err);
         return;
       }
+      if (u.length() >= sizeof(pump::StoredConfig::authUser)) {
+        PooledJsonDocument err(128);
+        err["error"] = "username is too long";
+        sendJson(400, err);
+        return;
+      }
       webAuthUser = u;
     }
     if (in["password"].is<const char*>()) {
       String p = in["password"].as<String>();
       if (p.length() == 0) {
-        DynamicJsonDocument err(128);
+        PooledJsonDocument err(128);
         err["error"] = "password cannot be empty";
         sendJson(400, err);
         return;
       }
+      if (p.length() >= sizeof(pump::StoredConfig::authPass)) {
+        PooledJsonDocument err(128);
+        err["error"] = "password is too long";
+        sendJson(400, err);
+        return;
+      }
       webAuthPass = p;
     }
-    prefs.putBool("auth_en", webAuthEnabled);
-    prefs.putString("auth_user", webAuthUser);
-    prefs.putString("auth_pass", webAuthPass);
-    DynamicJsonDocument doc(256);
+    savePersistentState();
+    PooledJsonDocument doc(256);
     doc["enabled"] = webAuthEnabled;
     doc["username"] = webAuthUser;
     sendJson(200, doc);
@@ -1837,9 +3130,9 @@ void setupApi() {
 
   server.on("/api/calibration/run", HTTP_POST, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(512);
+    PooledJsonDocument in(512);
     if (!parseBody(in) || !in["direction"].is<const char*>()) {
-      DynamicJsonDocument err(256);
+      PooledJsonDocument err(256);
       err["error"] = "direction is required (cw/ccw)";
       sendJson(400, err);
       return;
@@ -1847,7 +3140,7 @@ void setupApi() {
 
     const int revs = in["revolutions"] | 200;
     if (revs <= 0) {
-      DynamicJsonDocument err(256);
+      PooledJsonDocument err(256);
       err["error"] = "revolutions must be > 0";
       sendJson(400, err);
       return;
@@ -1857,33 +3150,48 @@ void setupApi() {
     bool ok = false;
     const uint8_t motorId = readMotorIdFromJson(in, &ok);
     if (!ok) {
-      DynamicJsonDocument err(256);
+      PooledJsonDocument err(256);
       err["error"] = "invalid motorId";
       sendJson(400, err);
       return;
     }
+    // Multi-point calibration runs each point at its own speed.
+    const float rpm = in["rpm"] | 0.0f;
+    if (rpm < 0.0f || rpm > controllerById(motorId).config().maxSpeed || (rpm > 0.0f && revs > 6500)) {
+      PooledJsonDocument err(256);
+      err["error"] = "rpm must be between 0 and maxSpeed, with at most 6500 revolutions";
+      sendJson(400, err);
+      return;
+    }
+    const float speed = (dir == "ccw") ? -rpm : rpm;
     const auto& st = controllerById(motorId).state();
     const float mlPerRev = (dir == "ccw") ? st.mlPerRevCcw : st.mlPerRevCw;
     const int volumeMl = static_cast<int>(roundf(mlPerRev * revs)) * ((dir == "ccw") ? -1 : 1);
     if (motorId == 0) {
-      controllerById(motorId).startDosing(volumeMl);
-    } else if (!expansionStartDosing(motorId - 1, static_cast<uint16_t>(abs(volumeMl)), dir == "ccw") || !expansionReadState(motorId - 1)) {
-      DynamicJsonDocument err(256);
+      if (rpm > 0.0f) {
+        controllerById(motorId).startRevolutions(static_cast<float>(revs), speed);
+      } else {
+        controllerById(motorId).startDosing(volumeMl);
+      }
+    } else if (!(rpm > 0.0f ? expansionStartRevolutions(motorId - 1, static_cast<float>(revs), speed)
+                            : expansionStartDosing(motorId - 1, static_cast<uint16_t>(abs(volumeMl)), dir == "ccw")) ||
+               !expansionReadState(motorId - 1)) {
+      PooledJsonDocument err(256);
       err["error"] = "expansion calibration run failed";
       sendJson(503, err);
       return;
     }
 
-    DynamicJsonDocument doc(2048);
+    PooledJsonDocument doc(cfg::kStateJsonCapacity);
     writeJsonState(doc, motorId);
     sendJson(200, doc);
   });
 
   server.on("/api/calibration/apply", HTTP_POST, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument in(1024);
+    PooledJsonDocument in(1024);
     if (!parseBody(in) || !in["direction"].is<const char*>()) {
-      DynamicJsonDocument err(256);
+      PooledJsonDocument err(256);
       err["error"] = "direction is required (cw/ccw)";
       sendJson(400, err);
       return;
@@ -1891,7 +3199,7 @@ void setupApi() {
     const float measuredMl = in["measuredMl"] | -1.0f;
     const float revs = in["revolutions"] | -1.0f;
     if (measuredMl <= 0.0f || revs <= 0.0f) {
-      DynamicJsonDocument err(256);
+      PooledJsonDocument err(256);
       err["error"] = "measuredMl and revolutions must be > 0";
       sendJson(400, err);
       return;
@@ -1900,7 +3208,7 @@ void setupApi() {
     bool ok = false;
     const uint8_t motorId = readMotorIdFromJson(in, &ok);
     if (!ok) {
-      DynamicJsonDocument err(256);
+      PooledJsonDocument err(256);
       err["error"] = "invalid motorId";
       sendJson(400, err);
       return;
@@ -1908,7 +3216,24 @@ void setupApi() {
     auto st = controllerById(motorId).state();
     const float calibrated = measuredMl / revs;
     const String dir = in["direction"].as<String>();
-    if (motorId == 0) {
+    const float rpm = in["rpm"] | 0.0f;
+    if (rpm > 0.0f) {
+      // A run made at a given speed becomes one point of the direction's curve.
+      const bool reverse = dir == "ccw";
+      pump::CalibrationCurve curve = controllerById(motorId).calibrationCurve(reverse);
+      if (!curve.setPoint(rpm, calibrated)) {
+        PooledJsonDocument err(256);
+        err["error"] = "calibration point rejected: flow must rise with rpm, at most 6 points";
+        sendJson(400, err);
+        return;
+      }
+      if (!applyCalibrationCurve(motorId, reverse, curve)) {
+        PooledJsonDocument err(256);
+        err["error"] = "expansion calibration apply failed";
+        sendJson(503, err);
+        return;
+      }
+    } else if (motorId == 0) {
       if (dir == "ccw") {
         controllerById(motorId).setMlPerRev(st.mlPerRevCw, calibrated);
       } else {
@@ -1917,10 +3242,12 @@ void setupApi() {
     } else {
       const float newCw = (dir == "ccw") ? st.mlPerRevCw : calibrated;
       const float newCcw = (dir == "ccw") ? calibrated : st.mlPerRevCcw;
-      const float dosingFlowLph = fabsf(st.dosingSpeed * newCw * 0.06f);
-      const float maxFlowLph = controllerById(motorId).config().maxSpeed * newCw * 0.06f;
-      if (!expansionSetSettings(motorId - 1, newCw, newCcw, dosingFlowLph, maxFlowLph) || !expansionReadState(motorId - 1)) {
-        DynamicJsonDocument err(256);
+      const auto& ctrl = controllerById(motorId);
+      const float dosingFlowLph = forwardFlowLph(ctrl, st.dosingSpeed, newCw);
+      const float maxFlowLph = forwardFlowLph(ctrl, ctrl.config().maxSpeed, newCw);
+      if (!expansionSetSettings(motorId - 1, newCw, newCcw, dosingFlowLph, maxFlowLph, ctrl.config().rampProfile) ||
+          !expansionReadState(motorId - 1)) {
+        PooledJsonDocument err(256);
         err["error"] = "expansion calibration apply failed";
         sendJson(503, err);
         return;
@@ -1928,14 +3255,153 @@ void setupApi() {
     }
     savePersistentState();
 
-    DynamicJsonDocument doc(2048);
+    PooledJsonDocument doc(cfg::kStateJsonCapacity);
     writeJsonState(doc, motorId);
     sendJson(200, doc);
   });
 
+  server.on("/api/calibration/curve", HTTP_GET, []() {
+    if (!ensureAuthenticated()) return;
+    bool ok = false;
+    const uint8_t motorId = readMotorIdFromRequest(&ok);
+    if (!ok) {
+      PooledJsonDocument err(128);
+      err["error"] = "invalid motorId";
+      sendJson(400, err);
+      return;
+    }
+    PooledJsonDocument doc(1024);
+    writeCalibrationCurves(doc, motorId);
+    sendJson(200, doc);
+  });
+
+  server.on("/api/calibration/curve", HTTP_POST, []() {
+    if (!ensureAuthenticated()) return;
+    PooledJsonDocument in(1024);
+    if (!parseBody(in) || !in["direction"].is<const char*>() || !in["points"].is<JsonArray>()) {
+      PooledJsonDocument err(256);
+      err["error"] = "direction (cw/ccw) and points are required";
+      sendJson(400, err);
+      return;
+    }
+    bool ok = false;
+    const uint8_t motorId = readMotorIdFromJson(in, &ok);
+    if (!ok) {
+      PooledJsonDocument err(256);
+      err["error"] = "invalid motorId";
+      sendJson(400, err);
+      return;
+    }
+    JsonArray arr = in["points"].as<JsonArray>();
+    pump::CalibrationPoint points[pump::CalibrationCurve::kMaxPoints];
+    size_t count = 0;
+    pump::CalibrationCurve curve;
+    for (JsonObject p : arr) {
+      if (count >= pump::CalibrationCurve::kMaxPoints) {
+        count = pump::CalibrationCurve::kMaxPoints + 1;
+        break;
+      }
+      points[count].rpm = p["rpm"] | 0.0f;
+      points[count].mlPerRev = p["mlPerRev"] | 0.0f;
+      ++count;
+    }
+    if (count > pump::CalibrationCurve::kMaxPoints || !curve.assign(points, count)) {
+      PooledJsonDocument err(256);
+      err["error"] = "invalid curve: up to 6 points, flow must rise with rpm";
+      sendJson(400, err);
+      return;
+    }
+    if (!applyCalibrationCurve(motorId, in["direction"].as<String>() == "ccw", curve)) {
+      PooledJsonDocument err(256);
+      err["error"] = "expansion calibration apply failed";
+      sendJson(503, err);
+      return;
+    }
+    PooledJsonDocument doc(1024);
+    writeCalibrationCurves(doc, motorId);
+    sendJson(200, doc);
+  });
+
+  server.on("/api/diagnostics", HTTP_GET, []() {
+    if (!ensureAuthenticated()) return;
+    PooledJsonDocument doc(1024);
+    JsonObject persist = doc.createNestedObject("persist");
+    persist["cachedKeys"] = persistCache.size();
+    persist["background"] = persistTask != nullptr;
+    persist["busy"] = persistBusy.load();
+    writeSaveStats(persist.createNestedObject("settings"), settingsSaveStats);
+    writeSaveStats(persist.createNestedObject("counters"), counterSaveStats);
+    JsonObject journal = persist.createNestedObject("counterJournal");
+    journal["enabled"] = counterJournalReady;
+    journal["damaged"] = counterCheckpointsDamaged;
+    journal["bytes"] = counterJournalBytes;
+    journal["generation"] = counterJournal.generation();
+    JsonObject stepGate = doc.createNestedObject("stepGate");
+    stepGate["budgets"] = stepBudgetsArmed;
+    stepGate["budgetedSteps"] = stepsBudgeted;
+    stepGate["closed"] = stepGateClosed;
+    JsonObject pool = doc.createNestedObject("jsonPool");
+    pool["slabs"] = jsonPool.slabs();
+    pool["borrowed"] = jsonPool.stats().borrowed;
+    pool["heapAllocations"] = jsonPool.stats().heapAllocations;
+    pool["inUse"] = jsonPool.stats().inUse;
+    pool["maxInUse"] = jsonPool.stats().maxInUse;
+    JsonObject loopOut = doc.createNestedObject("loop");
+    loopOut["passes"] = loopStats.passes;
+    loopOut["meanMicros"] = loopStats.meanPassMicros();
+    loopOut["maxMicros"] = loopStats.maxPassMicros;
+    loopOut["slowPasses"] = loopStats.slowPasses;
+    loopOut["slowPassMicros"] = loopStats.slowPassMicros;
+    loopOut["ticks"] = loopStats.ticks;
+    loopOut["meanTickLateMicros"] = loopStats.meanTickLateMicros();
+    loopOut["maxTickLateMicros"] = loopStats.maxTickLateMicros;
+    sendJson(200, doc);
+  });
+
+  // Prometheus scrape target. Outside /api/, so the lock is only held while
+  // the values are copied. Measured first, like sendJson(), for a
+  // Content-Length.
+  server.on("/metrics", HTTP_GET, []() {
+    if (!ensureAuthenticated()) return;
+    const MetricsSnapshot snapshot = lockedMetricsSnapshot();
+    pump::ByteCounter length;
+    writeMetrics(length, snapshot);
+    server.setContentLength(length.bytes);
+    server.send(200, "text/plain; version=0.0.4", "");
+    pump::BufferedJsonWriter<ResponseSink> out{ResponseSink()};
+    writeMetrics(out, snapshot);
+  });
+
+  // The trace ring, binary: TraceDumpHeader, the events oldest first, then
+  // the route names. scripts/trace_to_timeline.py turns it into a timeline.
+  // Recording pauses while it streams, and loop() runs meanwhile.
+  server.on("/api/trace", HTTP_GET, []() {
+    if (!ensureAuthenticated()) return;
+    StateUnlock unlock;
+    traceRing.setEnabled(false);
+    const pump::TraceDumpHeader header = traceRing.header(micros());
+    size_t routeBytes = 0;
+    for (uint8_t i = 0; i < httpRouteCount; ++i) routeBytes += httpRoutes[i].uri.length() + 1;
+    server.sendHeader("Access-Control-Allow-Origin", "*");
+    server.setContentLength(sizeof(header) + header.events * sizeof(pump::TraceEvent) + routeBytes);
+    server.send(200, "application/octet-stream", "");
+    {
+      pump::BufferedJsonWriter<ResponseSink> out{ResponseSink()};
+      out.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+      for (size_t i = 0; i < header.events; ++i) {
+        out.write(reinterpret_cast<const uint8_t*>(&traceRing.at(i)), sizeof(pump::TraceEvent));
+      }
+      for (uint8_t i = 0; i < httpRouteCount; ++i) {
+        out.write(reinterpret_cast<const uint8_t*>(httpRoutes[i].uri.c_str()), httpRoutes[i].uri.length());
+        out.write('\n');
+      }
+    }
+    traceRing.setEnabled(true);
+  });
+
   server.on("/api/wifi", HTTP_GET, []() {
     if (!ensureAuthenticated()) return;
-    DynamicJsonDocument doc(256);
+    PooledJsonDocument doc(256);
     doc["wifiConnected"] = (WiFi.status() == WL_CONNECTED);
     doc["ssid"] = WiFi.SSID();
     doc["ip"] = WiFi.localIP().toString();
@@ -1946,11 +3412,17 @@ void setupApi() {
   server.on("/api/wifi/reset", HTTP_POST, []() {
     if (!ensureAuthenticated()) return;
     wifiManager.resetSettings();
-    DynamicJsonDocument doc(256);
+    PooledJsonDocument doc(256);
     doc["ok"] = true;
     doc["message"] = "Wi-Fi settings reset. Device will reboot to AP config portal.";
     sendJson(200, doc);
-    delay(300);
+    saveCounters();
+    flushPersistence();
+    {
+      // Lets the reply go out; loop() runs meanwhile.
+      StateUnlock unlock;
+      delay(300);
+    }
     ESP.restart();
   });
 
@@ -1960,8 +3432,9 @@ void setupApi() {
       handleOptions();
       return;
     }
+    if (server.method() == HTTP_GET && !server.uri().startsWith("/api/") && serveStaticAsset(server.uri())) return;
 
-    DynamicJsonDocument doc(256);
+    PooledJsonDocument doc(256);
     doc["error"] = "not found";
     sendJson(404, doc);
   });
@@ -1969,6 +3442,25 @@ void setupApi() {
   server.begin();
 }
 
+void httpTaskMain(void*) {
+  for (;;) {
+    server.handleClient();
+    pushEvents();
+    vTaskDelay(pdMS_TO_TICKS(cfg::kHttpPollMs));
+  }
+}
+
+// Without the task, loop() polls the server as before.
+void startHttpTask() {
+  stateMutex = xSemaphoreCreateMutex();
+  if (stateMutex == nullptr ||
+      xTaskCreatePinnedToCore(httpTaskMain, "http", cfg::kHttpTaskStackBytes, nullptr, cfg::kHttpTaskPriority,
+                              &httpTask, cfg::kHttpTaskCore) != pdPASS) {
+    httpTask = nullptr;
+    Serial.println("HTTP task failed to start, serving from loop()");
+  }
+}
+
 void setupWifi() {
   WiFi.mode(WIFI_STA);
   wifiManager.setHostname("peristaltic-esp32");
@@ -2002,8 +3494,9 @@ const char* modeToName(pump::Mode mode) {
 void drawOledStatus() {
   if (!oledReady) return;
   const uint8_t motorId = isValidMotorId(selectedMotorId) ? selectedMotorId : 0;
-  const auto& st = controllerById(motorId).state();
-  const float targetFlowMlMin = st.targetSpeed * ((st.targetSpeed >= 0) ? st.mlPerRevCw : st.mlPerRevCcw);
+  const auto& ctrl = controllerById(motorId);
+  const auto& st = ctrl.state();
+  const float targetFlowMlMin = st.targetSpeed * ctrl.mlPerRevAt(st.targetSpeed);
   const float targetFlowLph = fabsf(targetFlowMlMin * 0.06f);
   const bool wifiConnected = (WiFi.status() == WL_CONNECTED);
   const bool isRu = (uiLanguage == "ru");
@@ -2036,7 +3529,7 @@ void drawOledStatus() {
   oled.print(flowLabel);
   oled.println(targetFlowLph, 2);
   oled.print(pumpedLabel);
-  oled.println(st.totalPumpedVolumeL, 3);
+  oled.println(st.totalPumpedVolumeL(), 3);
   oled.print(dosingLabel);
   oled.println(st.dosingRemainingMl, 0);
 
@@ -2053,10 +3546,15 @@ void setup() {
   Serial.begin(115200);
   prefs.begin("pump", false);
   loadPersistentState();
+  // NVS already holds what was just loaded.
+  savePersistentState(nullptr);
 
-  if (!LittleFS.begin(true)) {
+  const bool fsMounted = LittleFS.begin(true);
+  if (!fsMounted) {
     Serial.println("LittleFS mount failed");
   }
+  loadCounters(fsMounted);
+  startPersistTask();
 
   pinMode(cfg::kPinStep, OUTPUT);
   pinMode(cfg::kPinDir, OUTPUT);
@@ -2064,7 +3562,8 @@ void setup() {
   digitalWrite(cfg::kPinEnable, HIGH);
 
   ledcSetup(cfg::kLedcChannel, 1, cfg::kLedcResolutionBits);
-  ledcAttachPin(cfg::kPinStep, cfg::kLedcChannel);
+  setupStepCounter();
+  attachStepPin();
 
   Wire.begin(cfg::kPinI2cSda, cfg::kPinI2cScl);
   if (expansionEnabled && expansionInterface == "i2c") {
@@ -2090,25 +3589,70 @@ void setup() {
   applyNtpConfig();
   setupApi();
 
+  stateBootTag = esp_random();
   lastControlMs = millis();
+  lastControlMicros = micros();
+  controllerById(0).advanceTo(lastControlMs);
   lastSaveMs = millis();
+  lastCounterSaveMs = lastSaveMs;
   lastOledMs = millis();
 
   Serial.printf("Pump firmware %s started\n", cfg::kFirmwareVersion);
   Serial.printf("IP: %s\n", WiFi.localIP().toString().c_str());
+  startHttpTask();
+}
+
+// Between control ticks motor 0's controller lags the clock by up to
+// kControlIdleMs; handlers bring it up to date before reading or commanding it.
+void catchUpLocalMotor() { controllerById(0).advanceTo(millis()); }
+
+// When the next control tick is due: every kControlTickMs while the speed
+// changes or the driver lags it, else at the controller's next event (never
+// sooner than one tick period, never later than kControlIdleMs).
+uint32_t controlTickDueMs(const pump::PumpController& ctrl) {
+  const uint32_t soonest = lastControlMs + cfg::kControlTickMs;
+  if (ctrl.isRamping() || stepToneSpeed(ctrl) != appliedMotorSpeed) return soonest;
+  const uint32_t idle = lastControlMs + cfg::kControlIdleMs;
+  const uint32_t event = ctrl.nextEventMs();
+  if (event == pump::kNoEvent || static_cast<int32_t>(event - idle) > 0) return idle;
+  return static_cast<int32_t>(event - soonest) > 0 ? event : soonest;
 }
 
 void loop() {
+  if (httpTask == nullptr) {
+    server.handleClient();
+    pushEvents();
+  }
+  // A handler waiting for the lock goes before the next pass.
+  if (apiWaiting) vTaskDelay(1);
+  const uint32_t passStarted = micros();
+  StateLock lock;
   const uint32_t now = millis();
-  server.handleClient();
   refreshExpansionState();
-  processDosingSchedule();
-
-  if (now - lastControlMs >= cfg::kControlTickMs) {
-    const uint32_t delta = now - lastControlMs;
-    controllerById(0).tick(delta);
+  // Not millis(): polling the expansion takes time, and the tick below must
+  // not hand the controller a clock older than the one a new dose started at.
+  processDosingSchedule(now);
+
+  auto& local = controllerById(0);
+  const uint32_t tickDueMs = controlTickDueMs(local);
+  if (static_cast<int32_t>(now - tickDueMs) >= 0) {
+    const uint32_t nowMicros = micros();
+    traceRing.record(nowMicros, pump::TraceType::kTickBegin);
+    const uint32_t periodMs = tickDueMs - lastControlMs;
+    loopStats.tick(nowMicros - lastControlMicros, periodMs * 1000u);
+    // The histogram's buckets are for the ramp cadence.
+    if (periodMs == cfg::kControlTickMs) tickIntervalHistogram.observe(nowMicros - lastControlMicros);
+    lastControlMicros = nowMicros;
+    local.advanceTo(now);
     lastControlMs = now;
-    applyMotorSpeed(controllerById(0).state().currentSpeed);
+    syncStepBudget(local);
+    // Cruising or idle: keep the LEDC tone running instead of rewriting it.
+    const float toneSpeed = stepToneSpeed(local);
+    if (toneSpeed != appliedMotorSpeed) {
+      appliedMotorSpeed = toneSpeed;
+      applyMotorSpeed(appliedMotorSpeed);
+    }
+    trace(pump::TraceType::kTickEnd);
   }
 
   if (now - lastSaveMs >= cfg::kSavePeriodMs) {
@@ -2116,8 +3660,16 @@ void loop() {
     savePersistentState();
   }
 
+  if (now - lastCounterSaveMs >= cfg::kCounterSavePeriodMs) {
+    lastCounterSaveMs = now;
+    saveCounters();
+  }
+
   if (now - lastOledMs >= cfg::kOledRefreshMs) {
     lastOledMs = now;
     drawOledStatus();
   }
+  const uint32_t passMicros = micros() - passStarted;
+  loopStats.pass(passMicros);
+  loopPassHistogram.observe(passMicros);
 }
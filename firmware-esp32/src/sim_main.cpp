@@ -0,0 +1,439 @@
+// Deterministic host simulation of the main board firmware. Build and run with
+//   pio run -e native-sim && .pio/build/native-sim/program [--days 14] [--seed 1] [--json]
+// main.cpp runs unchanged against the fakes in sim/ on a virtual clock: idle
+// stretches advance in 1 s steps, moving motors in control ticks, so weeks of
+// schedules, expansion polling and persistence take seconds. The expansion
+// board is simulated on the I2C bus. Options:
+//   --days N          simulated days (14)
+//   --seed N          scenario seed: schedules, time zone, injected faults (1)
+//   --schedules N     dose schedule entries, 1..8 (6)
+//   --i2c-fail P      probability that an I2C transfer fails (0)
+//   --i2c-ms N        virtual time each I2C transfer takes (0)
+//   --ntp-delay-ms N  time until the first NTP sync (30000)
+//   --tick-jitter-ms N  moving passes land 10 ms plus up to N ms apart (0)
+//   --no-expansion    main board only
+//   --verbose         firmware Serial output on stderr
+//   --json            one JSON document instead of the text report
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Preferences.h>
+
+#include "LoopStats.h"
+#include "PumpController.h"
+#include "SimExpansion.h"
+
+void setup();
+void loop();
+// main.cpp's motors; only read, to pick the step size and check the clock.
+extern std::array<pump::PumpController, 5> controllers;
+extern pump::LoopStats loopStats;
+// Steps main.cpp armed motor 0's STEP pulse counter with.
+extern uint64_t stepsBudgeted;
+
+// Firmware wall-clock reads go to the virtual clock.
+extern "C" time_t time(time_t* out) {
+  const auto now = static_cast<time_t>(sim::board().wallTimeSec());
+  if (out) *out = now;
+  return now;
+}
+
+namespace {
+
+constexpr std::uint8_t kExpansionAddress = 0x2A;
+constexpr std::uint8_t kMotors = 5;
+constexpr std::uint32_t kIdleStepMs = 1000;
+constexpr std::uint32_t kMovingStepMs = 10;
+constexpr std::int64_t kDaySec = 24 * 3600;
+
+struct Options {
+  std::uint32_t days = 14;
+  std::uint64_t seed = 1;
+  std::uint32_t schedules = 6;
+  double i2cFailRate = 0.0;
+  std::uint32_t i2cTransferMs = 0;
+  std::uint32_t ntpDelayMs = 30000;
+  std::uint32_t tickJitterMs = 0;
+  bool expansion = true;
+  bool verbose = false;
+  bool json = false;
+};
+
+struct Schedule {
+  std::uint8_t hour;
+  std::uint8_t minute;
+  std::uint16_t volumeMl;
+  bool reverse;
+  std::uint8_t motorId;
+  std::uint8_t weekdaysMask;
+};
+
+enum class Outcome { PENDING, HIT, BUSY, MISSED };
+
+struct Trigger {
+  std::uint64_t atMs;
+  std::size_t schedule;
+  std::uint8_t motorId;
+  std::uint16_t volumeMl;
+  Outcome outcome = Outcome::PENDING;
+};
+
+struct MotorReport {
+  std::uint32_t hits = 0;
+  double scheduledMl = 0.0;
+  double dosedMl = 0.0;
+};
+
+struct Report {
+  std::uint64_t loops = 0;
+  double wallSec = 0.0;
+  std::uint32_t expected = 0;
+  std::uint32_t hits = 0;
+  std::uint32_t busy = 0;
+  std::uint32_t missed = 0;
+  std::uint32_t unexpected = 0;
+  // loop() calls that left motor 0's controller ahead of the clock the pass
+  // read at its start, which the next control tick would then undercount.
+  std::uint32_t localClockAhead = 0;
+  MotorReport motors[kMotors];
+  // Motor 0's pulses on the STEP pin against the steps its doses planned.
+  std::uint64_t budgetedSteps = 0;
+  std::uint64_t stepPulses = 0;
+};
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (std::strcmp(arg, "--json") == 0) {
+      opt.json = true;
+    } else if (std::strcmp(arg, "--verbose") == 0) {
+      opt.verbose = true;
+    } else if (std::strcmp(arg, "--no-expansion") == 0) {
+      opt.expansion = false;
+    } else if (value && std::strcmp(arg, "--days") == 0) {
+      opt.days = static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+      ++i;
+    } else if (value && std::strcmp(arg, "--seed") == 0) {
+      opt.seed = std::strtoull(value, nullptr, 10);
+      ++i;
+    } else if (value && std::strcmp(arg, "--schedules") == 0) {
+      opt.schedules = static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+      ++i;
+    } else if (value && std::strcmp(arg, "--i2c-fail") == 0) {
+      opt.i2cFailRate = std::strtod(value, nullptr);
+      ++i;
+    } else if (value && std::strcmp(arg, "--i2c-ms") == 0) {
+      opt.i2cTransferMs = static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+      ++i;
+    } else if (value && std::strcmp(arg, "--ntp-delay-ms") == 0) {
+      opt.ntpDelayMs = static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+      ++i;
+    } else if (value && std::strcmp(arg, "--tick-jitter-ms") == 0) {
+      opt.tickJitterMs = static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+      ++i;
+    } else {
+      std::fprintf(stderr, "unknown or incomplete option: %s\n", arg);
+      return false;
+    }
+  }
+  return opt.days > 0 && opt.schedules >= 1 && opt.schedules <= 8;
+}
+
+int pick(int lo, int hi) {
+  return lo + static_cast<int>(sim::board().uniform() * (hi - lo + 1));
+}
+
+// Random but reproducible plan; motors only move when a schedule fires.
+std::vector<Schedule> makeSchedules(const Options& opt) {
+  std::vector<Schedule> out;
+  const int maxMotor = opt.expansion ? kMotors - 1 : 0;
+  for (std::uint32_t i = 0; i < opt.schedules; ++i) {
+    Schedule s;
+    s.hour = static_cast<std::uint8_t>(pick(0, 23));
+    s.minute = static_cast<std::uint8_t>(pick(0, 59));
+    s.volumeMl = static_cast<std::uint16_t>(pick(1, 40) * 5);
+    s.reverse = sim::board().uniform() < 0.2;
+    s.motorId = static_cast<std::uint8_t>(pick(0, maxMotor));
+    s.weekdaysMask = sim::board().uniform() < 0.5 ? 0x7F : static_cast<std::uint8_t>(pick(1, 0x7F));
+    out.push_back(s);
+  }
+  // Two entries on one motor in the same minute: the second finds it busy.
+  if (out.size() >= 2) out[1] = out[0];
+  return out;
+}
+
+// What the web UI would have stored; written before setup() like a device
+// that was configured and rebooted.
+void seedPreferences(const Options& opt, const std::vector<Schedule>& schedules, int tzOffsetMin) {
+  Preferences prefs;
+  prefs.begin("pump", false);
+  prefs.putBool("exp_en", opt.expansion);
+  prefs.putString("exp_if", "i2c");
+  prefs.putUChar("exp_count", opt.expansion ? kMotors - 1 : 0);
+  prefs.putInt("tz_offset_min", tzOffsetMin);
+  std::string json = "{\"entries\":[";
+  for (std::size_t i = 0; i < schedules.size(); ++i) {
+    const Schedule& s = schedules[i];
+    char entry[192];
+    std::snprintf(entry, sizeof(entry),
+                  "%s{\"enabled\":true,\"hour\":%u,\"minute\":%u,\"volumeMl\":%u,\"reverse\":%s,\"motorId\":%u,"
+                  "\"name\":\"sim %zu\",\"weekdaysMask\":%u}",
+                  i ? "," : "", s.hour, s.minute, s.volumeMl, s.reverse ? "true" : "false", s.motorId, i,
+                  s.weekdaysMask);
+    json += entry;
+  }
+  json += "]}";
+  prefs.putString("dose_sched", json.c_str());
+  sim::board().nvsStats = sim::NvsStats();
+}
+
+bool weekdayEnabled(std::uint8_t mask, int tmWday) {
+  const int bit = tmWday == 0 ? 6 : tmWday - 1;  // Mon=bit0 .. Sun=bit6
+  return (mask & (1u << bit)) != 0;
+}
+
+// Every firing the firmware should attempt once its clock is valid.
+std::vector<Trigger> expectedTriggers(const std::vector<Schedule>& schedules, int tzOffsetMin, std::uint64_t fromMs,
+                                      std::uint64_t toMs) {
+  const auto& board = sim::board();
+  const std::int64_t tzSec = static_cast<std::int64_t>(tzOffsetMin) * 60;
+  const std::int64_t firstLocal = board.epochAtBootSec + static_cast<std::int64_t>(fromMs / 1000) + tzSec;
+  const std::int64_t lastLocal = board.epochAtBootSec + static_cast<std::int64_t>(toMs / 1000) + tzSec;
+  std::vector<Trigger> out;
+  for (std::int64_t day = firstLocal - firstLocal % kDaySec; day <= lastLocal; day += kDaySec) {
+    const time_t dayStart = static_cast<time_t>(day);
+    struct tm dayTm {};
+    gmtime_r(&dayStart, &dayTm);
+    for (std::size_t i = 0; i < schedules.size(); ++i) {
+      const Schedule& s = schedules[i];
+      if (!weekdayEnabled(s.weekdaysMask, dayTm.tm_wday)) continue;
+      const std::int64_t local = day + s.hour * 3600 + s.minute * 60;
+      if (local < firstLocal || local >= lastLocal) continue;
+      const auto atMs = static_cast<std::uint64_t>(local - tzSec - board.epochAtBootSec) * 1000;
+      out.push_back({atMs, i, s.motorId, s.volumeMl});
+    }
+  }
+  std::sort(out.begin(), out.end(), [](const Trigger& a, const Trigger& b) {
+    return a.atMs != b.atMs ? a.atMs < b.atMs : a.schedule < b.schedule;
+  });
+  return out;
+}
+
+// Credits a dose start to the first open trigger for that motor within the
+// same minute.
+bool creditStart(std::vector<Trigger>& triggers, std::uint8_t motorId, std::uint64_t atMs, Report& report) {
+  for (auto& t : triggers) {
+    if (t.motorId != motorId || t.outcome == Outcome::HIT || t.outcome == Outcome::MISSED) continue;
+    if (atMs < t.atMs || atMs >= t.atMs + 60000) continue;
+    t.outcome = Outcome::HIT;
+    auto& m = report.motors[motorId];
+    ++m.hits;
+    m.scheduledMl += t.volumeMl;
+    return true;
+  }
+  ++report.unexpected;
+  return false;
+}
+
+const char* outcomeName(Outcome o) {
+  switch (o) {
+    case Outcome::HIT: return "hit";
+    case Outcome::BUSY: return "busy";
+    case Outcome::MISSED: return "missed";
+    case Outcome::PENDING: break;
+  }
+  return "pending";
+}
+
+std::vector<std::pair<std::string, std::uint64_t>> topNvsKeys(std::size_t n) {
+  const auto& byKey = sim::board().nvsStats.writesByKey;
+  std::vector<std::pair<std::string, std::uint64_t>> keys(byKey.begin(), byKey.end());
+  std::sort(keys.begin(), keys.end(), [](const std::pair<std::string, std::uint64_t>& a,
+                                         const std::pair<std::string, std::uint64_t>& b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+  });
+  if (keys.size() > n) keys.resize(n);
+  return keys;
+}
+
+void printText(const Options& opt, int tzOffsetMin, const Report& r, const std::vector<Trigger>& triggers) {
+  const auto& b = sim::board();
+  std::printf("sim: %u days, seed %llu, %u schedules, tz %+d min, i2c fail rate %.4f, %u ms per transfer\n",
+              opt.days, static_cast<unsigned long long>(opt.seed), opt.schedules, tzOffsetMin, opt.i2cFailRate,
+              opt.i2cTransferMs);
+  std::printf("ran %llu loop() calls in %.2f s, %u control ticks, %u left motor 0 ahead of the pass clock\n",
+              static_cast<unsigned long long>(r.loops), r.wallSec, loopStats.ticks, r.localClockAhead);
+  std::printf("schedule: %u expected, %u hits, %u busy, %u missed, %u unexpected starts\n", r.expected, r.hits, r.busy,
+              r.missed, r.unexpected);
+  for (const auto& t : triggers) {
+    if (t.outcome == Outcome::HIT) continue;
+    std::printf("  %-6s schedule %zu motor %u at %.3f h\n", outcomeName(t.outcome), t.schedule, t.motorId,
+                static_cast<double>(t.atMs) / 3.6e6);
+  }
+  for (std::uint8_t i = 0; i < kMotors; ++i) {
+    const auto& m = r.motors[i];
+    std::printf("motor %u: %u hits, scheduled %.1f ml, dosed %.1f ml\n", i, m.hits, m.scheduledMl, m.dosedMl);
+  }
+  std::printf("step pulses: %llu of %llu budgeted on motor 0\n", static_cast<unsigned long long>(r.stepPulses),
+              static_cast<unsigned long long>(r.budgetedSteps));
+  const auto& nvs = b.nvsStats;
+  std::printf("nvs: %llu put calls, %llu flash writes (%.0f/day), %llu bytes written\n",
+              static_cast<unsigned long long>(nvs.putCalls), static_cast<unsigned long long>(nvs.writes),
+              static_cast<double>(nvs.writes) / opt.days, static_cast<unsigned long long>(nvs.bytesWritten));
+  for (const auto& kv : topNvsKeys(5)) {
+    std::printf("  %-16s %llu writes\n", kv.first.c_str(), static_cast<unsigned long long>(kv.second));
+  }
+  const auto& fs = b.fsStats;
+  std::printf("fs: %llu opens, %llu bytes written, %llu renames\n", static_cast<unsigned long long>(fs.opens),
+              static_cast<unsigned long long>(fs.bytesWritten), static_cast<unsigned long long>(fs.renames));
+  std::printf("i2c: %llu transactions, %llu injected failures\n",
+              static_cast<unsigned long long>(b.i2cStats.transactions),
+              static_cast<unsigned long long>(b.i2cStats.injectedFailures));
+}
+
+void printJson(const Options& opt, int tzOffsetMin, const Report& r, const std::vector<Trigger>& triggers) {
+  const auto& b = sim::board();
+  std::printf("{\"days\":%u,\"seed\":%llu,\"schedules\":%u,\"tz_offset_min\":%d,\"i2c_fail_rate\":%.6f,", opt.days,
+              static_cast<unsigned long long>(opt.seed), opt.schedules, tzOffsetMin, opt.i2cFailRate);
+  std::printf("\"i2c_transfer_ms\":%u,\"tick_jitter_ms\":%u,", opt.i2cTransferMs, opt.tickJitterMs);
+  std::printf("\"loops\":%llu,\"wall_sec\":%.3f,\"control_ticks\":%u,\"local_clock_ahead\":%u,",
+              static_cast<unsigned long long>(r.loops), r.wallSec, loopStats.ticks, r.localClockAhead);
+  std::printf("\"budgeted_steps\":%llu,\"step_pulses\":%llu,", static_cast<unsigned long long>(r.budgetedSteps),
+              static_cast<unsigned long long>(r.stepPulses));
+  std::printf("\"schedule\":{\"expected\":%u,\"hits\":%u,\"busy\":%u,\"missed\":%u,\"unexpected\":%u,\"misses\":[",
+              r.expected, r.hits, r.busy, r.missed, r.unexpected);
+  bool first = true;
+  for (const auto& t : triggers) {
+    if (t.outcome == Outcome::HIT) continue;
+    std::printf("%s{\"schedule\":%zu,\"motor\":%u,\"at_ms\":%llu,\"outcome\":\"%s\"}", first ? "" : ",", t.schedule,
+                t.motorId, static_cast<unsigned long long>(t.atMs), outcomeName(t.outcome));
+    first = false;
+  }
+  std::printf("]},\"motors\":[");
+  for (std::uint8_t i = 0; i < kMotors; ++i) {
+    const auto& m = r.motors[i];
+    std::printf("%s{\"id\":%u,\"hits\":%u,\"scheduled_ml\":%.3f,\"dosed_ml\":%.3f}", i ? "," : "", i, m.hits,
+                m.scheduledMl, m.dosedMl);
+  }
+  const auto& nvs = b.nvsStats;
+  std::printf("],\"nvs\":{\"put_calls\":%llu,\"writes\":%llu,\"bytes_written\":%llu,\"writes_by_key\":{",
+              static_cast<unsigned long long>(nvs.putCalls), static_cast<unsigned long long>(nvs.writes),
+              static_cast<unsigned long long>(nvs.bytesWritten));
+  first = true;
+  for (const auto& kv : nvs.writesByKey) {
+    std::printf("%s\"%s\":%llu", first ? "" : ",", kv.first.c_str(), static_cast<unsigned long long>(kv.second));
+    first = false;
+  }
+  std::printf("}},\"fs\":{\"opens\":%llu,\"bytes_written\":%llu,\"renames\":%llu}",
+              static_cast<unsigned long long>(b.fsStats.opens), static_cast<unsigned long long>(b.fsStats.bytesWritten),
+              static_cast<unsigned long long>(b.fsStats.renames));
+  std::printf(",\"i2c\":{\"transactions\":%llu,\"injected_failures\":%llu}}\n",
+              static_cast<unsigned long long>(b.i2cStats.transactions),
+              static_cast<unsigned long long>(b.i2cStats.injectedFailures));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!parseArgs(argc, argv, opt)) return 2;
+
+  auto& board = sim::board();
+  board.seed(opt.seed);
+  board.verbose = opt.verbose;
+  board.ntpDelayMs = opt.ntpDelayMs;
+  const int tzOffsets[] = {-300, 0, 60, 180, 330};
+  const int tzOffsetMin = tzOffsets[pick(0, 4)];
+  const std::vector<Schedule> schedules = makeSchedules(opt);
+
+  // Same motor setup as expansion_main.cpp.
+  const pump::Config motorCfg;
+  sim::ExpansionBoard<kMotors - 1> expansion(motorCfg);
+  if (opt.expansion) board.i2cDevices[kExpansionAddress] = &expansion;
+  seedPreferences(opt, schedules, tzOffsetMin);
+  // Faults start after the seed so the scenario does not depend on the rate.
+  board.i2cFailRate = opt.i2cFailRate;
+  board.i2cTransferMs = opt.i2cTransferMs;
+
+  const auto started = std::chrono::steady_clock::now();
+  setup();
+  const std::uint64_t endMs = board.nowMs + static_cast<std::uint64_t>(opt.days) * kDaySec * 1000;
+  std::vector<Trigger> triggers = expectedTriggers(schedules, tzOffsetMin, board.nowMs + opt.ntpDelayMs, endMs);
+
+  Report report;
+  report.expected = static_cast<std::uint32_t>(triggers.size());
+  std::size_t nextTrigger = 0;
+  std::size_t seenExpansionDoses = 0;
+  bool localWasMoving = false;
+  while (board.nowMs < endMs) {
+    const auto passMs = static_cast<std::uint32_t>(board.nowMs);
+    loop();
+    ++report.loops;
+    if (static_cast<std::int32_t>(controllers[0].nowMs() - passMs) > 0) ++report.localClockAhead;
+
+    const bool localMoving = board.ledc[0].freqHz > 0.0;
+    if (localMoving && !localWasMoving) creditStart(triggers, 0, board.nowMs, report);
+    localWasMoving = localMoving;
+    const auto& doses = expansion.doseCommands();
+    for (; seenExpansionDoses < doses.size(); ++seenExpansionDoses) {
+      const auto& d = doses[seenExpansionDoses];
+      creditStart(triggers, static_cast<std::uint8_t>(d.motor + 1), d.atMs, report);
+    }
+
+    // A dose that just started has not reached the LEDC yet, so ask the
+    // controller rather than the pins.
+    bool anyMoving = localMoving || controllers[0].state().running;
+    for (std::size_t i = 0; i < kMotors - 1; ++i) anyMoving = anyMoving || expansion.motors().state(i).running;
+    std::uint32_t stepMs = kIdleStepMs;
+    if (anyMoving) {
+      stepMs = kMovingStepMs;
+      if (opt.tickJitterMs > 0) stepMs += static_cast<std::uint32_t>(pick(0, static_cast<int>(opt.tickJitterMs)));
+    }
+    board.advance(stepMs);
+
+    // Classify triggers whose minute has passed without a credited start.
+    for (; nextTrigger < triggers.size() && triggers[nextTrigger].atMs + 60000 <= board.nowMs; ++nextTrigger) {
+      Trigger& t = triggers[nextTrigger];
+      if (t.outcome == Outcome::PENDING) t.outcome = Outcome::MISSED;
+    }
+    for (std::size_t i = nextTrigger; i < triggers.size() && triggers[i].atMs <= board.nowMs; ++i) {
+      Trigger& t = triggers[i];
+      if (t.outcome != Outcome::PENDING) continue;
+      const bool busy = t.motorId == 0 ? localMoving : expansion.motors().state(t.motorId - 1).running;
+      if (busy) t.outcome = Outcome::BUSY;
+    }
+  }
+  for (auto& t : triggers) {
+    if (t.outcome == Outcome::PENDING) t.outcome = Outcome::MISSED;
+    if (t.outcome == Outcome::HIT) ++report.hits;
+    if (t.outcome == Outcome::BUSY) ++report.busy;
+    if (t.outcome == Outcome::MISSED) ++report.missed;
+  }
+
+  // Motor 0 volume from the step pulses the LEDC produced, the expansion
+  // motors from the board's own counters.
+  report.motors[0].dosedMl = board.ledc[0].steps / motorCfg.stepsPerRev * motorCfg.mlPerRevCw;
+  report.budgetedSteps = stepsBudgeted;
+  report.stepPulses = static_cast<std::uint64_t>(board.ledc[0].steps);
+  for (std::size_t i = 0; i < kMotors - 1; ++i) {
+    report.motors[i + 1].dosedMl = static_cast<double>(expansion.motors().state(i).totalPumpedNl) / 1e6;
+  }
+  report.wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  if (opt.json) {
+    printJson(opt, tzOffsetMin, report, triggers);
+  } else {
+    printText(opt, tzOffsetMin, report, triggers);
+  }
+  return 0;
+}
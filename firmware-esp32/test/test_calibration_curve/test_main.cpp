@@ -0,0 +1,167 @@
+#include <unity.h>
+
+#include <cmath>
+
+#include "CalibrationCurve.h"
+#include "PumpController.h"
+
+namespace {
+
+// Synthetic tube: the hose stops refilling fully at speed, so ml/rev falls
+// from 2.8 at standstill to about 2.2 at 450 rpm.
+float tubeMlPerRev(float rpm) { return 2.8f / (1.0f + 0.0006f * std::fabs(rpm)); }
+
+pump::CalibrationCurve measuredCurve() {
+  pump::CalibrationCurve curve;
+  const float speeds[] = {30.0f, 100.0f, 200.0f, 300.0f, 450.0f};
+  for (float rpm : speeds) TEST_ASSERT_TRUE(curve.setPoint(rpm, tubeMlPerRev(rpm)));
+  return curve;
+}
+
+pump::Config makeConfig() {
+  pump::Config cfg;
+  cfg.maxSpeed = 450.0f;
+  cfg.minSpeed = 0.01f;
+  cfg.speedAccelPerSec = 50.0f;
+  cfg.speedHaltPerSec = 200.0f;
+  cfg.mlPerRevCw = 2.6f;
+  cfg.mlPerRevCcw = 2.6f;
+  return cfg;
+}
+
+// Volume the synthetic tube really delivers while `ctrl` runs for `ms`.
+float runOnTube(pump::PumpController& ctrl, std::uint32_t ms) {
+  float ml = 0.0f;
+  for (std::uint32_t t = 0; t < ms; t += 10) {
+    const float from = ctrl.state().currentSpeed;
+    ctrl.tick(10);
+    const float mean = 0.5f * (from + ctrl.state().currentSpeed);
+    ml += std::fabs(mean) / 60.0f * 0.01f * tubeMlPerRev(mean);
+  }
+  return ml;
+}
+
+float pumpedMl(const pump::PumpController& ctrl) { return static_cast<float>(ctrl.state().totalPumpedVolumeL() * 1000.0); }
+
+void test_curve_tracks_nonlinear_tube() {
+  const pump::CalibrationCurve curve = measuredCurve();
+  TEST_ASSERT_EQUAL_UINT32(5, curve.size());
+  for (float rpm = 30.0f; rpm <= 450.0f; rpm += 5.0f) {
+    const float want = tubeMlPerRev(rpm);
+    TEST_ASSERT_FLOAT_WITHIN(want * 0.01f, want, curve.mlPerRevAt(rpm));
+    TEST_ASSERT_FLOAT_WITHIN(want * 0.01f, want, curve.mlPerRevAt(-rpm));
+    TEST_ASSERT_FLOAT_WITHIN(rpm * 0.01f, rpm, curve.rpmForFlow(rpm * want));
+  }
+  // Held flat past the last point.
+  TEST_ASSERT_EQUAL_FLOAT(tubeMlPerRev(450.0f), curve.mlPerRevAt(600.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 600.0f, curve.rpmForFlow(600.0f * tubeMlPerRev(450.0f)));
+}
+
+void test_curve_rejects_bad_points() {
+  pump::CalibrationCurve curve;
+  TEST_ASSERT_FALSE(curve.setPoint(100.0f, 0.0f));
+  TEST_ASSERT_FALSE(curve.setPoint(0.0f, 2.6f));
+  TEST_ASSERT_TRUE(curve.setPoint(100.0f, 2.6f));
+  // 260 ml/min at 100 rpm but 200 ml/min at 200 rpm: flow would fall.
+  TEST_ASSERT_FALSE(curve.setPoint(200.0f, 1.0f));
+  TEST_ASSERT_EQUAL_UINT32(1, curve.size());
+
+  // A point within 1 rpm replaces the old one.
+  TEST_ASSERT_TRUE(curve.setPoint(100.5f, 2.5f));
+  TEST_ASSERT_EQUAL_UINT32(1, curve.size());
+  TEST_ASSERT_EQUAL_FLOAT(2.5f, curve.mlPerRevAt(100.0f));
+
+  for (std::size_t i = 1; i < pump::CalibrationCurve::kMaxPoints; ++i) {
+    TEST_ASSERT_TRUE(curve.setPoint(100.0f + 50.0f * static_cast<float>(i), 2.5f));
+  }
+  TEST_ASSERT_FALSE(curve.setPoint(500.0f, 2.5f));
+  TEST_ASSERT_EQUAL_UINT32(pump::CalibrationCurve::kMaxPoints, curve.size());
+  // Points arrive in any order and are kept sorted.
+  TEST_ASSERT_EQUAL_FLOAT(100.5f, curve.point(0).rpm);
+}
+
+void test_empty_curve_keeps_scalar_calibration() {
+  pump::PumpController ctrl(makeConfig());
+  ctrl.setMlPerRev(2.4f, 2.9f);
+  TEST_ASSERT_TRUE(ctrl.calibrationCurve(false).empty());
+  TEST_ASSERT_EQUAL_FLOAT(2.4f, ctrl.mlPerRevAt(300.0f));
+  TEST_ASSERT_EQUAL_FLOAT(2.9f, ctrl.mlPerRevAt(-300.0f));
+  TEST_ASSERT_EQUAL_FLOAT(-(500.0f / 2.9f), ctrl.speedForFlow(500.0f, true));
+
+  ctrl.setCalibrationCurve(false, measuredCurve());
+  TEST_ASSERT_FLOAT_WITHIN(3.0f, 300.0f, ctrl.speedForFlow(300.0f * tubeMlPerRev(300.0f), false));
+  // The other direction keeps its scalar.
+  TEST_ASSERT_EQUAL_FLOAT(2.9f, ctrl.mlPerRevAt(-300.0f));
+}
+
+void test_fast_flow_matches_tube_with_curve() {
+  pump::PumpController curved(makeConfig());
+  curved.setCalibrationCurve(false, measuredCurve());
+  curved.setSpeed(400.0f);
+  const float curvedTrue = runOnTube(curved, 60000);
+  TEST_ASSERT_FLOAT_WITHIN(curvedTrue * 0.01f, curvedTrue, pumpedMl(curved));
+
+  // A single calibration taken at 100 rpm over-reports a fast run.
+  pump::PumpController flat(makeConfig());
+  flat.setMlPerRev(tubeMlPerRev(100.0f), tubeMlPerRev(100.0f));
+  flat.setSpeed(400.0f);
+  const float flatTrue = runOnTube(flat, 60000);
+  TEST_ASSERT_TRUE(pumpedMl(flat) > flatTrue * 1.1f);
+}
+
+void test_dose_lands_on_volume_with_curve() {
+  pump::PumpController ctrl(makeConfig());
+  ctrl.setCalibrationCurve(false, measuredCurve());
+  ctrl.setDosingSpeed(400.0f);
+  // Short enough that most of the dose is spent ramping.
+  ctrl.startDosing(40);
+  const float delivered = runOnTube(ctrl, 30000);
+  TEST_ASSERT_FALSE(ctrl.state().running);
+  TEST_ASSERT_FLOAT_WITHIN(0.4f, 40.0f, delivered);
+  TEST_ASSERT_FLOAT_WITHIN(0.4f, 40.0f, pumpedMl(ctrl));
+
+  ctrl.startDosing(250);
+  const float longDose = runOnTube(ctrl, 120000);
+  TEST_ASSERT_FLOAT_WITHIN(2.5f, 250.0f, longDose);
+}
+
+void test_revolutions_run_exact_turns_at_speed() {
+  pump::PumpController ctrl(makeConfig());
+  ctrl.setMlPerRev(2.0f, 2.0f);
+  ctrl.startRevolutions(50.0f, -120.0f);
+  TEST_ASSERT_EQUAL_FLOAT(-120.0f, ctrl.state().targetSpeed);
+  TEST_ASSERT_EQUAL_FLOAT(100.0f, ctrl.state().dosingRemainingMl);
+  float peak = 0.0f;
+  for (int i = 0; i < 6000 && ctrl.state().running; ++i) {
+    ctrl.tick(10);
+    peak = std::fmin(peak, ctrl.state().currentSpeed);
+  }
+  TEST_ASSERT_FALSE(ctrl.state().running);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, -120.0f, peak);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 100.0f, pumpedMl(ctrl));
+  // The regular dosing speed is left alone.
+  TEST_ASSERT_EQUAL_FLOAT(180.0f, ctrl.state().dosingSpeed);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_curve_tracks_nonlinear_tube);
+  RUN_TEST(test_curve_rejects_bad_points);
+  RUN_TEST(test_empty_curve_keeps_scalar_calibration);
+  RUN_TEST(test_fast_flow_matches_tube_with_curve);
+  RUN_TEST(test_dose_lands_on_volume_with_curve);
+  RUN_TEST(test_revolutions_run_exact_turns_at_speed);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
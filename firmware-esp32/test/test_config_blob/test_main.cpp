@@ -0,0 +1,264 @@
+#include <unity.h>
+
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ConfigBlob.h"
+#include "LegacyConfig.h"
+#include "RampProfile.h"
+
+namespace {
+
+// Just enough of Arduino's Preferences for the legacy migration.
+class FakePrefs {
+ public:
+  template <typename T>
+  void put(const char* key, T v) {
+    kv_[key] = std::string(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+  void putString(const char* key, const std::string& v) { kv_[key] = v; }
+  void putBytes(const char* key, const void* v, std::size_t len) {
+    kv_[key] = std::string(static_cast<const char*>(v), len);
+  }
+
+  bool isKey(const char* key) const { return kv_.count(key) != 0; }
+  bool remove(const char* key) { return kv_.erase(key) != 0; }
+  std::size_t size() const { return kv_.size(); }
+
+  float getFloat(const char* key, float def) const { return get(key, def); }
+  bool getBool(const char* key, bool def) const { return get(key, def); }
+  std::uint8_t getUChar(const char* key, std::uint8_t def) const { return get(key, def); }
+  std::int32_t getInt(const char* key, std::int32_t def) const { return get(key, def); }
+  std::string getString(const char* key, const char* def) const {
+    const auto it = kv_.find(key);
+    return it == kv_.end() ? std::string(def) : it->second;
+  }
+  std::size_t getBytesLength(const char* key) const {
+    const auto it = kv_.find(key);
+    return it == kv_.end() ? 0 : it->second.size();
+  }
+  std::size_t getBytes(const char* key, void* out, std::size_t len) const {
+    const auto it = kv_.find(key);
+    if (it == kv_.end() || it->second.size() > len) return 0;
+    std::memcpy(out, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+
+ private:
+  template <typename T>
+  T get(const char* key, T def) const {
+    const auto it = kv_.find(key);
+    if (it == kv_.end() || it->second.size() != sizeof(T)) return def;
+    T v;
+    std::memcpy(&v, it->second.data(), sizeof(T));
+    return v;
+  }
+
+  std::map<std::string, std::string> kv_;
+};
+
+pump::StoredConfig defaults() {
+  pump::StoredConfig config = pump::StoredConfig();
+  for (auto& m : config.motors) {
+    m.lastManualSpeed = 120.0f;
+    m.maxSpeed = 450.0f;
+    m.mlPerRevCw = 2.6f;
+    m.mlPerRevCcw = 2.6f;
+    m.dosingSpeed = 180.0f;
+  }
+  pump::copyStoredString(config.uiLanguage, "en");
+  pump::copyStoredString(config.ntpServer, "time.google.com");
+  return config;
+}
+
+std::vector<std::uint8_t> sealed(const pump::StoredConfig& config) {
+  pump::ConfigBlob blob;
+  blob.config = config;
+  pump::sealConfigBlob(blob);
+  const auto* p = reinterpret_cast<const std::uint8_t*>(&blob);
+  return std::vector<std::uint8_t>(p, p + sizeof(blob));
+}
+
+// A blob as another layout version would have written it: the first
+// `configSize` bytes of config, followed by `extra` bytes of newer fields.
+std::vector<std::uint8_t> sealedAs(std::uint16_t version, const pump::StoredConfig& config, std::size_t configSize,
+                                   std::size_t extra) {
+  std::vector<std::uint8_t> payload(configSize + extra, 0x5A);
+  std::memcpy(payload.data(), &config, configSize < sizeof(config) ? configSize : sizeof(config));
+  pump::ConfigBlobHeader header;
+  header.magic = pump::kConfigMagic;
+  header.version = version;
+  header.size = static_cast<std::uint16_t>(payload.size());
+  header.crc = pump::crc32(payload.data(), payload.size());
+  std::vector<std::uint8_t> out(sizeof(header));
+  std::memcpy(out.data(), &header, sizeof(header));
+  out.insert(out.end(), payload.begin(), payload.end());
+  return out;
+}
+
+void test_blob_round_trips() {
+  pump::StoredConfig config = defaults();
+  config.motors[2].mlPerRevCw = 2.44f;
+  config.motors[2].curveCcw.count = 1;
+  config.motors[2].curveCcw.points[0] = pump::CalibrationPoint{300.0f, 2.3f};
+  config.schedules[7].volumeMl = 25;
+  pump::copyStoredString(config.schedules[7].name, "Night");
+  config.tzOffsetMinutes = -300;
+
+  const auto bytes = sealed(config);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(pump::ConfigBlob), bytes.size());
+  pump::StoredConfig loaded = defaults();
+  TEST_ASSERT_TRUE(pump::openConfigBlob(bytes.data(), bytes.size(), loaded) == pump::ConfigLoad::kOk);
+  TEST_ASSERT_EQUAL_MEMORY(&config, &loaded, sizeof(config));
+}
+
+void test_damaged_blob_leaves_defaults() {
+  pump::StoredConfig config = defaults();
+  config.motors[0].maxSpeed = 300.0f;
+  auto bytes = sealed(config);
+  pump::StoredConfig loaded = defaults();
+
+  TEST_ASSERT_TRUE(pump::openConfigBlob(nullptr, 0, loaded) == pump::ConfigLoad::kMissing);
+  TEST_ASSERT_TRUE(pump::openConfigBlob(bytes.data(), 6, loaded) == pump::ConfigLoad::kMissing);
+  TEST_ASSERT_TRUE(pump::openConfigBlob(bytes.data(), bytes.size() - 1, loaded) == pump::ConfigLoad::kCorrupt);
+  bytes[sizeof(pump::ConfigBlobHeader) + 40] ^= 0x01;
+  TEST_ASSERT_TRUE(pump::openConfigBlob(bytes.data(), bytes.size(), loaded) == pump::ConfigLoad::kCorrupt);
+  bytes[sizeof(pump::ConfigBlobHeader) + 40] ^= 0x01;
+  bytes[0] ^= 0xFF;
+  TEST_ASSERT_TRUE(pump::openConfigBlob(bytes.data(), bytes.size(), loaded) == pump::ConfigLoad::kCorrupt);
+  TEST_ASSERT_EQUAL_FLOAT(450.0f, loaded.motors[0].maxSpeed);
+}
+
+void test_older_layout_keeps_defaults_for_new_fields() {
+  pump::StoredConfig old = defaults();
+  old.motors[4].dosingSpeed = 90.0f;
+  // A layout that ended before the firmware asset names.
+  const std::size_t prefix = offsetof(pump::StoredConfig, firmwareAsset);
+  const auto bytes = sealedAs(pump::kConfigVersion, old, prefix, 0);
+
+  pump::StoredConfig loaded = defaults();
+  pump::copyStoredString(loaded.firmwareAsset, "firmware.bin");
+  TEST_ASSERT_TRUE(pump::openConfigBlob(bytes.data(), bytes.size(), loaded) == pump::ConfigLoad::kOk);
+  TEST_ASSERT_EQUAL_FLOAT(90.0f, loaded.motors[4].dosingSpeed);
+  TEST_ASSERT_EQUAL_STRING("firmware.bin", loaded.firmwareAsset);
+}
+
+void test_version_1_blob_leaves_ramp_profiles_linear() {
+  pump::StoredConfig old = defaults();
+  old.tzOffsetMinutes = 120;
+  const auto bytes = sealedAs(1, old, offsetof(pump::StoredConfig, rampProfiles), 0);
+
+  pump::StoredConfig loaded = defaults();
+  TEST_ASSERT_TRUE(pump::openConfigBlob(bytes.data(), bytes.size(), loaded) == pump::ConfigLoad::kOk);
+  TEST_ASSERT_EQUAL_INT(120, loaded.tzOffsetMinutes);
+  for (std::uint8_t profile : loaded.rampProfiles) {
+    TEST_ASSERT_EQUAL_UINT8(static_cast<std::uint8_t>(pump::RampProfile::LINEAR), profile);
+  }
+}
+
+void test_newer_layout_loads_known_prefix() {
+  pump::StoredConfig config = defaults();
+  pump::copyStoredString(config.firmwareFsAsset, "littlefs.bin");
+  const auto bytes = sealedAs(pump::kConfigVersion + 1, config, sizeof(config), 64);
+
+  pump::StoredConfig loaded = defaults();
+  TEST_ASSERT_TRUE(pump::openConfigBlob(bytes.data(), bytes.size(), loaded) == pump::ConfigLoad::kOk);
+  TEST_ASSERT_EQUAL_MEMORY(&config, &loaded, sizeof(config));
+}
+
+void test_legacy_keys_migrate_and_are_removed() {
+  FakePrefs prefs;
+  // Motor 0 from the single-motor firmware, motor 1 from the per-motor one.
+  prefs.put("ml_cw", 2.1f);
+  prefs.put("dosing_speed", 150.0f);
+  prefs.put("pref_rev", true);
+  prefs.putString("motor_alias", "Nutrient A");
+  prefs.put("ml_cw_0", 2.2f);
+  prefs.put("max_speed_1", 320.0f);
+  prefs.putString("alias_1", "pH down");
+  const pump::CalibrationPoint curve[] = {{100.0f, 2.5f}, {300.0f, 2.3f}};
+  prefs.putBytes("cal_ccw_1", curve, sizeof(curve));
+  prefs.put("exp_en", true);
+  prefs.put<std::uint8_t>("exp_count", 2);
+  prefs.putString("auth_pass", std::string(100, 'p'));
+  prefs.put<std::int32_t>("tz_offset_min", 180);
+  prefs.putString("dose_sched",
+                  "{\"entries\":[{\"enabled\":true,\"hour\":7,\"minute\":30,\"volumeMl\":40,"
+                  "\"motorId\":1,\"name\":\"Morning\",\"weekdaysMask\":31}]}");
+  // Counters are not config.
+  prefs.put<std::uint32_t>("uptime_0", 3600);
+
+  pump::StoredConfig config = defaults();
+  TEST_ASSERT_TRUE(pump::migrateLegacyConfig(prefs, config));
+  const pump::StoredMotor& m0 = config.motors[0];
+  TEST_ASSERT_EQUAL_FLOAT(2.2f, m0.mlPerRevCw);  // suffixed key wins
+  TEST_ASSERT_EQUAL_FLOAT(150.0f, m0.dosingSpeed);
+  TEST_ASSERT_EQUAL_FLOAT(2.6f, m0.mlPerRevCcw);  // never written
+  TEST_ASSERT_EQUAL_UINT8(1, m0.preferredReverse);
+  TEST_ASSERT_EQUAL_STRING("Nutrient A", m0.alias);
+  TEST_ASSERT_EQUAL_FLOAT(320.0f, config.motors[1].maxSpeed);
+  TEST_ASSERT_EQUAL_STRING("pH down", config.motors[1].alias);
+  TEST_ASSERT_EQUAL_UINT8(2, config.motors[1].curveCcw.count);
+  TEST_ASSERT_EQUAL_FLOAT(300.0f, config.motors[1].curveCcw.points[1].rpm);
+  TEST_ASSERT_EQUAL_UINT8(0, config.motors[1].curveCw.count);
+  TEST_ASSERT_EQUAL_UINT8(1, config.expansionEnabled);
+  TEST_ASSERT_EQUAL_UINT8(2, config.expansionMotorCount);
+  TEST_ASSERT_EQUAL_INT32(180, config.tzOffsetMinutes);
+  TEST_ASSERT_EQUAL_UINT32(sizeof(config.authPass) - 1, std::strlen(config.authPass));
+  TEST_ASSERT_EQUAL_STRING("time.google.com", config.ntpServer);
+  const pump::StoredSchedule& s = config.schedules[0];
+  TEST_ASSERT_EQUAL_UINT16(40, s.volumeMl);
+  TEST_ASSERT_EQUAL_UINT8(7, s.hour);
+  TEST_ASSERT_EQUAL_UINT8(30, s.minute);
+  TEST_ASSERT_EQUAL_UINT8(1, s.motorId);
+  TEST_ASSERT_EQUAL_UINT8(31, s.weekdaysMask);
+  TEST_ASSERT_EQUAL_STRING("Morning", s.name);
+  TEST_ASSERT_EQUAL_UINT16(0, config.schedules[1].volumeMl);
+
+  pump::removeLegacyConfig(prefs);
+  TEST_ASSERT_EQUAL_UINT32(1, prefs.size());
+  TEST_ASSERT_TRUE(prefs.isKey("uptime_0"));
+
+  // Nothing left to migrate on the next boot.
+  pump::StoredConfig again = defaults();
+  TEST_ASSERT_FALSE(pump::migrateLegacyConfig(prefs, again));
+  const pump::StoredConfig fresh = defaults();
+  TEST_ASSERT_EQUAL_MEMORY(&fresh, &again, sizeof(again));
+}
+
+void test_stored_strings_truncate_on_character_boundary() {
+  char field[8];
+  TEST_ASSERT_TRUE(pump::copyStoredString(field, "Motor"));
+  TEST_ASSERT_EQUAL_STRING("Motor", field);
+  TEST_ASSERT_EQUAL_UINT8(0, field[7]);
+  // "Насос" is 10 bytes; 7 would split the fourth letter.
+  TEST_ASSERT_FALSE(pump::copyStoredString(field, "\xD0\x9D\xD0\xB0\xD1\x81\xD0\xBE\xD1\x81"));
+  TEST_ASSERT_EQUAL_STRING("\xD0\x9D\xD0\xB0\xD1\x81", field);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_blob_round_trips);
+  RUN_TEST(test_damaged_blob_leaves_defaults);
+  RUN_TEST(test_older_layout_keeps_defaults_for_new_fields);
+  RUN_TEST(test_version_1_blob_leaves_ramp_profiles_linear);
+  RUN_TEST(test_newer_layout_loads_known_prefix);
+  RUN_TEST(test_legacy_keys_migrate_and_are_removed);
+  RUN_TEST(test_stored_strings_truncate_on_character_boundary);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
@@ -0,0 +1,271 @@
+#include <unity.h>
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "ConfigBlob.h"
+#include "CounterJournal.h"
+
+namespace {
+
+// The files the firmware keeps on LittleFS: two checkpoint slots and the log.
+struct Disk {
+  pump::CounterCheckpoint slots[2]{};
+  std::vector<std::uint8_t> log;
+
+  void append(const pump::CounterRecord& r) {
+    const auto* p = reinterpret_cast<const std::uint8_t*>(&r);
+    log.insert(log.end(), p, p + sizeof(r));
+  }
+  void compact(pump::CounterJournal& journal) {
+    const pump::CounterCheckpoint cp = journal.nextCheckpoint();
+    slots[pump::CounterJournal::slotOf(cp.generation)] = cp;
+    journal.committed(cp);
+    log.clear();
+  }
+  // Boot: checkpoint, then records until the first one that does not replay.
+  std::size_t boot(pump::CounterJournal& journal) const {
+    journal.restoreNewest(&slots[0], sizeof(slots[0]), &slots[1], sizeof(slots[1]));
+    const std::size_t bytes = journal.recordBytes();
+    std::size_t n = 0;
+    while ((n + 1) * bytes <= log.size() && journal.replay(log.data() + n * bytes, bytes)) ++n;
+    return n;
+  }
+};
+
+constexpr std::uint64_t kNlPerL = 1000000000ull;
+
+pump::CounterTotals totals(std::uint32_t uptime, std::uint64_t pumpedNl, std::uint64_t hoseNl) {
+  pump::CounterTotals t = pump::CounterTotals();
+  t.uptimeSec = uptime;
+  t.pumpedNl = pumpedNl;
+  t.hoseNl = hoseNl;
+  return t;
+}
+
+void test_replay_rebuilds_totals() {
+  pump::CounterJournal journal;
+  Disk disk;
+  journal.seed(2, totals(1000, 12500000000ull, 3000000000ull));
+  disk.compact(journal);
+
+  pump::CounterRecord r;
+  TEST_ASSERT_FALSE(journal.record(2, totals(1000, 12500000000ull, 3000000000ull), r));  // nothing moved
+  TEST_ASSERT_TRUE(journal.record(2, totals(1060, 12750000000ull, 3250000000ull), r));
+  disk.append(r);
+  TEST_ASSERT_TRUE(journal.record(0, totals(60, 100000000ull, 100000000ull), r));
+  disk.append(r);
+
+  pump::CounterJournal rebooted;
+  TEST_ASSERT_EQUAL_UINT32(2, disk.boot(rebooted));
+  TEST_ASSERT_EQUAL_UINT32(1060, rebooted.totals(2).uptimeSec);
+  TEST_ASSERT_TRUE(rebooted.totals(2).pumpedNl == 12750000000ull);
+  TEST_ASSERT_TRUE(rebooted.totals(2).hoseNl == 3250000000ull);
+  TEST_ASSERT_EQUAL_UINT32(60, rebooted.totals(0).uptimeSec);
+  TEST_ASSERT_EQUAL_UINT32(0, rebooted.totals(1).uptimeSec);
+  TEST_ASSERT_EQUAL_UINT32(journal.generation(), rebooted.generation());
+}
+
+void test_rounding_carries_instead_of_drifting() {
+  pump::CounterJournal journal;
+  Disk disk;
+  disk.compact(journal);
+  // A month of one-minute records at an awkward rate.
+  std::uint64_t pumped = 0;
+  pump::CounterRecord r;
+  for (int minute = 1; minute <= 30 * 24 * 60; ++minute) {
+    pumped += 12345679;
+    TEST_ASSERT_TRUE(journal.record(1, totals(minute * 60, pumped, pumped), r));
+    disk.append(r);
+  }
+  pump::CounterJournal rebooted;
+  disk.boot(rebooted);
+  TEST_ASSERT_TRUE(rebooted.totals(1).pumpedNl == pumped);
+  TEST_ASSERT_EQUAL_UINT32(30u * 24 * 3600, rebooted.totals(1).uptimeSec);
+}
+
+void test_small_deltas_on_large_total_replay_exactly() {
+  pump::CounterJournal journal;
+  Disk disk;
+  // Ten thousand litres already through the hose, then single ticks of a
+  // slow dose: far below what a float delta onto a double total resolves.
+  std::uint64_t pumped = 10000 * kNlPerL + 1;
+  std::uint64_t hose = 4321 * kNlPerL + 7;
+  journal.seed(4, totals(0, pumped, hose));
+  disk.compact(journal);
+  pump::CounterRecord r;
+  for (std::uint32_t i = 1; i <= 100000; ++i) {
+    pumped += 1 + i % 7;
+    hose += 3;
+    TEST_ASSERT_TRUE(journal.record(4, totals(i, pumped, hose), r));
+    disk.append(r);
+  }
+  // A hose change resets its counter: a negative delta, still exact.
+  hose = 5;
+  TEST_ASSERT_TRUE(journal.record(4, totals(100000, pumped, hose), r));
+  TEST_ASSERT_TRUE(r.hoseNl < 0);
+  disk.append(r);
+
+  pump::CounterJournal rebooted;
+  TEST_ASSERT_EQUAL_UINT32(100001, disk.boot(rebooted));
+  TEST_ASSERT_TRUE(rebooted.totals(4).pumpedNl == pumped);
+  TEST_ASSERT_TRUE(rebooted.totals(4).hoseNl == hose);
+  TEST_ASSERT_EQUAL_UINT32(100000, rebooted.totals(4).uptimeSec);
+}
+
+void test_torn_record_ends_replay() {
+  pump::CounterJournal journal;
+  Disk disk;
+  disk.compact(journal);
+  pump::CounterRecord r;
+  journal.record(0, totals(60, kNlPerL, kNlPerL), r);
+  disk.append(r);
+  journal.record(0, totals(120, 2 * kNlPerL, 2 * kNlPerL), r);
+  disk.append(r);
+  // Power cut halfway through the second record, then a stray flipped bit.
+  disk.log.resize(disk.log.size() - sizeof(r) / 2);
+  pump::CounterJournal rebooted;
+  TEST_ASSERT_EQUAL_UINT32(1, disk.boot(rebooted));
+  TEST_ASSERT_EQUAL_UINT32(60, rebooted.totals(0).uptimeSec);
+
+  disk.log.resize(sizeof(r));
+  disk.log[6] ^= 0x40;
+  TEST_ASSERT_EQUAL_UINT32(0, disk.boot(rebooted));
+  TEST_ASSERT_EQUAL_UINT32(0, rebooted.totals(0).uptimeSec);
+}
+
+void test_records_before_checkpoint_do_not_count_twice() {
+  pump::CounterJournal journal;
+  Disk disk;
+  disk.compact(journal);
+  pump::CounterRecord r;
+  journal.record(3, totals(60, kNlPerL, kNlPerL), r);
+  disk.append(r);
+  // Power cut after the new checkpoint landed but before the log was cleared.
+  const std::vector<std::uint8_t> oldLog = disk.log;
+  disk.compact(journal);
+  disk.log = oldLog;
+
+  pump::CounterJournal rebooted;
+  TEST_ASSERT_EQUAL_UINT32(0, disk.boot(rebooted));
+  TEST_ASSERT_EQUAL_UINT32(60, rebooted.totals(3).uptimeSec);
+  TEST_ASSERT_TRUE(rebooted.totals(3).pumpedNl == kNlPerL);
+}
+
+void test_damaged_checkpoint_is_rejected() {
+  pump::CounterJournal journal;
+  journal.seed(0, totals(5, 5 * kNlPerL, 5 * kNlPerL));
+  pump::CounterCheckpoint cp = journal.nextCheckpoint();
+  TEST_ASSERT_EQUAL_UINT32(1, cp.generation);
+  TEST_ASSERT_EQUAL_UINT32(0, journal.generation());  // not until committed
+
+  pump::CounterJournal rebooted;
+  TEST_ASSERT_TRUE(rebooted.restore(&cp, sizeof(cp)));
+  TEST_ASSERT_EQUAL_UINT32(5, rebooted.totals(0).uptimeSec);
+  TEST_ASSERT_FALSE(rebooted.restore(&cp, sizeof(cp) - 1));
+  cp.motors[0].uptimeSec = 6;
+  TEST_ASSERT_FALSE(rebooted.restore(&cp, sizeof(cp)));
+  TEST_ASSERT_EQUAL_UINT32(0, rebooted.totals(0).uptimeSec);
+  TEST_ASSERT_EQUAL_UINT32(0, rebooted.generation());
+}
+
+void test_torn_checkpoint_falls_back_to_the_other_slot() {
+  pump::CounterJournal journal;
+  Disk disk;
+  disk.compact(journal);
+  pump::CounterRecord r;
+  journal.record(0, totals(60, kNlPerL, kNlPerL), r);
+  disk.append(r);
+  disk.compact(journal);
+  journal.record(0, totals(120, 2 * kNlPerL, 2 * kNlPerL), r);
+  disk.append(r);
+  // Power cut halfway through writing generation 3 over generation 1.
+  const pump::CounterCheckpoint next = journal.nextCheckpoint();
+  std::memcpy(&disk.slots[1], &next, sizeof(next) / 2);
+
+  pump::CounterJournal rebooted;
+  TEST_ASSERT_EQUAL_UINT32(1, disk.boot(rebooted));
+  TEST_ASSERT_EQUAL_UINT32(2, rebooted.generation());
+  TEST_ASSERT_EQUAL_UINT32(120, rebooted.totals(0).uptimeSec);
+  TEST_ASSERT_TRUE(rebooted.totals(0).pumpedNl == 2 * kNlPerL);
+
+  // Both slots gone: nothing to restore, which the firmware must not save.
+  disk.slots[0].motors[0].uptimeSec ^= 1;
+  TEST_ASSERT_FALSE(rebooted.restoreNewest(&disk.slots[0], sizeof(disk.slots[0]), &disk.slots[1],
+                                           sizeof(disk.slots[1])));
+  TEST_ASSERT_EQUAL_UINT32(0, rebooted.totals(0).uptimeSec);
+  TEST_ASSERT_EQUAL_UINT32(0, rebooted.generation());
+}
+
+// A journal written by the litre format: double totals, float deltas.
+void test_litre_format_is_still_read() {
+  struct OldTotals {
+    std::uint32_t uptimeSec;
+    std::uint32_t reserved;
+    double pumpedL;
+    double hoseL;
+  };
+  struct OldRecord {
+    std::uint8_t magic;
+    std::uint8_t motor;
+    std::uint16_t generation;
+    std::int32_t uptimeSec;
+    float pumpedL;
+    float hoseL;
+    std::uint32_t crc;
+  };
+  Disk disk;
+  pump::CounterCheckpoint& cp = disk.slots[1];
+  cp.magic = 0x50434e54;
+  cp.generation = 3;
+  const OldTotals old = {100, 0, 12.5, 2.25};
+  std::memcpy(&cp.motors[1], &old, sizeof(old));
+  cp.crc = pump::crc32(&cp, offsetof(pump::CounterCheckpoint, crc));
+  OldRecord rec = {0xC7, 1, 3, 60, 0.25f, 0.5f, 0};
+  rec.crc = pump::crc32(&rec, offsetof(OldRecord, crc));
+  const auto* p = reinterpret_cast<const std::uint8_t*>(&rec);
+  disk.log.assign(p, p + sizeof(rec));
+
+  pump::CounterJournal journal;
+  TEST_ASSERT_EQUAL_UINT32(1, disk.boot(journal));
+  TEST_ASSERT_TRUE(journal.legacy());
+  TEST_ASSERT_EQUAL_UINT32(160, journal.totals(1).uptimeSec);
+  TEST_ASSERT_TRUE(journal.totals(1).pumpedNl == 12750000000ull);
+  TEST_ASSERT_TRUE(journal.totals(1).hoseNl == 2750000000ull);
+
+  // Checkpointing moves it to the nanolitre format.
+  disk.compact(journal);
+  TEST_ASSERT_FALSE(journal.legacy());
+  TEST_ASSERT_EQUAL_UINT32(sizeof(pump::CounterRecord), journal.recordBytes());
+  pump::CounterJournal rebooted;
+  TEST_ASSERT_EQUAL_UINT32(0, disk.boot(rebooted));
+  TEST_ASSERT_FALSE(rebooted.legacy());
+  TEST_ASSERT_TRUE(rebooted.totals(1).pumpedNl == 12750000000ull);
+  TEST_ASSERT_EQUAL_UINT32(4, rebooted.generation());
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_replay_rebuilds_totals);
+  RUN_TEST(test_rounding_carries_instead_of_drifting);
+  RUN_TEST(test_small_deltas_on_large_total_replay_exactly);
+  RUN_TEST(test_torn_record_ends_replay);
+  RUN_TEST(test_records_before_checkpoint_do_not_count_twice);
+  RUN_TEST(test_damaged_checkpoint_is_rejected);
+  RUN_TEST(test_torn_checkpoint_falls_back_to_the_other_slot);
+  RUN_TEST(test_litre_format_is_still_read);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
@@ -0,0 +1,56 @@
+#include <unity.h>
+
+#include "EventThrottle.h"
+
+namespace {
+
+void test_checks_at_most_once_per_interval() {
+  pump::EventThrottle throttle(250, 15000);
+  TEST_ASSERT_TRUE(throttle.due(1000));
+  TEST_ASSERT_FALSE(throttle.due(1000));
+  TEST_ASSERT_FALSE(throttle.due(1249));
+  TEST_ASSERT_TRUE(throttle.due(1250));
+  // A late poll does not shift the next window earlier.
+  TEST_ASSERT_TRUE(throttle.due(1900));
+  TEST_ASSERT_FALSE(throttle.due(2000));
+  TEST_ASSERT_TRUE(throttle.due(2150));
+}
+
+void test_keep_alive_after_quiet_period() {
+  pump::EventThrottle throttle(250, 15000);
+  throttle.sent(1000);
+  TEST_ASSERT_FALSE(throttle.keepAliveDue(15999));
+  TEST_ASSERT_TRUE(throttle.keepAliveDue(16000));
+  throttle.sent(16000);
+  TEST_ASSERT_FALSE(throttle.keepAliveDue(16250));
+}
+
+void test_survives_millis_wrap() {
+  pump::EventThrottle throttle(250, 15000);
+  TEST_ASSERT_TRUE(throttle.due(0xFFFFFF80u));
+  throttle.sent(0xFFFFFF80u);
+  TEST_ASSERT_FALSE(throttle.due(0x00000010u));
+  TEST_ASSERT_TRUE(throttle.due(0x0000007Au));
+  TEST_ASSERT_FALSE(throttle.keepAliveDue(0x00003A97u - 0x80u));
+  TEST_ASSERT_TRUE(throttle.keepAliveDue(0x00003A98u - 0x80u));
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_checks_at_most_once_per_interval);
+  RUN_TEST(test_keep_alive_after_quiet_period);
+  RUN_TEST(test_survives_millis_wrap);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
@@ -0,0 +1,129 @@
+#include <unity.h>
+
+#include <cstdint>
+
+#include "ExpansionProtocol.h"
+
+namespace {
+
+pump::State sampleState() {
+  pump::State st;
+  st.mode = pump::Mode::DOSING;
+  st.running = true;
+  st.targetSpeed = -123.4f;
+  st.currentSpeed = -98.76f;
+  st.dosingRemainingMl = 41.6f;
+  st.totalMotorUptimeSec = 86400u * 30u;
+  st.totalPumpedNl = 1234567890123ULL;
+  st.totalHoseNl = 499999ULL;
+  st.mlPerRevCw = 2.61f;
+  st.mlPerRevCcw = 2.59f;
+  st.dosingSpeed = 200.0f;
+  return st;
+}
+
+void test_state_round_trips_at_wire_resolution() {
+  std::uint8_t frame[exproto::kStateRespLen] = {0};
+  exproto::encodeState(sampleState(), 450.0f, frame);
+
+  pump::State got;
+  float maxSpeed = 0.0f;
+  TEST_ASSERT_TRUE(exproto::decodeState(frame, got, maxSpeed));
+  TEST_ASSERT_EQUAL_UINT32(static_cast<std::uint32_t>(pump::Mode::DOSING), static_cast<std::uint32_t>(got.mode));
+  TEST_ASSERT_TRUE(got.running);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, -123.4f, got.targetSpeed);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, -98.8f, got.currentSpeed);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 42.0f, got.dosingRemainingMl);
+  TEST_ASSERT_EQUAL_UINT32(86400u * 30u, got.totalMotorUptimeSec);
+  // Totals travel as rounded whole millilitres.
+  TEST_ASSERT_EQUAL_UINT64(1234568000000ULL, got.totalPumpedNl);
+  TEST_ASSERT_EQUAL_UINT64(0, got.totalHoseNl);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001f, 2.61f, got.mlPerRevCw);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001f, 2.59f, got.mlPerRevCcw);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 200.0f, got.dosingSpeed);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 450.0f, maxSpeed);
+}
+
+void test_frame_layout_matches_protocol_doc() {
+  std::uint8_t frame[exproto::kStateRespLen] = {0};
+  exproto::encodeState(sampleState(), 450.0f, frame);
+  TEST_ASSERT_EQUAL_UINT8(1, frame[0]);
+  TEST_ASSERT_EQUAL_UINT8(1, frame[1]);
+  // -1234 little-endian
+  TEST_ASSERT_EQUAL_UINT8(0x2E, frame[2]);
+  TEST_ASSERT_EQUAL_UINT8(0xFB, frame[3]);
+  // 4500
+  TEST_ASSERT_EQUAL_UINT8(0x94, frame[26]);
+  TEST_ASSERT_EQUAL_UINT8(0x11, frame[27]);
+  TEST_ASSERT_EQUAL_UINT8(exproto::frameCrc(frame, exproto::kStateRespLen - 1), frame[exproto::kStateRespLen - 1]);
+}
+
+void test_bad_crc_leaves_state_untouched() {
+  std::uint8_t frame[exproto::kStateRespLen] = {0};
+  exproto::encodeState(sampleState(), 450.0f, frame);
+  frame[5] ^= 0x40;
+
+  pump::State got;
+  got.mlPerRevCw = 3.3f;
+  float maxSpeed = 99.0f;
+  TEST_ASSERT_FALSE(exproto::decodeState(frame, got, maxSpeed));
+  TEST_ASSERT_EQUAL_FLOAT(3.3f, got.mlPerRevCw);
+  TEST_ASSERT_EQUAL_FLOAT(99.0f, maxSpeed);
+  TEST_ASSERT_FALSE(got.running);
+}
+
+void test_curve_frame_round_trips_and_fits_wire_buffer() {
+  pump::CalibrationCurve curve;
+  for (std::size_t i = 0; i < pump::CalibrationCurve::kMaxPoints; ++i) {
+    TEST_ASSERT_TRUE(curve.setPoint(40.0f + 80.0f * static_cast<float>(i), 2.9f - 0.1f * static_cast<float>(i)));
+  }
+  std::uint8_t frame[exproto::kCurveFrameMaxLen] = {0};
+  const std::size_t len = exproto::encodeCurve(3, true, curve, frame);
+  // Wire and the expansion receive handler take at most 32 bytes.
+  TEST_ASSERT_EQUAL_UINT32(exproto::kCurveFrameMaxLen, len);
+  TEST_ASSERT_TRUE(len <= 32);
+
+  std::uint8_t motor = 0;
+  bool reverse = false;
+  pump::CalibrationCurve got;
+  TEST_ASSERT_TRUE(exproto::decodeCurve(frame, len, motor, reverse, got));
+  TEST_ASSERT_EQUAL_UINT8(3, motor);
+  TEST_ASSERT_TRUE(reverse);
+  TEST_ASSERT_EQUAL_UINT32(curve.size(), got.size());
+  for (std::size_t i = 0; i < curve.size(); ++i) {
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, curve.point(i).rpm, got.point(i).rpm);
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, curve.point(i).mlPerRev, got.point(i).mlPerRev);
+  }
+
+  // Truncated or corrupted frames leave the curve alone.
+  TEST_ASSERT_FALSE(exproto::decodeCurve(frame, len - 4, motor, reverse, got));
+  frame[6] ^= 0x01;
+  TEST_ASSERT_FALSE(exproto::decodeCurve(frame, len, motor, reverse, got));
+  TEST_ASSERT_EQUAL_UINT32(curve.size(), got.size());
+
+  // An empty curve clears the expansion's calibration.
+  TEST_ASSERT_EQUAL_UINT32(5, exproto::encodeCurve(0, false, pump::CalibrationCurve(), frame));
+  TEST_ASSERT_TRUE(exproto::decodeCurve(frame, 5, motor, reverse, got));
+  TEST_ASSERT_TRUE(got.empty());
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_state_round_trips_at_wire_resolution);
+  RUN_TEST(test_frame_layout_matches_protocol_doc);
+  RUN_TEST(test_bad_crc_leaves_state_untouched);
+  RUN_TEST(test_curve_frame_round_trips_and_fits_wire_buffer);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
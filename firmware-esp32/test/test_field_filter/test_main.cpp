@@ -0,0 +1,97 @@
+#include <ArduinoJson.h>
+#include <unity.h>
+
+#include "PumpController.h"
+#include "StateJson.h"
+
+namespace {
+
+void test_no_list_wants_everything() {
+  const pump::FieldFilter none;
+  TEST_ASSERT_TRUE(none.all());
+  TEST_ASSERT_TRUE(none.wants("flowLph"));
+  TEST_ASSERT_TRUE(none.nested("motors").wants("flowLph"));
+  TEST_ASSERT_TRUE(pump::FieldFilter("").all());
+}
+
+void test_listed_keys_only() {
+  const pump::FieldFilter fields("flowLph,running");
+  TEST_ASSERT_TRUE(fields.wants("flowLph"));
+  TEST_ASSERT_TRUE(fields.wants("running"));
+  TEST_ASSERT_FALSE(fields.wants("flowMlMin"));
+  TEST_ASSERT_FALSE(fields.wants("flow"));
+  TEST_ASSERT_FALSE(fields.wants("motors"));
+}
+
+void test_nested_keys_select_their_parent() {
+  const pump::FieldFilter fields("time,motors.flowLph,expansion");
+  TEST_ASSERT_TRUE(fields.wants("motors"));
+  TEST_ASSERT_FALSE(fields.wants("motor"));
+  TEST_ASSERT_FALSE(fields.wants("flowLph"));
+
+  const pump::FieldFilter motors = fields.nested("motors");
+  TEST_ASSERT_TRUE(motors.wants("flowLph"));
+  TEST_ASSERT_FALSE(motors.wants("time"));
+  TEST_ASSERT_FALSE(motors.wants("running"));
+
+  // A parent listed on its own brings all of its keys.
+  const pump::FieldFilter expansion = fields.nested("expansion");
+  TEST_ASSERT_TRUE(expansion.wants("connected"));
+  TEST_ASSERT_TRUE(expansion.wants("address"));
+}
+
+void test_state_fields_follow_the_filter() {
+  pump::PumpController ctrl{pump::Config{}};
+  ctrl.advanceTo(1000);
+  DynamicJsonDocument doc(1024);
+  pump::writeStateFields(doc.to<JsonObject>(), ctrl, pump::FieldFilter("flowLph,direction"));
+  TEST_ASSERT_EQUAL_UINT32(2, doc.as<JsonObject>().size());
+  TEST_ASSERT_TRUE(doc.containsKey("flowLph"));
+  TEST_ASSERT_TRUE(doc.containsKey("direction"));
+
+  DynamicJsonDocument all(1024);
+  pump::writeStateFields(all.to<JsonObject>(), ctrl);
+  TEST_ASSERT_EQUAL_UINT32(16, all.as<JsonObject>().size());
+}
+
+void test_narrow_list_shrinks_the_payload() {
+  pump::PumpController ctrl{pump::Config{}};
+  ctrl.setSpeed(120.0f);
+  ctrl.startDosing(25);
+  ctrl.advanceTo(1000);
+  const auto measure = [&](const pump::FieldFilter& fields) {
+    DynamicJsonDocument doc(1024);
+    JsonArray motors = doc.createNestedArray("motors");
+    for (int i = 0; i < 5; ++i) pump::writeStateFields(motors.createNestedObject(), ctrl, fields.nested("motors"));
+    return measureJson(doc);
+  };
+  const std::size_t all = measure(pump::FieldFilter());
+  const std::size_t two = measure(pump::FieldFilter("motors.flowLph,motors.running"));
+  const std::size_t one = measure(pump::FieldFilter("motors.flowLph"));
+  TEST_ASSERT_TRUE(one < two);
+  TEST_ASSERT_TRUE(two < all);
+  // A dashboard polling one value per motor gets a fraction of the document.
+  TEST_ASSERT_TRUE(one * 5 < all);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_list_wants_everything);
+  RUN_TEST(test_listed_keys_only);
+  RUN_TEST(test_nested_keys_select_their_parent);
+  RUN_TEST(test_state_fields_follow_the_filter);
+  RUN_TEST(test_narrow_list_shrinks_the_payload);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
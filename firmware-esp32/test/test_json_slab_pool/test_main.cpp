@@ -0,0 +1,112 @@
+#include <unity.h>
+
+#include <ArduinoJson.h>
+
+#include <cstring>
+
+#include "JsonSlabPool.h"
+
+namespace {
+
+const std::size_t kSizes[] = {256, 256, 1024, 4096};
+std::uint8_t storage[256 + 256 + 1024 + 4096];
+
+}  // namespace
+
+// Template arguments need external linkage.
+pump::JsonSlabPool testPool(storage, kSizes, 4);
+
+namespace {
+
+using PooledDoc = BasicJsonDocument<pump::SlabAllocator<testPool>>;
+
+bool inStorage(const void* p) {
+  const auto* b = static_cast<const std::uint8_t*>(p);
+  return b >= storage && b < storage + sizeof(storage);
+}
+
+void test_smallest_free_slab_is_lent() {
+  pump::JsonSlabPool pool(storage, kSizes, 4);
+  TEST_ASSERT_EQUAL_UINT32(4, pool.slabs());
+  void* a = pool.allocate(128);
+  void* b = pool.allocate(200);
+  void* c = pool.allocate(200);  // both 256s taken: next size up
+  TEST_ASSERT_TRUE(a == storage);
+  TEST_ASSERT_TRUE(b == storage + 256);
+  TEST_ASSERT_TRUE(c == storage + 512);
+  pool.deallocate(b);
+  TEST_ASSERT_TRUE(pool.allocate(64) == storage + 256);
+  TEST_ASSERT_EQUAL_UINT32(0, pool.stats().heapAllocations);
+  TEST_ASSERT_EQUAL_UINT32(3, pool.stats().inUse);
+  TEST_ASSERT_EQUAL_UINT32(3, pool.stats().maxInUse);
+  TEST_ASSERT_EQUAL_UINT32(4, pool.stats().borrowed);
+}
+
+void test_oversized_or_exhausted_falls_back_to_heap() {
+  pump::JsonSlabPool pool(storage, kSizes, 4);
+  void* big = pool.allocate(65520);
+  TEST_ASSERT_NOT_NULL(big);
+  TEST_ASSERT_FALSE(inStorage(big));
+  TEST_ASSERT_EQUAL_UINT32(1, pool.stats().heapAllocations);
+  void* slabs[4];
+  for (auto& s : slabs) s = pool.allocate(100);
+  void* extra = pool.allocate(100);
+  TEST_ASSERT_FALSE(inStorage(extra));
+  TEST_ASSERT_EQUAL_UINT32(2, pool.stats().heapAllocations);
+  pool.deallocate(big);
+  pool.deallocate(extra);
+  for (auto& s : slabs) pool.deallocate(s);
+  TEST_ASSERT_EQUAL_UINT32(0, pool.stats().inUse);
+  TEST_ASSERT_EQUAL_UINT32(6, pool.stats().maxInUse);
+}
+
+void test_reallocate_keeps_contents() {
+  pump::JsonSlabPool pool(storage, kSizes, 4);
+  auto* p = static_cast<char*>(pool.allocate(100));
+  std::strcpy(p, "kept");
+  TEST_ASSERT_TRUE(pool.reallocate(p, 200) == p);  // still fits its slab
+  auto* q = static_cast<char*>(pool.reallocate(p, 900));
+  TEST_ASSERT_TRUE(q == reinterpret_cast<char*>(storage + 512));
+  TEST_ASSERT_EQUAL_STRING("kept", q);
+  TEST_ASSERT_EQUAL_UINT32(1, pool.stats().inUse);
+  TEST_ASSERT_TRUE(pool.allocate(100) == storage);  // the old slab is free again
+}
+
+void test_documents_stop_allocating_once_warm() {
+  for (int request = 0; request < 100; ++request) {
+    PooledDoc in(1024);
+    in["motorId"] = 2;
+    PooledDoc out(3072);
+    out["ok"] = true;
+    out["motorId"] = in["motorId"];
+    if (request % 10 == 0) {
+      PooledDoc err(128);
+      err["error"] = "invalid motorId";
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, testPool.stats().heapAllocations);
+  TEST_ASSERT_EQUAL_UINT32(0, testPool.stats().inUse);
+  TEST_ASSERT_EQUAL_UINT32(3, testPool.stats().maxInUse);
+  TEST_ASSERT_EQUAL_UINT32(210, testPool.stats().borrowed);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_smallest_free_slab_is_lent);
+  RUN_TEST(test_oversized_or_exhausted_falls_back_to_heap);
+  RUN_TEST(test_reallocate_keeps_contents);
+  RUN_TEST(test_documents_stop_allocating_once_warm);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
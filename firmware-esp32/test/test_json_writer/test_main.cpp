@@ -0,0 +1,91 @@
+#include <unity.h>
+
+#include <ArduinoJson.h>
+
+#include <string>
+#include <vector>
+
+#include "JsonWriter.h"
+
+namespace {
+
+// Records every flush, the way the socket would see them.
+struct Chunks {
+  std::vector<std::string>* out;
+  void operator()(const char* data, std::size_t len) const { out->push_back(std::string(data, len)); }
+};
+
+std::string joined(const std::vector<std::string>& chunks) {
+  std::string all;
+  for (const auto& c : chunks) all += c;
+  return all;
+}
+
+void test_output_matches_serialize_to_string() {
+  DynamicJsonDocument doc(2048);
+  JsonArray motors = doc.createNestedArray("motors");
+  for (int i = 0; i < 20; ++i) {
+    JsonObject m = motors.createNestedObject();
+    m["motorId"] = i;
+    m["alias"] = "Motor \"quoted\" \xc3\xa9";
+    m["speed"] = 12.5 * i;
+  }
+  std::string expected;
+  serializeJson(doc, expected);
+
+  std::vector<std::string> chunks;
+  std::size_t flushed = 0;
+  {
+    pump::BufferedJsonWriter<Chunks, 64> out(Chunks{&chunks});
+    serializeJson(doc, out);
+    out.flush();
+    flushed = out.flushed();
+  }
+  TEST_ASSERT_EQUAL_STRING(expected.c_str(), joined(chunks).c_str());
+  TEST_ASSERT_EQUAL_UINT32(expected.size(), flushed);
+  TEST_ASSERT_EQUAL_UINT32(measureJson(doc), flushed);
+  // Every chunk but the last fills the buffer.
+  for (std::size_t i = 0; i + 1 < chunks.size(); ++i) TEST_ASSERT_EQUAL_UINT32(64, chunks[i].size());
+}
+
+void test_large_writes_are_split_and_rest_flushed_on_destruction() {
+  std::vector<std::string> chunks;
+  const std::string text(150, 'x');
+  {
+    pump::BufferedJsonWriter<Chunks, 64> out(Chunks{&chunks});
+    out.write('[');
+    out.write(reinterpret_cast<const std::uint8_t*>(text.data()), text.size());
+    TEST_ASSERT_EQUAL_UINT32(2, chunks.size());
+  }
+  TEST_ASSERT_EQUAL_UINT32(3, chunks.size());
+  TEST_ASSERT_EQUAL_STRING(("[" + text).c_str(), joined(chunks).c_str());
+}
+
+void test_empty_writer_sends_nothing() {
+  std::vector<std::string> chunks;
+  {
+    pump::BufferedJsonWriter<Chunks, 64> out(Chunks{&chunks});
+    out.flush();
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, chunks.size());
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_output_matches_serialize_to_string);
+  RUN_TEST(test_large_writes_are_split_and_rest_flushed_on_destruction);
+  RUN_TEST(test_empty_writer_sends_nothing);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
@@ -0,0 +1,59 @@
+#include <unity.h>
+
+#include "LoopStats.h"
+
+namespace {
+
+void test_pass_times_and_slow_passes() {
+  pump::LoopStats stats(10000);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.meanPassMicros());
+  stats.pass(200);
+  stats.pass(400);
+  stats.pass(10000);  // at the limit is not slow
+  stats.pass(25000);
+  TEST_ASSERT_EQUAL_UINT32(4, stats.passes);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.slowPasses);
+  TEST_ASSERT_EQUAL_UINT32(25000, stats.maxPassMicros);
+  TEST_ASSERT_EQUAL_UINT32(8900, stats.meanPassMicros());
+}
+
+void test_tick_lateness_ignores_early_ticks() {
+  pump::LoopStats stats(10000);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.meanTickLateMicros());
+  stats.tick(10000, 10000);
+  stats.tick(9990, 10000);
+  stats.tick(13000, 10000);
+  stats.tick(11000, 10000);
+  TEST_ASSERT_EQUAL_UINT32(4, stats.ticks);
+  TEST_ASSERT_EQUAL_UINT32(3000, stats.maxTickLateMicros);
+  TEST_ASSERT_EQUAL_UINT32(1000, stats.meanTickLateMicros());
+}
+
+void test_totals_do_not_wrap_over_long_uptimes() {
+  pump::LoopStats stats(10000);
+  // 2.5 million 2 ms passes add up to 5e9 us, past what 32 bits hold.
+  stats.passes = 2500000 - 1;
+  stats.totalPassMicros = 4999998000ull;
+  stats.pass(2000);
+  TEST_ASSERT_EQUAL_UINT32(2000, stats.meanPassMicros());
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_pass_times_and_slow_passes);
+  RUN_TEST(test_tick_lateness_ignores_early_ticks);
+  RUN_TEST(test_totals_do_not_wrap_over_long_uptimes);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
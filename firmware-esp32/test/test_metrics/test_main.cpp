@@ -0,0 +1,87 @@
+#include <unity.h>
+
+#include <string>
+
+#include "Metrics.h"
+
+namespace {
+
+struct StringOut {
+  std::string text;
+  std::size_t write(const std::uint8_t* data, std::size_t n) {
+    text.append(reinterpret_cast<const char*>(data), n);
+    return n;
+  }
+};
+
+void test_histogram_buckets_are_cumulative() {
+  const std::array<std::uint32_t, 3> bounds = {{100, 1000, 10000}};
+  pump::Histogram<3> h(bounds);
+  h.observe(50);
+  h.observe(100);  // on a bound counts in that bucket
+  h.observe(101);
+  h.observe(20000);
+  TEST_ASSERT_EQUAL_UINT32(2, h.cumulative(0));
+  TEST_ASSERT_EQUAL_UINT32(3, h.cumulative(1));
+  TEST_ASSERT_EQUAL_UINT32(3, h.cumulative(2));
+  TEST_ASSERT_EQUAL_UINT32(4, h.count());
+  TEST_ASSERT_TRUE(h.sum() == 20251);
+}
+
+void test_samples_and_families() {
+  StringOut out;
+  pump::MetricsWriter<StringOut> w(out);
+  w.family("pump_doses_total", "counter", "Doses started.");
+  w.sample("pump_doses_total", "motor=\"1\"", static_cast<std::uint64_t>(3));
+  w.sample("pump_i2c_errors_total", nullptr, static_cast<std::uint64_t>(0));
+  w.sample("pump_pumped_liters_total", nullptr, 1.25);
+  TEST_ASSERT_EQUAL_STRING(
+      "# HELP pump_doses_total Doses started.\n"
+      "# TYPE pump_doses_total counter\n"
+      "pump_doses_total{motor=\"1\"} 3\n"
+      "pump_i2c_errors_total 0\n"
+      "pump_pumped_liters_total 1.25\n",
+      out.text.c_str());
+}
+
+void test_histogram_in_seconds() {
+  const std::array<std::uint32_t, 2> bounds = {{500, 10000}};
+  pump::Histogram<2> h(bounds);
+  h.observe(400);
+  h.observe(12000);
+  StringOut out;
+  pump::MetricsWriter<StringOut> w(out);
+  w.histogram("pump_loop_pass_seconds", nullptr, h, 1e-6);
+  TEST_ASSERT_EQUAL_STRING(
+      "pump_loop_pass_seconds_bucket{le=\"0.0005\"} 1\n"
+      "pump_loop_pass_seconds_bucket{le=\"0.01\"} 1\n"
+      "pump_loop_pass_seconds_bucket{le=\"+Inf\"} 2\n"
+      "pump_loop_pass_seconds_sum 0.0124\n"
+      "pump_loop_pass_seconds_count 2\n",
+      out.text.c_str());
+
+  pump::ByteCounter length;
+  pump::MetricsWriter<pump::ByteCounter> counted(length);
+  counted.histogram("pump_loop_pass_seconds", nullptr, h, 1e-6);
+  TEST_ASSERT_EQUAL_UINT32(out.text.size(), length.bytes);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_histogram_buckets_are_cumulative);
+  RUN_TEST(test_samples_and_families);
+  RUN_TEST(test_histogram_in_seconds);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
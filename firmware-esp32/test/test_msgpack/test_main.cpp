@@ -0,0 +1,80 @@
+#include <unity.h>
+
+#include "MsgPack.h"
+#include "StateJson.h"
+
+namespace {
+
+void test_uint_uses_smallest_encoding() {
+  std::uint8_t buf[32];
+  pump::MsgPackWriter out(buf, sizeof(buf));
+  out.uint(0x7f);
+  out.uint(0x80);
+  out.uint(0x1234);
+  out.uint(0x12345678);
+  const std::uint8_t expected[] = {0x7f, 0xcc, 0x80, 0xcd, 0x12, 0x34, 0xce, 0x12, 0x34, 0x56, 0x78};
+  TEST_ASSERT_TRUE(out.ok());
+  TEST_ASSERT_EQUAL_UINT32(sizeof(expected), out.size());
+  TEST_ASSERT_EQUAL_MEMORY(expected, buf, sizeof(expected));
+}
+
+void test_arrays_bools_and_floats_are_big_endian() {
+  std::uint8_t buf[32];
+  pump::MsgPackWriter out(buf, sizeof(buf));
+  out.array(2);
+  out.boolean(true);
+  out.float32(1.5f);
+  out.array(16);
+  out.float64(-2.0);
+  const std::uint8_t expected[] = {0x92, 0xc3, 0xca, 0x3f, 0xc0, 0x00, 0x00, 0xdc, 0x00, 0x10,
+                                   0xcb, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+  TEST_ASSERT_TRUE(out.ok());
+  TEST_ASSERT_EQUAL_UINT32(sizeof(expected), out.size());
+  TEST_ASSERT_EQUAL_MEMORY(expected, buf, sizeof(expected));
+}
+
+void test_overflow_drops_value_and_reports() {
+  std::uint8_t buf[4];
+  pump::MsgPackWriter out(buf, sizeof(buf));
+  out.boolean(false);
+  out.float32(3.0f);  // needs 5 bytes, 3 left
+  TEST_ASSERT_FALSE(out.ok());
+  TEST_ASSERT_EQUAL_UINT32(1, out.size());
+  out.boolean(true);  // nothing more after an overflow
+  TEST_ASSERT_EQUAL_UINT32(1, out.size());
+}
+
+void test_packed_fields_of_idle_motor() {
+  pump::PumpController ctrl{pump::Config{}};
+  std::uint8_t buf[128];
+  pump::MsgPackWriter out(buf, sizeof(buf));
+  pump::packStateFields(out, ctrl);
+  TEST_ASSERT_TRUE(out.ok());
+  // mode, two bools, seven float32, a zero uptime and two float64.
+  TEST_ASSERT_EQUAL_UINT32(3 + 7 * 5 + 1 + 2 * 9, out.size());
+  TEST_ASSERT_EQUAL_UINT8(0x00, buf[0]);
+  TEST_ASSERT_EQUAL_UINT8(0xc2, buf[1]);  // not running
+  TEST_ASSERT_EQUAL_UINT8(0xc3, buf[2]);  // forward
+  TEST_ASSERT_EQUAL_UINT8(0xca, buf[3]);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_uint_uses_smallest_encoding);
+  RUN_TEST(test_arrays_bools_and_floats_are_big_endian);
+  RUN_TEST(test_overflow_drops_value_and_reports);
+  RUN_TEST(test_packed_fields_of_idle_motor);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
@@ -0,0 +1,96 @@
+#include <unity.h>
+
+#include <cstdio>
+#include <string>
+
+#include "PersistCache.h"
+
+namespace {
+
+bool changedFloat(pump::PersistCache& cache, const char* key, float v) { return cache.changed(key, &v, sizeof(v)); }
+
+bool changedString(pump::PersistCache& cache, const char* key, const std::string& v) {
+  return cache.changed(key, v.c_str(), v.size() + 1);
+}
+
+void test_only_changed_values_are_written() {
+  pump::PersistCache cache;
+  TEST_ASSERT_TRUE(changedFloat(cache, "ml_cw_0", 2.6f));
+  TEST_ASSERT_FALSE(changedFloat(cache, "ml_cw_0", 2.6f));
+  TEST_ASSERT_TRUE(changedFloat(cache, "ml_cw_0", 2.61f));
+  TEST_ASSERT_FALSE(changedFloat(cache, "ml_cw_0", 2.61f));
+  // Keys are tracked independently.
+  TEST_ASSERT_TRUE(changedFloat(cache, "ml_ccw_0", 2.61f));
+  TEST_ASSERT_EQUAL_UINT32(2, cache.size());
+}
+
+void test_long_values_compare_by_hash_and_length() {
+  pump::PersistCache cache;
+  const std::string sched(1500, 'x');
+  TEST_ASSERT_TRUE(changedString(cache, "dose_sched", sched));
+  TEST_ASSERT_FALSE(changedString(cache, "dose_sched", sched));
+  std::string edited = sched;
+  edited[700] = 'y';
+  TEST_ASSERT_TRUE(changedString(cache, "dose_sched", edited));
+  TEST_ASSERT_TRUE(changedString(cache, "dose_sched", edited + "x"));
+
+  // A shorter value that happens to share its leading bytes still counts.
+  TEST_ASSERT_TRUE(changedString(cache, "alias_0", "Motor 0"));
+  TEST_ASSERT_TRUE(cache.changed("alias_0", "Motor", 5));
+}
+
+void test_forget_and_overflow_never_skip_writes() {
+  pump::PersistCache cache;
+  TEST_ASSERT_TRUE(changedFloat(cache, "last_speed_0", 120.0f));
+  cache.forget("last_speed_0");
+  TEST_ASSERT_TRUE(changedFloat(cache, "last_speed_0", 120.0f));
+
+  cache.clear();
+  char key[16];
+  for (std::size_t i = 0; i < pump::PersistCache::kMaxKeys; ++i) {
+    std::snprintf(key, sizeof(key), "k%u", static_cast<unsigned>(i));
+    TEST_ASSERT_TRUE(changedFloat(cache, key, 1.0f));
+  }
+  // Untracked keys are always written.
+  TEST_ASSERT_TRUE(changedFloat(cache, "extra", 1.0f));
+  TEST_ASSERT_TRUE(changedFloat(cache, "extra", 1.0f));
+  TEST_ASSERT_FALSE(changedFloat(cache, "k0", 1.0f));
+}
+
+void test_save_stats_accumulate_per_pass() {
+  pump::SaveStats stats;
+  stats.beginPass();
+  stats.wrote(4);
+  stats.wrote(8);
+  stats.endPass(900);
+  stats.beginPass();
+  stats.endPass(30);
+  TEST_ASSERT_EQUAL_UINT32(2, stats.passes);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.lastKeys);
+  TEST_ASSERT_EQUAL_UINT32(30, stats.lastMicros);
+  TEST_ASSERT_EQUAL_UINT32(900, stats.maxMicros);
+  TEST_ASSERT_EQUAL_UINT32(2, stats.totalKeys);
+  TEST_ASSERT_EQUAL_UINT32(12, stats.totalBytes);
+  TEST_ASSERT_EQUAL_UINT32(930, stats.totalMicros);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_only_changed_values_are_written);
+  RUN_TEST(test_long_values_compare_by_hash_and_length);
+  RUN_TEST(test_forget_and_overflow_never_skip_writes);
+  RUN_TEST(test_save_stats_accumulate_per_pass);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
@@ -0,0 +1,150 @@
+#include <unity.h>
+
+#include <cstdint>
+
+#include "PulseBudget.h"
+#include "StepPlanner.h"
+
+namespace {
+
+// A PCNT unit counting rising edges on the STEP pin, with the firmware's ISR:
+// the pin leaves the LEDC on the event that spends the budget.
+struct GatedPin {
+  pump::PulseBudget budget;
+  std::int16_t counter = 0;
+  bool attached = true;
+  std::uint32_t pulses = 0;  // edges that reached the driver
+
+  void arm(std::uint32_t steps) {
+    counter = 0;
+    budget.arm(steps);
+    attached = true;
+  }
+  void edge() {
+    if (!attached) return;
+    ++pulses;
+    ++counter;
+    const bool reachedThreshold = counter == budget.threshold();
+    const bool wrapped = counter == pump::PulseBudget::kChunk;
+    if (wrapped) counter = 0;
+    if (budget.onEvent(wrapped, reachedThreshold)) attached = false;
+  }
+};
+
+struct Lcg {
+  std::uint32_t state;
+  std::uint32_t next(std::uint32_t range) {
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) % range;
+  }
+};
+
+// Runs `plan` the way loop() does: the LEDC tone follows speedAt() at each
+// control tick, ticks land 10 ms apart plus up to `jitterMs`, and a plan
+// whose pulses lag the model creeps on at kFinishHz until the gate closes.
+// Returns the edges the tone would have put out ungated, stopping with the
+// model as it did before.
+std::uint32_t runPlan(const pump::StepPlanner& plan, GatedPin& pin, std::uint32_t jitterMs, std::uint32_t seed) {
+  constexpr double kFinishHz = 200.0;
+  Lcg rng{seed};
+  pin.arm(plan.totalSteps());
+  double t = 0.0;
+  double phase = 0.0;
+  double freePhase = 0.0;
+  for (int tick = 0; tick < 100000 && (t < plan.durationSec() || !pin.budget.spent()); ++tick) {
+    const double modelHz = t < plan.durationSec() ? plan.speedAt(static_cast<float>(t)) : 0.0;
+    const double hz = pin.budget.spent() ? 0.0 : (modelHz < kFinishHz ? kFinishHz : modelHz);
+    const double dt = (10.0 + static_cast<double>(rng.next(jitterMs + 1))) / 1000.0;
+    phase += hz * dt;
+    for (; phase >= 1.0; phase -= 1.0) pin.edge();
+    freePhase += modelHz * dt;
+    t += dt;
+  }
+  return static_cast<std::uint32_t>(freePhase);
+}
+
+void test_budget_spans_counter_wraps() {
+  pump::PulseBudget budget;
+  budget.arm(65000);  // two wraps, then 5000
+  TEST_ASSERT_EQUAL_INT(5000, budget.threshold());
+  TEST_ASSERT_FALSE(budget.onEvent(false, true));  // 5000 of the first chunk
+  TEST_ASSERT_FALSE(budget.onEvent(true, false));
+  TEST_ASSERT_EQUAL_UINT32(35000, budget.counted(5000));
+  TEST_ASSERT_FALSE(budget.onEvent(false, true));
+  TEST_ASSERT_FALSE(budget.onEvent(true, false));
+  TEST_ASSERT_EQUAL_UINT32(64999, budget.counted(4999));
+  TEST_ASSERT_TRUE(budget.onEvent(false, true));
+  TEST_ASSERT_TRUE(budget.spent());
+  TEST_ASSERT_EQUAL_UINT32(65000, budget.counted(0));
+  TEST_ASSERT_FALSE(budget.onEvent(true, true));  // only once
+}
+
+void test_budget_of_whole_chunks_ends_on_the_wrap() {
+  pump::PulseBudget budget;
+  budget.arm(2 * pump::PulseBudget::kChunk);
+  TEST_ASSERT_EQUAL_INT(pump::PulseBudget::kChunk, budget.threshold());
+  // The threshold sits on the wrap, so a chunk may report both at once.
+  TEST_ASSERT_FALSE(budget.onEvent(true, true));
+  TEST_ASSERT_TRUE(budget.onEvent(true, false));
+
+  budget.arm(1);
+  TEST_ASSERT_EQUAL_INT(1, budget.threshold());
+  TEST_ASSERT_TRUE(budget.onEvent(false, true));
+}
+
+void test_disarmed_budget_ignores_events() {
+  pump::PulseBudget budget;
+  TEST_ASSERT_FALSE(budget.onEvent(true, true));
+  budget.arm(10);
+  budget.disarm();
+  TEST_ASSERT_FALSE(budget.onEvent(false, true));
+  TEST_ASSERT_FALSE(budget.spent());
+}
+
+void test_pulses_match_plan_under_tick_jitter() {
+  struct Case {
+    std::uint32_t steps;
+    float cruise;
+    std::uint32_t jitterMs;
+  };
+  // Steps/s as the firmware plans them: 1600 steps/rev, 50 and 200 rpm/s.
+  const float accel = 50.0f * 1600.0f / 60.0f;
+  const float decel = 200.0f * 1600.0f / 60.0f;
+  const Case cases[] = {
+      {37, 4800.0f, 0},        {640, 4800.0f, 15},     {15385, 4800.0f, 40},
+      {76923, 12000.0f, 25},   {100000, 2000.0f, 90},  {30000, 12000.0f, 60},
+  };
+  std::uint32_t ungatedMisses = 0;
+  for (std::uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    pump::StepPlanner plan;
+    plan.plan(cases[i].steps, cases[i].cruise, accel, decel);
+    GatedPin pin;
+    const std::uint32_t ungated = runPlan(plan, pin, cases[i].jitterMs, 17u + i);
+    TEST_ASSERT_TRUE(pin.budget.spent());
+    TEST_ASSERT_EQUAL_UINT32(plan.totalSteps(), pin.pulses);
+    if (ungated != plan.totalSteps()) ++ungatedMisses;
+  }
+  // The tone on its own is off by whatever the tick timing did to it.
+  TEST_ASSERT_TRUE(ungatedMisses > 0);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_budget_spans_counter_wraps);
+  RUN_TEST(test_budget_of_whole_chunks_ends_on_the_wrap);
+  RUN_TEST(test_disarmed_budget_ignores_events);
+  RUN_TEST(test_pulses_match_plan_under_tick_jitter);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
@@ -0,0 +1,173 @@
+#include <unity.h>
+
+#include <array>
+#include <cstdint>
+
+#include "PumpBank.h"
+
+namespace {
+
+constexpr std::size_t kMotors = 6;
+
+pump::Config makeConfig() {
+  pump::Config cfg;
+  cfg.maxSpeed = 450.0f;
+  cfg.minSpeed = 0.01f;
+  cfg.speedAccelPerSec = 50.0f;
+  cfg.speedHaltPerSec = 200.0f;
+  cfg.mlPerRevCw = 2.6f;
+  cfg.mlPerRevCcw = 2.6f;
+  return cfg;
+}
+
+template <std::size_t N>
+void assertMatches(const pump::PumpBank<N>& bank, const std::array<pump::PumpController, N>& refs) {
+  for (std::size_t i = 0; i < N; ++i) {
+    const pump::State got = bank.state(i);
+    const pump::State& want = refs[i].state();
+    TEST_ASSERT_EQUAL_UINT32(static_cast<std::uint32_t>(want.mode), static_cast<std::uint32_t>(got.mode));
+    TEST_ASSERT_TRUE(want.currentSpeed == got.currentSpeed);
+    TEST_ASSERT_TRUE(want.targetSpeed == got.targetSpeed);
+    TEST_ASSERT_TRUE(want.dosingRemainingMl == got.dosingRemainingMl);
+    TEST_ASSERT_EQUAL(want.running, got.running);
+    TEST_ASSERT_EQUAL_UINT32(want.totalMotorUptimeSec, got.totalMotorUptimeSec);
+    TEST_ASSERT_EQUAL_UINT64(want.totalPumpedNl, got.totalPumpedNl);
+    TEST_ASSERT_EQUAL_UINT64(want.totalHoseNl, got.totalHoseNl);
+    TEST_ASSERT_EQUAL_UINT32(refs[i].nextEventMs(), bank.nextEventMs(i));
+  }
+}
+
+void test_bank_matches_independent_controllers() {
+  pump::Config sCurve = makeConfig();
+  sCurve.rampProfile = pump::RampProfile::S_CURVE;
+  pump::PumpBank<kMotors> bank(makeConfig());
+  std::array<pump::PumpController, kMotors> refs = {
+      pump::PumpController(makeConfig()), pump::PumpController(makeConfig()), pump::PumpController(makeConfig()),
+      pump::PumpController(makeConfig()), pump::PumpController(makeConfig()), pump::PumpController(makeConfig()),
+  };
+  // Motor 5 runs S-curves; edit() reaches the whole controller.
+  bank.edit(5, [&](pump::PumpController& ctrl) { ctrl = pump::PumpController(sCurve); });
+  refs[5] = pump::PumpController(sCurve);
+
+  std::uint32_t now = 0;
+  const auto run = [&](std::uint32_t ms, std::uint32_t step) {
+    for (std::uint32_t t = 0; t < ms; t += step) {
+      now += step;
+      bank.tickAll(step);
+      for (auto& ref : refs) ref.advanceTo(now);
+      assertMatches(bank, refs);
+    }
+  };
+
+  for (std::size_t i = 0; i < kMotors; ++i) {
+    bank.setSpeed(i, 40.0f + 60.0f * static_cast<float>(i));
+    refs[i].setSpeed(40.0f + 60.0f * static_cast<float>(i));
+  }
+  run(4000, 10);
+  bank.setSpeed(1, -200.0f);
+  refs[1].setSpeed(-200.0f);
+  bank.startDosing(2, 25);
+  refs[2].startDosing(25);
+  bank.stop(3);
+  refs[3].stop();
+  bank.setMlPerRev(4, 3.1f, 1.9f);
+  refs[4].setMlPerRev(3.1f, 1.9f);
+  bank.setSpeed(5, -90.0f);
+  refs[5].setSpeed(-90.0f);
+  run(6000, 10);
+  bank.startDosing(1, 30);
+  refs[1].startDosing(30);
+  bank.setMaxSpeed(4, 100.0f);
+  refs[4].setMaxSpeed(100.0f);
+  bank.stop(0, true);
+  refs[0].stop(true);
+  run(20000, 7);
+  run(30000, 1000);
+}
+
+void test_bank_covers_long_gaps_through_controllers() {
+  pump::PumpBank<2> bank(makeConfig());
+  std::array<pump::PumpController, 2> refs = {pump::PumpController(makeConfig()), pump::PumpController(makeConfig())};
+  bank.setSpeed(0, 300.0f);
+  refs[0].setSpeed(300.0f);
+  bank.start(1);
+  refs[1].start();
+  const std::uint32_t day = 24u * 3600u * 1000u;
+  bank.advanceAllTo(day);
+  for (auto& ref : refs) ref.advanceTo(day);
+  TEST_ASSERT_EQUAL_UINT32(day, bank.nowMs());
+  assertMatches(bank, refs);
+}
+
+void test_bank_ignores_older_time() {
+  pump::PumpBank<2> bank(makeConfig());
+  bank.setSpeed(0, 120.0f);
+  bank.startDosing(1, 50);
+  bank.advanceAllTo(3000);
+  const pump::State flowing = bank.state(0);
+  const pump::State dosing = bank.state(1);
+  bank.advanceAllTo(2995);
+  TEST_ASSERT_EQUAL_UINT32(3000, bank.nowMs());
+  TEST_ASSERT_EQUAL_UINT64(flowing.totalPumpedNl, bank.state(0).totalPumpedNl);
+  TEST_ASSERT_EQUAL_UINT32(flowing.totalMotorUptimeSec, bank.state(0).totalMotorUptimeSec);
+  TEST_ASSERT_TRUE(dosing.dosingRemainingMl == bank.state(1).dosingRemainingMl);
+  TEST_ASSERT_TRUE(bank.state(1).running);
+}
+
+void test_bank_matches_controllers_with_calibration_curve() {
+  pump::CalibrationCurve curve;
+  TEST_ASSERT_TRUE(curve.setPoint(50.0f, 2.8f));
+  TEST_ASSERT_TRUE(curve.setPoint(400.0f, 2.2f));
+  pump::PumpBank<2> bank(makeConfig());
+  std::array<pump::PumpController, 2> refs = {pump::PumpController(makeConfig()), pump::PumpController(makeConfig())};
+  bank.setCalibrationCurve(0, false, curve);
+  refs[0].setCalibrationCurve(false, curve);
+  TEST_ASSERT_EQUAL_FLOAT(refs[0].speedForFlow(600.0f, false), bank.speedForFlow(0, 600.0f, false));
+  for (std::size_t i = 0; i < 2; ++i) {
+    bank.setSpeed(i, 350.0f);
+    refs[i].setSpeed(350.0f);
+  }
+  for (std::uint32_t now = 10; now <= 12000; now += 10) {
+    bank.tickAll(10);
+    for (auto& ref : refs) ref.advanceTo(now);
+    assertMatches(bank, refs);
+  }
+  // Same speed, less volume once the curve has drooped.
+  TEST_ASSERT_TRUE(bank.state(0).totalPumpedNl < bank.state(1).totalPumpedNl);
+}
+
+void test_fixed_point_bank_matches_controllers() {
+  pump::PumpBank<3, pump::Q16x16> bank(makeConfig());
+  pump::FixedPumpController ref(makeConfig());
+  bank.setSpeed(1, 120.0f);
+  ref.setSpeed(120.0f);
+  for (std::uint32_t now = 10; now <= 5000; now += 10) {
+    bank.tickAll(10);
+    ref.advanceTo(now);
+  }
+  TEST_ASSERT_TRUE(ref.state().currentSpeed == bank.state(1).currentSpeed);
+  TEST_ASSERT_EQUAL_UINT64(ref.state().totalPumpedNl, bank.state(1).totalPumpedNl);
+  TEST_ASSERT_EQUAL_UINT64(0, bank.state(0).totalPumpedNl);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bank_matches_independent_controllers);
+  RUN_TEST(test_bank_covers_long_gaps_through_controllers);
+  RUN_TEST(test_bank_ignores_older_time);
+  RUN_TEST(test_bank_matches_controllers_with_calibration_curve);
+  RUN_TEST(test_fixed_point_bank_matches_controllers);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
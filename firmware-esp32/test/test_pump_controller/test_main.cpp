@@ -1,9 +1,19 @@
 #include <unity.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
 #include "PumpController.h"
 
+#ifndef PUMP_CONTROLLER_UNDER_TEST
+#define PUMP_CONTROLLER_UNDER_TEST pump::PumpController
+#endif
+
 namespace {
 
+using Controller = PUMP_CONTROLLER_UNDER_TEST;
+
 pump::Config makeConfig() {
   pump::Config cfg;
   cfg.maxSpeed = 450.0f;
@@ -16,7 +26,7 @@ pump::Config makeConfig() {
 }
 
 void test_set_speed_clamps_and_runs() {
-  pump::PumpController ctrl(makeConfig());
+  Controller ctrl(makeConfig());
   ctrl.setSpeed(999.0f);
   TEST_ASSERT_FLOAT_WITHIN(0.001f, 450.0f, ctrl.state().targetSpeed);
   TEST_ASSERT_TRUE(ctrl.state().running);
@@ -26,7 +36,7 @@ void test_set_speed_clamps_and_runs() {
 }
 
 void test_accelerates_by_rate() {
-  pump::PumpController ctrl(makeConfig());
+  Controller ctrl(makeConfig());
   ctrl.setSpeed(100.0f);
   ctrl.tick(10);
   TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.5f, ctrl.state().currentSpeed);
@@ -36,7 +46,7 @@ void test_accelerates_by_rate() {
 }
 
 void test_halts_with_higher_rate() {
-  pump::PumpController ctrl(makeConfig());
+  Controller ctrl(makeConfig());
   ctrl.setSpeed(100.0f);
   for (int i = 0; i < 50; ++i) {
     ctrl.tick(10);
@@ -50,7 +60,7 @@ void test_halts_with_higher_rate() {
 }
 
 void test_dosing_finishes_and_stops() {
-  pump::PumpController ctrl(makeConfig());
+  Controller ctrl(makeConfig());
   ctrl.startDosing(10);
 
   for (int i = 0; i < 2500; ++i) {
@@ -65,8 +75,443 @@ void test_dosing_finishes_and_stops() {
   TEST_ASSERT_EQUAL_UINT8(static_cast<uint8_t>(pump::Mode::FLOW), static_cast<uint8_t>(ctrl.state().mode));
 }
 
+// Reference model of the previous float integrator: dose volume counted down
+// from |speed| every tick, then stop() and the halt ramp keeps pumping.
+double legacyFloatDoseMl(const pump::Config& cfg, float volumeMl, std::uint32_t tickMs) {
+  const float dtSec = static_cast<float>(tickMs) / 1000.0f;
+  float speed = 0.0f;
+  float target = 180.0f;
+  float remaining = volumeMl;
+  double pumpedMl = 0.0;
+  for (int i = 0; i < 100000; ++i) {
+    const bool targetIsStop = target == 0.0f;
+    const float ramp = (targetIsStop ? cfg.speedHaltPerSec : cfg.speedAccelPerSec) * dtSec;
+    speed = speed < target ? std::min(speed + ramp, target) : std::max(speed - ramp, target);
+    if (speed < cfg.minSpeed && targetIsStop) break;
+    const float deltaMl = speed / 60.0f * cfg.mlPerRevCw * dtSec;
+    pumpedMl += deltaMl;
+    if (!targetIsStop) {
+      remaining -= deltaMl;
+      if (remaining <= 0.0f) target = 0.0f;
+    }
+  }
+  return pumpedMl;
+}
+
+double runDoseMl(Controller& ctrl, std::int32_t volumeMl, std::uint32_t maxTickMs) {
+  const double before = ctrl.state().totalPumpedVolumeL();
+  ctrl.startDosing(volumeMl);
+  std::srand(7);
+  for (int i = 0; i < 100000 && ctrl.state().running; ++i) {
+    const std::uint32_t delta = maxTickMs > 10 ? 1 + static_cast<std::uint32_t>(std::rand()) % maxTickMs : maxTickMs;
+    ctrl.tick(delta);
+  }
+  return (ctrl.state().totalPumpedVolumeL() - before) * 1000.0;
+}
+
+void test_step_dosing_lands_on_requested_volume() {
+  const pump::Config cfg = makeConfig();
+  const double mlPerStep = cfg.mlPerRevCw / cfg.stepsPerRev;
+  const std::int32_t volumes[] = {1, 3, 10, 50};
+  for (const std::int32_t volume : volumes) {
+    Controller ctrl(cfg);
+    const double dosedMl = runDoseMl(ctrl, volume, 10);
+    TEST_ASSERT_FALSE(ctrl.state().running);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, ctrl.state().currentSpeed);
+    TEST_ASSERT_DOUBLE_WITHIN(mlPerStep, static_cast<double>(volume), dosedMl);
+  }
+
+  // The float integrator overshoots small doses by the halt ramp volume.
+  const double legacyMl = legacyFloatDoseMl(cfg, 3.0f, 10);
+  TEST_ASSERT_TRUE(legacyMl > 3.0 * 1.05);
+}
+
+void test_step_dosing_ignores_tick_jitter() {
+  const pump::Config cfg = makeConfig();
+  const double mlPerStep = cfg.mlPerRevCw / cfg.stepsPerRev;
+  Controller steady(cfg);
+  Controller jittery(cfg);
+  const double steadyMl = runDoseMl(steady, 7, 10);
+  const double jitteryMl = runDoseMl(jittery, 7, 45);
+  TEST_ASSERT_DOUBLE_WITHIN(mlPerStep * 0.01, steadyMl, jitteryMl);
+  TEST_ASSERT_DOUBLE_WITHIN(mlPerStep, 7.0, jitteryMl);
+}
+
+void test_dosing_against_rotation_reverses_first() {
+  Controller ctrl(makeConfig());
+  ctrl.setSpeed(-60.0f);
+  for (int i = 0; i < 200; ++i) ctrl.tick(10);
+  TEST_ASSERT_TRUE(ctrl.state().currentSpeed < 0.0f);
+
+  ctrl.startDosing(5);
+  ctrl.tick(10);
+  // Still ramping through zero with the regular ramp instead of jumping.
+  TEST_ASSERT_TRUE(ctrl.state().currentSpeed < 0.0f);
+  for (int i = 0; i < 10000 && ctrl.state().running; ++i) ctrl.tick(10);
+  TEST_ASSERT_FALSE(ctrl.state().running);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, ctrl.state().dosingRemainingMl);
+}
+
+void test_dose_plan_ids_follow_starts_and_finishes() {
+  Controller ctrl(makeConfig());
+  const std::uint32_t firstId = ctrl.dosePlanId();
+  ctrl.startDosing(5);
+  TEST_ASSERT_TRUE(ctrl.dosePlan().active());
+  TEST_ASSERT_EQUAL_UINT32(firstId + 1, ctrl.dosePlanId());
+  const std::uint32_t steps = ctrl.dosePlan().totalSteps();
+  for (int i = 0; i < 10000 && ctrl.state().running; ++i) ctrl.tick(10);
+  TEST_ASSERT_FALSE(ctrl.dosePlan().active());
+  TEST_ASSERT_EQUAL_UINT32(1, ctrl.dosesFinished());
+  TEST_ASSERT_TRUE(steps > 0);
+
+  // A dose cut short is not finished.
+  ctrl.startDosing(5);
+  ctrl.tick(100);
+  ctrl.stop(false);
+  TEST_ASSERT_EQUAL_UINT32(firstId + 2, ctrl.dosePlanId());
+  TEST_ASSERT_EQUAL_UINT32(1, ctrl.dosesFinished());
+}
+
+struct Command {
+  std::uint32_t atMs;
+  int kind;  // 0 flow, 1 dose, 2 stop
+  float value;
+};
+
+void applyCommand(Controller& ctrl, const Command& cmd) {
+  if (cmd.kind == 0) ctrl.setSpeed(cmd.value);
+  if (cmd.kind == 1) ctrl.startDosing(static_cast<std::int32_t>(cmd.value));
+  if (cmd.kind == 2) ctrl.stop(false);
+}
+
+void checkAdvanceToMatches10msStepping(const pump::Config& cfg) {
+  const Command commands[] = {
+      {0, 0, 300.0f},         {3600000, 0, -120.0f}, {3605000, 1, 40.0f},
+      {3700000, 0, 450.0f},   {7200000, 2, 0.0f},    {7300000, 1, -25.0f},
+      {7400000, 0, 60.0f},    {43200000, 2, 0.0f},
+  };
+  const std::uint32_t endMs = 43300000;
+  Controller stepped(cfg);
+  Controller jumped(cfg);
+
+  std::size_t next = 0;
+  for (std::uint32_t now = 0; now <= endMs; now += 10) {
+    stepped.advanceTo(now);
+    while (next < sizeof(commands) / sizeof(commands[0]) && commands[next].atMs == now) {
+      applyCommand(stepped, commands[next]);
+      ++next;
+    }
+  }
+  for (const Command& cmd : commands) {
+    // Only wake for events and commands, like an event-driven loop would.
+    while (jumped.nextEventMs() != pump::kNoEvent && jumped.nextEventMs() < cmd.atMs) {
+      jumped.advanceTo(jumped.nextEventMs());
+    }
+    jumped.advanceTo(cmd.atMs);
+    applyCommand(jumped, cmd);
+  }
+  jumped.advanceTo(endMs);
+
+  const auto& a = stepped.state();
+  const auto& b = jumped.state();
+  TEST_ASSERT_FALSE(b.running);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, a.currentSpeed, b.currentSpeed);
+  TEST_ASSERT_DOUBLE_WITHIN(a.totalPumpedVolumeL() * 1e-5, a.totalPumpedVolumeL(), b.totalPumpedVolumeL());
+  TEST_ASSERT_DOUBLE_WITHIN(a.totalHoseVolumeL() * 1e-5, a.totalHoseVolumeL(), b.totalHoseVolumeL());
+  TEST_ASSERT_FLOAT_WITHIN(2.0f, static_cast<float>(a.totalMotorUptimeSec), static_cast<float>(b.totalMotorUptimeSec));
+}
+
+void test_advance_to_matches_10ms_stepping() { checkAdvanceToMatches10msStepping(makeConfig()); }
+
+pump::Config makeSCurveConfig() {
+  pump::Config cfg = makeConfig();
+  cfg.rampProfile = pump::RampProfile::S_CURVE;
+  cfg.sCurveAccelPerSec = 150.0f;
+  return cfg;
+}
+
+void test_s_curve_reaches_max_speed_sooner() {
+  Controller linear(makeConfig());
+  Controller sCurve(makeSCurveConfig());
+  linear.setSpeed(450.0f);
+  sCurve.setSpeed(450.0f);
+  TEST_ASSERT_EQUAL_UINT32(9000, linear.nextEventMs());
+  // 450 * 1.568 / 150 s.
+  const std::uint32_t rampMs = sCurve.nextEventMs();
+  TEST_ASSERT_UINT32_WITHIN(1, 4705, rampMs);
+
+  float prev = 0.0f;
+  float maxStep = 0.0f;
+  for (std::uint32_t now = 10; now <= rampMs + 10; now += 10) {
+    sCurve.advanceTo(now);
+    const float step = sCurve.state().currentSpeed - prev;
+    if (step > maxStep) maxStep = step;
+    if (now == 10) {
+      // Jerk-limited start: far below the linear ramp's first tick.
+      TEST_ASSERT_TRUE(step < 0.2f * 50.0f * 0.01f);
+    }
+    prev = sCurve.state().currentSpeed;
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 450.0f, sCurve.state().currentSpeed);
+  TEST_ASSERT_FALSE(sCurve.isRamping());
+  TEST_ASSERT_TRUE(maxStep <= 150.0f * 0.01f + 0.01f);
+}
+
+void test_s_curve_reverses_through_standstill() {
+  Controller ctrl(makeSCurveConfig());
+  ctrl.setSpeed(100.0f);
+  ctrl.advanceTo(ctrl.nextEventMs());
+  ctrl.setSpeed(-100.0f);
+
+  // First event is the stop, then the ramp the other way.
+  ctrl.advanceTo(ctrl.nextEventMs());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, ctrl.state().currentSpeed);
+  TEST_ASSERT_TRUE(ctrl.state().running);
+  ctrl.advanceTo(ctrl.nextEventMs());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, -100.0f, ctrl.state().currentSpeed);
+  TEST_ASSERT_EQUAL_UINT32(pump::kNoEvent, ctrl.nextEventMs());
+
+  ctrl.stop(false);
+  const std::uint32_t haltMs = ctrl.nextEventMs() - ctrl.nowMs();
+  // Halts peak at the halt rate.
+  TEST_ASSERT_UINT32_WITHIN(1, 785, haltMs);
+  ctrl.advanceTo(ctrl.nowMs() + haltMs);
+  TEST_ASSERT_FALSE(ctrl.state().running);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, ctrl.state().currentSpeed);
+}
+
+void test_s_curve_retargets_mid_ramp() {
+  Controller ctrl(makeSCurveConfig());
+  ctrl.setSpeed(300.0f);
+  ctrl.advanceTo(1000);
+  const float reached = ctrl.state().currentSpeed;
+  TEST_ASSERT_TRUE(reached > 0.0f && reached < 300.0f);
+  ctrl.setSpeed(100.0f);
+  ctrl.advanceTo(1010);
+  // Continues from where it was instead of jumping.
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, reached, ctrl.state().currentSpeed);
+  ctrl.advanceTo(ctrl.nextEventMs());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 100.0f, ctrl.state().currentSpeed);
+}
+
+void test_s_curve_advance_to_matches_10ms_stepping() { checkAdvanceToMatches10msStepping(makeSCurveConfig()); }
+
+void test_default_s_curve_peak_stays_within_linear_rate() {
+  const pump::Config cfg;
+  TEST_ASSERT_TRUE(cfg.sCurveAccelPerSec <= cfg.speedAccelPerSec);
+}
+
+void test_ramp_profile_switch_continues_from_current_speed() {
+  Controller ctrl(makeConfig());
+  ctrl.setSpeed(300.0f);
+  ctrl.advanceTo(1000);
+  const float reached = ctrl.state().currentSpeed;
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 50.0f, reached);
+  ctrl.setRampProfile(pump::RampProfile::S_CURVE);
+  TEST_ASSERT_TRUE(ctrl.config().rampProfile == pump::RampProfile::S_CURVE);
+  ctrl.advanceTo(1010);
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, reached, ctrl.state().currentSpeed);
+  TEST_ASSERT_TRUE(ctrl.isRamping());
+  ctrl.advanceTo(ctrl.nextEventMs());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 300.0f, ctrl.state().currentSpeed);
+
+  // Cruising: nothing to reshape.
+  ctrl.setRampProfile(pump::RampProfile::LINEAR);
+  TEST_ASSERT_FALSE(ctrl.isRamping());
+  TEST_ASSERT_EQUAL_UINT32(pump::kNoEvent, ctrl.nextEventMs());
+}
+
+void test_next_event_tracks_ramp_and_dose() {
+  Controller ctrl(makeConfig());
+  TEST_ASSERT_EQUAL_UINT32(pump::kNoEvent, ctrl.nextEventMs());
+
+  ctrl.advanceTo(1000);
+  ctrl.setSpeed(100.0f);
+  // 100 speed at 50 speed/s.
+  TEST_ASSERT_EQUAL_UINT32(3000, ctrl.nextEventMs());
+  TEST_ASSERT_TRUE(ctrl.isRamping());
+  ctrl.advanceTo(ctrl.nextEventMs());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 100.0f, ctrl.state().currentSpeed);
+  TEST_ASSERT_FALSE(ctrl.isRamping());
+  TEST_ASSERT_EQUAL_UINT32(pump::kNoEvent, ctrl.nextEventMs());
+
+  ctrl.stop(false);
+  ctrl.advanceTo(ctrl.nextEventMs());
+  TEST_ASSERT_FALSE(ctrl.state().running);
+
+  ctrl.startDosing(200);
+  int events = 0;
+  while (ctrl.nextEventMs() != pump::kNoEvent && events < 10) {
+    ctrl.advanceTo(ctrl.nextEventMs());
+    ++events;
+  }
+  // Ramp end, decel start and the last step.
+  TEST_ASSERT_EQUAL_INT(3, events);
+  TEST_ASSERT_FALSE(ctrl.state().running);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, ctrl.state().dosingRemainingMl);
+}
+
+void test_dosing_eta_counts_down_to_completion() {
+  Controller ctrl(makeConfig());
+  TEST_ASSERT_EQUAL_UINT32(0, ctrl.dosingEtaMs());
+  ctrl.startDosing(200);
+  const std::uint32_t eta = ctrl.dosingEtaMs();
+  TEST_ASSERT_TRUE(eta > 0);
+
+  ctrl.advanceTo(1000);
+  TEST_ASSERT_EQUAL_UINT32(eta - 1000, ctrl.dosingEtaMs());
+  ctrl.advanceTo(eta - 1);
+  TEST_ASSERT_TRUE(ctrl.state().running);
+  TEST_ASSERT_EQUAL_UINT32(1, ctrl.dosingEtaMs());
+  ctrl.advanceTo(eta);
+  TEST_ASSERT_FALSE(ctrl.state().running);
+  TEST_ASSERT_EQUAL_UINT32(0, ctrl.dosingEtaMs());
+}
+
+void test_dose_brakes_at_halt_rate() {
+  Controller ctrl(makeConfig());
+  ctrl.startDosing(200);
+  const std::uint32_t eta = ctrl.dosingEtaMs();
+  ctrl.advanceTo(eta - 100);
+  // 100 ms before the end at 200 speed/s.
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 20.0f, ctrl.state().currentSpeed);
+
+  // Braking at the accel rate would take longer.
+  const float k = ctrl.config().stepsPerRev / 60.0f;
+  pump::StepPlanner symmetric;
+  symmetric.plan(static_cast<std::uint32_t>(std::lround(200.0f / (2.6f / ctrl.config().stepsPerRev))),
+                 ctrl.state().dosingSpeed * k, 50.0f * k, 50.0f * k);
+  TEST_ASSERT_TRUE(static_cast<float>(eta) < symmetric.durationSec() * 1000.0f - 1000.0f);
+}
+
+void test_dose_cruises_at_dosing_speed_within_max_speed() {
+  Controller ctrl(makeConfig());
+  ctrl.startDosing(500);
+  float peak = 0.0f;
+  for (std::uint32_t now = 100; ctrl.state().running; now += 100) {
+    ctrl.advanceTo(now);
+    peak = std::max(peak, ctrl.state().currentSpeed);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 180.0f, peak);
+
+  Controller fastest(makeConfig());
+  fastest.setDosingSpeed(999.0f);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 450.0f, fastest.state().dosingSpeed);
+  fastest.startDosing(500);
+  Controller slow(makeConfig());
+  slow.startDosing(500);
+  TEST_ASSERT_TRUE(fastest.dosingEtaMs() < slow.dosingEtaMs());
+  peak = 0.0f;
+  for (std::uint32_t now = 100; fastest.state().running; now += 100) {
+    fastest.advanceTo(now);
+    peak = std::max(peak, fastest.state().currentSpeed);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 450.0f, peak);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, fastest.state().dosingRemainingMl);
+}
+
+void test_dosing_eta_estimates_mirrored_state() {
+  Controller local(makeConfig());
+  local.startDosing(200);
+  local.advanceTo(10000);
+  TEST_ASSERT_TRUE(local.state().running);
+
+  // Central copy of an expansion motor: state only, no local plan.
+  Controller mirror(makeConfig());
+  mirror.mutableState() = local.state();
+  TEST_ASSERT_INT32_WITHIN(20, static_cast<std::int32_t>(local.dosingEtaMs()),
+                           static_cast<std::int32_t>(mirror.dosingEtaMs()));
+
+  // Reversal is included in the estimate.
+  mirror.mutableState().targetSpeed = -mirror.mutableState().targetSpeed;
+  TEST_ASSERT_TRUE(mirror.dosingEtaMs() > local.dosingEtaMs());
+}
+
+void test_advance_to_covers_long_gaps_in_one_call() {
+  Controller ctrl(makeConfig());
+  ctrl.setSpeed(60.0f);
+  ctrl.advanceTo(ctrl.nextEventMs());
+  const double before = ctrl.state().totalPumpedVolumeL();
+  const std::uint32_t beforeUptime = ctrl.state().totalMotorUptimeSec;
+  ctrl.advanceTo(ctrl.nowMs() + 20u * 24u * 3600u * 1000u);
+  // 60 speed = 1 rev/s = 2.6 ml/s for 20 days.
+  TEST_ASSERT_DOUBLE_WITHIN(1.0, 2.6 * 20.0 * 24.0 * 3600.0 / 1000.0, ctrl.state().totalPumpedVolumeL() - before);
+  TEST_ASSERT_EQUAL_UINT32(20u * 24u * 3600u, ctrl.state().totalMotorUptimeSec - beforeUptime);
+}
+
+void test_advance_to_ignores_older_time() {
+  Controller ctrl(makeConfig());
+  ctrl.setSpeed(60.0f);
+  ctrl.advanceTo(5000);
+  const pump::State flowing = ctrl.state();
+  ctrl.advanceTo(4995);
+  TEST_ASSERT_EQUAL_UINT32(5000, ctrl.nowMs());
+  TEST_ASSERT_TRUE(flowing.currentSpeed == ctrl.state().currentSpeed);
+  TEST_ASSERT_EQUAL_UINT64(flowing.totalPumpedNl, ctrl.state().totalPumpedNl);
+  TEST_ASSERT_EQUAL_UINT32(flowing.totalMotorUptimeSec, ctrl.state().totalMotorUptimeSec);
+
+  ctrl.startDosing(50);
+  ctrl.advanceTo(6000);
+  const pump::State dosing = ctrl.state();
+  ctrl.advanceTo(5995);
+  TEST_ASSERT_TRUE(ctrl.state().running);
+  TEST_ASSERT_TRUE(dosing.dosingRemainingMl == ctrl.state().dosingRemainingMl);
+  TEST_ASSERT_EQUAL_UINT64(dosing.totalPumpedNl, ctrl.state().totalPumpedNl);
+  TEST_ASSERT_TRUE(ctrl.dosingEtaMs() > 0);
+}
+
+void test_totalizers_keep_small_deltas_on_large_totals() {
+  Controller ctrl(makeConfig());
+  // 500 m3 already pumped.
+  ctrl.mutableState().totalPumpedNl = 500000ULL * 1000000000ULL;
+  ctrl.setSpeed(0.6f);
+  ctrl.advanceTo(ctrl.nextEventMs());
+  const std::uint64_t before = ctrl.state().totalPumpedNl;
+  for (int i = 0; i < 100000; ++i) ctrl.tick(10);
+  // 0.6 speed = 0.026 ml/s; each 10 ms tick adds 260 nl.
+  const std::uint64_t added = ctrl.state().totalPumpedNl - before;
+  TEST_ASSERT_UINT32_WITHIN(1000, 26000000, static_cast<std::uint32_t>(added));
+}
+
+void test_totalizers_do_not_drift_over_years() {
+  const std::uint32_t days = 5 * 365;
+  Controller byMinute(makeConfig());
+  Controller byDay(makeConfig());
+  byMinute.setSpeed(60.0f);
+  byDay.setSpeed(60.0f);
+  // Reach 60 speed first so both run at 2.6 ml/s from time zero.
+  byMinute.mutableState().currentSpeed = 60.0f;
+  byDay.mutableState().currentSpeed = 60.0f;
+
+  std::uint64_t minuteMs = 0;
+  for (std::uint32_t day = 1; day <= days; ++day) {
+    for (int minute = 0; minute < 24 * 60; ++minute) {
+      minuteMs += 60000;
+      byMinute.advanceTo(static_cast<std::uint32_t>(minuteMs));
+    }
+    byDay.advanceTo(static_cast<std::uint32_t>(minuteMs));
+  }
+
+  const double seconds = days * 86400.0;
+  const double expectedNl = 2.6e6 * seconds;
+  TEST_ASSERT_DOUBLE_WITHIN(expectedNl * 1e-6, expectedNl, static_cast<double>(byMinute.state().totalPumpedNl));
+  TEST_ASSERT_DOUBLE_WITHIN(expectedNl * 1e-6, expectedNl, static_cast<double>(byDay.state().totalPumpedNl));
+  TEST_ASSERT_EQUAL_UINT64(byMinute.state().totalPumpedNl, byMinute.state().totalHoseNl);
+  TEST_ASSERT_EQUAL_UINT32(days * 86400u, byMinute.state().totalMotorUptimeSec);
+  TEST_ASSERT_EQUAL_UINT32(days * 86400u, byDay.state().totalMotorUptimeSec);
+}
+
+void test_totalizer_litre_accessors_round_trip() {
+  pump::State st;
+  st.setTotalPumpedVolumeL(1234.567891);
+  TEST_ASSERT_EQUAL_UINT64(1234567891000ULL, st.totalPumpedNl);
+  TEST_ASSERT_DOUBLE_WITHIN(1e-9, 1234.567891, st.totalPumpedVolumeL());
+  st.setTotalHoseVolumeL(-1.0);
+  TEST_ASSERT_EQUAL_UINT64(0, st.totalHoseNl);
+}
+
 void test_volume_is_integrated() {
-  pump::PumpController ctrl(makeConfig());
+  Controller ctrl(makeConfig());
   ctrl.setSpeed(60.0f);
 
   // Reach target and run for 1 second total in 10ms ticks.
@@ -74,12 +519,12 @@ void test_volume_is_integrated() {
     ctrl.tick(10);
   }
 
-  TEST_ASSERT_TRUE(ctrl.state().totalPumpedVolumeL > 0.0);
-  TEST_ASSERT_TRUE(ctrl.state().totalHoseVolumeL > 0.0);
+  TEST_ASSERT_TRUE(ctrl.state().totalPumpedVolumeL() > 0.0);
+  TEST_ASSERT_TRUE(ctrl.state().totalHoseVolumeL() > 0.0);
 }
 
 void test_uptime_accumulates_from_small_ticks() {
-  pump::PumpController ctrl(makeConfig());
+  Controller ctrl(makeConfig());
   ctrl.setSpeed(120.0f);
 
   for (int i = 0; i < 200; ++i) {
@@ -90,7 +535,7 @@ void test_uptime_accumulates_from_small_ticks() {
 }
 
 void test_max_speed_change_reclamps_targets() {
-  pump::PumpController ctrl(makeConfig());
+  Controller ctrl(makeConfig());
   ctrl.setSpeed(300.0f);
   TEST_ASSERT_FLOAT_WITHIN(0.001f, 300.0f, ctrl.state().targetSpeed);
 
@@ -107,6 +552,27 @@ void run_tests() {
   RUN_TEST(test_accelerates_by_rate);
   RUN_TEST(test_halts_with_higher_rate);
   RUN_TEST(test_dosing_finishes_and_stops);
+  RUN_TEST(test_step_dosing_lands_on_requested_volume);
+  RUN_TEST(test_step_dosing_ignores_tick_jitter);
+  RUN_TEST(test_dose_plan_ids_follow_starts_and_finishes);
+  RUN_TEST(test_dosing_against_rotation_reverses_first);
+  RUN_TEST(test_advance_to_matches_10ms_stepping);
+  RUN_TEST(test_s_curve_reaches_max_speed_sooner);
+  RUN_TEST(test_s_curve_reverses_through_standstill);
+  RUN_TEST(test_s_curve_retargets_mid_ramp);
+  RUN_TEST(test_s_curve_advance_to_matches_10ms_stepping);
+  RUN_TEST(test_default_s_curve_peak_stays_within_linear_rate);
+  RUN_TEST(test_ramp_profile_switch_continues_from_current_speed);
+  RUN_TEST(test_next_event_tracks_ramp_and_dose);
+  RUN_TEST(test_dosing_eta_counts_down_to_completion);
+  RUN_TEST(test_dose_brakes_at_halt_rate);
+  RUN_TEST(test_dose_cruises_at_dosing_speed_within_max_speed);
+  RUN_TEST(test_dosing_eta_estimates_mirrored_state);
+  RUN_TEST(test_advance_to_covers_long_gaps_in_one_call);
+  RUN_TEST(test_advance_to_ignores_older_time);
+  RUN_TEST(test_totalizers_keep_small_deltas_on_large_totals);
+  RUN_TEST(test_totalizers_do_not_drift_over_years);
+  RUN_TEST(test_totalizer_litre_accessors_round_trip);
   RUN_TEST(test_volume_is_integrated);
   RUN_TEST(test_uptime_accumulates_from_small_ticks);
   RUN_TEST(test_max_speed_change_reclamps_targets);
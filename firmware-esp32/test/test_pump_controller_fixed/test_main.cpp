@@ -0,0 +1,5 @@
+// Runs the PumpController suite against the Q16.16 backend.
+#include "PumpController.h"
+
+#define PUMP_CONTROLLER_UNDER_TEST pump::FixedPumpController
+#include "../test_pump_controller/test_main.cpp"
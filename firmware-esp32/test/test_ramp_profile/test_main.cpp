@@ -0,0 +1,69 @@
+#include <unity.h>
+
+#include "RampProfile.h"
+
+namespace {
+
+void test_s_curve_endpoints_and_symmetry() {
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, pump::sCurveSpeedFraction(0.0f));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, pump::sCurveSpeedFraction(1.0f));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.5f, pump::sCurveSpeedFraction(0.5f));
+  // Clamped outside the ramp.
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, pump::sCurveSpeedFraction(-1.0f));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f, pump::sCurveSpeedFraction(2.0f));
+  for (int i = 0; i <= 100; ++i) {
+    const float u = static_cast<float>(i) / 100.0f;
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 1.0f, pump::sCurveSpeedFraction(u) + pump::sCurveSpeedFraction(1.0f - u));
+  }
+}
+
+void test_s_curve_slope_is_bounded_and_soft_at_ends() {
+  const int samples = 1000;
+  float maxSlope = 0.0f;
+  for (int i = 0; i < samples; ++i) {
+    const float u0 = static_cast<float>(i) / samples;
+    const float u1 = static_cast<float>(i + 1) / samples;
+    const float slope = (pump::sCurveSpeedFraction(u1) - pump::sCurveSpeedFraction(u0)) * samples;
+    TEST_ASSERT_TRUE(slope >= 0.0f);
+    if (slope > maxSlope) maxSlope = slope;
+  }
+  TEST_ASSERT_TRUE(maxSlope <= pump::kSCurvePeakSlope + 1e-3f);
+  TEST_ASSERT_TRUE(maxSlope > pump::kSCurvePeakSlope - 1e-2f);
+  // Acceleration starts and ends near zero instead of stepping.
+  TEST_ASSERT_TRUE(pump::sCurveSpeedFraction(0.01f) * 100.0f < 0.1f);
+  TEST_ASSERT_TRUE((1.0f - pump::sCurveSpeedFraction(0.99f)) * 100.0f < 0.1f);
+}
+
+void test_s_curve_area_integrates_speed() {
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, pump::sCurveAreaFraction(0.0f));
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.5f, pump::sCurveAreaFraction(1.0f));
+  const int samples = 4000;
+  float area = 0.0f;
+  for (int i = 0; i < samples; ++i) {
+    const float mid = (static_cast<float>(i) + 0.5f) / samples;
+    area += pump::sCurveSpeedFraction(mid) / samples;
+    if ((i + 1) % 400 == 0) {
+      TEST_ASSERT_FLOAT_WITHIN(1e-4f, area, pump::sCurveAreaFraction(static_cast<float>(i + 1) / samples));
+    }
+  }
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_s_curve_endpoints_and_symmetry);
+  RUN_TEST(test_s_curve_slope_is_bounded_and_soft_at_ends);
+  RUN_TEST(test_s_curve_area_integrates_speed);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
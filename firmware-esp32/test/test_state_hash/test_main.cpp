@@ -0,0 +1,67 @@
+#include <unity.h>
+
+#include "PumpController.h"
+#include "StateJson.h"
+
+namespace {
+
+std::uint32_t hashOf(const pump::PumpController& ctrl) {
+  pump::StateHash hash;
+  pump::hashStateFields(hash, ctrl);
+  return hash.value();
+}
+
+void test_idle_pump_keeps_its_hash() {
+  pump::PumpController ctrl{pump::Config{}};
+  ctrl.advanceTo(1000);
+  const std::uint32_t idle = hashOf(ctrl);
+  ctrl.advanceTo(60000);
+  TEST_ASSERT_EQUAL_UINT32(idle, hashOf(ctrl));
+}
+
+void test_reported_changes_change_the_hash() {
+  pump::PumpController ctrl{pump::Config{}};
+  ctrl.advanceTo(1000);
+  const std::uint32_t idle = hashOf(ctrl);
+  ctrl.setSpeed(120.0f);
+  const std::uint32_t target = hashOf(ctrl);
+  TEST_ASSERT_TRUE(idle != target);
+  ctrl.advanceTo(2000);
+  TEST_ASSERT_TRUE(target != hashOf(ctrl));  // ramping, pumping
+
+  pump::PumpController other{pump::Config{}};
+  other.advanceTo(1000);
+  TEST_ASSERT_EQUAL_UINT32(idle, hashOf(other));
+  other.setMlPerRev(3.1f, 2.9f);
+  TEST_ASSERT_TRUE(idle != hashOf(other));
+}
+
+void test_strings_are_delimited() {
+  pump::StateHash a;
+  a.addString("ab");
+  a.addString("c");
+  pump::StateHash b;
+  b.addString("a");
+  b.addString("bc");
+  TEST_ASSERT_TRUE(a.value() != b.value());
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_idle_pump_keeps_its_hash);
+  RUN_TEST(test_reported_changes_change_the_hash);
+  RUN_TEST(test_strings_are_delimited);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
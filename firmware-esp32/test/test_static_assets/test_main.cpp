@@ -0,0 +1,51 @@
+#include <unity.h>
+
+#include "StaticAssets.h"
+
+namespace {
+
+void test_fingerprint_between_name_and_extension() {
+  char fp[pump::kAssetFingerprintLen + 1];
+  TEST_ASSERT_TRUE(pump::assetFingerprint("/app.1a2b3c4d.js", fp));
+  TEST_ASSERT_EQUAL_STRING("1a2b3c4d", fp);
+  TEST_ASSERT_TRUE(pump::assetFingerprint("/growth-schedule.00ff00ff.js", fp));
+  TEST_ASSERT_EQUAL_STRING("00ff00ff", fp);
+}
+
+void test_names_without_fingerprint() {
+  char fp[pump::kAssetFingerprintLen + 1];
+  TEST_ASSERT_FALSE(pump::assetFingerprint("/index.html", fp));
+  TEST_ASSERT_FALSE(pump::assetFingerprint("/app.js", fp));
+  TEST_ASSERT_FALSE(pump::assetFingerprint("/app.1a2b3c4g.js", fp));   // not hex
+  TEST_ASSERT_FALSE(pump::assetFingerprint("/app-1a2b3c4d.js", fp));   // no dot before
+  TEST_ASSERT_FALSE(pump::assetFingerprint("/1a2b3c4d.js", fp));
+  TEST_ASSERT_FALSE(pump::assetFingerprint("/a.1a2b3c4d5.js", fp));    // nine digits
+  TEST_ASSERT_FALSE(pump::assetFingerprint("/noext", fp));
+}
+
+void test_content_type_from_extension() {
+  TEST_ASSERT_EQUAL_STRING("text/html", pump::assetContentType("/index.html"));
+  TEST_ASSERT_EQUAL_STRING("text/css", pump::assetContentType("/styles.1a2b3c4d.css"));
+  TEST_ASSERT_EQUAL_STRING("application/javascript", pump::assetContentType("/app.js"));
+  TEST_ASSERT_EQUAL_STRING("application/octet-stream", pump::assetContentType("/firmware.bin"));
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_fingerprint_between_name_and_extension);
+  RUN_TEST(test_names_without_fingerprint);
+  RUN_TEST(test_content_type_from_extension);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
@@ -0,0 +1,81 @@
+#include <unity.h>
+
+#include "StepPlanner.h"
+
+namespace {
+
+void test_trapezoid_reaches_cruise_and_ends_on_last_step() {
+  pump::StepPlanner plan;
+  plan.plan(20000, 4000.0f, 2000.0f, 2000.0f);
+  TEST_ASSERT_TRUE(plan.active());
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 4000.0f, plan.peakSpeed());
+  // 2 s ramp up, 2 s ramp down (4000 steps each), 12000 steps cruise.
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 7.0f, plan.durationSec());
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, 4000.0f, static_cast<float>(plan.stepsAt(2.0f)));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 4000.0f, plan.speedAt(3.0f));
+  TEST_ASSERT_EQUAL_UINT32(19999, plan.stepsAt(plan.durationSec() - 0.0001f));
+  TEST_ASSERT_EQUAL_UINT32(20000, plan.stepsAt(plan.durationSec()));
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, plan.speedAt(plan.durationSec()));
+}
+
+void test_short_move_uses_triangular_profile() {
+  pump::StepPlanner plan;
+  plan.plan(1000, 4000.0f, 2000.0f, 2000.0f);
+  // Peak where accel and decel distances meet: sqrt(a * steps).
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 1414.2f, plan.peakSpeed());
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 2.0f * 1414.2136f / 2000.0f, plan.durationSec());
+  TEST_ASSERT_EQUAL_UINT32(1000, plan.stepsAt(10.0f));
+}
+
+void test_step_times_invert_positions() {
+  pump::StepPlanner plan;
+  plan.plan(5000, 3000.0f, 1500.0f, 4000.0f, 500.0f);
+  float previous = 0.0f;
+  for (std::uint32_t step = 1; step <= 5000; step += 7) {
+    const float t = plan.stepTimeSec(step);
+    TEST_ASSERT_TRUE(t > previous);
+    previous = t;
+    TEST_ASSERT_EQUAL_UINT32(step, plan.stepsAt(t + 1e-5f));
+    TEST_ASSERT_TRUE(plan.stepIntervalSec(step) > 0.0f || step == 5000);
+  }
+  // Cruise interval is exactly one step period.
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, 1.0f / 3000.0f, plan.stepIntervalSec(3400));
+}
+
+void test_fast_entry_brakes_onto_last_step() {
+  pump::StepPlanner plan;
+  // 4000 steps/s cannot stop in 100 steps at 2000 steps/s^2.
+  plan.plan(100, 1000.0f, 2000.0f, 2000.0f, 4000.0f);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 4000.0f, plan.speedAt(0.0f));
+  TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.05f, plan.durationSec());
+  TEST_ASSERT_EQUAL_UINT32(100, plan.stepsAt(plan.durationSec()));
+}
+
+void test_empty_plan_is_inactive() {
+  pump::StepPlanner plan;
+  plan.plan(0, 1000.0f, 100.0f, 100.0f);
+  TEST_ASSERT_FALSE(plan.active());
+  TEST_ASSERT_EQUAL_UINT32(0, plan.stepsAt(1.0f));
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_trapezoid_reaches_cruise_and_ends_on_last_step);
+  RUN_TEST(test_short_move_uses_triangular_profile);
+  RUN_TEST(test_step_times_invert_positions);
+  RUN_TEST(test_fast_entry_brakes_onto_last_step);
+  RUN_TEST(test_empty_plan_is_inactive);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif
@@ -0,0 +1,67 @@
+#include <unity.h>
+
+#include "TraceRing.h"
+
+namespace {
+
+void test_events_come_back_oldest_first() {
+  pump::TraceRing<8> ring;
+  TEST_ASSERT_EQUAL_UINT32(0, ring.size());
+  ring.record(100, pump::TraceType::kTickBegin);
+  ring.record(150, pump::TraceType::kI2c, 0x2a, 1, 420);
+  ring.record(200, pump::TraceType::kTickEnd);
+  TEST_ASSERT_EQUAL_UINT32(3, ring.size());
+  TEST_ASSERT_EQUAL_UINT32(100, ring.at(0).micros);
+  const pump::TraceEvent& i2c = ring.at(1);
+  TEST_ASSERT_EQUAL_UINT32(static_cast<std::uint8_t>(pump::TraceType::kI2c), i2c.type);
+  TEST_ASSERT_EQUAL_UINT32(0x2a, i2c.id);
+  TEST_ASSERT_EQUAL_UINT32(1, i2c.arg);
+  TEST_ASSERT_EQUAL_UINT32(420, i2c.value);
+  TEST_ASSERT_EQUAL_UINT32(200, ring.at(2).micros);
+}
+
+void test_wraps_keeping_the_newest() {
+  pump::TraceRing<4> ring;
+  for (std::uint32_t t = 1; t <= 10; ++t) ring.record(t, pump::TraceType::kTickBegin);
+  TEST_ASSERT_EQUAL_UINT32(10, ring.recorded());
+  TEST_ASSERT_EQUAL_UINT32(4, ring.size());
+  for (std::size_t i = 0; i < 4; ++i) TEST_ASSERT_EQUAL_UINT32(7 + i, ring.at(i).micros);
+}
+
+void test_paused_ring_and_header() {
+  pump::TraceRing<4> ring;
+  ring.record(1, pump::TraceType::kNvsCommit, 0, 1, 9000);
+  ring.setEnabled(false);
+  ring.record(2, pump::TraceType::kNvsCommit);
+  TEST_ASSERT_EQUAL_UINT32(1, ring.recorded());
+  ring.setEnabled(true);
+  ring.record(3, pump::TraceType::kNvsCommit);
+
+  const pump::TraceDumpHeader h = ring.header(77);
+  TEST_ASSERT_EQUAL_MEMORY("PTRC", h.magic, 4);
+  TEST_ASSERT_EQUAL_UINT32(pump::kTraceDumpVersion, h.version);
+  TEST_ASSERT_EQUAL_UINT32(12, h.eventBytes);
+  TEST_ASSERT_EQUAL_UINT32(2, h.events);
+  TEST_ASSERT_EQUAL_UINT32(2, h.recorded);
+  TEST_ASSERT_EQUAL_UINT32(77, h.nowMicros);
+}
+
+}  // namespace
+
+void run_tests() {
+  UNITY_BEGIN();
+  RUN_TEST(test_events_come_back_oldest_first);
+  RUN_TEST(test_wraps_keeping_the_newest);
+  RUN_TEST(test_paused_ring_and_header);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() { run_tests(); }
+void loop() {}
+#else
+int main(int, char**) {
+  run_tests();
+  return 0;
+}
+#endif